@@ -42,6 +42,7 @@
 #include <aprinter/base/TransferVector.h>
 #include <aprinter/base/LoopUtils.h>
 #include <aprinter/structure/DoubleEndedList.h>
+#include <aprinter/structure/HashIndexTable.h>
 
 #include <aprinter/BeginNamespace.h>
 
@@ -70,7 +71,7 @@ public:
     
 private:
     static_assert(NumCacheEntries > 0, "");
-    static_assert(NumCacheEntries <= 64, "");
+    static_assert(NumCacheEntries <= 1024, "");
     static_assert(NumIoUnits > 0 && NumIoUnits <= NumCacheEntries, "");
     static_assert(MaxIoBlocks > 0 && MaxIoBlocks <= NumCacheEntries, "");
     static_assert(MaxIoBlocks <= TheBlockAccess::MaxIoBlocks, "");
@@ -99,6 +100,17 @@ private:
     using NumRefsType = uint8_t;
     static NumRefsType const MaxNumRefs = (NumRefsType)-1;
     
+    using BlockIndexTable = HashIndexTable<typename TheBlockAccess::BlockIndexType, CacheEntryIndexType, NumCacheEntries>;
+    
+    // Entries which are candidates for (re)use are kept in one list for each class,
+    // see get_evict_class(). The order of the classes after FREE is the order of
+    // preference for eviction (see eviction_lesser_than()). The CLEAN lists are in
+    // the order in which the entries became unreferenced (LRU first) and the DIRTY
+    // lists in the order of their dirt times (dirty longest first). The FREE list
+    // is used as a stack, so initially the entries are used from the last one.
+    enum class EvictClass : uint8_t {FREE, CLEAN, DIRTY, CLEAN_WEAK, DIRTY_WEAK, NONE};
+    static int const NumEvictLists = (int)EvictClass::NONE;
+    
 public:
     using BlockIndexType = typename TheBlockAccess::BlockIndexType;
     static size_t const BlockSize = TheBlockAccess::BlockSize;
@@ -109,6 +121,10 @@ public:
         
         o->io_queue.init();
         o->io_queue_event.init(c, APRINTER_CB_STATFUNC_T(&BlockCache::io_queue_event_handler));
+        o->block_index.init();
+        for (auto &list : o->evict_lists) {
+            list.init();
+        }
         writable_init(c);
         
         for (CacheEntry &entry : o->cache_entries) {
@@ -142,56 +158,19 @@ public:
     
     static BlockIndexType hintBlocks (Context c, BlockIndexType protect_block, BlockIndexType start_block, BlockIndexType end_block, BlockIndexType write_stride, uint8_t write_count)
     {
-        auto *o = Object::self(c);
         TheDebugObject::access(c);
         AMBRO_ASSERT(protect_block <= start_block)
         AMBRO_ASSERT(start_block <= end_block)
         
-        // Create two lists, of:
-        // 1) Block indices in the given range which are already in the cache.
-        // 2) Indices of cache entries which we may use to assign the blocks.
-        
-        BlockIndexType cached_blocks[NumCacheEntries];
-        CacheEntryIndexType num_cached_blocks = 0;
-        
-        CacheEntryIndexType free_entries[NumCacheEntries];
-        CacheEntryIndexType num_free_entries = 0;
-        
-        for (auto i : LoopRange<CacheEntryIndexType>(NumCacheEntries)) {
-            CacheEntry *e = &o->cache_entries[i];
-            if (e->isAssigned(c)) {
-                BlockIndexType block = e->getBlock(c);
-                if (block >= protect_block && block < end_block) {
-                    if (block >= start_block) {
-                        cached_blocks[num_cached_blocks++] = block;
-                    }
-                    // This entry is assigned with a block in the while protected range,
-                    // so prevent it from being reassigned now to another hinted block.
-                    continue;
-                }
-            }
-            if (!e->isBeingReleased(c) && !e->isReferencedIncludingWeak(c) && (!e->isAssigned(c) || e->canReassign(c))) {
-                free_entries[num_free_entries++] = i;
-            }
-        }
-        
-        // Assign blocks based on information in these lists.
-        
         BlockIndexType block = start_block;
-        while (block < end_block && num_free_entries > 0) {
+        while (block < end_block) {
             // Skip this block if it is already in the cache.
-            bool already = false;
-            for (auto i : LoopRange<CacheEntryIndexType>(num_cached_blocks)) {
-                if (cached_blocks[i] == block) {
-                    already = true;
+            if (index_find(c, block) == -1) {
+                // Find an entry we may use to assign the block.
+                CacheEntry *free_entry = find_entry_for_hint(c, protect_block, end_block);
+                if (!free_entry) {
                     break;
                 }
-            }
-            
-            if (!already) {
-                // Pop a free entry from the list.
-                CacheEntryIndexType free_entry_index = free_entries[--num_free_entries];
-                CacheEntry *free_entry = &o->cache_entries[free_entry_index];
                 
                 // Assign this block to this entry.
                 free_entry->assignBlockAndAttachUser(c, block, write_stride, write_count, false, nullptr);
@@ -386,6 +365,26 @@ public:
             return false; // never do we end up in State::AVAILABLE in this branch
         }
         
+        // Moves the reference of another available CacheRef to this one,
+        // leaving the other one reset. Unlike requesting the same block again,
+        // the block stays referenced throughout and this completes immediately.
+        void takeFrom (Context c, CacheRef *other)
+        {
+            this->debugAccess(c);
+            AMBRO_ASSERT(other != this)
+            AMBRO_ASSERT(other->isAvailable(c))
+            
+            reset_internal(c);
+            
+            other->get_entry(c)->replaceUser(c, other, this);
+            copy_write_params(other);
+            m_entry_index = other->m_entry_index;
+            m_state = State::AVAILABLE;
+            
+            other->m_entry_index = -1;
+            other->m_state = State::INVALID;
+        }
+        
         bool isAvailable (Context c)
         {
             this->debugAccess(c);
@@ -438,6 +437,13 @@ public:
             this->m_no_need_to_read = (flags & FLAG_NO_NEED_TO_READ);
         }
         
+        APRINTER_FUNCTION_IF_OR_EMPTY(Writable, void, copy_write_params (CacheRef *other))
+        {
+            this->m_write_stride = other->m_write_stride;
+            this->m_write_count = other->m_write_count;
+            this->m_no_need_to_read = other->m_no_need_to_read;
+        }
+        
         APRINTER_FUNCTION_IF_OR_EMPTY(Writable, void, register_allocation (Context c, BlockIndexType block))
         {
             auto *o = Object::self(c);
@@ -596,6 +602,7 @@ private:
         
         o->allocations_event.init(c, APRINTER_CB_STATFUNC_T(&BlockCache::allocations_event_handler<>));
         o->current_dirt_time = 0;
+        o->releasing_entry = -1;
         o->waiting_flush_requests.init();
         o->pending_allocations.init();
         for (auto i : LoopRange<BufferIndexType>(NumBuffers)) {
@@ -680,37 +687,25 @@ private:
     {
         auto *o = Object::self(c);
         
-        CacheEntryIndexType free_entry = -1;
-        CacheEntryIndexType evictable_entry = -1;
-        CacheEntryIndexType releasing_entry = -1;
+        CacheEntryIndexType found_entry = index_find(c, block);
+        if (found_entry != -1) {
+            return o->cache_entries[found_entry].isBeingReleased(c) ? -1 : found_entry;
+        }
         
-        for (auto entry_index : LoopRange<CacheEntryIndexType>(NumCacheEntries)) {
-            CacheEntry *ce = &o->cache_entries[entry_index];
-            
-            if (ce->isAssigned(c) && ce->getBlock(c) == block) {
-                return ce->isBeingReleased(c) ? -1 : entry_index;
-            }
-            
-            if (!ce->isBeingReleased(c)) {
-                if (!ce->isAssigned(c)) {
-                    free_entry = entry_index;
-                }
-                else if (!Writable ? ce->canReassign(c) : (ce->isAssigned(c) && !ce->isReferenced(c))) {
-                    if (evictable_entry == -1 || eviction_lesser_than(c, ce, &o->cache_entries[evictable_entry])) {
-                        evictable_entry = entry_index;
-                    }
-                }
-            } else {
-                releasing_entry = entry_index;
-            }
+        CacheEntry *fe = o->evict_lists[(int)EvictClass::FREE].first();
+        if (fe) {
+            return fe - o->cache_entries;
         }
         
-        if (free_entry != -1) {
-            return free_entry;
+        CacheEntry *ee = nullptr;
+        for (int i = (int)EvictClass::CLEAN; i < NumEvictLists && !ee; i++) {
+            ee = o->evict_lists[i].first();
         }
         
-        if (evictable_entry != -1) {
-            CacheEntry *ee = &o->cache_entries[evictable_entry];
+        CacheEntryIndexType releasing_entry = get_releasing_entry(c);
+        
+        if (ee) {
+            CacheEntryIndexType evictable_entry = ee - o->cache_entries;
             
             if (!Writable) {
                 AMBRO_ASSERT(ee->canReassign(c))
@@ -734,6 +729,54 @@ private:
         return -2;
     }
     
+    // Finds an entry which may be assigned a hinted block right away. Entries
+    // assigned to blocks in the protected range are not considered.
+    static CacheEntry * find_entry_for_hint (Context c, BlockIndexType protect_block, BlockIndexType end_block)
+    {
+        auto *o = Object::self(c);
+        
+        CacheEntry *fe = o->evict_lists[(int)EvictClass::FREE].first();
+        if (fe) {
+            return fe;
+        }
+        
+        auto *list = &o->evict_lists[(int)EvictClass::CLEAN];
+        for (CacheEntry *e = list->first(); e; e = list->next(e)) {
+            BlockIndexType block = e->getBlock(c);
+            if (e->canReassign(c) && !(block >= protect_block && block < end_block)) {
+                return e;
+            }
+        }
+        
+        return nullptr;
+    }
+    
+    APRINTER_FUNCTION_IF_ELSE_EXT(Writable, static, CacheEntryIndexType, get_releasing_entry (Context c), {
+        auto *o = Object::self(c);
+        return o->releasing_entry;
+    }, {
+        return -1;
+    })
+    
+    static CacheEntryIndexType index_find (Context c, BlockIndexType block)
+    {
+        auto *o = Object::self(c);
+        return o->block_index.find(block, [&](CacheEntryIndexType i) { return o->cache_entries[i].getBlock(c); });
+    }
+    
+    static void index_insert (Context c, CacheEntryIndexType entry_index, BlockIndexType block)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(index_find(c, block) == -1)
+        o->block_index.insert(entry_index, block);
+    }
+    
+    static void index_remove (Context c, CacheEntryIndexType entry_index, BlockIndexType block)
+    {
+        auto *o = Object::self(c);
+        o->block_index.remove(entry_index, block, [&](CacheEntryIndexType i) { return o->cache_entries[i].getBlock(c); });
+    }
+    
     /**
      * Determines if eviction of e1 is preferred to eviction of e2.
      * 
@@ -788,9 +831,10 @@ private:
         auto *o = Object::self(c);
         TheDebugObject::access(c);
         
-        for (CacheEntry &ce : o->cache_entries) {
-            if (ce.isBeingReleased(c) && !ce.isAssigned(c)) {
-                ce.completeRelease(c);
+        if (o->releasing_entry != -1) {
+            CacheEntry *ce = &o->cache_entries[o->releasing_entry];
+            if (!ce->isAssigned(c)) {
+                ce->completeRelease(c);
             }
         }
         
@@ -845,8 +889,10 @@ private:
             m_cache_users_list.init();
             m_num_hard_refs = 0;
             m_state = State::INVALID;
+            m_evict_class = EvictClass::NONE;
             IoQueue::markRemoved(this);
             writable_entry_init(c);
+            update_evict_class(c);
         }
         
         void deinit (Context c)
@@ -979,6 +1025,11 @@ private:
                 
                 break_weak_refs(c);
                 
+                if (isAssigned(c)) {
+                    index_remove(c, get_entry_index(c), m_block);
+                }
+                index_insert(c, get_entry_index(c), block);
+                
                 m_block = block;
                 writable_assign(c, write_stride, write_count);
                 
@@ -997,6 +1048,8 @@ private:
                 m_cache_users_list.prepend(user);
                 m_num_hard_refs++;
             }
+            
+            update_evict_class(c);
         }
         
         enum class DetachMode {HARD_TO_WEAK, DETACH_HARD, DETACH_WEAK};
@@ -1011,6 +1064,16 @@ private:
             if (mode != DetachMode::DETACH_WEAK) {
                 m_num_hard_refs--;
             }
+            
+            update_evict_class(c);
+        }
+        
+        void replaceUser (Context c, CacheRef *old_user, CacheRef *new_user)
+        {
+            AMBRO_ASSERT(m_num_hard_refs > 0)
+            
+            m_cache_users_list.remove(old_user);
+            m_cache_users_list.prepend(new_user);
         }
         
         void hardenWeakUser (Context c, CacheRef *user)
@@ -1020,6 +1083,8 @@ private:
             AMBRO_ASSERT(!isBeingReleased(c))
             
             m_num_hard_refs++;
+            
+            update_evict_class(c);
         }
         
         APRINTER_FUNCTION_IF(Writable, void, markDirty (Context c))
@@ -1054,9 +1119,15 @@ private:
             AMBRO_ASSERT(!isReferenced(c))
             AMBRO_ASSERT(!isBeingReleased(c))
             
+            auto *o = Object::self(c);
+            AMBRO_ASSERT(o->releasing_entry == -1)
+            
             break_weak_refs(c);
             
             this->m_releasing = true;
+            o->releasing_entry = get_entry_index(c);
+            update_evict_class(c);
+            
             if (m_state == State::IDLE) {
                 scheduleWriting(c);
             }
@@ -1064,8 +1135,13 @@ private:
         
         APRINTER_FUNCTION_IF(Writable, void, completeRelease (Context c))
         {
+            auto *o = Object::self(c);
             AMBRO_ASSERT(this->m_releasing)
+            AMBRO_ASSERT(o->releasing_entry == get_entry_index(c))
+            
             this->m_releasing = false;
+            o->releasing_entry = -1;
+            update_evict_class(c);
         }
         
     private:
@@ -1075,6 +1151,81 @@ private:
             return (this - o->cache_entries);
         }
         
+        void set_invalid (Context c)
+        {
+            AMBRO_ASSERT(isAssigned(c))
+            
+            index_remove(c, get_entry_index(c), m_block);
+            m_state = State::INVALID;
+            update_evict_class(c);
+        }
+        
+        EvictClass get_evict_class (Context c)
+        {
+            if (!isAssigned(c)) {
+                return isBeingReleased(c) ? EvictClass::NONE : EvictClass::FREE;
+            }
+            if (isBeingReleased(c) || isReferenced(c) || !(Writable || canReassign(c))) {
+                return EvictClass::NONE;
+            }
+            bool weak = isReferencedIncludingWeak(c);
+            if (is_dirty_for_eviction(c)) {
+                return weak ? EvictClass::DIRTY_WEAK : EvictClass::DIRTY;
+            }
+            return weak ? EvictClass::CLEAN_WEAK : EvictClass::CLEAN;
+        }
+        
+        // Must be called after any change which may affect get_evict_class().
+        void update_evict_class (Context c)
+        {
+            auto *o = Object::self(c);
+            
+            EvictClass evict_class = get_evict_class(c);
+            if (evict_class == m_evict_class) {
+                return;
+            }
+            
+            if (m_evict_class != EvictClass::NONE) {
+                o->evict_lists[(int)m_evict_class].remove(this);
+            }
+            m_evict_class = evict_class;
+            if (evict_class == EvictClass::FREE) {
+                o->evict_lists[(int)evict_class].prepend(this);
+            }
+            else if (evict_class == EvictClass::DIRTY || evict_class == EvictClass::DIRTY_WEAK) {
+                insert_dirty_sorted(c, evict_class);
+            }
+            else if (evict_class != EvictClass::NONE) {
+                o->evict_lists[(int)evict_class].append(this);
+            }
+        }
+        
+        APRINTER_FUNCTION_IF_ELSE(Writable, bool, is_dirty_for_eviction (Context c), {
+            return isDirty(c);
+        }, {
+            return false;
+        })
+        
+        // Usually the entry goes to the end, only entries which were hard-referenced
+        // for a while after having been dirtied need to be moved further forward.
+        APRINTER_FUNCTION_IF_OR_EMPTY(Writable, void, insert_dirty_sorted (Context c, EvictClass evict_class))
+        {
+            auto *o = Object::self(c);
+            auto *list = &o->evict_lists[(int)evict_class];
+            
+            DirtTimeType current = o->current_dirt_time;
+            DirtTimeType age = current - this->m_dirt_time;
+            CacheEntry *after = list->last();
+            while (after && (DirtTimeType)(current - after->m_dirt_time) < age) {
+                after = list->prev(after);
+            }
+            if (after) {
+                list->insertAfter(this, after);
+            } else {
+                list->prepend(this);
+            }
+        }
+        
         APRINTER_FUNCTION_IF_OR_EMPTY(Writable, void, writable_entry_init (Context c))
         {
             auto *o = Object::self(c);
@@ -1162,10 +1313,15 @@ private:
             if (m_state == State::READING) {
                 APRINTER_BLOCKCACHE_MSG("c RD %" PRIu32 " e%d", (uint32_t)m_block, (int)error);
                 if (isBeingReleased(c)) {
-                    m_state = State::INVALID;
+                    set_invalid(c);
                     return schedule_allocations_check(c);
                 }
-                m_state = error ? State::INVALID : State::IDLE;
+                if (error) {
+                    set_invalid(c);
+                } else {
+                    m_state = State::IDLE;
+                    update_evict_class(c);
+                }
                 raise_read_completed(c, error);
                 AMBRO_ASSERT(!error || !isReferencedIncludingWeak(c))
             }
@@ -1238,6 +1394,7 @@ private:
             this->m_last_write_failed = error;
             this->m_flush_write_failed = error;
             this->m_dirt_state = (!error && this->m_dirt_state == DirtState::WRITING) ? DirtState::CLEAN : DirtState::DIRTY;
+            update_evict_class(c);
             
             if (!error && this->m_dirt_state == DirtState::DIRTY && (!o->waiting_flush_requests.isEmpty() || this->m_releasing)) {
                 return write_event_handler(c);
@@ -1249,7 +1406,7 @@ private:
                     report_allocation_event(c, true);
                 } else {
                     AMBRO_ASSERT(this->m_dirt_state == DirtState::CLEAN)
-                    m_state = State::INVALID;
+                    set_invalid(c);
                     schedule_allocations_check(c);
                 }
             }
@@ -1264,12 +1421,15 @@ private:
         
         DoubleEndedList<CacheRef, &CacheRef::m_list_node, false> m_cache_users_list;
         DoubleEndedListNode<CacheEntry> m_queue_node;
+        DoubleEndedListNode<CacheEntry> m_evict_node;
         BlockIndexType m_block;
         NumRefsType m_num_hard_refs;
         State m_state;
+        EvictClass m_evict_class;
         
     public:
         using IoQueue = DoubleEndedList<CacheEntry, &CacheEntry::m_queue_node>;
+        using EvictList = DoubleEndedList<CacheEntry, &CacheEntry::m_evict_node>;
     };
     
     class IoDispatcher {
@@ -1401,16 +1561,27 @@ private:
                 m_entry_indices[i] = -1;
             }
             
-            // Find candidate blocks to add to the sequence.
-            for (CacheEntry &this_e : o->cache_entries) {
-                // Ignore unassigned entries (they do not have a block index).
-                if (!this_e.isAssigned(c)) {
+            // Find candidate blocks to add to the sequence. We look up the entries assigned
+            // to the following blocks, as well as those which would be at the same offset
+            // within their multi-block write as the first entry is (e.g. the same FAT copy).
+            BlockIndexType first_offset = start_block - first_e->m_block;
+            for (auto io_index : LoopRange<IoBlockIndexType>(1, MaxIoBlocks)) {
+                BlockIndexType block_index = start_block + io_index;
+                if (block_index < start_block) {
+                    break;
+                }
+                
+                CacheEntryIndexType entry_index = index_find(c, block_index);
+                if (entry_index == -1 && first_offset != 0) {
+                    entry_index = index_find(c, block_index - first_offset);
+                }
+                if (entry_index == -1) {
                     continue;
                 }
+                CacheEntry &this_e = o->cache_entries[entry_index];
                 
                 // Check if the entry has a place in the sequence.
-                BlockIndexType block_index = this_e.get_io_block_index();
-                if (!(block_index > start_block && block_index - start_block < MaxIoBlocks)) {
+                if (this_e.get_io_block_index() != block_index) {
                     continue;
                 }
                 
@@ -1432,12 +1603,7 @@ private:
                 }
                 
                 // The entry is a candidate, add it to the list.
-                // Unless some other entry is already in this place - but the only way this can
-                // happen if the user caused a conflict with the write strides.
-                IoBlockIndexType io_index = block_index - start_block;
-                if (m_entry_indices[io_index] == -1) {
-                    m_entry_indices[io_index] = (&this_e - o->cache_entries);
-                }
+                m_entry_indices[io_index] = entry_index;
             }
             
             // Extend the chain into the candidate entries as much as possible,
@@ -1504,6 +1670,7 @@ private:
     APRINTER_STRUCT_IF_TEMPLATE(CacheWritableMembers) {
         typename Context::EventLoop::QueuedEvent allocations_event;
         DirtTimeType current_dirt_time;
+        CacheEntryIndexType releasing_entry;
         DoubleEndedList<FlushRequest<>, &FlushRequest<>::m_waiting_flush_requests_node, false> waiting_flush_requests;
         DoubleEndedList<CacheRef, &CacheRef::m_list_node> pending_allocations;
         bool buffer_usage[NumBuffers];
@@ -1514,6 +1681,8 @@ public:
         TheDebugObject
     >>, public CacheWritableMembers<Writable> {
         CacheEntry cache_entries[NumCacheEntries];
+        BlockIndexTable block_index;
+        typename CacheEntry::EvictList evict_lists[NumEvictLists];
         IoUnit io_units[NumIoUnits];
         typename CacheEntry::IoQueue io_queue;
         typename Context::EventLoop::QueuedEvent io_queue_event;
@@ -25,6 +25,7 @@
 #ifndef APRINTER_BUFFERED_FILE_H
 #define APRINTER_BUFFERED_FILE_H
 
+#include <stdint.h>
 #include <stddef.h>
 #include <string.h>
 
@@ -47,10 +48,13 @@ private:
         OPEN_ACCESS, OPEN_BASEDIR, OPEN_OPEN, OPEN_OPENWR,
         READY,
         WRITE_EVENT, WRITE_WRITE, WRITE_TRUNCATE, WRITE_FLUSH,
-        READ_EVENT, READ_READ
+        READ_EVENT, READ_READ,
+        SEEK_SEEK
     };
     
 public:
+    using CacheRef = typename TheFs::CacheRefForUser;
+    
     enum class OpenMode {OPEN_READ, OPEN_WRITE};
     enum class Error {NO_ERROR, OTHER_ERROR, NOT_FOUND};
     
@@ -117,6 +121,60 @@ public:
         m_event.prependNowNotAlready(c);
     }
     
+    // Tells the file system how much data is expected to be written,
+    // so that it can allocate the file contiguously.
+    void setPreallocationSize (Context c, uint32_t size)
+    {
+        AMBRO_ASSERT(m_state == State::READY)
+        AMBRO_ASSERT(m_write_mode)
+        
+        m_fs_file.setPreallocationSize(c, size);
+    }
+    
+    // Returns the part of the current block buffer of the file which has not
+    // been written yet, for writing data directly without startWriteData.
+    // The written data is submitted using commitWriteBuffer. If no space is
+    // returned, startPrepareWrite should be used to start the next block.
+    char * getWriteBuffer (Context c, size_t *out_length)
+    {
+        AMBRO_ASSERT(m_state == State::READY)
+        AMBRO_ASSERT(m_write_mode)
+        AMBRO_ASSERT(!m_write_eof)
+        
+        *out_length = TheFs::BlockSize - m_write_buffer_pos;
+        if (m_write_buffer_pos == TheFs::BlockSize) {
+            return nullptr;
+        }
+        return m_fs_file.getWritePointer(c) + m_write_buffer_pos;
+    }
+    
+    void commitWriteBuffer (Context c, size_t length)
+    {
+        AMBRO_ASSERT(m_state == State::READY)
+        AMBRO_ASSERT(m_write_mode)
+        AMBRO_ASSERT(!m_write_eof)
+        AMBRO_ASSERT(length <= TheFs::BlockSize - m_write_buffer_pos)
+        
+        m_write_buffer_pos += length;
+        if (length > 0 && m_write_buffer_pos == TheFs::BlockSize) {
+            m_fs_file.finishWrite(c, m_write_buffer_pos);
+        }
+    }
+    
+    // Starts the next block, so that getWriteBuffer will return space.
+    // The completion handler is called as with startWriteData.
+    void startPrepareWrite (Context c)
+    {
+        AMBRO_ASSERT(m_state == State::READY)
+        AMBRO_ASSERT(m_write_mode)
+        AMBRO_ASSERT(!m_write_eof)
+        AMBRO_ASSERT(m_write_buffer_pos == TheFs::BlockSize)
+        
+        m_write_length = 0;
+        m_state = State::WRITE_WRITE;
+        m_fs_file.startWrite(c, true);
+    }
+    
     void startReadData (Context c, char *data, size_t avail)
     {
         AMBRO_ASSERT(m_state == State::READY)
@@ -125,10 +183,45 @@ public:
         m_read_data = data;
         m_read_avail = avail;
         m_read_pos = 0;
+        m_read_pin_ref = nullptr;
         m_state = State::READ_EVENT;
         m_event.prependNowNotAlready(c);
     }
     
+    // Reads the rest of the current block without copying the data. The block
+    // is handed over to pin_ref (which the user must have initialized), which
+    // keeps it in the cache until the user resets it. The completion handler
+    // reports the length of the data, which is then available at *out_data,
+    // or zero at the end of the file. The data pointer is not updated if the
+    // block is modified through the cache after this, so it should not be.
+    void startReadPinned (Context c, CacheRef *pin_ref, char const **out_data)
+    {
+        AMBRO_ASSERT(m_state == State::READY)
+        AMBRO_ASSERT(!m_write_mode)
+        AMBRO_ASSERT(pin_ref)
+        
+        m_read_pin_ref = pin_ref;
+        m_read_pin_data = out_data;
+        m_read_pos = 0;
+        m_state = State::READ_EVENT;
+        m_event.prependNowNotAlready(c);
+    }
+    
+    // Seeking past the end of the file positions it at the end.
+    void startSeek (Context c, uint32_t offset)
+    {
+        AMBRO_ASSERT(m_state == State::READY)
+        AMBRO_ASSERT(!m_write_mode)
+        
+        if (m_read_buffer_pos < m_read_buffer_length) {
+            m_fs_file.finishRead(c);
+        }
+        offset = MinValue(offset, m_fs_file.getFileSize(c));
+        m_read_skip = offset % TheFs::BlockSize;
+        m_state = State::SEEK_SEEK;
+        m_fs_file.startSeek(c, offset - m_read_skip);
+    }
+    
     bool isReady (Context c)
     {
         return (m_state == State::READY);
@@ -211,13 +304,14 @@ private:
             m_state = State::READY;
             m_read_buffer_pos = TheFs::BlockSize;
             m_read_buffer_length = TheFs::BlockSize;
+            m_read_skip = 0;
             return m_completion_handler(c, Error::NO_ERROR, 0);
         }
     }
     
     void fs_file_handler (Context c, bool io_error, size_t read_length)
     {
-        AMBRO_ASSERT(m_state == State::OPEN_OPENWR || m_state == State::WRITE_WRITE || m_state == State::READ_READ || m_state == State::WRITE_TRUNCATE)
+        AMBRO_ASSERT(m_state == State::OPEN_OPENWR || m_state == State::WRITE_WRITE || m_state == State::READ_READ || m_state == State::WRITE_TRUNCATE || m_state == State::SEEK_SEEK)
         AMBRO_ASSERT(m_have_file)
         
         if (io_error) {
@@ -239,10 +333,20 @@ private:
             AMBRO_ASSERT(read_length <= TheFs::BlockSize)
             
             m_state = State::READ_EVENT;
-            m_read_buffer_pos = 0;
+            m_read_buffer_pos = MinValue(m_read_skip, read_length);
             m_read_buffer_length = read_length;
+            m_read_skip = 0;
+            if (read_length > 0 && m_read_buffer_pos == m_read_buffer_length) {
+                m_fs_file.finishRead(c);
+            }
             m_event.prependNowNotAlready(c);
         }
+        else if (m_state == State::SEEK_SEEK) {
+            m_state = State::READY;
+            m_read_buffer_pos = TheFs::BlockSize;
+            m_read_buffer_length = TheFs::BlockSize;
+            return m_completion_handler(c, Error::NO_ERROR, 0);
+        }
         else { // m_state == State::WRITE_TRUNCATE
             AMBRO_ASSERT(!m_have_flush)
             
@@ -311,6 +415,10 @@ private:
     
     void handle_event_read (Context c)
     {
+        if (m_read_pin_ref) {
+            return handle_event_read_pinned(c);
+        }
+        
         size_t to_copy = MinValue(m_read_avail, (size_t)(m_read_buffer_length - m_read_buffer_pos));
         if (to_copy > 0) {
             memcpy(m_read_data, m_fs_file.getReadPointer(c) + m_read_buffer_pos, to_copy);
@@ -334,6 +442,24 @@ private:
         return m_completion_handler(c, Error::NO_ERROR, m_read_pos);
     }
     
+    void handle_event_read_pinned (Context c)
+    {
+        if (m_read_buffer_pos < m_read_buffer_length) {
+            *m_read_pin_data = m_fs_file.getReadPointer(c) + m_read_buffer_pos;
+            m_read_pos = m_read_buffer_length - m_read_buffer_pos;
+            m_read_buffer_pos = m_read_buffer_length;
+            m_fs_file.finishReadKeepBlock(c, m_read_pin_ref);
+        }
+        else if (m_read_buffer_pos == TheFs::BlockSize) {
+            m_state = State::READ_READ;
+            m_fs_file.startRead(c);
+            return;
+        }
+        
+        m_state = State::READY;
+        return m_completion_handler(c, Error::NO_ERROR, m_read_pos);
+    }
+    
 private:
     CompletionHandler m_completion_handler;
     typename Context::EventLoop::QueuedEvent m_event;
@@ -367,6 +493,9 @@ private:
                 size_t m_read_pos;
                 size_t m_read_buffer_pos;
                 size_t m_read_buffer_length;
+                size_t m_read_skip;
+                CacheRef *m_read_pin_ref;
+                char const **m_read_pin_data;
             };
         };
     };
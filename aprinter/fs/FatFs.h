@@ -68,6 +68,10 @@ public:
 private:
     static_assert(Params::NumCacheEntries >= 1, "");
     static_assert(Params::MaxFileNameSize >= 12, "");
+    static_assert(Params::NumChainExtents >= 1, "");
+    static_assert(Params::NumChainExtents <= 16, "");
+    static_assert(Params::NumNameCacheEntries >= 0, "");
+    static_assert(Params::NumNameCacheEntries <= 32, "");
     
     using TheDebugObject = DebugObject<Context, Object>;
     APRINTER_MAKE_INSTANCE(TheBlockCache, (BlockCacheArg<Context, Object, TheBlockAccess, Params::NumCacheEntries, Params::NumIoUnits, Params::MaxIoBlocks, FsWritable>))
@@ -102,6 +106,9 @@ private:
     
     static size_t const DirEntrySizeOffset = 0x1C;
     
+    static bool const NameCacheEnabled = (Params::NumNameCacheEntries > 0);
+    static size_t const NameCacheMaxNameLen = MinValue(Params::MaxFileNameSize, 64);
+    
     static size_t const FsInfoSig1Offset = 0x0;
     static size_t const FsInfoSig2Offset = 0x1E4;
     static size_t const FsInfoFreeClustersOffset = 0x1E8;
@@ -154,6 +161,8 @@ public:
         o->block_range = block_range;
         o->state = FsState::INIT;
         
+        name_cache_clear(c);
+        
         o->init_block_ref.init(c, APRINTER_CB_STATFUNC_T(&FatFs::init_block_ref_handler));
         o->init_block_ref.requestBlock(c, get_abs_block_index(c, 0), 0, 1, CacheBlockRef::FLAG_NO_IMMEDIATE_COMPLETION);
         
@@ -251,7 +260,7 @@ public:
     };
     
     class Opener {
-        enum class State : uint8_t {NO_NAMES, REQUESTING_ENTRY, COMPLETED};
+        enum class State : uint8_t {START_EVENT, REQUESTING_ENTRY, COMPLETED};
         
     public:
         enum class OpenerStatus : uint8_t {SUCCESS, NOT_FOUND, ERROR};
@@ -268,28 +277,20 @@ public:
             
             m_entry_type = entry_type;
             m_handler = handler;
-            
+            m_state = State::START_EVENT;
+            m_cur_entry = dir_entry;
             m_path_comp = path;
-            find_name_component_length();
             
-            if (m_path_comp_len == 0) {
-                m_state = State::NO_NAMES;
-                m_no_names_event.init(c, APRINTER_CB_OBJFUNC_T(&Opener::no_names_event_handler, this));
-                m_no_names_event.prependNowNotAlready(c);
-                m_no_names_entry = dir_entry;
-            } else {
-                m_state = State::REQUESTING_ENTRY;
-                m_dir_iter.init(c, dir_entry.cluster_index, APRINTER_CB_OBJFUNC_T(&Opener::dir_iter_handler, this));
-                m_dir_iter.requestEntry(c);
-            }
+            m_start_event.init(c, APRINTER_CB_OBJFUNC_T(&Opener::start_event_handler, this));
+            m_start_event.prependNowNotAlready(c);
         }
         
         void deinit (Context c)
         {
             TheDebugObject::access(c);
             
-            if (m_state == State::NO_NAMES) {
-                m_no_names_event.deinit(c);
+            if (m_state == State::START_EVENT) {
+                m_start_event.deinit(c);
             }
             else if (m_state == State::REQUESTING_ENTRY) {
                 m_dir_iter.deinit(c);
@@ -313,16 +314,49 @@ public:
             return skipped_slashes;
         }
         
-        void no_names_event_handler (Context c)
+        bool component_found (FsEntry entry)
+        {
+            m_cur_entry = entry;
+            m_path_comp += m_path_comp_len;
+            return find_name_component_length();
+        }
+        
+        void start_event_handler (Context c)
         {
             TheDebugObject::access(c);
-            AMBRO_ASSERT(m_state == State::NO_NAMES)
+            AMBRO_ASSERT(m_state == State::START_EVENT)
             
-            m_state = State::COMPLETED;
-            m_no_names_event.deinit(c);
+            m_start_event.deinit(c);
             
-            if (m_no_names_entry.type == m_entry_type) {
-                return m_handler(c, OpenerStatus::SUCCESS, m_no_names_entry);
+            find_name_component_length();
+            return walk_path(c, false);
+        }
+        
+        // Resolves the remaining path components through the name cache
+        // for as long as possible, then scans the directory for the first
+        // component not found there.
+        void walk_path (Context c, bool skipped_slashes)
+        {
+            while (m_path_comp_len > 0) {
+                if (m_cur_entry.type != EntryType::DIR_TYPE) {
+                    m_state = State::COMPLETED;
+                    return m_handler(c, OpenerStatus::NOT_FOUND, FsEntry{});
+                }
+                
+                FsEntry entry;
+                if (!name_cache_lookup(c, m_cur_entry.cluster_index, m_path_comp, m_path_comp_len, &entry)) {
+                    m_state = State::REQUESTING_ENTRY;
+                    m_dir_iter.init(c, m_cur_entry.cluster_index, APRINTER_CB_OBJFUNC_T(&Opener::dir_iter_handler, this));
+                    m_dir_iter.requestMatchingEntry(c, m_path_comp, m_path_comp_len);
+                    return;
+                }
+                
+                skipped_slashes = component_found(entry);
+            }
+            
+            m_state = State::COMPLETED;
+            if (m_cur_entry.type == m_entry_type && !skipped_slashes) {
+                return m_handler(c, OpenerStatus::SUCCESS, m_cur_entry);
             } else {
                 return m_handler(c, OpenerStatus::NOT_FOUND, FsEntry{});
             }
@@ -333,44 +367,17 @@ public:
             TheDebugObject::access(c);
             AMBRO_ASSERT(m_state == State::REQUESTING_ENTRY)
             
+            m_dir_iter.deinit(c);
+            
             if (is_error || !name) {
                 m_state = State::COMPLETED;
-                m_dir_iter.deinit(c);
                 OpenerStatus status = is_error ? OpenerStatus::ERROR : OpenerStatus::NOT_FOUND;
                 return m_handler(c, status, FsEntry{});
             }
             
-            if (!compare_filename_equal(name, m_path_comp, m_path_comp_len)) {
-                m_dir_iter.requestEntry(c);
-                return;
-            }
-            
-            m_dir_iter.deinit(c);
-            
-            m_path_comp += m_path_comp_len;
-            bool skipped_slashes = find_name_component_length();
-            
-            if (m_path_comp_len > 0) {
-                if (entry.type != EntryType::DIR_TYPE) {
-                    m_state = State::COMPLETED;
-                    return m_handler(c, OpenerStatus::NOT_FOUND, FsEntry{});
-                }
-                m_dir_iter.init(c, entry.cluster_index, APRINTER_CB_OBJFUNC_T(&Opener::dir_iter_handler, this));
-                m_dir_iter.requestEntry(c);
-                return;
-            }
+            name_cache_insert(c, m_cur_entry.cluster_index, m_path_comp, m_path_comp_len, entry);
             
-            m_state = State::COMPLETED;
-            if (entry.type == m_entry_type && !skipped_slashes) {
-                return m_handler(c, OpenerStatus::SUCCESS, entry);
-            } else {
-                return m_handler(c, OpenerStatus::NOT_FOUND, FsEntry{});
-            }
-        }
-        
-        static bool compare_filename_equal (char const *str1, char const *str2, size_t str2_len)
-        {
-            return Params::CaseInsens ? AsciiCaseInsensStringEqualToMem(str1, str2, str2_len) : (strlen(str1) == str2_len && !memcmp(str1, str2, str2_len));
+            return walk_path(c, component_found(entry));
         }
         
         EntryType m_entry_type;
@@ -378,11 +385,9 @@ public:
         char const *m_path_comp;
         size_t m_path_comp_len;
         OpenerHandler m_handler;
+        FsEntry m_cur_entry;
         union {
-            struct {
-                typename Context::EventLoop::QueuedEvent m_no_names_event;
-                FsEntry m_no_names_entry;
-            };
+            typename Context::EventLoop::QueuedEvent m_start_event;
             DirectoryIterator m_dir_iter;
         };
     };
@@ -394,6 +399,7 @@ public:
         DirEntriesPerBlockType m_dir_entry_block_offset;
         bool m_no_need_to_read_for_write;
         WriteReference<true> m_write_ref;
+        uint32_t m_prealloc_size;
     };
     
     APRINTER_STRUCT_IF_TEMPLATE(FileHintingMembers) {
@@ -407,6 +413,7 @@ public:
         enum class State : uint8_t {
             IDLE,
             READ_EVENT, READ_NEXT_CLUSTER, READ_BLOCK, READ_READY,
+            SEEK_CHAIN,
             OPENWR_EVENT, OPENWR_DIR_ENTRY,
             WRITE_EVENT, WRITE_NEXT_CLUSTER, WRITE_BLOCK, WRITE_READY,
             TRUNC_EVENT, TRUNC_CHAIN
@@ -472,6 +479,36 @@ public:
             m_block_in_cluster = o->blocks_per_cluster;
         }
         
+        // Moves to the given block-aligned offset, which must not be beyond the end of
+        // the file. Completion is reported to the handler. On error the file is rewound.
+        void startSeek (Context c, uint32_t offset)
+        {
+            auto *o = Object::self(c);
+            TheDebugObject::access(c);
+            AMBRO_ASSERT(m_state == State::IDLE)
+            AMBRO_ASSERT(offset % BlockSize == 0)
+            AMBRO_ASSERT(offset <= m_file_size)
+            
+            uint32_t block_idx = offset / BlockSize;
+            uint32_t chain_pos = block_idx / o->blocks_per_cluster;
+            m_block_in_cluster = block_idx % o->blocks_per_cluster;
+            if (m_block_in_cluster == 0) {
+                m_block_in_cluster = o->blocks_per_cluster;
+            } else {
+                chain_pos++;
+            }
+            m_file_pos = offset;
+            m_state = State::SEEK_CHAIN;
+            m_chain.requestSeek(c, chain_pos);
+        }
+        
+        uint32_t getFileSize (Context c)
+        {
+            TheDebugObject::access(c);
+            
+            return m_file_size;
+        }
+        
         void startReadUserBuf (Context c, DataWordType *buf)
         {
             TheDebugObject::access(c);
@@ -513,6 +550,19 @@ public:
             m_state = State::IDLE;
         }
         
+        // Like finishRead, but the block stays in the cache, referenced by the
+        // given CacheRefForUser, so the data remains accessible through that.
+        void finishReadKeepBlock (Context c, CacheBlockRef *keep_ref)
+        {
+            TheDebugObject::access(c);
+            AMBRO_ASSERT(m_state == State::READ_READY)
+            AMBRO_ASSERT(m_io_mode == IoMode::FS_BUFFER)
+            
+            finish_read(c, get_bytes_in_block(c));
+            keep_ref->takeFrom(c, &m_fs_buffer_mode.block_ref);
+            m_state = State::IDLE;
+        }
+        
         APRINTER_FUNCTION_IF(Writable, void, startOpenWritable (Context c))
         {
             TheDebugObject::access(c);
@@ -577,6 +627,19 @@ public:
             m_event.prependNowNotAlready(c);
         }
         
+        // Tells how large the file is expected to become, so that when writing
+        // past the end of the cluster chain, clusters up to this size are
+        // allocated together where possible, keeping the file contiguous.
+        // It is only a hint, clusters allocated past the data actually written
+        // stay in the chain until the file is truncated. To bound what an aborted
+        // write leaves behind, a run is at most as long as the file already is.
+        APRINTER_FUNCTION_IF(Writable, void, setPreallocationSize (Context c, uint32_t size))
+        {
+            TheDebugObject::access(c);
+            
+            this->m_prealloc_size = size;
+        }
+        
     private:
         APRINTER_FUNCTION_IF_OR_EMPTY(Writable, void, writable_init (Context c, FsEntry file_entry))
         {
@@ -585,6 +648,7 @@ public:
             
             this->m_dir_entry_block_index = file_entry.dir_entry_block_index;
             this->m_dir_entry_block_offset = file_entry.dir_entry_block_offset;
+            this->m_prealloc_size = 0;
         }
         
         APRINTER_FUNCTION_IF_OR_EMPTY(Writable, void, writable_deinit (Context c))
@@ -642,6 +706,15 @@ public:
             }
         }
         
+        APRINTER_FUNCTION_IF_OR_EMPTY(EnableReadHinting, void, reset_read_hinting (Context c))
+        {
+            auto *o = Object::self(c);
+            
+            if (m_block_in_cluster < o->blocks_per_cluster) {
+                this->m_hint_block_pos = get_cluster_data_abs_block_index(c, m_chain.getCurrentCluster(c), m_block_in_cluster);
+            }
+        }
+        
         APRINTER_FUNCTION_IF_OR_EMPTY(Writable, void, handle_event_write (Context c))
         {
             auto *o = Object::self(c);
@@ -703,6 +776,22 @@ public:
             m_event.prependNowNotAlready(c);
         }
         
+        void handle_chain_seek (Context c, bool error)
+        {
+            auto *o = Object::self(c);
+            if (!error && m_block_in_cluster < o->blocks_per_cluster && m_chain.endReached(c)) {
+                error = true;
+            }
+            if (error) {
+                m_chain.rewind(c);
+                m_file_pos = 0;
+                m_block_in_cluster = o->blocks_per_cluster;
+            } else {
+                reset_read_hinting(c);
+            }
+            return complete_request(c, error);
+        }
+        
         APRINTER_FUNCTION_IF_OR_EMPTY(Writable, void, handle_chain_write_next (Context c, bool error))
         {
             auto *o = Object::self(c);
@@ -711,7 +800,13 @@ public:
                 return complete_request(c, true);
             }
             if (m_chain.endReached(c)) {
-                m_chain.requestNew(c);
+                ClusterIndexType max_clusters = 1;
+                if (this->m_prealloc_size > m_file_pos) {
+                    uint32_t cluster_size = (uint32_t)o->blocks_per_cluster * BlockSize;
+                    max_clusters = (this->m_prealloc_size - m_file_pos - 1) / cluster_size + 1;
+                    max_clusters = MinValue(max_clusters, (ClusterIndexType)MaxValue((uint32_t)1, m_file_pos / cluster_size));
+                }
+                m_chain.requestNew(c, max_clusters);
                 return;
             }
             m_block_in_cluster = 0;
@@ -797,6 +892,9 @@ public:
             if (m_state == State::READ_NEXT_CLUSTER) {
                 handle_chain_read_next(c, error);
             }
+            else if (m_state == State::SEEK_CHAIN) {
+                handle_chain_seek(c, error);
+            }
             else if (Writable && m_state == State::WRITE_NEXT_CLUSTER) {
                 handle_chain_write_next(c, error);
             }
@@ -1317,7 +1415,7 @@ private:
         o->fs_info_block_ref.markDirty(c);
     }
     
-    APRINTER_FUNCTION_IF_EXT(FsWritable, static, void, update_fs_info_free_clusters (Context c, bool inc_else_dec))
+    APRINTER_FUNCTION_IF_EXT(FsWritable, static, void, update_fs_info_free_clusters (Context c, bool inc_else_dec, ClusterIndexType count=1))
     {
         auto *o = Object::self(c);
         
@@ -1325,9 +1423,10 @@ private:
         uint32_t free_clusters = ReadBinaryInt<uint32_t, BinaryLittleEndian>(buffer + FsInfoFreeClustersOffset);
         if (free_clusters <= o->num_valid_clusters) {
             if (inc_else_dec) {
-                free_clusters++;
+                free_clusters += count;
             } else {
-                free_clusters--;
+                // Don't wrap around if the stored count was too low, just mark it unknown.
+                free_clusters = (count <= free_clusters) ? (free_clusters - count) : UINT32_C(0xFFFFFFFF);
             }
             WriteBinaryInt<uint32_t, BinaryLittleEndian>(free_clusters, buffer + FsInfoFreeClustersOffset);
             o->fs_info_block_ref.markDirty(c);
@@ -1363,7 +1462,7 @@ private:
         o->alloc_event.prependNowNotAlready(c);
     }
     
-    APRINTER_FUNCTION_IF_EXT(FsWritable, static, void, complete_allocation (Context c, bool error, ClusterIndexType cluster_index=0))
+    APRINTER_FUNCTION_IF_EXT(FsWritable, static, void, complete_allocation (Context c, bool error, ClusterIndexType cluster_index=0, ClusterIndexType num_clusters=0))
     {
         auto *o = Object::self(c);
         AMBRO_ASSERT(o->alloc_state != AllocationState::IDLE)
@@ -1386,7 +1485,7 @@ private:
             o->alloc_state = AllocationState::IDLE;
             o->write_block_ref.reset(c);
         }
-        complete_request->allocation_result(c, error, cluster_index);
+        complete_request->allocation_result(c, error, cluster_index, num_clusters);
     }
     
     APRINTER_FUNCTION_IF_EXT(FsWritable, static, void, alloc_event_handler (Context c))
@@ -1412,9 +1511,10 @@ private:
             ClusterIndexType fat_value = read_fat_entry_in_cache_block(c, &o->write_block_ref, current_cluster);
             if (fat_value == FreeClusterMarker) {
                 update_fat_entry_in_cache_block(c, &o->write_block_ref, current_cluster, EndOfChainMarker);
-                update_fs_info_free_clusters(c, false);
+                ClusterIndexType num_clusters = claim_following_free_clusters(c, current_cluster);
+                update_fs_info_free_clusters(c, false, num_clusters);
                 update_fs_info_allocated_cluster(c);
-                return complete_allocation(c, false, current_cluster);
+                return complete_allocation(c, false, current_cluster, num_clusters);
             }
             
             if (o->alloc_position == o->alloc_start) {
@@ -1423,6 +1523,39 @@ private:
         }
     }
     
+    // Having claimed first_cluster, claims as many of the directly following
+    // free clusters as the requesting chain wants and are described by the same
+    // FAT block, linking them after first_cluster. Returns the total number of
+    // clusters claimed, including first_cluster.
+    APRINTER_FUNCTION_IF_EXT(FsWritable, static, ClusterIndexType, claim_following_free_clusters (Context c, ClusterIndexType first_cluster))
+    {
+        auto *o = Object::self(c);
+        
+        ClusterIndexType max_clusters = o->allocating_chains_list.first()->m_alloc_max_clusters;
+        ClusterIndexType last_cluster = first_cluster;
+        ClusterIndexType num_clusters = 1;
+        
+        while (num_clusters < max_clusters && o->alloc_position != 0 && o->alloc_position != o->alloc_start) {
+            ClusterIndexType next_cluster = 2 + o->alloc_position;
+            if (next_cluster / FatEntriesPerBlock != first_cluster / FatEntriesPerBlock ||
+                read_fat_entry_in_cache_block(c, &o->write_block_ref, next_cluster) != FreeClusterMarker)
+            {
+                break;
+            }
+            update_fat_entry_in_cache_block(c, &o->write_block_ref, next_cluster, EndOfChainMarker);
+            update_fat_entry_in_cache_block(c, &o->write_block_ref, last_cluster, next_cluster);
+            last_cluster = next_cluster;
+            num_clusters++;
+            
+            o->alloc_position++;
+            if (o->alloc_position == o->num_valid_clusters) {
+                o->alloc_position = 0;
+            }
+        }
+        
+        return num_clusters;
+    }
+    
     APRINTER_FUNCTION_IF_EXT(FsWritable, static, void, alloc_block_ref_handler (Context c, bool error))
     {
         auto *o = Object::self(c);
@@ -1441,10 +1574,101 @@ private:
         entry->dir_entry_block_offset = dir_entry_block_offset;
     }
     
+    static bool compare_filename_equal (char const *str1, char const *str2, size_t str2_len)
+    {
+        return Params::CaseInsens ? AsciiCaseInsensStringEqualToMem(str1, str2, str2_len) : (strlen(str1) == str2_len && !memcmp(str1, str2, str2_len));
+    }
+    
+    static bool compare_filename_mem_equal (char const *str1, char const *str2, size_t len)
+    {
+        for (auto i : LoopRange<size_t>(len)) {
+            if (Params::CaseInsens ? (AsciiToLower(str1[i]) != AsciiToLower(str2[i])) : (str1[i] != str2[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // FNV-1a over the directory cluster and the name, lowercased if
+    // names are case-insensitive.
+    static uint32_t name_cache_hash (ClusterIndexType dir_cluster, char const *name, size_t name_len)
+    {
+        uint32_t hash = UINT32_C(2166136261) ^ dir_cluster;
+        for (auto i : LoopRange<size_t>(name_len)) {
+            char ch = Params::CaseInsens ? AsciiToLower(name[i]) : name[i];
+            hash = (hash ^ (uint8_t)ch) * UINT32_C(16777619);
+        }
+        return hash;
+    }
+    
+    APRINTER_FUNCTION_IF_OR_EMPTY_EXT(NameCacheEnabled, static, void, name_cache_clear (Context c))
+    {
+        auto *o = Object::self(c);
+        for (auto &ce : o->name_cache) {
+            ce.name_len = 0;
+        }
+        o->name_cache_victim = 0;
+    }
+    
+    APRINTER_FUNCTION_IF_ELSE_EXT(NameCacheEnabled, static, bool, name_cache_lookup (Context c, ClusterIndexType dir_cluster, char const *name, size_t name_len, FsEntry *out_entry), {
+        auto *o = Object::self(c);
+        uint32_t hash = name_cache_hash(dir_cluster, name, name_len);
+        for (auto &ce : o->name_cache) {
+            if (ce.name_len == name_len && ce.name_hash == hash && ce.dir_cluster == dir_cluster && compare_filename_mem_equal(ce.name, name, name_len)) {
+                *out_entry = ce.entry;
+                return true;
+            }
+        }
+        return false;
+    }, {
+        return false;
+    })
+    
+    APRINTER_FUNCTION_IF_OR_EMPTY_EXT(NameCacheEnabled, static, void, name_cache_insert (Context c, ClusterIndexType dir_cluster, char const *name, size_t name_len, FsEntry entry))
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(name_len > 0)
+        
+        if (name_len > NameCacheMaxNameLen) {
+            return;
+        }
+        
+        // Replace entries round-robin; a lookup was just missed so the
+        // name is not in the cache already.
+        auto *ce = &o->name_cache[o->name_cache_victim];
+        o->name_cache_victim = (o->name_cache_victim + 1) % Params::NumNameCacheEntries;
+        
+        ce->dir_cluster = dir_cluster;
+        ce->name_hash = name_cache_hash(dir_cluster, name, name_len);
+        ce->name_len = name_len;
+        memcpy(ce->name, name, name_len);
+        ce->entry = entry;
+    }
+    
+    // Called when a directory entry is modified, to forget any cached
+    // lookup result which would now be stale.
+    APRINTER_FUNCTION_IF_OR_EMPTY_EXT(NameCacheEnabled, static, void, name_cache_invalidate (Context c, BlockIndexType dir_entry_block_index, DirEntriesPerBlockType dir_entry_block_offset))
+    {
+        auto *o = Object::self(c);
+        for (auto &ce : o->name_cache) {
+            if (ce.name_len > 0 && ce.entry.dir_entry_block_index == dir_entry_block_index && ce.entry.dir_entry_block_offset == dir_entry_block_offset) {
+                ce.name_len = 0;
+            }
+        }
+    }
+    
+    // A run of clusters which are consecutive both in the chain and on the disk.
+    struct ChainExtent {
+        uint32_t chain_index;
+        ClusterIndexType first_cluster;
+        uint32_t num_clusters;
+    };
+    
     APRINTER_STRUCT_IF_TEMPLATE(ClusterChainExtraMembers) {
         CacheBlockRef m_fat_cache_ref2;
         DoubleEndedListNode<ClusterChain<true>> m_allocating_chains_node;
         ClusterIndexType m_prev_cluster;
+        ClusterIndexType m_alloc_max_clusters;
     };
     
     template <bool Writable>
@@ -1454,10 +1678,15 @@ private:
         enum class State : uint8_t {
             IDLE,
             NEXT_CHECK, NEXT_REQUESTING_FAT,
+            SEEK_CHECK, SEEK_REQUESTING_FAT,
             NEW_CHECK, NEW_REQUESTING_FAT, NEW_ALLOCATING,
             TRUNCATE_CHECK, TRUNCATE_REQUESTING_FAT, TRUNCATE_REQUESTING_FAT2
         };
         enum class IterState : uint8_t {START, CLUSTER, END};
+        enum class AdvanceResult : uint8_t {DONE, WAIT_FAT, ERROR};
+        
+        static int const NumExtents = Params::NumChainExtents;
+        static int const MaxSeekStepsPerEvent = 32;
         
     public:
         using ClusterChainHandler = Callback<void(Context c, bool error, bool first_cluster_changed)>;
@@ -1471,6 +1700,7 @@ private:
             m_state = State::IDLE;
             m_first_cluster = first_cluster;
             
+            clear_extents();
             extra_init(c);
             
             rewind_internal(c);
@@ -1498,6 +1728,17 @@ private:
             m_event.prependNowNotAlready(c);
         }
         
+        // Positions the chain as if rewind() and then position calls of requestNext()
+        // had been done. Clusters are located using the extent cache where possible.
+        void requestSeek (Context c, uint32_t position)
+        {
+            AMBRO_ASSERT(m_state == State::IDLE)
+            
+            m_seek_position = position;
+            m_state = State::SEEK_CHECK;
+            m_event.prependNowNotAlready(c);
+        }
+        
         bool endReached (Context c)
         {
             AMBRO_ASSERT(m_state == State::IDLE)
@@ -1513,13 +1754,20 @@ private:
             return m_current_cluster;
         }
         
-        APRINTER_FUNCTION_IF(Writable, void, requestNew (Context c))
+        // Appends a new cluster to the end of the chain and moves to it.
+        // If max_clusters is greater than one, up to that many clusters may be
+        // allocated at once, if they are free and directly follow the first one.
+        // The additional clusters are then reached by requestNext without
+        // reading the FAT.
+        APRINTER_FUNCTION_IF(Writable, void, requestNew (Context c, ClusterIndexType max_clusters=1))
         {
             auto *o = Object::self(c);
             AMBRO_ASSERT(o->write_mount_state == WriteMountState::MOUNTED)
             AMBRO_ASSERT(m_state == State::IDLE)
             AMBRO_ASSERT(m_iter_state == IterState::END)
+            AMBRO_ASSERT(max_clusters >= 1)
             
+            this->m_alloc_max_clusters = max_clusters;
             m_state = State::NEW_CHECK;
             m_event.prependNowNotAlready(c);
         }
@@ -1535,6 +1783,7 @@ private:
         {
             AMBRO_ASSERT(m_state == State::IDLE)
             
+            trim_extents();
             m_state = State::TRUNCATE_CHECK;
             m_event.prependNowNotAlready(c);
         }
@@ -1625,9 +1874,154 @@ private:
         {
             m_iter_state = IterState::START;
             m_current_cluster = m_first_cluster;
+            m_position = 0;
+            m_cur_extent = -1;
             extra_set_prev_cluster(c, 0);
         }
         
+        void clear_extents ()
+        {
+            for (int i = 0; i < NumExtents; i++) {
+                m_extents[i].num_clusters = 0;
+            }
+            m_cur_extent = -1;
+            m_extent_replace_slot = 0;
+        }
+        
+        // Forgets clusters after the current one, in preparation for truncation.
+        void trim_extents ()
+        {
+            if (m_iter_state == IterState::START) {
+                clear_extents();
+                return;
+            }
+            for (int i = 0; i < NumExtents; i++) {
+                ChainExtent *ext = &m_extents[i];
+                if (ext->chain_index >= m_position) {
+                    ext->num_clusters = 0;
+                } else {
+                    ext->num_clusters = MinValue(ext->num_clusters, (uint32_t)(m_position - ext->chain_index));
+                }
+            }
+        }
+        
+        int find_extent (uint32_t chain_index)
+        {
+            for (int i = 0; i < NumExtents; i++) {
+                ChainExtent *ext = &m_extents[i];
+                if (chain_index >= ext->chain_index && chain_index - ext->chain_index < ext->num_clusters) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+        
+        // Records that m_current_cluster is at chain index m_position-1.
+        void record_extent (bool have_prev, ClusterIndexType prev_cluster)
+        {
+            uint32_t chain_index = m_position - 1;
+            if (have_prev && m_cur_extent >= 0) {
+                ChainExtent *ext = &m_extents[m_cur_extent];
+                if (m_current_cluster == prev_cluster + 1 && ext->chain_index + ext->num_clusters == chain_index) {
+                    ext->num_clusters++;
+                    return;
+                }
+            }
+            int slot = find_extent(chain_index);
+            if (slot < 0) {
+                slot = m_extent_replace_slot;
+                m_extent_replace_slot = (slot + 1 == NumExtents) ? 0 : (slot + 1);
+                m_extents[slot] = ChainExtent{chain_index, m_current_cluster, 1};
+            }
+            m_cur_extent = slot;
+        }
+        
+        // Moves one cluster forward, reading the FAT unless the current extent
+        // already tells where the next cluster is.
+        AdvanceResult advance (Context c)
+        {
+            AMBRO_ASSERT(m_iter_state != IterState::END)
+            
+            bool have_prev = (m_iter_state == IterState::CLUSTER);
+            ClusterIndexType prev_cluster = m_current_cluster;
+            if (have_prev) {
+                if (m_cur_extent >= 0 && m_position - m_extents[m_cur_extent].chain_index < m_extents[m_cur_extent].num_clusters) {
+                    m_current_cluster++;
+                } else {
+                    if (!is_cluster_idx_valid_for_fat(c, m_current_cluster)) {
+                        return AdvanceResult::ERROR;
+                    }
+                    if (!request_fat_cache_block(c, &m_fat_cache_ref1, m_current_cluster, false)) {
+                        return AdvanceResult::WAIT_FAT;
+                    }
+                    m_current_cluster = read_fat_entry_in_cache_block(c, &m_fat_cache_ref1, m_current_cluster);
+                }
+                extra_set_prev_cluster(c, prev_cluster);
+            }
+            m_position++;
+            m_iter_state = is_cluster_idx_normal(m_current_cluster) ? IterState::CLUSTER : IterState::END;
+            if (m_iter_state == IterState::CLUSTER) {
+                record_extent(have_prev, prev_cluster);
+            }
+            return AdvanceResult::DONE;
+        }
+        
+        // Jumps to the cached cluster closest to (but not after) the seek target,
+        // if that is further than the current position.
+        bool jump_using_extents ()
+        {
+            uint32_t target_index = m_seek_position - 1;
+            int best_slot = -1;
+            uint32_t best_index = 0;
+            for (int i = 0; i < NumExtents; i++) {
+                ChainExtent *ext = &m_extents[i];
+                if (ext->num_clusters == 0 || ext->chain_index > target_index) {
+                    continue;
+                }
+                uint32_t index = MinValue(target_index, (uint32_t)(ext->chain_index + (ext->num_clusters - 1)));
+                if (index >= m_position && (best_slot < 0 || index > best_index)) {
+                    best_slot = i;
+                    best_index = index;
+                }
+            }
+            if (best_slot < 0) {
+                return false;
+            }
+            ChainExtent *ext = &m_extents[best_slot];
+            m_current_cluster = ext->first_cluster + (best_index - ext->chain_index);
+            m_position = best_index + 1;
+            m_iter_state = IterState::CLUSTER;
+            m_cur_extent = best_slot;
+            return true;
+        }
+        
+        void handle_event_seek_check (Context c)
+        {
+            if (m_seek_position < m_position) {
+                rewind_internal(c);
+            }
+            int steps = 0;
+            while (m_position < m_seek_position && m_iter_state != IterState::END) {
+                if (jump_using_extents()) {
+                    continue;
+                }
+                if (steps == MaxSeekStepsPerEvent) {
+                    m_event.appendNowNotAlready(c);
+                    return;
+                }
+                AdvanceResult res = advance(c);
+                if (res == AdvanceResult::WAIT_FAT) {
+                    m_state = State::SEEK_REQUESTING_FAT;
+                    return;
+                }
+                if (res == AdvanceResult::ERROR) {
+                    return complete_request(c, true);
+                }
+                steps++;
+            }
+            return complete_request(c, false);
+        }
+        
         void complete_request (Context c, bool error, bool first_cluster_changed=false)
         {
             m_state = State::IDLE;
@@ -1642,22 +2036,21 @@ private:
             TheDebugObject::access(c);
             
             if (m_state == State::NEXT_CHECK) {
-                if (m_iter_state == IterState::CLUSTER) {
-                    if (!is_cluster_idx_valid_for_fat(c, m_current_cluster)) {
-                        return complete_request(c, true);
-                    }
-                    if (!request_fat_cache_block(c, &m_fat_cache_ref1, m_current_cluster, false)) {
+                if (m_iter_state != IterState::END) {
+                    AdvanceResult res = advance(c);
+                    if (res == AdvanceResult::WAIT_FAT) {
                         m_state = State::NEXT_REQUESTING_FAT;
                         return;
                     }
-                    extra_set_prev_cluster(c, m_current_cluster);
-                    m_current_cluster = read_fat_entry_in_cache_block(c, &m_fat_cache_ref1, m_current_cluster);
-                }
-                if (m_iter_state != IterState::END) {
-                    m_iter_state = is_cluster_idx_normal(m_current_cluster) ? IterState::CLUSTER : IterState::END;
+                    if (res == AdvanceResult::ERROR) {
+                        return complete_request(c, true);
+                    }
                 }
                 return complete_request(c, false);
             }
+            else if (m_state == State::SEEK_CHECK) {
+                handle_event_seek_check(c);
+            }
             else if (Writable && m_state == State::NEW_CHECK) {
                 handle_event_new_check(c);
             }
@@ -1676,6 +2069,7 @@ private:
             State success_state;
             switch (m_state) {
                 case State::NEXT_REQUESTING_FAT:      success_state = State::NEXT_CHECK;     break;
+                case State::SEEK_REQUESTING_FAT:      success_state = State::SEEK_CHECK;     break;
                 case State::NEW_REQUESTING_FAT:       success_state = State::NEW_CHECK;      break;
                 case State::TRUNCATE_REQUESTING_FAT:  success_state = State::TRUNCATE_CHECK; break;
                 case State::TRUNCATE_REQUESTING_FAT2: success_state = State::TRUNCATE_CHECK; break;
@@ -1688,12 +2082,13 @@ private:
             m_event.prependNowNotAlready(c);
         }
         
-        APRINTER_FUNCTION_IF(Writable, void, allocation_result (Context c, bool error, ClusterIndexType new_cluster_index))
+        APRINTER_FUNCTION_IF(Writable, void, allocation_result (Context c, bool error, ClusterIndexType new_cluster_index, ClusterIndexType num_clusters))
         {
             auto *o = Object::self(c);
             AMBRO_ASSERT(m_state == State::NEW_ALLOCATING)
             AMBRO_ASSERT(error || is_cluster_idx_valid_for_fat(c, new_cluster_index))
             AMBRO_ASSERT(error || is_cluster_idx_normal(new_cluster_index))
+            AMBRO_ASSERT(error || (num_clusters >= 1 && num_clusters <= this->m_alloc_max_clusters))
             AMBRO_ASSERT(m_iter_state == IterState::END)
             AMBRO_ASSERT(!is_cluster_idx_normal(m_current_cluster))
             AMBRO_ASSERT(is_cluster_idx_normal(m_first_cluster) == is_cluster_idx_normal(this->m_prev_cluster))
@@ -1710,6 +2105,14 @@ private:
                 update_fat_entry_in_cache_block(c, &m_fat_cache_ref1, this->m_prev_cluster, m_current_cluster);
             }
             m_iter_state = IterState::CLUSTER;
+            record_extent(!changing_first_cluster, this->m_prev_cluster);
+            
+            // The current extent ends at the new cluster, extend it over
+            // the other clusters allocated together with it.
+            ChainExtent *ext = &m_extents[m_cur_extent];
+            AMBRO_ASSERT(ext->chain_index + ext->num_clusters == m_position)
+            ext->num_clusters += num_clusters - 1;
+            
             return complete_request(c, false, changing_first_cluster);
         }
         
@@ -1718,8 +2121,13 @@ private:
         ClusterChainHandler m_handler;
         State m_state;
         IterState m_iter_state;
+        int8_t m_cur_extent;
+        uint8_t m_extent_replace_slot;
         ClusterIndexType m_first_cluster;
         ClusterIndexType m_current_cluster;
+        uint32_t m_position;
+        uint32_t m_seek_position;
+        ChainExtent m_extents[NumExtents];
     };
     
     template <bool Writable>
@@ -1754,6 +2162,7 @@ private:
             AMBRO_ASSERT(m_state == State::INVALID)
             
             m_state = State::REQUESTING_BLOCK;
+            m_block_index = block_index;
             m_block_offset = block_offset;
             m_block_ref.requestBlock(c, get_abs_block_index(c, block_index), 0, 1, CacheBlockRef::FLAG_NO_IMMEDIATE_COMPLETION);
         }
@@ -1773,6 +2182,7 @@ private:
             uint32_t write_value = update_cluster_entry(read_dir_entry_first_cluster(c, buffer), value);
             write_dir_entry_first_cluster(c, write_value, buffer);
             m_block_ref.markDirty(c);
+            name_cache_invalidate(c, m_block_index, m_block_offset);
         }
         
         uint32_t getFileSize (Context c)
@@ -1788,6 +2198,7 @@ private:
             
             WriteBinaryInt<uint32_t, BinaryLittleEndian>(value, get_entry_ptr<true>(c) + DirEntrySizeOffset);
             m_block_ref.markDirty(c);
+            name_cache_invalidate(c, m_block_index, m_block_offset);
         }
         
     private:
@@ -1809,6 +2220,7 @@ private:
         CacheBlockRef m_block_ref;
         DirEntryRefHandler m_handler;
         State m_state;
+        BlockIndexType m_block_index;
         DirEntriesPerBlockType m_block_offset;
     };
     
@@ -1828,6 +2240,7 @@ private:
             
             m_handler = handler;
             m_state = State::WAIT_REQUEST;
+            m_match_name = nullptr;
             m_block_in_cluster = o->blocks_per_cluster;
             m_block_entry_pos = DirEntriesPerBlock;
             m_vfat_seq = -1;
@@ -1844,6 +2257,22 @@ private:
         {
             AMBRO_ASSERT(m_state == State::WAIT_REQUEST)
             
+            m_match_name = nullptr;
+            schedule_event(c);
+        }
+        
+        /**
+         * Like requestEntry, but entries whose name does not equal the given
+         * name are skipped without reporting them. The name must remain valid
+         * until the request completes.
+         */
+        void requestMatchingEntry (Context c, char const *name, size_t name_len)
+        {
+            AMBRO_ASSERT(m_state == State::WAIT_REQUEST)
+            AMBRO_ASSERT(name)
+            
+            m_match_name = name;
+            m_match_len = name_len;
             schedule_event(c);
         }
         
@@ -1866,145 +2295,161 @@ private:
             TheDebugObject::access(c);
             AMBRO_ASSERT(m_state == State::CHECK_NEXT_EVENT)
             
-            if (m_block_entry_pos == DirEntriesPerBlock) {
-                if (m_block_in_cluster == o->blocks_per_cluster) {
-                    m_dir_block_ref.reset(c);
-                    m_chain.requestNext(c);
-                    m_state = State::REQUESTING_CLUSTER;
-                    return;
-                }
+            // Process entries until one is to be reported, or there is need to
+            // wait for the next cluster or for a block which is not in cache.
+            // This way, skipped entries do not cost an event each.
+            bool block_done = false;
+            while (true) {
+                if (m_block_entry_pos == DirEntriesPerBlock) {
+                    // Yield after each block, to bound the time spent here.
+                    if (block_done) {
+                        return schedule_event(c);
+                    }
+                    
+                    if (m_block_in_cluster == o->blocks_per_cluster) {
+                        m_dir_block_ref.reset(c);
+                        m_chain.requestNext(c);
+                        m_state = State::REQUESTING_CLUSTER;
+                        return;
+                    }
                 
-                if (!is_cluster_idx_valid_for_data(c, m_chain.getCurrentCluster(c))) {
-                    return complete_request(c, true);
-                }
+                    if (!is_cluster_idx_valid_for_data(c, m_chain.getCurrentCluster(c))) {
+                        return complete_request(c, true);
+                    }
                 
-                BlockIndexType abs_block_idx = get_cluster_data_abs_block_index(c, m_chain.getCurrentCluster(c), m_block_in_cluster);
-                if (!m_dir_block_ref.requestBlock(c, abs_block_idx, 0, 1, 0)) {
-                    m_state = State::REQUESTING_BLOCK;
-                    return;
+                    BlockIndexType abs_block_idx = get_cluster_data_abs_block_index(c, m_chain.getCurrentCluster(c), m_block_in_cluster);
+                    if (!m_dir_block_ref.requestBlock(c, abs_block_idx, 0, 1, 0)) {
+                        m_state = State::REQUESTING_BLOCK;
+                        return;
+                    }
+                
+                    m_block_in_cluster++;
+                    m_block_entry_pos = 0;
+                    block_done = true;
                 }
                 
-                m_block_in_cluster++;
-                m_block_entry_pos = 0;
-            }
-            
-            char const *entry_ptr = m_dir_block_ref.getData(c, WrapBool<false>()) + ((size_t)m_block_entry_pos * 32);
-            
-            uint8_t first_byte =    ReadBinaryInt<uint8_t, BinaryLittleEndian>(entry_ptr + 0x0);
-            uint8_t attrs =         ReadBinaryInt<uint8_t, BinaryLittleEndian>(entry_ptr + 0xB);
-            uint8_t type_byte =     ReadBinaryInt<uint8_t, BinaryLittleEndian>(entry_ptr + 0xC);
-            uint8_t checksum_byte = ReadBinaryInt<uint8_t, BinaryLittleEndian>(entry_ptr + 0xD);
-            uint32_t file_size =    ReadBinaryInt<uint32_t, BinaryLittleEndian>(entry_ptr + DirEntrySizeOffset);
-            
-            if (first_byte == 0) {
-                return complete_request(c, false);
-            }
-            
-            m_block_entry_pos++;
-            
-            // VFAT entry
-            if (first_byte != 0xE5 && attrs == 0xF && type_byte == 0 && file_size != 0) {
-                int8_t entry_vfat_seq = first_byte & 0x1F;
-                if ((first_byte & 0x60) == 0x40) {
-                    // Start collection.
-                    m_vfat_seq = entry_vfat_seq;
-                    m_vfat_csum = checksum_byte;
-                    m_filename_pos = Params::MaxFileNameSize;
+                char const *entry_ptr = m_dir_block_ref.getData(c, WrapBool<false>()) + ((size_t)m_block_entry_pos * 32);
+                
+                uint8_t first_byte =    ReadBinaryInt<uint8_t, BinaryLittleEndian>(entry_ptr + 0x0);
+                uint8_t attrs =         ReadBinaryInt<uint8_t, BinaryLittleEndian>(entry_ptr + 0xB);
+                uint8_t type_byte =     ReadBinaryInt<uint8_t, BinaryLittleEndian>(entry_ptr + 0xC);
+                uint8_t checksum_byte = ReadBinaryInt<uint8_t, BinaryLittleEndian>(entry_ptr + 0xD);
+                uint32_t file_size =    ReadBinaryInt<uint32_t, BinaryLittleEndian>(entry_ptr + DirEntrySizeOffset);
+                
+                if (first_byte == 0) {
+                    return complete_request(c, false);
                 }
                 
-                if (entry_vfat_seq > 0 && m_vfat_seq != -1 && entry_vfat_seq == m_vfat_seq && checksum_byte == m_vfat_csum) {
-                    // Collect entry.
-                    char name_data[26];
-                    memcpy(name_data + 0, entry_ptr + 0x1, 10);
-                    memcpy(name_data + 10, entry_ptr + 0xE, 12);
-                    memcpy(name_data + 22, entry_ptr + 0x1C, 4);
-                    size_t chunk_len = 0;
-                    for (size_t i = 0; i < sizeof(name_data); i += 2) {
-                        uint16_t ch = ReadBinaryInt<uint16_t, BinaryLittleEndian>(name_data + i);
-                        if (ch == 0) {
-                            break;
-                        }
-                        char enc_buf[4];
-                        int enc_len = Utf8EncodeChar(ch, enc_buf);
-                        if (enc_len > m_filename_pos - chunk_len) {
-                            goto cancel_vfat;
+                m_block_entry_pos++;
+                
+                // VFAT entry
+                if (first_byte != 0xE5 && attrs == 0xF && type_byte == 0 && file_size != 0) {
+                    int8_t entry_vfat_seq = first_byte & 0x1F;
+                    if ((first_byte & 0x60) == 0x40) {
+                        // Start collection.
+                        m_vfat_seq = entry_vfat_seq;
+                        m_vfat_csum = checksum_byte;
+                        m_filename_pos = Params::MaxFileNameSize;
+                    }
+                
+                    if (entry_vfat_seq > 0 && m_vfat_seq != -1 && entry_vfat_seq == m_vfat_seq && checksum_byte == m_vfat_csum) {
+                        // Collect entry.
+                        char name_data[26];
+                        memcpy(name_data + 0, entry_ptr + 0x1, 10);
+                        memcpy(name_data + 10, entry_ptr + 0xE, 12);
+                        memcpy(name_data + 22, entry_ptr + 0x1C, 4);
+                        size_t chunk_len = 0;
+                        for (size_t i = 0; i < sizeof(name_data); i += 2) {
+                            uint16_t ch = ReadBinaryInt<uint16_t, BinaryLittleEndian>(name_data + i);
+                            if (ch == 0) {
+                                break;
+                            }
+                            char enc_buf[4];
+                            int enc_len = Utf8EncodeChar(ch, enc_buf);
+                            if (enc_len > m_filename_pos - chunk_len) {
+                                goto cancel_vfat;
+                            }
+                            memcpy(m_filename + chunk_len, enc_buf, enc_len);
+                            chunk_len += enc_len;
                         }
-                        memcpy(m_filename + chunk_len, enc_buf, enc_len);
-                        chunk_len += enc_len;
+                        memmove(m_filename + (m_filename_pos - chunk_len), m_filename, chunk_len);
+                        m_filename_pos -= chunk_len;
+                        m_vfat_seq--;
+                    } else {
+                    cancel_vfat:
+                        // Cancel any collection.
+                        m_vfat_seq = -1;
                     }
-                    memmove(m_filename + (m_filename_pos - chunk_len), m_filename, chunk_len);
-                    m_filename_pos -= chunk_len;
-                    m_vfat_seq--;
-                } else {
-                cancel_vfat:
-                    // Cancel any collection.
-                    m_vfat_seq = -1;
+                
+                    // Go on reading directory entries.
+                    continue;
                 }
                 
-                // Go on reading directory entries.
-                return schedule_event(c);
-            }
-            
-            // Forget VFAT state but remember for use in this entry.
-            int8_t cur_vfat_seq = m_vfat_seq;
-            m_vfat_seq = -1;
-            
-            // Free marker.
-            if (first_byte == 0xE5) {
-                return schedule_event(c);
-            }
-            
-            // Ignore: volume label or device.
-            if ((attrs & 0x8) || (attrs & 0x40)) {
-                return schedule_event(c);
-            }
-            
-            bool is_dir = (attrs & 0x10);
-            bool is_dot_entry = (first_byte == (uint8_t)'.');
-            
-            ClusterIndexType first_cluster = mask_cluster_entry(read_dir_entry_first_cluster(c, entry_ptr));
-            
-            if (is_dot_entry && first_cluster == 0) {
-                first_cluster = o->root_cluster;
-            }
-            
-            char const *filename;
-            if (!is_dot_entry && cur_vfat_seq == 0 && vfat_checksum(entry_ptr) == m_vfat_csum) {
-                filename = m_filename + m_filename_pos;
-                m_filename[Params::MaxFileNameSize] = 0;
-            } else {
-                char name_temp[8];
-                memcpy(name_temp, entry_ptr + 0, 8);
-                if (name_temp[0] == 0x5) {
-                    name_temp[0] = 0xE5;
+                // Forget VFAT state but remember for use in this entry.
+                int8_t cur_vfat_seq = m_vfat_seq;
+                m_vfat_seq = -1;
+                
+                // Free marker.
+                if (first_byte == 0xE5) {
+                    continue;
+                }
+                
+                // Ignore: volume label or device.
+                if ((attrs & 0x8) || (attrs & 0x40)) {
+                    continue;
+                }
+                
+                bool is_dir = (attrs & 0x10);
+                bool is_dot_entry = (first_byte == (uint8_t)'.');
+                
+                ClusterIndexType first_cluster = mask_cluster_entry(read_dir_entry_first_cluster(c, entry_ptr));
+                
+                if (is_dot_entry && first_cluster == 0) {
+                    first_cluster = o->root_cluster;
                 }
-                size_t name_len = fixup_83_name(name_temp, 8, bool(type_byte & 0x8));
                 
-                char ext_temp[3];
-                memcpy(ext_temp, entry_ptr + 8, 3);
-                size_t ext_len = fixup_83_name(ext_temp, 3, bool(type_byte & 0x10));
+                char const *filename;
+                if (!is_dot_entry && cur_vfat_seq == 0 && vfat_checksum(entry_ptr) == m_vfat_csum) {
+                    filename = m_filename + m_filename_pos;
+                    m_filename[Params::MaxFileNameSize] = 0;
+                } else {
+                    char name_temp[8];
+                    memcpy(name_temp, entry_ptr + 0, 8);
+                    if (name_temp[0] == 0x5) {
+                        name_temp[0] = 0xE5;
+                    }
+                    size_t name_len = fixup_83_name(name_temp, 8, bool(type_byte & 0x8));
+                
+                    char ext_temp[3];
+                    memcpy(ext_temp, entry_ptr + 8, 3);
+                    size_t ext_len = fixup_83_name(ext_temp, 3, bool(type_byte & 0x10));
+                
+                    size_t filename_len = 0;
+                    memcpy(m_filename + filename_len, name_temp, name_len);
+                    filename_len += name_len;
+                    if (ext_len > 0) {
+                        m_filename[filename_len++] = '.';
+                        memcpy(m_filename + filename_len, ext_temp, ext_len);
+                        filename_len += ext_len;
+                    }
+                    m_filename[filename_len] = '\0';
+                    filename = m_filename;
+                }
                 
-                size_t filename_len = 0;
-                memcpy(m_filename + filename_len, name_temp, name_len);
-                filename_len += name_len;
-                if (ext_len > 0) {
-                    m_filename[filename_len++] = '.';
-                    memcpy(m_filename + filename_len, ext_temp, ext_len);
-                    filename_len += ext_len;
+                if (m_match_name && !compare_filename_equal(filename, m_match_name, m_match_len)) {
+                    continue;
                 }
-                m_filename[filename_len] = '\0';
-                filename = m_filename;
+                
+                FsEntry entry;
+                entry.type = is_dir ? EntryType::DIR_TYPE : EntryType::FILE_TYPE;
+                entry.file_size = file_size;
+                entry.cluster_index = first_cluster;
+                set_fs_entry_extra(&entry,
+                    get_cluster_data_block_index(c, m_chain.getCurrentCluster(c), m_block_in_cluster - 1),
+                    m_block_entry_pos - 1);
+                
+                return complete_request(c, false, filename, entry);
             }
-            
-            FsEntry entry;
-            entry.type = is_dir ? EntryType::DIR_TYPE : EntryType::FILE_TYPE;
-            entry.file_size = file_size;
-            entry.cluster_index = first_cluster;
-            set_fs_entry_extra(&entry,
-                get_cluster_data_block_index(c, m_chain.getCurrentCluster(c), m_block_in_cluster - 1),
-                m_block_entry_pos - 1);
-            
-            return complete_request(c, false, filename, entry);
         }
         
         void chain_handler (Context c, bool error, bool first_cluster_changed)
@@ -2064,6 +2509,8 @@ private:
         int8_t m_vfat_seq;
         uint8_t m_vfat_csum;
         FileNameLenType m_filename_pos;
+        char const *m_match_name;
+        size_t m_match_len;
         char m_filename[Params::MaxFileNameSize + 1];
     };
     
@@ -2128,11 +2575,24 @@ private:
         size_t num_write_references;
     };
     
+    struct NameCacheEntry {
+        ClusterIndexType dir_cluster;
+        uint32_t name_hash;
+        uint8_t name_len;
+        char name[NameCacheMaxNameLen];
+        FsEntry entry;
+    };
+    
+    APRINTER_STRUCT_IF_TEMPLATE(NameCacheMembers) {
+        NameCacheEntry name_cache[MaxValue(1, Params::NumNameCacheEntries)];
+        uint8_t name_cache_victim;
+    };
+    
 public:
     struct Object : public ObjBase<FatFs, ParentObject, MakeTypeList<
         TheDebugObject,
         TheBlockCache
-    >>, public FsWritableMembers<FsWritable> {
+    >>, public FsWritableMembers<FsWritable>, public NameCacheMembers<NameCacheEnabled> {
         BlockRange<BlockIndexType> block_range;
         FsState state;
         union {
@@ -2154,6 +2614,8 @@ APRINTER_ALIAS_STRUCT_EXT(FatFsService, (
     APRINTER_AS_VALUE(int, NumCacheEntries),
     APRINTER_AS_VALUE(int, NumIoUnits),
     APRINTER_AS_VALUE(int, MaxIoBlocks),
+    APRINTER_AS_VALUE(int, NumChainExtents),
+    APRINTER_AS_VALUE(int, NumNameCacheEntries),
     APRINTER_AS_VALUE(bool, CaseInsens),
     APRINTER_AS_VALUE(bool, Writable),
     APRINTER_AS_VALUE(bool, EnableReadHinting)
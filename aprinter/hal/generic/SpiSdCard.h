@@ -72,8 +72,10 @@ public:
     using BlockIndexType = uint32_t;
     static size_t const BlockSize = 512;
     using DataWordType = uint8_t;
-    static size_t const MaxIoBlocks = 1;
-    static int const MaxIoDescriptors = 1;
+    static size_t const MaxIoBlocks = Params::MaxIoBlocks;
+    static int const MaxIoDescriptors = Params::MaxIoBlocks;
+    
+    static_assert(MaxIoBlocks >= 1, "");
     
     static void init (Context c)
     {
@@ -144,13 +146,29 @@ public:
         AMBRO_ASSERT(o->m_state == STATE_RUNNING)
         AMBRO_ASSERT(o->m_io_state == IO_STATE_IDLE)
         AMBRO_ASSERT(block < o->m_capacity_blocks)
-        AMBRO_ASSERT(num_blocks == 1)
-        AMBRO_ASSERT(data_vector.num_descriptors == 1)
-        AMBRO_ASSERT(data_vector.descriptors[0].num_words == BlockSize)
+        AMBRO_ASSERT(num_blocks > 0)
+        AMBRO_ASSERT(num_blocks <= MaxIoBlocks)
+        AMBRO_ASSERT(num_blocks <= o->m_capacity_blocks - block)
+        AMBRO_ASSERT(data_vector.num_descriptors == (int)num_blocks)
+        AMBRO_ASSERT(check_descriptors(data_vector))
+        
+        // Each descriptor is one block. For more than one block, the
+        // multiple-block commands are used, which are terminated by
+        // CMD_STOP_TRANSMISSION (reading) or the stop token (writing).
+        o->m_io_descriptors = data_vector.descriptors;
+        o->m_io_num_blocks = num_blocks;
+        o->m_io_block = 0;
+        o->m_io_multi = (num_blocks > 1);
+        o->m_io_error = false;
         
-        o->m_request_buf = data_vector.descriptors[0].buffer_ptr;
         uint32_t addr = o->m_sdhc ? block : (block * 512);
-        sd_command(c, (is_write ? CMD_WRITE_BLOCK : CMD_READ_SINGLE_BLOCK), addr, true, o->m_io_buf, o->m_io_buf);
+        uint8_t cmd;
+        if (is_write) {
+            cmd = o->m_io_multi ? CMD_WRITE_MULTIPLE_BLOCK : CMD_WRITE_BLOCK;
+        } else {
+            cmd = o->m_io_multi ? CMD_READ_MULTIPLE_BLOCK : CMD_READ_SINGLE_BLOCK;
+        }
+        sd_command(c, cmd, addr, true, o->m_io_buf, o->m_io_buf);
         if (!is_write) {
             TheSpi::cmdReadUntilDifferent(c, 0xff, 255, 0xff, o->m_io_buf + 1);
         }
@@ -179,17 +197,20 @@ private:
     
     enum {
         IO_STATE_IDLE,
-        IO_STATE_READING_CMD, IO_STATE_READING_DATA,
-        IO_STATE_WRITING_CMD, IO_STATE_WRITING_DATA, IO_STATE_WRITING_DATARESP, IO_STATE_WRITING_BUSY, IO_STATE_WRITING_STATUS
+        IO_STATE_READING_CMD, IO_STATE_READING_DATA, IO_STATE_READING_STOP, IO_STATE_READING_STOP_BUSY,
+        IO_STATE_WRITING_CMD, IO_STATE_WRITING_DATARESP, IO_STATE_WRITING_BUSY, IO_STATE_WRITING_STOP_BUSY, IO_STATE_WRITING_STATUS
     };
     
     static const uint8_t CMD_GO_IDLE_STATE = 0;
     static const uint8_t CMD_SEND_IF_COND = 8;
     static const uint8_t CMD_SEND_CSD = 9;
+    static const uint8_t CMD_STOP_TRANSMISSION = 12;
     static const uint8_t CMD_SEND_STATUS = 13;
     static const uint8_t CMD_SET_BLOCKLEN = 16;
     static const uint8_t CMD_READ_SINGLE_BLOCK = 17;
+    static const uint8_t CMD_READ_MULTIPLE_BLOCK = 18;
     static const uint8_t CMD_WRITE_BLOCK = 24;
+    static const uint8_t CMD_WRITE_MULTIPLE_BLOCK = 25;
     static const uint8_t CMD_APP_CMD = 55;
     static const uint8_t CMD_READ_OCR = 58;
     static const uint8_t CMD_CRC_ON_OFF = 59;
@@ -199,6 +220,9 @@ private:
     static const uint32_t OCR_CCS = (UINT32_C(1) << 30);
     static const uint32_t OCR_CPUS = (UINT32_C(1) << 31);
     static const uint32_t IfCondArgumentResponse = UINT32_C(0x1AA);
+    static const uint8_t TOKEN_START_BLOCK = 0xfe;
+    static const uint8_t TOKEN_START_BLOCK_MULTIPLE = 0xfc;
+    static const uint8_t TOKEN_STOP_TRAN = 0xfd;
     
     static uint8_t crc7 (uint8_t const *data, uint8_t count, uint8_t crc)
     { 
@@ -215,10 +239,8 @@ private:
         return (crc & 0x7f);
     }
     
-    static void sd_command (Context c, uint8_t cmd, uint32_t param, bool checksum, uint8_t *request_buf, uint8_t *response_buf)
+    static void sd_send_command (Context c, uint8_t cmd, uint32_t param, bool checksum, uint8_t *request_buf)
     {
-        auto *o = Object::self(c);
-        
         request_buf[0] = cmd | 0x40;
         request_buf[1] = param >> 24;
         request_buf[2] = param >> 16;
@@ -229,6 +251,11 @@ private:
             request_buf[5] |= crc7(request_buf, 5, 0) << 1;
         }
         TheSpi::cmdWriteBuffer(c, 0xff, request_buf, 6);
+    }
+    
+    static void sd_command (Context c, uint8_t cmd, uint32_t param, bool checksum, uint8_t *request_buf, uint8_t *response_buf)
+    {
+        sd_send_command(c, cmd, param, checksum, request_buf);
         TheSpi::cmdReadUntilDifferent(c, 0xff, 255, 0xff, response_buf);
     }
     
@@ -386,6 +413,86 @@ private:
         }
     }
     
+    static bool check_descriptors (TransferVector<DataWordType> data_vector)
+    {
+        for (int i = 0; i < data_vector.num_descriptors; i++) {
+            if (data_vector.descriptors[i].num_words != BlockSize) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    static DataWordType * current_block_buf (Context c)
+    {
+        auto *o = Object::self(c);
+        return o->m_io_descriptors[o->m_io_block].buffer_ptr;
+    }
+    
+    static void read_block (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        // Also wait for the start token of the next block if there is one,
+        // so each block takes a single round of SPI commands.
+        TheSpi::cmdReadBuffer(c, current_block_buf(c), BlockSize, 0xff);
+        TheSpi::cmdReadBuffer(c, o->m_io_buf + 2, 2, 0xff);
+        if (o->m_io_block + 1 < o->m_io_num_blocks) {
+            TheSpi::cmdReadUntilDifferent(c, 0xff, 255, 0xff, o->m_io_buf + 1);
+        }
+        o->m_io_state = IO_STATE_READING_DATA;
+    }
+    
+    static void stop_reading (Context c, bool error)
+    {
+        auto *o = Object::self(c);
+        
+        // The byte following the command is a stuff byte which may still
+        // be part of the data, so skip it before looking for the response.
+        o->m_io_error = error;
+        sd_send_command(c, CMD_STOP_TRANSMISSION, 0, true, o->m_io_buf);
+        TheSpi::cmdWriteByte(c, 0xff, 0);
+        TheSpi::cmdReadUntilDifferent(c, 0xff, 255, 0xff, o->m_io_buf);
+        o->m_io_state = IO_STATE_READING_STOP;
+    }
+    
+    static void write_block (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        DataWordType const *data = current_block_buf(c);
+        uint8_t token = o->m_io_multi ? TOKEN_START_BLOCK_MULTIPLE : TOKEN_START_BLOCK;
+        TheSpi::cmdWriteBuffer(c, token, data, BlockSize);
+        uint16_t checksum = CrcItuTUpdate(CrcItuTInitial, (char const *)data, BlockSize);
+        WriteBinaryInt<uint16_t, BinaryBigEndian>(checksum, (char *)o->m_io_buf);
+        TheSpi::cmdWriteBuffer(c, o->m_io_buf[0], o->m_io_buf + 1, 1);
+        TheSpi::cmdReadBuffer(c, o->m_io_buf + 2, 1, 0xff);
+        o->m_io_state = IO_STATE_WRITING_DATARESP;
+    }
+    
+    static void stop_writing (Context c, bool error)
+    {
+        auto *o = Object::self(c);
+        
+        // The card signals busy starting with the second byte after the
+        // stop token.
+        o->m_io_error = error;
+        TheSpi::cmdWriteByte(c, TOKEN_STOP_TRAN, 0);
+        TheSpi::cmdWriteByte(c, 0xff, 0);
+        TheSpi::cmdReadUntilDifferent(c, 0x00, 255, 0xff, o->m_io_buf);
+        o->m_io_state = IO_STATE_WRITING_STOP_BUSY;
+        o->m_poll_timer.setAfter(c, WriteBusyTimeoutTicks);
+    }
+    
+    static void write_status (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        sd_command(c, CMD_SEND_STATUS, 0, true, o->m_io_buf, o->m_io_buf);
+        TheSpi::cmdReadBuffer(c, o->m_io_buf + 1, 1, 0xff);
+        o->m_io_state = IO_STATE_WRITING_STATUS;
+    }
+    
     static void spi_for_io_completed (Context c)
     {
         auto *o = Object::self(c);
@@ -394,45 +501,73 @@ private:
         
         switch (o->m_io_state) {
             case IO_STATE_READING_CMD: {
-                if (o->m_io_buf[0] != 0 || o->m_io_buf[1] != 0xfe) {
+                if (o->m_io_buf[0] != 0) {
                     goto complete_request;
                 }
-                TheSpi::cmdReadBuffer(c, o->m_request_buf, BlockSize, 0xff);
-                TheSpi::cmdReadBuffer(c, o->m_io_buf + 2, 2, 0xff);
-                o->m_io_state = IO_STATE_READING_DATA;
+                if (o->m_io_buf[1] != TOKEN_START_BLOCK) {
+                    goto read_failed;
+                }
+                read_block(c);
                 return;
             } break;
             
             case IO_STATE_READING_DATA: {
                 uint16_t checksum_received = ReadBinaryInt<uint16_t, BinaryBigEndian>((char *)(o->m_io_buf + 2));
-                uint16_t checksum_computed = CrcItuTUpdate(CrcItuTInitial, (char const *)o->m_request_buf, BlockSize);
+                uint16_t checksum_computed = CrcItuTUpdate(CrcItuTInitial, (char const *)current_block_buf(c), BlockSize);
                 if (checksum_received != checksum_computed) {
-                    goto complete_request;
+                    goto read_failed;
+                }
+                o->m_io_block++;
+                if (o->m_io_block < o->m_io_num_blocks) {
+                    if (o->m_io_buf[1] != TOKEN_START_BLOCK) {
+                        goto read_failed;
+                    }
+                    read_block(c);
+                    return;
+                }
+                if (o->m_io_multi) {
+                    stop_reading(c, false);
+                    return;
                 }
                 error = false;
             } break;
             
-            case IO_STATE_WRITING_CMD: {
+            case IO_STATE_READING_STOP: {
                 if (o->m_io_buf[0] != 0) {
                     goto complete_request;
                 }
-                TheSpi::cmdWriteBuffer(c, 0xfe, o->m_request_buf, BlockSize);
-                uint16_t checksum = CrcItuTUpdate(CrcItuTInitial, (char const *)o->m_request_buf, BlockSize);
-                WriteBinaryInt<uint16_t, BinaryBigEndian>(checksum, (char *)o->m_io_buf);
-                TheSpi::cmdWriteBuffer(c, o->m_io_buf[0], o->m_io_buf + 1, 1);
-                o->m_io_state = IO_STATE_WRITING_DATA;
+                TheSpi::cmdReadUntilDifferent(c, 0x00, 255, 0xff, o->m_io_buf);
+                o->m_io_state = IO_STATE_READING_STOP_BUSY;
+                o->m_poll_timer.setAfter(c, WriteBusyTimeoutTicks);
                 return;
             } break;
             
-            case IO_STATE_WRITING_DATA: {
-                TheSpi::cmdReadBuffer(c, o->m_io_buf + 2, 1, 0xff);
-                o->m_io_state = IO_STATE_WRITING_DATARESP;
+            case IO_STATE_READING_STOP_BUSY: {
+                if (o->m_io_buf[0] == 0x00) {
+                    if (o->m_poll_timer.isExpired(c)) {
+                        goto complete_request;
+                    }
+                    TheSpi::cmdReadUntilDifferent(c, 0x00, 255, 0xff, o->m_io_buf);
+                    return;
+                }
+                error = o->m_io_error;
+            } break;
+            
+            case IO_STATE_WRITING_CMD: {
+                if (o->m_io_buf[0] != 0) {
+                    goto complete_request;
+                }
+                write_block(c);
                 return;
             } break;
             
             case IO_STATE_WRITING_DATARESP: {
                 uint8_t data_response = o->m_io_buf[2];
                 if ((data_response & 0x1F) != 5) {
+                    if (o->m_io_multi) {
+                        stop_writing(c, true);
+                        return;
+                    }
                     goto complete_request;
                 }
                 TheSpi::cmdReadUntilDifferent(c, 0x00, 255, 0xff, o->m_io_buf);
@@ -441,7 +576,8 @@ private:
                 return;
             } break;
             
-            case IO_STATE_WRITING_BUSY: {
+            case IO_STATE_WRITING_BUSY:
+            case IO_STATE_WRITING_STOP_BUSY: {
                 if (o->m_io_buf[0] == 0x00) {
                     if (o->m_poll_timer.isExpired(c)) {
                         goto complete_request;
@@ -449,9 +585,18 @@ private:
                     TheSpi::cmdReadUntilDifferent(c, 0x00, 255, 0xff, o->m_io_buf);
                     return;
                 }
-                sd_command(c, CMD_SEND_STATUS, 0, true, o->m_io_buf, o->m_io_buf);
-                TheSpi::cmdReadBuffer(c, o->m_io_buf + 1, 1, 0xff);
-                o->m_io_state = IO_STATE_WRITING_STATUS;
+                if (o->m_io_state == IO_STATE_WRITING_BUSY) {
+                    o->m_io_block++;
+                    if (o->m_io_block < o->m_io_num_blocks) {
+                        write_block(c);
+                        return;
+                    }
+                    if (o->m_io_multi) {
+                        stop_writing(c, false);
+                        return;
+                    }
+                }
+                write_status(c);
                 return;
             } break;
             
@@ -459,11 +604,19 @@ private:
                 if (o->m_io_buf[0] != 0 || o->m_io_buf[1] != 0) {
                     goto complete_request;
                 }
-                error = false;
+                error = o->m_io_error;
             } break;
             
             default: AMBRO_ASSERT(false);
         }
+        
+        goto complete_request;
+        
+    read_failed:
+        if (o->m_io_multi) {
+            stop_reading(c, true);
+            return;
+        }
     
     complete_request:
         o->m_io_state = IO_STATE_IDLE;
@@ -493,8 +646,10 @@ public:
         TheSpi
     >> {
         uint8_t m_state : 4;
-        uint8_t m_io_state : 3;
+        uint8_t m_io_state : 4;
         bool m_sdhc : 1;
+        bool m_io_multi : 1;
+        bool m_io_error : 1;
         typename TheClockUtils::PollTimer m_poll_timer;
         union {
             struct {
@@ -504,7 +659,9 @@ public:
             struct {
                 uint32_t m_capacity_blocks;
                 uint8_t m_io_buf[6];
-                DataWordType *m_request_buf;
+                TransferDescriptor<DataWordType> const *m_io_descriptors;
+                size_t m_io_num_blocks;
+                size_t m_io_block;
             };
         };
     };
@@ -514,7 +671,8 @@ public:
 
 APRINTER_ALIAS_STRUCT_EXT(SpiSdCardService, (
     APRINTER_AS_TYPE(SsPin),
-    APRINTER_AS_TYPE(SpiService)
+    APRINTER_AS_TYPE(SpiService),
+    APRINTER_AS_VALUE(size_t, MaxIoBlocks)
 ), (
     APRINTER_ALIAS_STRUCT_EXT(SdCard, (
         APRINTER_AS_TYPE(Context),
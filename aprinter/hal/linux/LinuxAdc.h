@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_LINUX_ADC_H
+#define APRINTER_LINUX_ADC_H
+
+#include <stdint.h>
+
+#include <aprinter/meta/FixedPoint.h>
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/*
+ * Simulated ADC for the Linux platform. All inputs read as the same
+ * fixed fraction of the full scale.
+ */
+
+template <typename Arg>
+class LinuxAdc {
+    using Context        = typename Arg::Context;
+    using ParentObject   = typename Arg::ParentObject;
+    using Params         = typename Arg::Params;
+
+public:
+    struct Object;
+    using FixedType = FixedPoint<16, false, -16>;
+
+private:
+    using TheDebugObject = DebugObject<Context, Object>;
+    
+    static_assert(Params::Value::value() >= 0.0 && Params::Value::value() <= 1.0, "");
+    static uint16_t const ValueBits = Params::Value::value() * 65535.0;
+
+public:
+    static void init (Context c)
+    {
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        TheDebugObject::deinit(c);
+    }
+    
+    template <typename Pin, typename ThisContext>
+    static FixedType getValue (ThisContext c)
+    {
+        TheDebugObject::access(c);
+        
+        return FixedType::importBits(ValueBits);
+    }
+
+public:
+    struct Object : public ObjBase<LinuxAdc, ParentObject, MakeTypeList<TheDebugObject>> {};
+};
+
+APRINTER_ALIAS_STRUCT_EXT(LinuxAdcService, (
+    APRINTER_AS_TYPE(Value)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(Adc, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(PinsList)
+    ), (
+        using Params = LinuxAdcService;
+        APRINTER_DEF_INSTANCE(Adc, LinuxAdc)
+    ))
+))
+
+#include <aprinter/EndNamespace.h>
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_LINUX_CLOCK_H
+#define APRINTER_LINUX_CLOCK_H
+
+#include <stdint.h>
+
+#include <aprinter/base/Object.h>
+#include <aprinter/meta/TypeListUtils.h>
+#include <aprinter/meta/PowerOfTwo.h>
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/system/InterruptLock.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/*
+ * Simulated clock for the Linux platform, see linux_support.h.
+ * There is no hardware behind the timers; they only exist so that
+ * configurations can name interrupt timers like on other platforms.
+ */
+
+template <int TIndex>
+struct LinuxClockTc {
+    static int const Index = TIndex;
+};
+
+template <typename Arg>
+class LinuxClock {
+    using Context      = typename Arg::Context;
+    using ParentObject = typename Arg::ParentObject;
+    using Params       = typename Arg::Params;
+    
+    static int const Prescale = Params::Prescale;
+    static_assert(Prescale >= 0, "");
+    static_assert(Prescale <= 16, "");
+
+public:
+    struct Object;
+    using TimeType = uint32_t;
+    
+    static constexpr TimeType prescale_divide = PowerOfTwo<TimeType, Prescale>::Value;
+    
+    static constexpr double time_unit = (double)prescale_divide / F_CPU;
+    static constexpr double time_freq = (double)F_CPU / prescale_divide;
+
+private:
+    using TheDebugObject = DebugObject<Context, Object>;
+
+public:
+    static void init (Context c)
+    {
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        TheDebugObject::deinit(c);
+    }
+    
+    template <typename ThisContext>
+    static TimeType getTime (ThisContext c)
+    {
+        return linux_sim_get_time();
+    }
+
+public:
+    struct Object : public ObjBase<LinuxClock, ParentObject, MakeTypeList<TheDebugObject>> {};
+};
+
+APRINTER_ALIAS_STRUCT_EXT(LinuxClockService, (
+    APRINTER_AS_VALUE(int, Prescale)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(Clock, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(TimersList)
+    ), (
+        using Params = LinuxClockService;
+        APRINTER_DEF_INSTANCE(Clock, LinuxClock)
+    ))
+))
+
+template <typename Arg>
+class LinuxClockInterruptTimer {
+    using Context      = typename Arg::Context;
+    using ParentObject = typename Arg::ParentObject;
+    using Handler      = typename Arg::Handler;
+
+public:
+    struct Object;
+    using Clock = typename Context::Clock;
+    using TimeType = typename Clock::TimeType;
+    using HandlerContext = InterruptContext<Context>;
+
+private:
+    using TheDebugObject = DebugObject<Context, Object>;
+
+public:
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        linux_sim_irq_register(&o->m_irq, &LinuxClockInterruptTimer::irq_handler);
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::deinit(c);
+        
+        linux_sim_irq_unregister(&o->m_irq);
+    }
+    
+    template <typename ThisContext>
+    static void setFirst (ThisContext c, TimeType time)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(!o->m_irq.armed)
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            linux_sim_irq_set(&o->m_irq, time);
+        }
+    }
+    
+    static void setNext (HandlerContext c, TimeType time)
+    {
+        auto *o = Object::self(c);
+        
+        linux_sim_irq_set(&o->m_irq, time);
+    }
+    
+    template <typename ThisContext>
+    static void unset (ThisContext c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            linux_sim_irq_unset(&o->m_irq);
+        }
+    }
+    
+    template <typename ThisContext>
+    static TimeType getLastSetTime (ThisContext c)
+    {
+        auto *o = Object::self(c);
+        
+        return o->m_irq.time;
+    }
+
+private:
+    static void irq_handler ()
+    {
+        // The IRQ has been disarmed before calling us. If the handler wants
+        // to be called again it will have re-armed it using setNext().
+        Handler::call(MakeInterruptContext(Context()));
+    }
+
+public:
+    struct Object : public ObjBase<LinuxClockInterruptTimer, ParentObject, MakeTypeList<TheDebugObject>> {
+        LinuxSimIrq m_irq;
+    };
+};
+
+APRINTER_ALIAS_STRUCT_EXT(LinuxClockInterruptTimerService, (
+    APRINTER_AS_TYPE(Tc),
+    APRINTER_AS_VALUE(int, ChannelIndex),
+    APRINTER_AS_TYPE(ExtraClearance)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(InterruptTimer, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(Handler)
+    ), (
+        using Params = LinuxClockInterruptTimerService;
+        APRINTER_DEF_INSTANCE(InterruptTimer, LinuxClockInterruptTimer)
+    ))
+))
+
+#include <aprinter/EndNamespace.h>
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_LINUX_EEPROM_H
+#define APRINTER_LINUX_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <aprinter/base/Object.h>
+#include <aprinter/meta/TypeListUtils.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Assert.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/*
+ * EEPROM for the Linux platform, backed by the file given by
+ * APRINTER_LINUX_EEPROM (default aprinter-eeprom.bin). A missing or
+ * short file reads as erased (0xFF) memory.
+ */
+
+template <typename Context, typename ParentObject, typename Handler, typename Params>
+class LinuxEeprom {
+public:
+    struct Object;
+
+private:
+    using FastEvent = typename Context::EventLoop::template FastEventSpec<LinuxEeprom>;
+    using TheDebugObject = DebugObject<Context, Object>;
+    enum {STATE_IDLE, STATE_READ, STATE_WRITE};
+
+public:
+    using SizeType = uint32_t;
+    static SizeType const Size = Params::Size;
+    static SizeType const BlockSize = Params::FakeBlockSize;
+    static SizeType const NumBlocks = Size / BlockSize;
+    
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        Context::EventLoop::template initFastEvent<FastEvent>(c, LinuxEeprom::event_handler);
+        o->state = STATE_IDLE;
+        
+        memset(o->memory, 0xFF, Size);
+        o->fd = open(linux_sim_get_param("APRINTER_LINUX_EEPROM", "aprinter-eeprom.bin"), O_RDWR | O_CREAT, 0644);
+        if (o->fd >= 0) {
+            ssize_t res = pread(o->fd, o->memory, Size, 0);
+            (void)res;
+        }
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::deinit(c);
+        
+        if (o->fd >= 0) {
+            close(o->fd);
+        }
+        
+        Context::EventLoop::template resetFastEvent<FastEvent>(c);
+    }
+    
+    static void startRead (Context c, SizeType offset, uint8_t *data, size_t length)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->state == STATE_IDLE)
+        AMBRO_ASSERT(offset <= Size)
+        AMBRO_ASSERT(length <= Size - offset)
+        AMBRO_ASSERT(length > 0)
+        
+        memcpy(data, o->memory + offset, length);
+        
+        o->state = STATE_READ;
+        Context::EventLoop::template triggerFastEvent<FastEvent>(c);
+    }
+    
+    static void startWrite (Context c, SizeType offset, uint8_t const *data, size_t length)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->state == STATE_IDLE)
+        AMBRO_ASSERT(offset <= Size)
+        AMBRO_ASSERT(length <= Size - offset)
+        AMBRO_ASSERT(length > 0)
+        
+        memcpy(o->memory + offset, data, length);
+        o->success = (o->fd >= 0 && pwrite(o->fd, data, length, offset) == (ssize_t)length);
+        
+        o->state = STATE_WRITE;
+        Context::EventLoop::template triggerFastEvent<FastEvent>(c);
+    }
+    
+    using EventLoopFastEvents = MakeTypeList<FastEvent>;
+
+private:
+    static void event_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->state == STATE_READ || o->state == STATE_WRITE)
+        
+        bool success = (o->state == STATE_READ || o->success);
+        o->state = STATE_IDLE;
+        return Handler::call(c, success);
+    }
+
+public:
+    struct Object : public ObjBase<LinuxEeprom, ParentObject, MakeTypeList<
+        TheDebugObject
+    >> {
+        uint8_t state;
+        bool success;
+        int fd;
+        uint8_t memory[Size];
+    };
+};
+
+template <
+    uint32_t TSize,
+    uint32_t TFakeBlockSize
+>
+struct LinuxEepromService {
+    static uint32_t const Size = TSize;
+    static uint32_t const FakeBlockSize = TFakeBlockSize;
+    
+    template <typename Context, typename ParentObject, typename Handler>
+    using Eeprom = LinuxEeprom<Context, ParentObject, Handler, LinuxEepromService>;
+};
+
+#include <aprinter/EndNamespace.h>
+
+#endif
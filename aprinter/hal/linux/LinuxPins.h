@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_LINUX_PINS_H
+#define APRINTER_LINUX_PINS_H
+
+#include <stdint.h>
+
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/*
+ * Simulated pins for the Linux platform. Changes of output pins are
+ * recorded to the trace file (see linux_support.h). Input pins read
+ * as their pull level, or low when there is none.
+ */
+
+static int const LinuxPinsNumPins = 256;
+
+template <int TPinIndex>
+struct LinuxPin {
+    static_assert(TPinIndex >= 0 && TPinIndex < LinuxPinsNumPins, "");
+    static int const PinIndex = TPinIndex;
+};
+
+template <bool TPullUp>
+struct LinuxPinInputMode {
+    static bool const PullUp = TPullUp;
+};
+
+using LinuxPinInputModeNormal = LinuxPinInputMode<false>;
+using LinuxPinInputModePullUp = LinuxPinInputMode<true>;
+
+using LinuxPinOutputModeNormal = void;
+
+template <typename Arg>
+class LinuxPins {
+    using Context      = typename Arg::Context;
+    using ParentObject = typename Arg::ParentObject;
+
+public:
+    struct Object;
+
+private:
+    using TheDebugObject = DebugObject<Context, Object>;
+
+public:
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        for (int i = 0; i < LinuxPinsNumPins; i++) {
+            o->m_state[i] = false;
+            o->m_output[i] = false;
+        }
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        TheDebugObject::deinit(c);
+    }
+    
+    template <typename Pin, typename Mode = LinuxPinInputModeNormal, typename ThisContext>
+    static void setInput (ThisContext c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        o->m_output[Pin::PinIndex] = false;
+        o->m_state[Pin::PinIndex] = Mode::PullUp;
+    }
+    
+    template <typename Pin, typename Mode = LinuxPinOutputModeNormal, typename ThisContext>
+    static void setOutput (ThisContext c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        o->m_output[Pin::PinIndex] = true;
+        linux_sim_trace_pin(Pin::PinIndex, o->m_state[Pin::PinIndex]);
+    }
+    
+    template <typename Pin, typename ThisContext>
+    static bool get (ThisContext c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        return o->m_state[Pin::PinIndex];
+    }
+    
+    template <typename Pin, typename ThisContext>
+    static void set (ThisContext c, bool x)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        set_pin(o, Pin::PinIndex, x);
+    }
+    
+    template <typename Pin>
+    static void emergencySet (bool x)
+    {
+        set_pin(Object::self(Context()), Pin::PinIndex, x);
+    }
+    
+    template <typename Pin>
+    static void emergencySetOutput ()
+    {
+        Object::self(Context())->m_output[Pin::PinIndex] = true;
+    }
+
+private:
+    static void set_pin (Object *o, int pin, bool x)
+    {
+        if (o->m_state[pin] != x) {
+            o->m_state[pin] = x;
+            if (o->m_output[pin]) {
+                linux_sim_trace_pin(pin, x);
+            }
+        }
+    }
+
+public:
+    struct Object : public ObjBase<LinuxPins, ParentObject, MakeTypeList<TheDebugObject>> {
+        bool m_state[LinuxPinsNumPins];
+        bool m_output[LinuxPinsNumPins];
+    };
+};
+
+struct LinuxPinsService {
+    APRINTER_ALIAS_STRUCT_EXT(Pins, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject)
+    ), (
+        APRINTER_DEF_INSTANCE(Pins, LinuxPins)
+    ))
+};
+
+#include <aprinter/EndNamespace.h>
+
+#endif
@@ -0,0 +1,417 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_LINUX_PTY_SERIAL_H
+#define APRINTER_LINUX_PTY_SERIAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include <aprinter/meta/BoundedInt.h>
+#include <aprinter/meta/TypeListUtils.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/base/Lock.h>
+#include <aprinter/system/InterruptLock.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/*
+ * Simulated UART for the Linux platform. It is connected to a newly
+ * created pseudo-terminal, whose name is printed at startup, or, if
+ * APRINTER_LINUX_SERIAL_INPUT is set, reads from that file and writes
+ * to stdout. Characters are moved at the configured baud rate in
+ * simulated time. Input from a file is held back while the receive
+ * buffer is full, so that it can be larger than the buffer.
+ */
+
+template <typename Context, typename ParentObject, int RecvBufferBits, int SendBufferBits, typename RecvHandler, typename SendHandler, typename Params>
+class LinuxPtySerial {
+private:
+    using RecvFastEvent = typename Context::EventLoop::template FastEventSpec<LinuxPtySerial>;
+    using SendFastEvent = typename Context::EventLoop::template FastEventSpec<RecvFastEvent>;
+
+public:
+    struct Object;
+
+private:
+    using TheDebugObject = DebugObject<Context, Object>;
+    using Clock = typename Context::Clock;
+    using TimeType = typename Clock::TimeType;
+    
+    static size_t const StagingSize = 64;
+    static uint32_t const DefaultBaud = 1000000;
+
+public:
+    using RecvSizeType = BoundedInt<RecvBufferBits, false>;
+    using SendSizeType = BoundedInt<SendBufferBits, false>;
+    
+    static void init (Context c, uint32_t baud)
+    {
+        auto *o = Object::self(c);
+        
+        Context::EventLoop::template initFastEvent<RecvFastEvent>(c, LinuxPtySerial::recv_event_handler);
+        o->m_recv_start = RecvSizeType::import(0);
+        o->m_recv_end = RecvSizeType::import(0);
+        o->m_recv_overrun = false;
+        
+        Context::EventLoop::template initFastEvent<SendFastEvent>(c, LinuxPtySerial::send_event_handler);
+        o->m_send_start = SendSizeType::import(0);
+        o->m_send_end = SendSizeType::import(0);
+        o->m_send_event = SendSizeType::import(0);
+        
+        o->m_rx_staging_pos = 0;
+        o->m_rx_staging_len = 0;
+        o->m_rx_eof = false;
+        o->m_tx_staging_len = 0;
+        
+        open_port(o);
+        
+        double char_ticks = (10.0 * Clock::time_freq) / (baud > 0 ? baud : DefaultBaud);
+        o->m_char_ticks = (char_ticks < 1.0) ? 1 : (TimeType)char_ticks;
+        
+        linux_sim_irq_register(&o->m_irq, &LinuxPtySerial::irq_entry);
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            linux_sim_irq_set(&o->m_irq, Clock::getTime(lock_c) + o->m_char_ticks);
+        }
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::deinit(c);
+        
+        linux_sim_irq_unregister(&o->m_irq);
+        
+        flush_tx(o);
+        close(o->m_in_fd);
+        
+        Context::EventLoop::template resetFastEvent<SendFastEvent>(c);
+        Context::EventLoop::template resetFastEvent<RecvFastEvent>(c);
+    }
+    
+    static RecvSizeType recvQuery (Context c, bool *out_overrun)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(out_overrun)
+        
+        RecvSizeType end;
+        bool overrun;
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            end = o->m_recv_end;
+            overrun = o->m_recv_overrun;
+        }
+        
+        *out_overrun = overrun;
+        return recv_avail(o->m_recv_start, end);
+    }
+    
+    static char * recvGetChunkPtr (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        return (o->m_recv_buffer + o->m_recv_start.value());
+    }
+    
+    static void recvConsume (Context c, RecvSizeType amount)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            AMBRO_ASSERT(amount <= recv_avail(o->m_recv_start, o->m_recv_end))
+            o->m_recv_start = BoundedModuloAdd(o->m_recv_start, amount);
+        }
+    }
+    
+    static void recvClearOverrun (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->m_recv_overrun)
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            o->m_recv_overrun = false;
+            o->m_rx_staging_pos = 0;
+            o->m_rx_staging_len = 0;
+        }
+    }
+    
+    static void recvForceEvent (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        Context::EventLoop::template triggerFastEvent<RecvFastEvent>(c);
+    }
+    
+    static SendSizeType sendQuery (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        SendSizeType start;
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            start = o->m_send_start;
+        }
+        
+        return send_avail(start, o->m_send_end);
+    }
+    
+    static SendSizeType sendGetChunkLen (Context c, SendSizeType rem_length)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        if (o->m_send_end.value() > 0 && rem_length > BoundedModuloNegative(o->m_send_end)) {
+            rem_length = BoundedModuloNegative(o->m_send_end);
+        }
+        
+        return rem_length;
+    }
+    
+    static char * sendGetChunkPtr (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        return (o->m_send_buffer + o->m_send_end.value());
+    }
+    
+    static void sendProvide (Context c, SendSizeType amount)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            AMBRO_ASSERT(amount <= send_avail(o->m_send_start, o->m_send_end))
+            o->m_send_end = BoundedModuloAdd(o->m_send_end, amount);
+        }
+    }
+    
+    static void sendPoke (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+    }
+    
+    static void sendRequestEvent (Context c, SendSizeType min_amount)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            o->m_send_event = min_amount;
+            Context::EventLoop::template triggerFastEvent<SendFastEvent>(lock_c);
+        }
+    }
+    
+    using EventLoopFastEvents = MakeTypeList<RecvFastEvent, SendFastEvent>;
+
+private:
+    static void open_port (Object *o)
+    {
+        char const *input = linux_sim_get_param("APRINTER_LINUX_SERIAL_INPUT", nullptr);
+        if (input) {
+            o->m_in_fd = open(input, O_RDONLY);
+            if (o->m_in_fd < 0) {
+                fprintf(stderr, "Failed to open serial input %s\n", input);
+                exit(1);
+            }
+            o->m_out_fd = STDOUT_FILENO;
+            return;
+        }
+        
+        int fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+            fprintf(stderr, "Failed to create pseudo-terminal\n");
+            exit(1);
+        }
+        
+        struct termios tio;
+        if (tcgetattr(fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        
+        fprintf(stderr, "Serial port: %s\n", ptsname(fd));
+        
+        o->m_in_fd = fd;
+        o->m_out_fd = fd;
+    }
+    
+    static void flush_tx (Object *o)
+    {
+        size_t pos = 0;
+        while (pos < o->m_tx_staging_len) {
+            ssize_t res = write(o->m_out_fd, o->m_tx_staging + pos, o->m_tx_staging_len - pos);
+            if (res < 0) {
+                if (errno == EAGAIN) {
+                    // The reader is slow, keep the rest for later.
+                    break;
+                }
+                // Nobody is listening (e.g. the pty slave is not open); drop the data
+                // like a UART would.
+                pos = o->m_tx_staging_len;
+                break;
+            }
+            pos += res;
+        }
+        for (size_t i = pos; i < o->m_tx_staging_len; i++) {
+            o->m_tx_staging[i - pos] = o->m_tx_staging[i];
+        }
+        o->m_tx_staging_len -= pos;
+    }
+    
+    static void irq_entry ()
+    {
+        irq_handler(MakeInterruptContext(Context()));
+    }
+    
+    static void irq_handler (InterruptContext<Context> c)
+    {
+        auto *o = Object::self(c);
+        
+        // Receive one character.
+        if (!o->m_recv_overrun) {
+            if (o->m_rx_staging_pos == o->m_rx_staging_len && !o->m_rx_eof) {
+                ssize_t res = read(o->m_in_fd, o->m_rx_staging, StagingSize);
+                o->m_rx_staging_pos = 0;
+                o->m_rx_staging_len = (res > 0) ? res : 0;
+                if (res == 0 && o->m_in_fd != o->m_out_fd) {
+                    o->m_rx_eof = true;
+                }
+            }
+            
+            if (o->m_rx_staging_pos < o->m_rx_staging_len) {
+                RecvSizeType new_end = BoundedModuloInc(o->m_recv_end);
+                if (new_end != o->m_recv_start) {
+                    char ch = o->m_rx_staging[o->m_rx_staging_pos++];
+                    o->m_recv_buffer[o->m_recv_end.value()] = ch;
+                    o->m_recv_buffer[o->m_recv_end.value() + (sizeof(o->m_recv_buffer) / 2)] = ch;
+                    o->m_recv_end = new_end;
+                } else if (o->m_in_fd == o->m_out_fd) {
+                    o->m_recv_overrun = true;
+                }
+                
+                Context::EventLoop::template triggerFastEvent<RecvFastEvent>(c);
+            }
+        }
+        
+        // Send one character.
+        if (o->m_send_start != o->m_send_end && o->m_tx_staging_len < StagingSize) {
+            o->m_tx_staging[o->m_tx_staging_len++] = o->m_send_buffer[o->m_send_start.value()];
+            o->m_send_start = BoundedModuloInc(o->m_send_start);
+            
+            if (o->m_send_event != SendSizeType::import(0)) {
+                Context::EventLoop::template triggerFastEvent<SendFastEvent>(c);
+            }
+        }
+        
+        if (o->m_tx_staging_len == StagingSize || (o->m_tx_staging_len > 0 && o->m_send_start == o->m_send_end)) {
+            flush_tx(o);
+        }
+        
+        linux_sim_irq_set(&o->m_irq, o->m_irq.time + o->m_char_ticks);
+    }
+    
+    static RecvSizeType recv_avail (RecvSizeType start, RecvSizeType end)
+    {
+        return BoundedModuloSubtract(end, start);
+    }
+    
+    static SendSizeType send_avail (SendSizeType start, SendSizeType end)
+    {
+        return BoundedModuloDec(BoundedModuloSubtract(start, end));
+    }
+    
+    static void recv_event_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        RecvHandler::call(c);
+    }
+    
+    static void send_event_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        bool report;
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            report = (o->m_send_event != SendSizeType::import(0) && send_avail(o->m_send_start, o->m_send_end) >= o->m_send_event);
+            if (report) {
+                o->m_send_event = SendSizeType::import(0);
+            }
+        }
+        if (report) {
+            SendHandler::call(c);
+        }
+    }
+
+public:
+    struct Object : public ObjBase<LinuxPtySerial, ParentObject, MakeTypeList<TheDebugObject>> {
+        RecvSizeType m_recv_start;
+        RecvSizeType m_recv_end;
+        bool m_recv_overrun;
+        char m_recv_buffer[2 * ((size_t)RecvSizeType::maxIntValue() + 1)];
+        SendSizeType m_send_start;
+        SendSizeType m_send_end;
+        SendSizeType m_send_event;
+        char m_send_buffer[(size_t)SendSizeType::maxIntValue() + 1];
+        LinuxSimIrq m_irq;
+        TimeType m_char_ticks;
+        int m_in_fd;
+        int m_out_fd;
+        bool m_rx_eof;
+        size_t m_rx_staging_pos;
+        size_t m_rx_staging_len;
+        size_t m_tx_staging_len;
+        char m_rx_staging[StagingSize];
+        char m_tx_staging[StagingSize];
+    };
+};
+
+struct LinuxPtySerialService {
+    template <typename Context, typename ParentObject, int RecvBufferBits, int SendBufferBits, typename RecvHandler, typename SendHandler>
+    using Serial = LinuxPtySerial<Context, ParentObject, RecvBufferBits, SendBufferBits, RecvHandler, SendHandler, LinuxPtySerialService>;
+};
+
+#include <aprinter/EndNamespace.h>
+
+#endif
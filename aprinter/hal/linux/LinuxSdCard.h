@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_LINUX_SDCARD_H
+#define APRINTER_LINUX_SDCARD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/TypeListUtils.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/base/TransferVector.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/*
+ * SD card for the Linux platform, backed by the image file given by
+ * APRINTER_LINUX_SDCARD (default aprinter-sdcard.img). The card is
+ * read-only if the file cannot be opened for writing.
+ */
+
+template <typename Arg>
+class LinuxSdCard {
+    using Context        = typename Arg::Context;
+    using ParentObject   = typename Arg::ParentObject;
+    using InitHandler    = typename Arg::InitHandler;
+    using CommandHandler = typename Arg::CommandHandler;
+    using Params         = typename Arg::Params;
+
+public:
+    struct Object;
+
+private:
+    using FastEvent = typename Context::EventLoop::template FastEventSpec<LinuxSdCard>;
+    using TheDebugObject = DebugObject<Context, Object>;
+    
+    enum {STATE_INACTIVE, STATE_INITING, STATE_RUNNING};
+
+public:
+    using BlockIndexType = uint32_t;
+    static size_t const BlockSize = 512;
+    using DataWordType = uint32_t;
+    static size_t const MaxIoBlocks = Params::MaxIoBlocks;
+    static int const MaxIoDescriptors = Params::MaxIoDescriptors;
+    
+    static_assert(MaxIoBlocks >= 1, "");
+    static_assert(MaxIoDescriptors >= 1, "");
+    
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        Context::EventLoop::template initFastEvent<FastEvent>(c, LinuxSdCard::event_handler);
+        o->state = STATE_INACTIVE;
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::deinit(c);
+        
+        if (o->state != STATE_INACTIVE) {
+            deactivate_common(c);
+        }
+        
+        Context::EventLoop::template resetFastEvent<FastEvent>(c);
+    }
+    
+    static void activate (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->state == STATE_INACTIVE)
+        
+        o->init_error = 0;
+        char const *path = linux_sim_get_param("APRINTER_LINUX_SDCARD", "aprinter-sdcard.img");
+        o->writable = true;
+        o->fd = open(path, O_RDWR);
+        if (o->fd < 0) {
+            o->writable = false;
+            o->fd = open(path, O_RDONLY);
+        }
+        
+        struct stat st;
+        if (o->fd < 0) {
+            o->init_error = 1;
+        } else if (fstat(o->fd, &st) < 0 || st.st_size / BlockSize == 0) {
+            o->init_error = 2;
+        } else {
+            o->capacity_blocks = st.st_size / BlockSize;
+        }
+        
+        o->state = STATE_INITING;
+        Context::EventLoop::template triggerFastEvent<FastEvent>(c);
+    }
+    
+    static void deactivate (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->state != STATE_INACTIVE)
+        
+        deactivate_common(c);
+    }
+    
+    static BlockIndexType getCapacityBlocks (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->state == STATE_RUNNING)
+        
+        return o->capacity_blocks;
+    }
+    
+    static bool isWritable (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->state == STATE_RUNNING)
+        
+        return o->writable;
+    }
+    
+    static void startReadOrWrite (Context c, bool is_write, BlockIndexType block, size_t num_blocks, TransferVector<DataWordType> data_vector)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->state == STATE_RUNNING)
+        AMBRO_ASSERT(!o->io_pending)
+        AMBRO_ASSERT(block <= o->capacity_blocks)
+        AMBRO_ASSERT(num_blocks > 0)
+        AMBRO_ASSERT(num_blocks <= MaxIoBlocks)
+        AMBRO_ASSERT(num_blocks <= o->capacity_blocks - block)
+        AMBRO_ASSERT(data_vector.num_descriptors <= MaxIoDescriptors)
+        AMBRO_ASSERT(CheckTransferVector(data_vector, num_blocks * (BlockSize / sizeof(DataWordType))))
+        
+        off_t offset = (off_t)block * BlockSize;
+        bool error = (is_write && !o->writable);
+        for (int i = 0; !error && i < data_vector.num_descriptors; i++) {
+            TransferDescriptor<DataWordType> const *desc = &data_vector.descriptors[i];
+            size_t bytes = desc->num_words * sizeof(DataWordType);
+            ssize_t res = is_write ? pwrite(o->fd, desc->buffer_ptr, bytes, offset) : pread(o->fd, desc->buffer_ptr, bytes, offset);
+            error = (res != (ssize_t)bytes);
+            offset += bytes;
+        }
+        
+        o->io_pending = true;
+        o->io_error = error;
+        Context::EventLoop::template triggerFastEvent<FastEvent>(c);
+    }
+    
+    using EventLoopFastEvents = MakeTypeList<FastEvent>;
+    
+private:
+    static void event_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        if (o->state == STATE_INITING) {
+            if (o->init_error) {
+                uint8_t error_code = o->init_error;
+                deactivate_common(c);
+                return InitHandler::call(c, error_code);
+            }
+            o->state = STATE_RUNNING;
+            o->io_pending = false;
+            return InitHandler::call(c, 0);
+        }
+        
+        if (o->state == STATE_RUNNING && o->io_pending) {
+            o->io_pending = false;
+            return CommandHandler::call(c, o->io_error);
+        }
+    }
+    
+    static void deactivate_common (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        if (o->fd >= 0) {
+            close(o->fd);
+        }
+        o->state = STATE_INACTIVE;
+        Context::EventLoop::template resetFastEvent<FastEvent>(c);
+    }
+
+public:
+    struct Object : public ObjBase<LinuxSdCard, ParentObject, MakeTypeList<
+        TheDebugObject
+    >> {
+        uint8_t state;
+        uint8_t init_error;
+        bool writable;
+        bool io_pending;
+        bool io_error;
+        int fd;
+        BlockIndexType capacity_blocks;
+    };
+};
+
+APRINTER_ALIAS_STRUCT_EXT(LinuxSdCardService, (
+    APRINTER_AS_VALUE(size_t, MaxIoBlocks),
+    APRINTER_AS_VALUE(int, MaxIoDescriptors)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(SdCard, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(InitHandler),
+        APRINTER_AS_TYPE(CommandHandler)
+    ), (
+        using Params = LinuxSdCardService;
+        APRINTER_DEF_INSTANCE(SdCard, LinuxSdCard)
+    ))
+))
+
+#include <aprinter/EndNamespace.h>
+
+#endif
@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_LINUX_SD_SPI_H
+#define APRINTER_LINUX_SD_SPI_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <aprinter/meta/TypeListUtils.h>
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/base/BinaryTools.h>
+#include <aprinter/misc/CrcItuT.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/*
+ * SPI driver for the Linux platform whose other end is a model of an SDHC
+ * card in SPI mode, backed by the image file given by APRINTER_LINUX_SDCARD
+ * (default aprinter-sdcard.img). It is meant for exercising SpiSdCard.
+ *
+ * The card implements the commands SpiSdCard uses, including the
+ * multiple-block commands. Bus bytes and transferred blocks are counted
+ * and printed to stderr at exit.
+ *
+ * Commands are executed as soon as they are queued, and completion is
+ * reported from a fast event.
+ */
+
+template <typename Arg>
+class LinuxSdSpi {
+    using Context                      = typename Arg::Context;
+    using ParentObject                 = typename Arg::ParentObject;
+    using Handler                      = typename Arg::Handler;
+    static int const CommandBufferBits = Arg::CommandBufferBits;
+    
+    using FastEvent = typename Context::EventLoop::template FastEventSpec<LinuxSdSpi>;
+    
+    static int const MaxCommands = (1 << CommandBufferBits) - 1;
+    static size_t const BlockSize = 512;
+    static size_t const MaxResponseSize = 1 + BlockSize + 2 + 8;
+    
+    enum {CARD_IDLE, CARD_WAIT_TOKEN, CARD_RECV_DATA};
+
+public:
+    struct Object;
+
+private:
+    using TheDebugObject = DebugObject<Context, Object>;
+
+public:
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        Context::EventLoop::template initFastEvent<FastEvent>(c, LinuxSdSpi::event_handler);
+        o->m_num_pending = 0;
+        
+        o->m_fd = open(linux_sim_get_param("APRINTER_LINUX_SDCARD", "aprinter-sdcard.img"), O_RDWR);
+        o->m_num_blocks = 0;
+        struct stat st;
+        if (o->m_fd >= 0 && fstat(o->m_fd, &st) == 0) {
+            o->m_num_blocks = st.st_size / BlockSize;
+        }
+        o->m_card_state = CARD_IDLE;
+        o->m_cmd_len = 0;
+        o->m_app_cmd = false;
+        o->m_ready = false;
+        o->m_streaming = false;
+        o->m_out_pos = 0;
+        o->m_out_len = 0;
+        
+        if (!o->m_stats_registered) {
+            o->m_stats_registered = true;
+            atexit(LinuxSdSpi::print_stats);
+        }
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::deinit(c);
+        
+        if (o->m_fd >= 0) {
+            close(o->m_fd);
+        }
+        
+        Context::EventLoop::template resetFastEvent<FastEvent>(c);
+    }
+    
+    static void cmdReadBuffer (Context c, uint8_t *data, size_t length, uint8_t send_byte)
+    {
+        AMBRO_ASSERT(length > 0)
+        
+        start_command(c);
+        for (size_t i = 0; i < length; i++) {
+            data[i] = exchange(c, send_byte);
+        }
+    }
+    
+    static void cmdReadUntilDifferent (Context c, uint8_t target_byte, uint8_t max_extra_length, uint8_t send_byte, uint8_t *data)
+    {
+        start_command(c);
+        uint8_t byte;
+        int remain = max_extra_length;
+        do {
+            byte = exchange(c, send_byte);
+        } while (byte == target_byte && remain-- > 0);
+        *data = byte;
+    }
+    
+    static void cmdWriteBuffer (Context c, uint8_t first_byte, uint8_t const *data, size_t length)
+    {
+        start_command(c);
+        exchange(c, first_byte);
+        for (size_t i = 0; i < length; i++) {
+            exchange(c, data[i]);
+        }
+    }
+    
+    static void cmdWriteByte (Context c, uint8_t byte, size_t extra_count)
+    {
+        start_command(c);
+        for (size_t i = 0; i <= extra_count; i++) {
+            exchange(c, byte);
+        }
+    }
+    
+    static bool endReached (Context c)
+    {
+        TheDebugObject::access(c);
+        
+        return true;
+    }
+    
+    static void unsetEvent (Context c)
+    {
+        TheDebugObject::access(c);
+        
+        Context::EventLoop::template resetFastEvent<FastEvent>(c);
+    }
+    
+    using EventLoopFastEvents = MakeTypeList<FastEvent>;
+
+private:
+    static void event_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        o->m_num_pending = 0;
+        return Handler::call(c);
+    }
+    
+    static void start_command (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->m_num_pending < MaxCommands)
+        
+        o->m_num_pending++;
+        Context::EventLoop::template triggerFastEvent<FastEvent>(c);
+    }
+    
+    static uint8_t exchange (Context c, uint8_t in)
+    {
+        auto *o = Object::self(c);
+        
+        o->m_stat_bytes++;
+        
+        if (o->m_out_pos == o->m_out_len && o->m_streaming) {
+            load_read_block(c);
+        }
+        uint8_t out = 0xff;
+        if (o->m_out_pos < o->m_out_len) {
+            out = o->m_out[o->m_out_pos++];
+        }
+        
+        switch (o->m_card_state) {
+            case CARD_IDLE: {
+                if (o->m_cmd_len == 0 && (in & 0xC0) != 0x40) {
+                    break;
+                }
+                o->m_cmd[o->m_cmd_len++] = in;
+                if (o->m_cmd_len == 6) {
+                    o->m_cmd_len = 0;
+                    handle_command(c);
+                }
+            } break;
+            
+            case CARD_WAIT_TOKEN: {
+                if (in == 0xfe || in == 0xfc) {
+                    o->m_data_len = 0;
+                    o->m_card_state = CARD_RECV_DATA;
+                }
+                else if (in == 0xfd && o->m_multi) {
+                    // Stop token: one more byte, then busy.
+                    static uint8_t const stop[] = {0xff, 0x00, 0x00};
+                    set_response(c, stop, sizeof(stop));
+                    o->m_card_state = CARD_IDLE;
+                }
+            } break;
+            
+            case CARD_RECV_DATA: {
+                o->m_data[o->m_data_len++] = in;
+                if (o->m_data_len == BlockSize + 2) {
+                    receive_write_block(c);
+                }
+            } break;
+        }
+        
+        return out;
+    }
+    
+    static void set_response (Context c, uint8_t const *data, size_t length)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(length <= MaxResponseSize)
+        
+        memcpy(o->m_out, data, length);
+        o->m_out_pos = 0;
+        o->m_out_len = length;
+    }
+    
+    static void set_r1_response (Context c, uint8_t r1)
+    {
+        uint8_t resp[] = {0xff, r1};
+        set_response(c, resp, sizeof(resp));
+    }
+    
+    static void handle_command (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        uint8_t cmd = o->m_cmd[0] & 0x3F;
+        uint32_t arg = ReadBinaryInt<uint32_t, BinaryBigEndian>((char const *)(o->m_cmd + 1));
+        bool app_cmd = o->m_app_cmd;
+        o->m_app_cmd = false;
+        uint8_t r1 = o->m_ready ? 0x00 : 0x01;
+        
+        if (o->m_streaming) {
+            // Only CMD12 is accepted while sending data. Its response
+            // follows a stuff byte, and is followed by a few busy bytes.
+            if (cmd != 12) {
+                return;
+            }
+            o->m_streaming = false;
+            if (o->m_out_pos < o->m_out_len) {
+                o->m_stat_blocks_read--;
+            }
+            static uint8_t const stop[] = {0x3f, 0x00, 0x00, 0x00};
+            set_response(c, stop, sizeof(stop));
+            return;
+        }
+        
+        if (app_cmd && cmd == 41) {
+            // Initialization completes after the first ACMD41.
+            o->m_ready = true;
+            return set_r1_response(c, r1);
+        }
+        
+        switch (cmd) {
+            case 0: {
+                o->m_ready = false;
+                set_r1_response(c, 0x01);
+            } break;
+            
+            case 8: {
+                uint8_t resp[] = {0xff, r1, 0x00, 0x00, (uint8_t)((arg >> 8) & 0xF), (uint8_t)arg};
+                set_response(c, resp, sizeof(resp));
+            } break;
+            
+            case 9: {
+                uint32_t c_size = (o->m_num_blocks >= 1024) ? (o->m_num_blocks / 1024 - 1) : 0;
+                uint8_t resp[1 + 1 + 1 + 16 + 2] = {0xff, r1, 0xfe};
+                uint8_t *csd = resp + 3;
+                csd[0] = 0x40;
+                csd[7] = (c_size >> 16) & 0x3f;
+                csd[8] = c_size >> 8;
+                csd[9] = c_size;
+                WriteBinaryInt<uint16_t, BinaryBigEndian>(CrcItuTUpdate(CrcItuTInitial, (char const *)csd, 16), (char *)(csd + 16));
+                set_response(c, resp, sizeof(resp));
+            } break;
+            
+            case 13: {
+                uint8_t resp[] = {0xff, r1, 0x00};
+                set_response(c, resp, sizeof(resp));
+            } break;
+            
+            case 17:
+            case 18: {
+                if (!o->m_ready || arg >= o->m_num_blocks) {
+                    return set_r1_response(c, 0x40);
+                }
+                o->m_block = arg;
+                o->m_multi = (cmd == 18);
+                o->m_stat_data_commands++;
+                set_r1_response(c, 0x00);
+                o->m_streaming = true;
+                o->m_first_read = true;
+            } break;
+            
+            case 24:
+            case 25: {
+                if (!o->m_ready || arg >= o->m_num_blocks) {
+                    return set_r1_response(c, 0x40);
+                }
+                o->m_block = arg;
+                o->m_multi = (cmd == 25);
+                o->m_stat_data_commands++;
+                set_r1_response(c, 0x00);
+                o->m_card_state = CARD_WAIT_TOKEN;
+            } break;
+            
+            case 55: {
+                o->m_app_cmd = true;
+                set_r1_response(c, r1);
+            } break;
+            
+            case 58: {
+                uint8_t resp[] = {0xff, r1, 0xC0, 0xFF, 0x80, 0x00};
+                set_response(c, resp, sizeof(resp));
+            } break;
+            
+            case 16:
+            case 59: {
+                set_r1_response(c, r1);
+            } break;
+            
+            default: {
+                set_r1_response(c, r1 | 0x04);
+            } break;
+        }
+    }
+    
+    static void load_read_block (Context c)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(o->m_streaming)
+        
+        // Gap byte, start token, data and CRC. A single-block read ends
+        // after the first block.
+        if (!o->m_first_read && !o->m_multi) {
+            o->m_streaming = false;
+            return;
+        }
+        o->m_first_read = false;
+        
+        uint8_t *buf = o->m_out;
+        buf[0] = 0xff;
+        buf[1] = 0xfe;
+        memset(buf + 2, 0, BlockSize);
+        if (o->m_block < o->m_num_blocks) {
+            ssize_t res = pread(o->m_fd, buf + 2, BlockSize, (off_t)o->m_block * BlockSize);
+            (void)res;
+        }
+        WriteBinaryInt<uint16_t, BinaryBigEndian>(CrcItuTUpdate(CrcItuTInitial, (char const *)(buf + 2), BlockSize), (char *)(buf + 2 + BlockSize));
+        o->m_out_pos = 0;
+        o->m_out_len = 2 + BlockSize + 2;
+        o->m_block++;
+        o->m_stat_blocks_read++;
+    }
+    
+    static void receive_write_block (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        uint16_t crc = ReadBinaryInt<uint16_t, BinaryBigEndian>((char const *)(o->m_data + BlockSize));
+        bool ok = (crc == CrcItuTUpdate(CrcItuTInitial, (char const *)o->m_data, BlockSize));
+        if (ok && o->m_block < o->m_num_blocks) {
+            ok = (pwrite(o->m_fd, o->m_data, BlockSize, (off_t)o->m_block * BlockSize) == (ssize_t)BlockSize);
+        }
+        o->m_block++;
+        o->m_stat_blocks_written++;
+        
+        // Data response, then busy.
+        uint8_t resp[] = {(uint8_t)(ok ? 0xE5 : 0xEB), 0x00, 0x00, 0x00};
+        set_response(c, resp, sizeof(resp));
+        o->m_card_state = (ok && o->m_multi) ? CARD_WAIT_TOKEN : CARD_IDLE;
+    }
+    
+    static void print_stats ()
+    {
+        auto *o = Object::self(Context());
+        
+        uint64_t blocks = o->m_stat_blocks_read + o->m_stat_blocks_written;
+        fprintf(stderr, "SD SPI: %llu bus bytes, %llu data commands, %llu blocks read, %llu blocks written, %.1f bytes/block\n",
+                (unsigned long long)o->m_stat_bytes, (unsigned long long)o->m_stat_data_commands,
+                (unsigned long long)o->m_stat_blocks_read, (unsigned long long)o->m_stat_blocks_written,
+                (blocks == 0) ? 0.0 : (double)o->m_stat_bytes / blocks);
+    }
+
+public:
+    struct Object : public ObjBase<LinuxSdSpi, ParentObject, MakeTypeList<TheDebugObject>> {
+        int m_num_pending;
+        int m_fd;
+        uint32_t m_num_blocks;
+        uint8_t m_card_state;
+        uint8_t m_cmd_len;
+        bool m_app_cmd;
+        bool m_ready;
+        bool m_streaming;
+        bool m_first_read;
+        bool m_multi;
+        bool m_stats_registered;
+        uint32_t m_block;
+        size_t m_out_pos;
+        size_t m_out_len;
+        size_t m_data_len;
+        uint64_t m_stat_bytes;
+        uint64_t m_stat_data_commands;
+        uint64_t m_stat_blocks_read;
+        uint64_t m_stat_blocks_written;
+        uint8_t m_cmd[6];
+        uint8_t m_out[MaxResponseSize];
+        uint8_t m_data[BlockSize + 2];
+    };
+};
+
+struct LinuxSdSpiService {
+    APRINTER_ALIAS_STRUCT_EXT(Spi, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(Handler),
+        APRINTER_AS_VALUE(int, CommandBufferBits)
+    ), (
+        APRINTER_DEF_INSTANCE(Spi, LinuxSdSpi)
+    ))
+};
+
+#include <aprinter/EndNamespace.h>
+
+#endif
@@ -131,6 +131,67 @@ T StrToFloat (char const *nptr, char **endptr)
 #endif
 }
 
+/**
+ * Fast conversion of a string of the form [+-]digits[.digits], like the
+ * numbers generated by slicers. Returns false if the whole string is not
+ * in this form, or if there are too many significant or fractional digits
+ * for the result to be computed exactly; StrToFloat() must be used then.
+ *
+ * The significant digits and the power of ten are exactly representable,
+ * so the one division gives the correctly rounded result, the same as a
+ * correctly rounding strtod() would.
+ */
+template <typename T>
+bool StrToFloatFast (char const *str, T *out)
+{
+    static_assert(IsFpType<T>::Value, "");
+    
+    static uint32_t const MaxExactInt = IsFloat<T>::Value ? UINT32_C(16777216) : UINT32_C(0xFFFFFFFF);
+    static uint32_t const MaxDivisor = UINT32_C(1000000000);
+    
+    bool negative = false;
+    if (*str == '-' || *str == '+') {
+        negative = (*str == '-');
+        str++;
+    }
+    
+    uint32_t mantissa = 0;
+    uint32_t divisor = 1;
+    bool have_digits = false;
+    bool in_fraction = false;
+    
+    while (char ch = *str++) {
+        if (ch >= '0' && ch <= '9') {
+            if (mantissa >= MaxDivisor / 10) {
+                return false;
+            }
+            mantissa = 10 * mantissa + (ch - '0');
+            if (in_fraction) {
+                if (divisor == MaxDivisor) {
+                    return false;
+                }
+                divisor *= 10;
+            }
+            have_digits = true;
+        } else if (ch == '.' && !in_fraction) {
+            in_fraction = true;
+        } else {
+            return false;
+        }
+    }
+    
+    if (!have_digits || mantissa > MaxExactInt) {
+        return false;
+    }
+    
+    T value = (T)mantissa;
+    if (divisor != 1) {
+        value /= (T)divisor;
+    }
+    *out = negative ? -value : value;
+    return true;
+}
+
 double FloatLdexp (double x, int exp)
 {
     return ldexp(x, exp);
@@ -141,6 +202,16 @@ float FloatLdexp (float x, int exp)
     return ldexpf(x, exp);
 }
 
+double FloatFrexp (double x, int *exp)
+{
+    return frexp(x, exp);
+}
+
+float FloatFrexp (float x, int *exp)
+{
+    return frexpf(x, exp);
+}
+
 double FloatRound (double x)
 {
     return round(x);
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2013 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef AMBROLIB_PRINT_FLOAT_H
+#define AMBROLIB_PRINT_FLOAT_H
+
+#include <stdint.h>
+
+#include <aprinter/base/Assert.h>
+#include <aprinter/math/FloatTools.h>
+#include <aprinter/math/PrintInt.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/**
+ * Enough for the output of PrintFloatDecimal() with up to 9 significant
+ * digits, such as "-1.23456789e-308".
+ */
+static int const PrintFloatMaxLength = 17;
+
+template <typename T>
+static T PrintFloatPowerOfTen (int n)
+{
+    T result = 1.0f;
+    T base = 10.0f;
+    while (n > 0) {
+        if ((n & 1)) {
+            result *= base;
+        }
+        base *= base;
+        n >>= 1;
+    }
+    return result;
+}
+
+static uint32_t PrintFloatIntPowerOfTen (int n)
+{
+    uint32_t result = 1;
+    while (n-- > 0) {
+        result *= 10;
+    }
+    return result;
+}
+
+// Computes x*10^n. Dividing by an exact power of ten is more accurate than
+// multiplying by an inexact negative one.
+template <typename T>
+static T PrintFloatScale (T x, int n)
+{
+    if (n < 0) {
+        while (n < -16) {
+            x /= PrintFloatPowerOfTen<T>(16);
+            n += 16;
+        }
+        return x / PrintFloatPowerOfTen<T>(-n);
+    }
+    while (n > 16) {
+        x *= PrintFloatPowerOfTen<T>(16);
+        n -= 16;
+    }
+    return x * PrintFloatPowerOfTen<T>(n);
+}
+
+// Rounds a nonnegative x to an integer, with ties to even like printf.
+template <typename T>
+static uint32_t PrintFloatRound (T x)
+{
+    uint32_t res = x;
+    T frac = x - (T)res;
+    if (frac > 0.5f || (frac == 0.5f && (res & 1))) {
+        res++;
+    }
+    return res;
+}
+
+template <typename T>
+static int PrintFloatSpecial (T x, char *s)
+{
+    int len = 0;
+    if (FloatSignBit(x)) {
+        s[len++] = '-';
+    }
+    char const *str = FloatIsNan(x) ? "nan" : "inf";
+    for (int i = 0; i < 3; i++) {
+        s[len++] = str[i];
+    }
+    return len;
+}
+
+/**
+ * Writes x to s like printf("%.*g", precision, x), without a terminating
+ * null, and returns the length. At most PrintFloatMaxLength characters are
+ * written.
+ * 
+ * The digits are computed by scaling x with a power of ten in double, also
+ * for float, so the last digit may only differ from printf when x is within
+ * a few ulps of a double of a rounding boundary. Scaling a float in its own
+ * type would make such differences common.
+ */
+template <typename T>
+static int PrintFloatDecimal (T x, char *s, int precision=6)
+{
+    static_assert(IsFpType<T>::Value, "");
+    AMBRO_ASSERT(precision >= 1 && precision <= 9)
+    
+    if (AMBRO_UNLIKELY(FloatIsNan(x) || x == (T)INFINITY || x == -(T)INFINITY)) {
+        return PrintFloatSpecial(x, s);
+    }
+    
+    int len = 0;
+    if (FloatSignBit(x)) {
+        s[len++] = '-';
+        x = -x;
+    }
+    
+    if (x == 0.0f) {
+        s[len++] = '0';
+        return len;
+    }
+    
+    // Estimate the decimal exponent from the binary one (1233/4096 is just
+    // above log10(2)), then correct it using the scaled value.
+    int exp2;
+    FloatFrexp(x, &exp2);
+    int exp10 = (exp2 - 1) * 1233;
+    exp10 = (exp10 >= 0) ? (exp10 >> 12) : -((-exp10 + 4095) >> 12);
+    
+    uint32_t const low = PrintFloatIntPowerOfTen(precision - 1);
+    uint32_t const high = 10 * low;
+    
+    // Near a power of ten the scaling error may put the value on either
+    // side of it, so the corrections only go one way each, and a value at
+    // or above high is fixed up after rounding.
+    double scaled = PrintFloatScale((double)x, precision - 1 - exp10);
+    while (scaled >= (double)high) {
+        exp10++;
+        scaled = PrintFloatScale((double)x, precision - 1 - exp10);
+    }
+    while (scaled < (double)low) {
+        exp10--;
+        scaled = PrintFloatScale((double)x, precision - 1 - exp10);
+    }
+    uint32_t mantissa = PrintFloatRound(scaled);
+    if (mantissa >= high) {
+        mantissa = low;
+        exp10++;
+    }
+    
+    char digits[10];
+    PrintNonnegativeIntDecimal(mantissa, digits);
+    int num_digits = precision;
+    while (num_digits > 1 && digits[num_digits - 1] == '0') {
+        num_digits--;
+    }
+    
+    if (exp10 < -4 || exp10 >= precision) {
+        s[len++] = digits[0];
+        if (num_digits > 1) {
+            s[len++] = '.';
+            for (int i = 1; i < num_digits; i++) {
+                s[len++] = digits[i];
+            }
+        }
+        s[len++] = 'e';
+        s[len++] = (exp10 < 0) ? '-' : '+';
+        int abs_exp10 = (exp10 < 0) ? -exp10 : exp10;
+        if (abs_exp10 < 10) {
+            s[len++] = '0';
+        }
+        len += PrintNonnegativeIntDecimal(abs_exp10, s + len);
+    }
+    else if (exp10 < 0) {
+        s[len++] = '0';
+        s[len++] = '.';
+        for (int i = exp10 + 1; i < 0; i++) {
+            s[len++] = '0';
+        }
+        for (int i = 0; i < num_digits; i++) {
+            s[len++] = digits[i];
+        }
+    }
+    else {
+        for (int i = 0; i <= exp10; i++) {
+            s[len++] = (i < num_digits) ? digits[i] : '0';
+        }
+        if (num_digits > exp10 + 1) {
+            s[len++] = '.';
+            for (int i = exp10 + 1; i < num_digits; i++) {
+                s[len++] = digits[i];
+            }
+        }
+    }
+    
+    return len;
+}
+
+/**
+ * Writes x to s like printf("%.*f", frac_digits, x), without a terminating
+ * null, and returns the length. Values whose digits do not fit into 32 bits
+ * are written like PrintFloatDecimal() with 9 significant digits. At most
+ * PrintFloatMaxLength characters are written. As in PrintFloatDecimal(), the
+ * scaling is done in double.
+ */
+template <typename T>
+static int PrintFloatFixed (T x, char *s, int frac_digits)
+{
+    static_assert(IsFpType<T>::Value, "");
+    AMBRO_ASSERT(frac_digits >= 0 && frac_digits <= 9)
+    
+    double scaled = FloatAbs(PrintFloatScale((double)x, frac_digits));
+    if (AMBRO_UNLIKELY(!(scaled < (double)UINT32_C(4000000000)))) {
+        return PrintFloatDecimal(x, s, 9);
+    }
+    
+    int len = 0;
+    if (FloatSignBit(x)) {
+        s[len++] = '-';
+    }
+    
+    char digits[10];
+    int num_digits = PrintNonnegativeIntDecimal(PrintFloatRound(scaled), digits);
+    
+    int int_digits = num_digits - frac_digits;
+    if (int_digits <= 0) {
+        s[len++] = '0';
+    } else {
+        for (int i = 0; i < int_digits; i++) {
+            s[len++] = digits[i];
+        }
+    }
+    if (frac_digits > 0) {
+        s[len++] = '.';
+        for (int i = int_digits; i < num_digits; i++) {
+            s[len++] = (i < 0) ? '0' : digits[i];
+        }
+    }
+    
+    return len;
+}
+
+#include <aprinter/EndNamespace.h>
+
+#endif
@@ -25,23 +25,36 @@
 #ifndef AMBROLIB_PRINT_INT_H
 #define AMBROLIB_PRINT_INT_H
 
+#include <stdint.h>
+#include <string.h>
+
 #include <aprinter/BeginNamespace.h>
 
+/**
+ * Writes the decimal representation of x to s, without a terminating null,
+ * and returns its length. The digits are produced in pairs, which halves the
+ * number of (possibly multi-word) divisions.
+ */
 template <typename T>
 static int PrintNonnegativeIntDecimal (T x, char *s)
 {
-    T x_temp = x;
-    int len = 0;
-    do {
-        len++;
-        x_temp /= 10;
-    } while (x_temp > 0);
-    int len_temp = len;
-    do {
-        len_temp--;
-        s[len_temp] = '0' + (x % 10);
-        x /= 10;
-    } while (x > 0);
+    char buf[3 * sizeof(T)];
+    char *p = buf + sizeof(buf);
+    while (x >= 100) {
+        T q = x / 100;
+        uint8_t pair = x - q * 100;
+        x = q;
+        *--p = '0' + (pair % 10);
+        *--p = '0' + (pair / 10);
+    }
+    uint8_t last = x;
+    if (last >= 10) {
+        *--p = '0' + (last % 10);
+        last /= 10;
+    }
+    *--p = '0' + last;
+    int len = (buf + sizeof(buf)) - p;
+    memcpy(s, p, len);
     return len;
 }
 
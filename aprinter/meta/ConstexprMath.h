@@ -58,6 +58,11 @@ static constexpr double ConstexprRound (double a)
     return (__builtin_isnan(a) || a == -INFINITY || a == INFINITY) ? a : __builtin_round(a);
 }
 
+static constexpr double ConstexprSqrt (double a)
+{
+    return (__builtin_isnan(a) || a < 0.0) ? NAN : __builtin_sqrt(a);
+}
+
 #include <aprinter/EndNamespace.h>
 
 #endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AMBROLIB_CONSTEXPR_PERFECT_HASH_H
+#define AMBROLIB_CONSTEXPR_PERFECT_HASH_H
+
+#include <stdint.h>
+
+#include <aprinter/meta/BitsInInt.h>
+#include <aprinter/meta/ChooseInt.h>
+#include <aprinter/meta/MinMax.h>
+#include <aprinter/meta/PowerOfTwo.h>
+#include <aprinter/meta/StaticArray.h>
+#include <aprinter/meta/TypeSequenceMakeInt.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/**
+ * Perfect hash table for a set of keys known at compile time, built at
+ * compile time using the hash-and-displace method.
+ *
+ * KeyHash<Index>::value() must give the 32-bit hash of each key; the hashes
+ * must be distinct. The keys are distributed into buckets by the low bits of
+ * the hash. For each bucket, a displacement is found such that the slots
+ * derived from the hashes and the displacement are distinct and unused by
+ * the buckets placed before. Both tables are in program memory.
+ *
+ * lookup() gives the index of the only key which could have the given hash,
+ * the caller must check whether it is actually the key being looked up.
+ */
+template <int NumKeys, template<int> class KeyHash>
+class ConstexprPerfectHash {
+    static_assert(NumKeys > 0, "");
+    
+    static int const BucketBits = MinValue(8, BitsInInt<(NumKeys / 2)>::Value);
+    static int const NumBuckets = PowerOfTwo<int, BucketBits>::Value;
+    static int const SlotBits = MaxValue(1, BitsInInt<(NumKeys + NumKeys / 4)>::Value);
+    static int const NumSlots = PowerOfTwo<int, SlotBits>::Value;
+    static int const MaxDisplacement = 255;
+
+public:
+    using IndexType = ChooseIntForMax<NumKeys>;
+    
+    static IndexType lookup (uint32_t hash)
+    {
+        uint8_t displacement = DisplacementTable::readAt(bucket_of(hash));
+        return SlotTable::readAt(slot_of(hash, displacement));
+    }
+
+private:
+    static constexpr int bucket_of (uint32_t hash)
+    {
+        return hash & (NumBuckets - 1);
+    }
+    
+    static constexpr int slot_of (uint32_t hash, uint8_t displacement)
+    {
+        return (uint32_t)((hash ^ (displacement * UINT32_C(0x9E3779B9))) * UINT32_C(0x85EBCA6B)) >> (32 - SlotBits);
+    }
+    
+    struct Tables {
+        bool ok;
+        uint8_t displacements[NumBuckets];
+        IndexType slots[NumSlots];
+    };
+    
+    using Hashes = StaticArrayStruct<uint32_t, NumKeys>;
+    
+    static constexpr void unmark_bucket (Hashes const &hashes, int bucket, int displacement, int end_key, bool (&used)[NumSlots])
+    {
+        for (int k = 0; k < end_key; k++) {
+            if (bucket_of(hashes.arr[k]) == bucket) {
+                used[slot_of(hashes.arr[k], displacement)] = false;
+            }
+        }
+    }
+    
+    static constexpr bool place_bucket (Hashes const &hashes, int bucket, bool (&used)[NumSlots], Tables &tables)
+    {
+        for (int d = 0; d <= MaxDisplacement; d++) {
+            int k = 0;
+            while (k < NumKeys) {
+                if (bucket_of(hashes.arr[k]) == bucket) {
+                    int slot = slot_of(hashes.arr[k], d);
+                    if (used[slot]) {
+                        break;
+                    }
+                    used[slot] = true;
+                    tables.slots[slot] = k;
+                }
+                k++;
+            }
+            if (k == NumKeys) {
+                tables.displacements[bucket] = d;
+                return true;
+            }
+            unmark_bucket(hashes, bucket, d, k, used);
+        }
+        return false;
+    }
+    
+    static constexpr Tables build ()
+    {
+        Hashes hashes = StaticArrayHelper<uint32_t, KeyHash, TypeSequenceMakeInt<NumKeys>>::getHelperStruct();
+        Tables tables = {};
+        bool used[NumSlots] = {};
+        int bucket_size[NumBuckets] = {};
+        int max_size = 0;
+        
+        for (int k = 0; k < NumKeys; k++) {
+            int bucket = bucket_of(hashes.arr[k]);
+            bucket_size[bucket]++;
+            max_size = MaxValue(max_size, bucket_size[bucket]);
+        }
+        
+        // Place the larger buckets first, while there is the most choice.
+        for (int size = max_size; size > 0; size--) {
+            for (int bucket = 0; bucket < NumBuckets; bucket++) {
+                if (bucket_size[bucket] == size && !place_bucket(hashes, bucket, used, tables)) {
+                    return tables;
+                }
+            }
+        }
+        
+        tables.ok = true;
+        return tables;
+    }
+    
+    static constexpr Tables TheTables = build();
+    static_assert(TheTables.ok, "Perfect hash construction failed (are there keys with equal hashes?).");
+    
+    template <int Index>
+    struct DisplacementElem {
+        static constexpr uint8_t value () { return TheTables.displacements[Index]; }
+    };
+    
+    template <int Index>
+    struct SlotElem {
+        static constexpr IndexType value () { return TheTables.slots[Index]; }
+    };
+    
+    using DisplacementTable = StaticArray<uint8_t, NumBuckets, DisplacementElem>;
+    using SlotTable = StaticArray<IndexType, NumSlots, SlotElem>;
+};
+
+template <int NumKeys, template<int> class KeyHash>
+constexpr typename ConstexprPerfectHash<NumKeys, KeyHash>::Tables ConstexprPerfectHash<NumKeys, KeyHash>::TheTables;
+
+#include <aprinter/EndNamespace.h>
+
+#endif
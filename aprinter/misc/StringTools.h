@@ -194,6 +194,30 @@ static bool StringParseHexadecimal (MemRef data, uint64_t *out)
     return true;
 }
 
+static bool StringParseDecimal (MemRef data, uint32_t *out)
+{
+    if (data.len == 0) {
+        return false;
+    }
+    
+    uint32_t res = 0;
+    while (data.len > 0) {
+        char ch = *data.ptr++;
+        data.len--;
+        if (!(ch >= '0' && ch <= '9')) {
+            return false;
+        }
+        uint32_t digit = ch - '0';
+        if (res > (UINT32_MAX - digit) / 10) {
+            return false;
+        }
+        res = 10 * res + digit;
+    }
+    *out = res;
+    
+    return true;
+}
+
 #include <aprinter/EndNamespace.h>
 
 #endif
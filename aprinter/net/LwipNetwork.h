@@ -626,6 +626,8 @@ public:
         // The user is supposed to call TcpConnection::copyReceivedData from within
         // RecvHandler, one or more times, with the sum of 'length' parameters
         // equal to the 'length' in the callback (or less if not all data is needed).
+        // Alternatively, the data can be read in place using getReceivedDataChunk
+        // and takeReceivedData, avoiding an intermediate copy.
         // WARNING: Do not call any other network functions from this callback.
         // It is specifically prohibited to close (deinit/reset) this connection.
         // Typically one will copy the data to a buffer and set a QueuedEvent to
@@ -643,6 +645,13 @@ public:
     class TcpConnection {
         enum class State : uint8_t {IDLE, RUNNING, ERRORING, ERRORED};
         
+        struct ExtSendBuf {
+            // Amount of data in the send buffer which is to be sent before this.
+            size_t ring_before;
+            char const *ptr;
+            size_t len;
+        };
+        
     public:
         // This is how much received data you are required to be able to buffer.
         // This refers to the amount of data that was passed to RecvHandler but
@@ -652,6 +661,10 @@ public:
         // This is how large the send buffer of the connection is.
         static size_t const ProvidedTxBufSize = TCP_SND_BUF;
         
+        // This is how many external buffers (provideExtSendData) can be
+        // queued for sending at the same time.
+        static int const MaxExtSendBufs = 8;
+        
         void init (Context c, TcpConnectionCallback *callback)
         {
             m_closed_event.init(c, APRINTER_CB_OBJFUNC_T(&TcpConnection::closed_event_handler, this));
@@ -697,6 +710,9 @@ public:
             m_send_buf_start = 0;
             m_send_buf_length = 0;
             m_send_buf_passed_length = 0;
+            m_ext_start = 0;
+            m_ext_count = 0;
+            m_ext_passed_length = 0;
         }
         
         void copyReceivedData (Context c, char *buffer, size_t length)
@@ -705,25 +721,50 @@ public:
             AMBRO_ASSERT(m_received_pbuf)
             
             while (length > 0) {
-                AMBRO_ASSERT(m_received_offset <= m_received_pbuf->len)
-                size_t rem_bytes_in_pbuf = m_received_pbuf->len - m_received_offset;
-                if (rem_bytes_in_pbuf == 0) {
-                    AMBRO_ASSERT(m_received_pbuf->next)
-                    m_received_pbuf = m_received_pbuf->next;
-                    m_received_offset = 0;
-                    continue;
-                }
+                MemRef chunk = getReceivedDataChunk(c);
+                AMBRO_ASSERT(chunk.len > 0)
                 
-                size_t bytes_to_take = MinValue(length, rem_bytes_in_pbuf);
+                size_t bytes_to_take = MinValue(length, chunk.len);
                 
-                memcpy(buffer, (char *)m_received_pbuf->payload + m_received_offset, bytes_to_take);
+                memcpy(buffer, chunk.ptr, bytes_to_take);
                 buffer += bytes_to_take;
                 length -= bytes_to_take;
                 
-                m_received_offset += bytes_to_take;
+                takeReceivedData(c, bytes_to_take);
             }
         }
         
+        // Zero-copy alternative to copyReceivedData(), also only to be used from
+        // within RecvHandler. Returns the next contiguous part of the received data
+        // directly from the pbuf chain, or an empty MemRef if all of the data passed
+        // to RecvHandler has been taken. The memory is only valid until RecvHandler
+        // returns, since the pbufs may refer to the buffers of the Ethernet driver.
+        MemRef getReceivedDataChunk (Context c)
+        {
+            AMBRO_ASSERT(m_state == State::RUNNING)
+            AMBRO_ASSERT(m_received_pbuf)
+            
+            while (m_received_offset == m_received_pbuf->len && m_received_pbuf->next) {
+                m_received_pbuf = m_received_pbuf->next;
+                m_received_offset = 0;
+            }
+            
+            AMBRO_ASSERT(m_received_offset <= m_received_pbuf->len)
+            return MemRef((char const *)m_received_pbuf->payload + m_received_offset, m_received_pbuf->len - m_received_offset);
+        }
+        
+        // Advances past data returned by getReceivedDataChunk(). The amount must not
+        // exceed the length of the last returned chunk. As with copyReceivedData(),
+        // this does not accept the data, acceptReceivedData() must still be called.
+        void takeReceivedData (Context c, size_t amount)
+        {
+            AMBRO_ASSERT(m_state == State::RUNNING)
+            AMBRO_ASSERT(m_received_pbuf)
+            AMBRO_ASSERT(amount <= m_received_pbuf->len - m_received_offset)
+            
+            m_received_offset += amount;
+        }
+        
         void acceptReceivedData (Context c, size_t amount)
         {
             AMBRO_ASSERT(m_state == OneOf(State::RUNNING, State::ERRORING))
@@ -770,13 +811,43 @@ public:
             m_send_buf_length += data.len;
         }
         
+        // Queues external data for sending after the data already in the send
+        // buffer, without copying it. The memory must remain valid and unchanged
+        // until the data is acknowledged, that is until getNumExtSendPending()
+        // reports that this and all previously provided external buffers are done.
+        // Buffers complete in the order they are provided, so the user can release
+        // the oldest ones as the number pending goes down. Until then, the
+        // connection cannot be closed gracefully; reset would abort it.
+        void provideExtSendData (Context c, MemRef data)
+        {
+            AMBRO_ASSERT(m_state == OneOf(State::RUNNING, State::ERRORING))
+            AMBRO_ASSERT(!m_send_closed)
+            AMBRO_ASSERT(m_ext_count < MaxExtSendBufs)
+            AMBRO_ASSERT(data.len > 0)
+            
+            size_t ring_before = m_send_buf_length;
+            for (int i = 0; i < m_ext_count; i++) {
+                ring_before -= m_ext_bufs[ext_index(i)].ring_before;
+            }
+            
+            m_ext_bufs[ext_index(m_ext_count)] = ExtSendBuf{ring_before, data.ptr, data.len};
+            m_ext_count++;
+        }
+        
+        int getNumExtSendPending (Context c)
+        {
+            AMBRO_ASSERT(m_state == OneOf(State::RUNNING, State::ERRORING))
+            
+            return m_ext_count;
+        }
+        
         void pokeSending (Context c)
         {
             AMBRO_ASSERT(m_state == OneOf(State::RUNNING, State::ERRORING))
             AMBRO_ASSERT(!m_send_closed)
             
             if (m_state == State::RUNNING && !m_write_event.isSet(c)) {
-                TimeType delay = (m_send_buf_passed_length == 0) ? ShortWriteDelayTicks : WriteDelayTicks;
+                TimeType delay = (get_passed_length() == 0) ? ShortWriteDelayTicks : WriteDelayTicks;
                 m_write_event.appendAfterNotAlready(c, delay);
             }
         }
@@ -802,7 +873,7 @@ public:
                 if (m_pcb == m_listener->m_newpcb) {
                     m_listener->m_newpcb = nullptr;
                 }
-                close_pcb(m_pcb, m_send_buf_passed_length);
+                close_pcb(m_pcb, get_passed_length());
                 m_pcb = nullptr;
                 m_listener->client_pcb_closed();
             }
@@ -818,7 +889,7 @@ public:
             AMBRO_ASSERT(m_pcb)
             
             if (!pcb_gone) {
-                close_pcb(m_pcb, m_send_buf_passed_length);
+                close_pcb(m_pcb, get_passed_length());
             }
             m_pcb = nullptr;
             m_listener->client_pcb_closed();
@@ -886,14 +957,37 @@ public:
         {
             Context c;
             AMBRO_ASSERT(m_state == State::RUNNING)
-            AMBRO_ASSERT(len <= m_send_buf_passed_length)
+            AMBRO_ASSERT(len <= get_passed_length())
             AMBRO_ASSERT(m_send_buf_passed_length <= m_send_buf_length)
             
-            m_send_buf_start = send_buf_add(m_send_buf_start, len);
-            m_send_buf_length -= len;
-            m_send_buf_passed_length -= len;
+            size_t ack_len = len;
             
-            if (m_send_buf_passed_length < m_send_buf_length) {
+            // Data is acked in the order it was passed: for each external buffer,
+            // first the ring data before it, then the buffer itself.
+            while (ack_len > 0 && m_ext_count > 0) {
+                ExtSendBuf *ext = &m_ext_bufs[m_ext_start];
+                
+                size_t ring_amount = MinValue(ack_len, ext->ring_before);
+                ack_send_buf(ring_amount);
+                ext->ring_before -= ring_amount;
+                ack_len -= ring_amount;
+                
+                size_t ext_amount = MinValue(ack_len, ext->len);
+                AMBRO_ASSERT(ext_amount <= m_ext_passed_length)
+                ext->ptr += ext_amount;
+                ext->len -= ext_amount;
+                m_ext_passed_length -= ext_amount;
+                ack_len -= ext_amount;
+                
+                if (ext->ring_before == 0 && ext->len == 0) {
+                    m_ext_start = ext_index(1);
+                    m_ext_count--;
+                }
+            }
+            
+            ack_send_buf(ack_len);
+            
+            if (have_unpassed_data()) {
                 m_write_event.appendAfter(c, WriteDelayTicks);
             }
             
@@ -918,21 +1012,23 @@ public:
         {
             AMBRO_ASSERT(m_state == State::RUNNING)
             
-            while (m_send_buf_passed_length < m_send_buf_length) {
-                size_t pass_offset = send_buf_add(m_send_buf_start, m_send_buf_passed_length);
-                size_t pass_avail = m_send_buf_length - m_send_buf_passed_length;
-                size_t pass_length = MinValue(pass_avail, (size_t)(ProvidedTxBufSize - pass_offset));
-                
+            MemRef pass_data;
+            bool is_ext;
+            while (get_next_pass(&pass_data, &is_ext)) {
                 u16_t written;
-                auto err = tcp_write(m_pcb, m_send_buf + pass_offset, pass_length, TCP_WRITE_FLAG_PARTIAL, &written);
+                auto err = tcp_write(m_pcb, pass_data.ptr, pass_data.len, TCP_WRITE_FLAG_PARTIAL, &written);
                 if (err != ERR_OK) {
                     return go_erroring(c, false);
                 }
                 
-                AMBRO_ASSERT(written <= pass_length)
-                m_send_buf_passed_length += written;
+                AMBRO_ASSERT(written <= pass_data.len)
+                if (is_ext) {
+                    m_ext_passed_length += written;
+                } else {
+                    m_send_buf_passed_length += written;
+                }
                 
-                if (written < pass_length) {
+                if (written < pass_data.len) {
                     goto output;
                 }
             }
@@ -966,6 +1062,77 @@ public:
             return WrapBuffer(ProvidedTxBufSize - write_offset, m_send_buf + write_offset, m_send_buf);
         }
         
+        int ext_index (int i)
+        {
+            int x = m_ext_start + i;
+            if (x >= MaxExtSendBufs) {
+                x -= MaxExtSendBufs;
+            }
+            return x;
+        }
+        
+        size_t get_passed_length ()
+        {
+            return m_send_buf_passed_length + m_ext_passed_length;
+        }
+        
+        void ack_send_buf (size_t amount)
+        {
+            AMBRO_ASSERT(amount <= m_send_buf_passed_length)
+            
+            m_send_buf_start = send_buf_add(m_send_buf_start, amount);
+            m_send_buf_length -= amount;
+            m_send_buf_passed_length -= amount;
+        }
+        
+        // Finds the next contiguous piece of data to pass to lwIP, following
+        // the order of ring data and external buffers. The passed counts are
+        // distributed over the queued external buffers to find the position.
+        bool get_next_pass (MemRef *out_data, bool *out_is_ext)
+        {
+            size_t ring_passed = m_send_buf_passed_length;
+            size_t ring_pos = 0;
+            size_t ext_passed = m_ext_passed_length;
+            
+            for (int i = 0; i < m_ext_count; i++) {
+                ExtSendBuf const *ext = &m_ext_bufs[ext_index(i)];
+                ring_pos += ext->ring_before;
+                if (ring_passed < ring_pos) {
+                    *out_data = get_ring_pass(ring_pos - ring_passed);
+                    *out_is_ext = false;
+                    return true;
+                }
+                if (ext_passed < ext->len) {
+                    *out_data = MemRef(ext->ptr + ext_passed, ext->len - ext_passed);
+                    *out_is_ext = true;
+                    return true;
+                }
+                ext_passed -= ext->len;
+            }
+            
+            if (ring_passed < m_send_buf_length) {
+                *out_data = get_ring_pass(m_send_buf_length - ring_passed);
+                *out_is_ext = false;
+                return true;
+            }
+            
+            return false;
+        }
+        
+        MemRef get_ring_pass (size_t max_length)
+        {
+            size_t pass_offset = send_buf_add(m_send_buf_start, m_send_buf_passed_length);
+            size_t pass_length = MinValue(max_length, (size_t)(ProvidedTxBufSize - pass_offset));
+            return MemRef(m_send_buf + pass_offset, pass_length);
+        }
+        
+        bool have_unpassed_data ()
+        {
+            MemRef data;
+            bool is_ext;
+            return get_next_pass(&data, &is_ext);
+        }
+        
         static void close_pcb (struct tcp_pcb *pcb, size_t send_buf_passed_length)
         {
             tcp_arg((struct tcp_pcb_base *)pcb, nullptr);
@@ -973,8 +1140,9 @@ public:
             tcp_recv(pcb, nullptr);
             tcp_sent(pcb, nullptr);
             
-            // If we have unacked data queued for sending, we have to resort
-            // to tcp_abort() because the referenced m_send_buf may go away.
+            // If we have unacked data queued for sending, we have to resort to
+            // tcp_abort() because the referenced m_send_buf or external buffers
+            // may go away.
             if (send_buf_passed_length > 0) {
                 tcp_abort(pcb);
             } else {
@@ -1006,6 +1174,10 @@ public:
         size_t m_send_buf_start;
         size_t m_send_buf_length;
         size_t m_send_buf_passed_length;
+        int m_ext_start;
+        int m_ext_count;
+        size_t m_ext_passed_length;
+        ExtSendBuf m_ext_bufs[MaxExtSendBufs];
         char m_send_buf[ProvidedTxBufSize];
     };
     
@@ -110,6 +110,7 @@ public:
     
     static size_t const MaxTxChunkOverhead = TxChunkOverhead;
     static size_t const MaxTxChunkSize = TxBufferSizeForChunkData;
+    static int const MaxTxExtChunks = TheTcpConnection::MaxExtSendBufs;
     static size_t const MaxGuaranteedBufferAvailBeforeHeadSent = TxBufferSizeForChunkData - MinValue(TxBufferSizeForChunkData, Params::ExpectedResponseLength);
     
     static void init (Context c)
@@ -238,6 +239,7 @@ private:
             m_rx_buf_start = 0;
             m_rx_buf_length = 0;
             m_rx_buf_eof = false;
+            m_rx_direct_unaccepted = 0;
             
             // Go prepare_for_request() very soon through this state for simplicity.
             // Really there will be no waiting.
@@ -366,7 +368,14 @@ private:
             AMBRO_ASSERT(!m_rx_buf_eof)
             AMBRO_ASSERT(bytes_read <= RxBufferSize - m_rx_buf_length)
             
-            // Write the received data to the RX buffer.
+            // Copy request body data directly to the user's buffer if possible.
+            // The data is accepted from recv_event_handler, since we may not
+            // call network functions from here.
+            size_t direct_amount = receive_direct(c, bytes_read);
+            m_rx_direct_unaccepted += direct_amount;
+            bytes_read -= direct_amount;
+            
+            // Write the remaining received data to the RX buffer.
             size_t write_offset = buf_add(m_rx_buf_start, m_rx_buf_length);
             size_t first_chunk_len = MinValue(bytes_read, (size_t)(RxBufferSize - write_offset));
             m_connection.copyReceivedData(c, m_rx_buf + write_offset, first_chunk_len);
@@ -379,6 +388,37 @@ private:
             m_recv_event.prependNow(c);
         }
         
+        size_t receive_direct (Context c, size_t bytes_read)
+        {
+            // The direct buffer is only used while there is no data in the RX buffer,
+            // which would have to be passed to the user first.
+            if (!(m_state == State::HEAD_RECEIVED && m_user_accepting_request_body && m_direct_buf &&
+                  m_recv_state == OneOf(RecvState::RECV_KNOWN_LENGTH, RecvState::RECV_CHUNK_DATA) &&
+                  !m_req_body_recevied && m_rx_buf_length == 0))
+            {
+                return 0;
+            }
+            
+            size_t amount = MinValue(bytes_read, (size_t)MinValue((uint64_t)(m_direct_buf_size - m_direct_buf_length), m_rem_req_body_length));
+            
+            // Copy the data straight out of the received pbufs.
+            size_t pos = 0;
+            while (pos < amount) {
+                MemRef chunk = m_connection.getReceivedDataChunk(c);
+                size_t bytes_to_take = MinValue(chunk.len, amount - pos);
+                memcpy(m_direct_buf + m_direct_buf_length + pos, chunk.ptr, bytes_to_take);
+                m_connection.takeReceivedData(c, bytes_to_take);
+                pos += bytes_to_take;
+            }
+            
+            if (amount > 0) {
+                m_direct_buf_length += amount;
+                account_request_body(c, amount);
+            }
+            
+            return amount;
+        }
+        
         void connectionSendHandler (Context c) override
         {
             AMBRO_ASSERT(m_state != State::NOT_CONNECTED)
@@ -454,6 +494,12 @@ private:
         
         void recv_event_handler (Context c)
         {
+            // Accept any data which was copied directly to the user's buffer.
+            if (m_rx_direct_unaccepted > 0) {
+                m_connection.acceptReceivedData(c, m_rx_direct_unaccepted);
+                m_rx_direct_unaccepted = 0;
+            }
+            
             switch (m_state) {
                 case State::RECV_REQUEST_LINE: {
                     // Receiving the request line.
@@ -937,6 +983,7 @@ private:
             
             // Remember if the user is accepting the body (else we're discarding it).
             m_user_accepting_request_body = user_accepting;
+            m_direct_buf = nullptr;
             
             // Start receiving the request body, chunked or known-length.
             if (m_have_chunked) {
@@ -971,6 +1018,13 @@ private:
             
             // Adjust RX buffer and remaining-data length.
             accept_rx_data(c, amount);
+            account_request_body(c, amount);
+        }
+        
+        void account_request_body (Context c, size_t amount)
+        {
+            AMBRO_ASSERT(amount <= m_rem_req_body_length)
+            
             m_rem_req_body_length -= amount;
             
             // End of known-length body or chunk?
@@ -996,6 +1050,7 @@ private:
             else if (m_recv_state != RecvState::COMPLETED) {
                 // Discard any remaining request-body data.
                 m_user_accepting_request_body = false;
+                m_direct_buf = nullptr;
                 m_recv_event.prependNow(c);
             }
         }
@@ -1009,6 +1064,12 @@ private:
             // Terminate the request with the user, if any.
             terminate_user(c);
             
+            // If there is external response data pending, the user has just
+            // released it, so we must not send anything more on this connection.
+            if (m_connection.getNumExtSendPending(c) > 0) {
+                return disconnect(c);
+            }
+            
             // Send an error response if desired and possible.
             if (resp_status && m_send_state == OneOf(SendState::INVALID, SendState::HEAD_NOT_SENT, SendState::SEND_HEAD)) {
                 send_response(c, resp_status, true, nullptr, nullptr, true);
@@ -1156,6 +1217,21 @@ private:
             return m_have_request_body;
         }
         
+        // Returns whether the request body has a known length (content-length
+        // without chunked encoding) and that length. Must be called before the
+        // request body is adopted.
+        bool getRequestBodyLength (Context c, uint64_t *out_length)
+        {
+            AMBRO_ASSERT(m_state == State::HEAD_RECEIVED)
+            AMBRO_ASSERT(m_recv_state == OneOf(RecvState::NOT_STARTED, RecvState::COMPLETED))
+            
+            if (!m_have_content_length || m_have_chunked) {
+                return false;
+            }
+            *out_length = m_rem_req_body_length;
+            return true;
+        }
+        
         void setCallback (Context c, RequestUserCallback *callback)
         {
             AMBRO_ASSERT(m_state == State::HEAD_RECEIVED)
@@ -1171,6 +1247,7 @@ private:
             AMBRO_ASSERT(m_state == State::HEAD_RECEIVED)
             AMBRO_ASSERT(m_recv_state != RecvState::INVALID)
             AMBRO_ASSERT(m_send_state != SendState::INVALID)
+            AMBRO_ASSERT(m_connection.getNumExtSendPending(c) == 0)
             
             // Remember that the user is gone.
             m_state = State::USER_GONE;
@@ -1241,6 +1318,40 @@ private:
             }
         }
         
+        // Provides a buffer to which request body data will be written directly from
+        // the network stack, bypassing the RX buffer. This is only used once there is
+        // no request body data in the RX buffer, so any data in the direct buffer
+        // precedes data which is subsequently reported by getRequestBodyBufferState.
+        // Data ends up in the direct buffer asynchronously, followed by a call of
+        // requestBufferEvent. The buffer must remain valid until it is released
+        // using takeRequestBodyDirectData, or the user stops receiving the body.
+        void setRequestBodyDirectBuffer (Context c, char *buf, size_t size)
+        {
+            AMBRO_ASSERT(m_state == State::HEAD_RECEIVED)
+            AMBRO_ASSERT(user_receiving_request_body(c))
+            AMBRO_ASSERT(!m_direct_buf)
+            AMBRO_ASSERT(buf)
+            AMBRO_ASSERT(size > 0)
+            
+            m_direct_buf = buf;
+            m_direct_buf_size = size;
+            m_direct_buf_length = 0;
+        }
+        
+        // Releases the buffer given to setRequestBodyDirectBuffer and returns
+        // the amount of request body data which has been written to it.
+        // The data has already been accepted, acceptRequestBodyData must not
+        // be called for it.
+        size_t takeRequestBodyDirectData (Context c)
+        {
+            AMBRO_ASSERT(m_state == State::HEAD_RECEIVED)
+            AMBRO_ASSERT(user_receiving_request_body(c))
+            AMBRO_ASSERT(m_direct_buf)
+            
+            m_direct_buf = nullptr;
+            return m_direct_buf_length;
+        }
+        
         void pokeRequestBodyBufferEvent (Context c)
         {
             AMBRO_ASSERT(m_state == State::HEAD_RECEIVED)
@@ -1361,16 +1472,8 @@ private:
             AMBRO_ASSERT(con_space_avail >= TxChunkOverhead)
             AMBRO_ASSERT(length <= con_space_avail - TxChunkOverhead)
             
-            // Prepare the chunk header, with speed.
-            if (AMBRO_UNLIKELY(length != m_last_chunk_length)) {
-                size_t rem_length = length;
-                for (int i = TxChunkHeaderDigits-1; i >= 0; i--) {
-                    char digit_num = rem_length & 0xF;
-                    m_chunk_header[i] = (digit_num < 10) ? ('0' + digit_num) : ('A' + (digit_num - 10));
-                    rem_length >>= 4;
-                }
-                m_last_chunk_length = length;
-            }
+            // Prepare the chunk header.
+            prepare_chunk_header(length);
             
             // Write the chunk header and footer.
             WrapBuffer con_space_buffer = m_connection.getSendBufferPtr(c);
@@ -1382,6 +1485,45 @@ private:
             m_connection.pokeSending(c);
         }
         
+        // Checks if provideResponseBodyExtData() can be called now.
+        bool haveResponseBodyExtSpace (Context c)
+        {
+            AMBRO_ASSERT(m_state == State::HEAD_RECEIVED)
+            AMBRO_ASSERT(m_send_state == SendState::SEND_BODY)
+            AMBRO_ASSERT(m_user)
+            
+            return m_connection.getSendBufferSpace(c) >= TxChunkOverhead &&
+                   m_connection.getNumExtSendPending(c) < MaxTxExtChunks;
+        }
+        
+        // Sends a chunk of the response body directly from the user's memory.
+        // The memory must remain valid until getResponseBodyExtPending()
+        // reports that this chunk is done, or until requestTerminated()
+        // is called. Chunks are done in the order they are provided, and
+        // completeHandling() must not be called while any are pending.
+        void provideResponseBodyExtData (Context c, MemRef data)
+        {
+            AMBRO_ASSERT(haveResponseBodyExtSpace(c))
+            AMBRO_ASSERT(data.len > 0)
+            AMBRO_ASSERT(data.len <= MaxTxChunkSize)
+            
+            // The chunk header and footer go to the send buffer around the data.
+            prepare_chunk_header(data.len);
+            m_connection.copySendData(c, MemRef(m_chunk_header, TxChunkHeaderSize));
+            m_connection.provideExtSendData(c, data);
+            m_connection.copySendData(c, MemRef(m_chunk_header+TxChunkHeaderDigits, 2));
+            
+            m_connection.pokeSending(c);
+        }
+        
+        int getResponseBodyExtPending (Context c)
+        {
+            AMBRO_ASSERT(m_state == State::HEAD_RECEIVED)
+            AMBRO_ASSERT(m_user)
+            
+            return m_connection.getNumExtSendPending(c);
+        }
+        
         void pokeResponseBodyBufferEvent (Context c)
         {
             AMBRO_ASSERT(m_state == State::HEAD_RECEIVED)
@@ -1405,6 +1547,20 @@ private:
         }
         
     private:
+        // Prepares the chunk header, with speed.
+        void prepare_chunk_header (size_t length)
+        {
+            if (AMBRO_UNLIKELY(length != m_last_chunk_length)) {
+                size_t rem_length = length;
+                for (int i = TxChunkHeaderDigits-1; i >= 0; i--) {
+                    char digit_num = rem_length & 0xF;
+                    m_chunk_header[i] = (digit_num < 10) ? ('0' + digit_num) : ('A' + (digit_num - 10));
+                    rem_length >>= 4;
+                }
+                m_last_chunk_length = length;
+            }
+        }
+        
         typename Context::EventLoop::QueuedEvent m_send_event;
         typename Context::EventLoop::QueuedEvent m_recv_event;
         typename Context::EventLoop::TimedEvent m_send_timeout_event;
@@ -1415,6 +1571,10 @@ private:
         UserClientState m_user_client_state;
         size_t m_rx_buf_start;
         size_t m_rx_buf_length;
+        size_t m_rx_direct_unaccepted;
+        char *m_direct_buf;
+        size_t m_direct_buf_size;
+        size_t m_direct_buf_length;
         size_t m_line_length;
         size_t m_rem_allowed_length;
         size_t m_last_chunk_length;
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <signal.h>
+
+#include <aprinter/platform/linux/linux_support.h>
+
+uint32_t linux_sim_time;
+uint32_t linux_sim_poll_ticks = 1;
+uint32_t linux_sim_next_time;
+bool linux_sim_have_next;
+bool linux_sim_irq_enabled;
+bool linux_sim_in_irq;
+sig_atomic_t volatile linux_sim_quit_requested;
+
+static LinuxSimIrq *linux_sim_irqs;
+static FILE *linux_sim_trace_file;
+
+static void linux_sim_signal_handler (int signum)
+{
+    linux_sim_quit_requested = 1;
+}
+
+static void linux_sim_flush (void)
+{
+    if (linux_sim_trace_file) {
+        fflush(linux_sim_trace_file);
+    }
+    fflush(stdout);
+}
+
+void platform_init (void)
+{
+    char const *poll_ticks = linux_sim_get_param("APRINTER_LINUX_POLL_TICKS", nullptr);
+    if (poll_ticks) {
+        linux_sim_poll_ticks = strtoul(poll_ticks, nullptr, 10);
+        if (linux_sim_poll_ticks == 0) {
+            linux_sim_poll_ticks = 1;
+        }
+    }
+
+    char const *trace = linux_sim_get_param("APRINTER_LINUX_TRACE", nullptr);
+    if (trace) {
+        linux_sim_trace_file = fopen(trace, "w");
+        if (!linux_sim_trace_file) {
+            fprintf(stderr, "Failed to open trace file %s\n", trace);
+            exit(1);
+        }
+        setvbuf(linux_sim_trace_file, nullptr, _IOFBF, 1 << 16);
+    }
+
+    // Output from printf() must not get stuck in a buffer while we spin.
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    // The simulation only stops by a signal; exit cleanly so the trace is complete.
+    signal(SIGINT, linux_sim_signal_handler);
+    signal(SIGTERM, linux_sim_signal_handler);
+    
+    // Like on a microcontroller, interrupts are enabled at startup.
+    linux_sim_irq_enabled = true;
+}
+
+void linux_sim_dispatch (void)
+{
+    linux_sim_in_irq = true;
+
+    while (true) {
+        // Find the armed IRQ with the earliest time, and the earliest time
+        // of the remaining ones so we know when to check again.
+        LinuxSimIrq *first = nullptr;
+        uint32_t next_time = 0;
+        bool have_next = false;
+        for (LinuxSimIrq *irq = linux_sim_irqs; irq; irq = irq->next) {
+            if (!irq->armed) {
+                continue;
+            }
+            if (!first || (uint32_t)(irq->time - first->time) >= UINT32_C(0x80000000)) {
+                if (first) {
+                    next_time = first->time;
+                    have_next = true;
+                }
+                first = irq;
+            } else if (!have_next || (uint32_t)(irq->time - next_time) >= UINT32_C(0x80000000)) {
+                next_time = irq->time;
+                have_next = true;
+            }
+        }
+
+        if (!first || (uint32_t)(linux_sim_time - first->time) >= UINT32_C(0x80000000)) {
+            linux_sim_have_next = (first != nullptr);
+            if (first) {
+                linux_sim_next_time = first->time;
+            }
+            break;
+        }
+
+        // The handler re-arms the IRQ if it wants to be called again.
+        first->armed = false;
+        linux_sim_next_time = next_time;
+        linux_sim_have_next = have_next;
+        first->handler();
+    }
+
+    linux_sim_in_irq = false;
+}
+
+void linux_sim_irq_register (LinuxSimIrq *irq, void (*handler) (void))
+{
+    irq->handler = handler;
+    irq->armed = false;
+    irq->next = linux_sim_irqs;
+    linux_sim_irqs = irq;
+}
+
+void linux_sim_irq_unregister (LinuxSimIrq *irq)
+{
+    LinuxSimIrq **ptr = &linux_sim_irqs;
+    while (*ptr != irq) {
+        ptr = &(*ptr)->next;
+    }
+    *ptr = irq->next;
+}
+
+void linux_sim_trace_pin (int pin, bool value)
+{
+    if (linux_sim_trace_file) {
+        fprintf(linux_sim_trace_file, "%" PRIu32 " %d %d\n", linux_sim_time, pin, (int)value);
+    }
+}
+
+char const * linux_sim_get_param (char const *name, char const *def)
+{
+    char const *value = getenv(name);
+    return (value && *value) ? value : def;
+}
+
+void linux_sim_abort (void)
+{
+    linux_sim_flush();
+    abort();
+}
+
+void linux_sim_quit (void)
+{
+    linux_sim_flush();
+    fprintf(stderr, "Quit at time %" PRIu32 "\n", linux_sim_time);
+    exit(0);
+}
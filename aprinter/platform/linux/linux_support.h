@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_LINUX_SUPPORT_H
+#define APRINTER_LINUX_SUPPORT_H
+
+#include <stdint.h>
+#include <signal.h>
+
+/*
+ * Support code for running the firmware as a simulation on a Linux host.
+ *
+ * Everything runs in a single thread, in simulated time. The simulated
+ * time advances by a fixed number of ticks whenever the clock is read
+ * from the main context with interrupts enabled, which in practice means
+ * once for each event loop iteration. "Interrupts" are simulated by
+ * calling registered handlers when the time they were set for is reached,
+ * or when interrupts are re-enabled while one is pending. Handlers are
+ * never nested and take no simulated time, so a run with the same input
+ * always gives the same result. The simulation runs until SIGINT or
+ * SIGTERM, upon which the trace is flushed and the program exits.
+ *
+ * Runtime parameters are taken from the environment:
+ * - APRINTER_LINUX_POLL_TICKS: ticks to advance per clock read (default 1).
+ * - APRINTER_LINUX_TRACE: file to record output pin changes to, as lines
+ *   of "<time> <pin> <value>".
+ * - APRINTER_LINUX_SERIAL_INPUT: file to read serial input from (output
+ *   then goes to stdout); if unset, a pseudo-terminal is created instead.
+ * - APRINTER_LINUX_SDCARD: SD card image file.
+ * - APRINTER_LINUX_EEPROM: EEPROM backing file.
+ */
+
+#define AMBROLIB_ABORT_ACTION { linux_sim_abort(); }
+
+struct LinuxSimIrq {
+    LinuxSimIrq *next;
+    void (*handler) (void);
+    uint32_t time;
+    bool armed;
+};
+
+extern uint32_t linux_sim_time;
+extern uint32_t linux_sim_poll_ticks;
+extern uint32_t linux_sim_next_time;
+extern bool linux_sim_have_next;
+extern bool linux_sim_irq_enabled;
+extern bool linux_sim_in_irq;
+extern sig_atomic_t volatile linux_sim_quit_requested;
+
+void platform_init (void);
+void linux_sim_dispatch (void);
+void linux_sim_irq_register (LinuxSimIrq *irq, void (*handler) (void));
+void linux_sim_irq_unregister (LinuxSimIrq *irq);
+void linux_sim_trace_pin (int pin, bool value);
+char const * linux_sim_get_param (char const *name, char const *def);
+__attribute__((noreturn)) void linux_sim_abort (void);
+__attribute__((noreturn)) void linux_sim_quit (void);
+
+inline static void linux_sim_check_irqs (void)
+{
+    if (linux_sim_have_next && !linux_sim_in_irq && (uint32_t)(linux_sim_time - linux_sim_next_time) < UINT32_C(0x80000000)) {
+        linux_sim_dispatch();
+    }
+}
+
+inline static void sei (void)
+{
+    linux_sim_irq_enabled = true;
+    linux_sim_check_irqs();
+}
+
+inline static void cli (void)
+{
+    linux_sim_irq_enabled = false;
+}
+
+inline static bool interrupts_enabled (void)
+{
+    return linux_sim_irq_enabled;
+}
+
+inline static void memory_barrier (void)
+{
+    asm volatile ("" : : : "memory");
+}
+
+inline static void memory_barrier_dma (void)
+{
+    asm volatile ("" : : : "memory");
+}
+
+inline static uint32_t linux_sim_get_time (void)
+{
+    if (linux_sim_irq_enabled && !linux_sim_in_irq) {
+        if (linux_sim_quit_requested) {
+            linux_sim_quit();
+        }
+        linux_sim_time += linux_sim_poll_ticks;
+        linux_sim_check_irqs();
+    }
+    return linux_sim_time;
+}
+
+inline static void linux_sim_irq_set (LinuxSimIrq *irq, uint32_t time)
+{
+    irq->time = time;
+    irq->armed = true;
+    if (!linux_sim_have_next || (uint32_t)(time - linux_sim_next_time) >= UINT32_C(0x80000000)) {
+        linux_sim_next_time = time;
+        linux_sim_have_next = true;
+    }
+}
+
+inline static void linux_sim_irq_unset (LinuxSimIrq *irq)
+{
+    irq->armed = false;
+}
+
+#endif
@@ -28,13 +28,12 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
-#include <inttypes.h>
-#include <stdio.h>
 
 #include <aprinter/base/ProgramMemory.h>
 #include <aprinter/base/Hints.h>
 #include <aprinter/math/FloatTools.h>
 #include <aprinter/math/PrintInt.h>
+#include <aprinter/math/PrintFloat.h>
 
 #include <aprinter/BeginNamespace.h>
 
@@ -88,28 +87,21 @@ public:
         reply_append_ch(c, '\n');
     }
     
+    // With frac_digits, the value is written with that many digits after
+    // the decimal point, otherwise like printf's %g.
     APRINTER_NO_INLINE
-    void reply_append_fp (Context c, FpType x)
+    void reply_append_fp (Context c, FpType x, int8_t frac_digits=-1)
     {
-        char buf[30];
-#if defined(AMBROLIB_AVR)
-        uint8_t len = AMBRO_PGM_SPRINTF(buf, AMBRO_PSTR("%g"), x);
+        char buf[PrintFloatMaxLength];
+        uint8_t len = (frac_digits < 0) ? PrintFloatDecimal<FpType>(x, buf) : PrintFloatFixed<FpType>(x, buf, frac_digits);
         reply_append_buffer(c, buf, len);
-#else
-        snprintf(buf, sizeof(buf), "%g", (double)x);
-        reply_append_buffer(c, buf, strlen(buf));
-#endif
     }
     
     APRINTER_NO_INLINE
     void reply_append_uint32 (Context c, uint32_t x)
     {
-        char buf[11];
-#if defined(AMBROLIB_AVR)
-        uint8_t len = AMBRO_PGM_SPRINTF(buf, AMBRO_PSTR("%" PRIu32), x);
-#else
+        char buf[10];
         uint8_t len = PrintNonnegativeIntDecimal<uint32_t>(x, buf);
-#endif
         reply_append_buffer(c, buf, len);
     }
 };
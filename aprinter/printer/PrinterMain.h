@@ -796,6 +796,7 @@ public:
                     case GCODE_ERROR_CHECKSUM:       err = AMBRO_PSTR("incorrect checksum");     break;
                     case GCODE_ERROR_RECV_OVERRUN:   err = AMBRO_PSTR("receive buffer overrun"); break;
                     case GCODE_ERROR_BAD_ESCAPE:     err = AMBRO_PSTR("bad escape sequence");    break;
+                    case GCODE_ERROR_NO_SETUP:       err = AMBRO_PSTR("moves without setup");    break;
                 }
                 
                 reportError(c, err);
@@ -1580,6 +1581,71 @@ public:
             return success;
         }
         
+        static bool compute_split_phys (Context c, FpType frac, FpType *phys_pos)
+        {
+            FpType virt_pos[NumVirtAxes];
+            ListFor<VirtAxesList>([&] APRINTER_TL(axis, axis::get_split_pos(c, frac, virt_pos)));
+            if (TheCorrectionService::CorrectionEnabled) {
+                FpType temp_virt_pos[NumVirtAxes];
+                TheCorrectionService::do_correction(c, ArraySrc{virt_pos}, ArrayDst{temp_virt_pos}, WrapBool<false>());
+                return TheTransformAlg::virtToPhys(c, ArraySrc{temp_virt_pos}, ArrayDst{phys_pos});
+            } else {
+                return TheTransformAlg::virtToPhys(c, ArraySrc{virt_pos}, ArrayDst{phys_pos});
+            }
+        }
+        
+        // Only the middle of a chord is new when the splitter halves it or
+        // continues with the next one. The start and middle of the last chord
+        // are kept here for the duration of one pull(), and its end across
+        // pulls in the object, with fractions which cannot occur otherwise
+        // marking them as unknown.
+        struct SplitEvaluator {
+            SplitEvaluator (Context c)
+            : m_c(c), m_start_frac(-1.0f), m_mid_frac(-1.0f)
+            {}
+            
+            bool get_deviation (FpType frac0, FpType frac1, FpType *out_deviation)
+            {
+                auto *o = Object::self(m_c);
+                FpType frac_mid = 0.5f * (frac0 + frac1);
+                FpType pos1[NumVirtAxes];
+                FpType pos_mid[NumVirtAxes];
+                
+                if (frac0 == o->split_end_frac) {
+                    memcpy(m_start_pos, o->split_end_pos, sizeof(m_start_pos));
+                } else if (frac0 != m_start_frac && !compute_split_phys(m_c, frac0, m_start_pos)) {
+                    return false;
+                }
+                m_start_frac = frac0;
+                if (frac1 == m_mid_frac) {
+                    memcpy(pos1, m_mid_pos, sizeof(pos1));
+                } else if (!compute_split_phys(m_c, frac1, pos1)) {
+                    return false;
+                }
+                if (!compute_split_phys(m_c, frac_mid, pos_mid)) {
+                    return false;
+                }
+                
+                FpType deviation = 0.0f;
+                for (int i = 0; i < NumVirtAxes; i++) {
+                    deviation = FloatMax(deviation, FloatAbs(pos_mid[i] - 0.5f * (m_start_pos[i] + pos1[i])));
+                }
+                *out_deviation = deviation;
+                
+                m_mid_frac = frac_mid;
+                memcpy(m_mid_pos, pos_mid, sizeof(pos_mid));
+                o->split_end_frac = frac1;
+                memcpy(o->split_end_pos, pos1, sizeof(pos1));
+                return true;
+            }
+            
+            Context m_c;
+            FpType m_start_frac;
+            FpType m_mid_frac;
+            FpType m_start_pos[NumVirtAxes];
+            FpType m_mid_pos[NumVirtAxes];
+        };
+        
         static void set_ignore_phys_limits (Context c, bool ignore_limits)
         {
             auto *o = Object::self(c);
@@ -1619,6 +1685,7 @@ public:
             
             o->splitter.start(c, distance, base_max_v_rec, time_freq_by_max_speed);
             o->frac = 0.0f;
+            o->split_end_frac = -1.0f;
             
             return do_split(c);
         }
@@ -1685,7 +1752,7 @@ public:
             FpType rel_max_v_rec;
             FpType saved_phys_req_pos[NumAxes];
             
-            if (o->splitter.pull(c, &rel_max_v_rec, &o->frac)) {
+            if (o->splitter.pull(c, &rel_max_v_rec, &o->frac, SplitEvaluator{c})) {
                 ListFor<AxesList>([&] APRINTER_TL(axis, axis::save_req_pos(c, saved_phys_req_pos)));
                 
                 FpType saved_virt_req_pos[NumVirtAxes];
@@ -1842,6 +1909,12 @@ public:
                 o->m_req_pos = o->m_old_pos + (frac * o->m_delta);
             }
             
+            static void get_split_pos (Context c, FpType frac, FpType *data)
+            {
+                auto *o = Object::self(c);
+                data[VirtAxisIndex] = o->m_old_pos + (frac * o->m_delta);
+            }
+            
             static FpType limit_virt_axis_speed (FpType accum, Context c)
             {
                 auto *o = Object::self(c);
@@ -1925,6 +1998,8 @@ public:
             bool splitting;
             bool ignore_phys_limits;
             FpType frac;
+            FpType split_end_frac;
+            FpType split_end_pos[NumVirtAxes];
             TheSplitter splitter;
             TheCommand *move_err_output;
             MoveEndCallback move_end_callback;
@@ -43,9 +43,11 @@
 #include <aprinter/meta/ConstexprHash.h>
 #include <aprinter/meta/ConstexprCrc32.h>
 #include <aprinter/meta/ConstexprString.h>
+#include <aprinter/meta/ConstexprPerfectHash.h>
 #include <aprinter/meta/StaticArray.h>
 #include <aprinter/meta/MemberType.h>
 #include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/CallIfExists.h>
 #include <aprinter/base/ProgramMemory.h>
 #include <aprinter/base/Assert.h>
 #include <aprinter/base/LoopUtils.h>
@@ -72,6 +74,33 @@ static bool RuntimeConfigManager__compare_option (char const *name, ProgPtr<char
     }
 }
 
+// Option names are looked up using a perfect hash of the lowercased name.
+// The hash is the CRC32 as computed by ConstexprHash<ConstexprCrc32>, and at
+// runtime it is computed four bits at a time using a small table.
+
+static constexpr ConstexprHash<ConstexprCrc32> RuntimeConfigManager__name_hash (ConstexprHash<ConstexprCrc32> hash, char const *name)
+{
+    return (*name == '\0') ? hash : RuntimeConfigManager__name_hash(hash.addUint8((*name >= 'A' && *name <= 'Z') ? (*name + 32) : *name), name + 1);
+}
+
+template <int Index>
+struct RuntimeConfigManager__Crc32NibbleElem {
+    static constexpr uint32_t value () { return ConstexprCrc32__Table[Index << 4]; }
+};
+
+static uint32_t RuntimeConfigManager__hash_name (char const *name)
+{
+    using NibbleTable = StaticArray<uint32_t, 16, RuntimeConfigManager__Crc32NibbleElem>;
+    
+    uint32_t crc = UINT32_MAX;
+    for (; *name != '\0'; ++name) {
+        crc ^= (uint8_t)AsciiToLower(*name);
+        crc = NibbleTable::readAt(crc & 0xF) ^ (crc >> 4);
+        crc = NibbleTable::readAt(crc & 0xF) ^ (crc >> 4);
+    }
+    return crc ^ UINT32_MAX;
+}
+
 struct RuntimeConfigManagerNoStoreService {};
 
 template <typename Arg>
@@ -88,6 +117,7 @@ public:
     
 private:
     AMBRO_DECLARE_GET_MEMBER_TYPE_FUNC(GetMemberType_Type, Type)
+    AMBRO_DECLARE_GET_MEMBER_TYPE_FUNC(GetMemberType_OptionsList, OptionsList)
     
     template <typename TheOption>
     using OptionIsNotConstant = WrapBool<(!TypeListFind<typename TheOption::Properties, ConfigPropertyConstant>::Found)>;
@@ -326,42 +356,46 @@ private:
         using NameTable = StaticArray<ProgPtr<char>, NumOptions, NameTableElem>;
         using DefaultTable = StaticArray<Type, NumOptions, DefaultTableElem>;
         
-        static int find_option (char const *name)
+        static void reset_config (Context c)
         {
+            auto *o = Object::self(c);
+            
             for (auto i : LoopRange<int>(NumOptions)) {
-                if (RuntimeConfigManager__compare_option(name, NameTable::readAt(i))) {
-                    return i;
-                }
+                o->values[i] = DefaultTable::readAt(i);
             }
-            return -1;
         }
         
-        static void reset_config (Context c)
+        static bool get_name_helper (int global_option_index, ProgPtr<char> *out_name)
         {
-            auto *o = Object::self(c);
+            AMBRO_ASSERT(global_option_index >= PrevTypeGeneral::OptionCounter)
             
-            for (auto i : LoopRange<int>(NumOptions)) {
-                o->values[i] = DefaultTable::readAt(i);
+            if (global_option_index < OptionCounter) {
+                int index = global_option_index - PrevTypeGeneral::OptionCounter;
+                *out_name = NameTable::readAt(index);
+                return false;
             }
+            return true;
         }
         
         template <typename This=RuntimeConfigManager>
-        static bool get_set_cmd (Context c, TheCommand<This> *cmd, bool get_it, char const *name)
+        static bool get_set_cmd (Context c, TheCommand<This> *cmd, bool get_it, int global_option_index)
         {
             auto *o = Object::self(c);
             auto *mo = RuntimeConfigManager::Object::self(c);
+            AMBRO_ASSERT(global_option_index >= PrevTypeGeneral::OptionCounter)
             
-            int index = find_option(name);
-            if (index < 0) {
-                return true;
-            }
-            if (get_it) {
-                TheTypeSpecific::get_value_cmd(c, cmd, o->values[index]);
-            } else {
-                TheTypeSpecific::set_value_cmd(c, cmd, &o->values[index], DefaultTable::readAt(index));
-                mo->apply_pending = true;
+            if (global_option_index < OptionCounter) {
+                int index = global_option_index - PrevTypeGeneral::OptionCounter;
+                if (get_it) {
+                    TheTypeSpecific::get_value_cmd(c, cmd, o->values[index]);
+                } else {
+                    TheTypeSpecific::set_value_cmd(c, cmd, &o->values[index], DefaultTable::readAt(index));
+                    mo->apply_pending = true;
+                    StoreFeature::mark_dirty(c, global_option_index);
+                }
+                return false;
             }
-            return false;
+            return true;
         }
         
         template <typename This=RuntimeConfigManager>
@@ -381,16 +415,18 @@ private:
             return true;
         }
         
-        static bool set_by_strings (Context c, char const *name, char const *set_value)
+        static bool set_by_strings (Context c, int global_option_index, char const *set_value)
         {
             auto *o = Object::self(c);
+            AMBRO_ASSERT(global_option_index >= PrevTypeGeneral::OptionCounter)
             
-            int index = find_option(name);
-            if (index < 0) {
-                return true;
+            if (global_option_index < OptionCounter) {
+                int index = global_option_index - PrevTypeGeneral::OptionCounter;
+                TheTypeSpecific::set_value_str(&o->values[index], set_value);
+                StoreFeature::mark_dirty(c, global_option_index);
+                return false;
             }
-            TheTypeSpecific::set_value_str(&o->values[index], set_value);
-            return false;
+            return true;
         }
         
         static bool get_string_helper (Context c, int global_option_index, char *output, size_t output_avail)
@@ -438,11 +474,41 @@ private:
     
     using TypeGeneralList = IndexElemList<TypesList, DedummyIndexTemplate<TypeGeneral>::template Result>;
     
+    // All runtime options in the order of their global indices.
+    using GlobalOptionsList = JoinTypeListList<MapTypeList<TypeGeneralList, GetMemberType_OptionsList>>;
+    
+    template <int OptionIndex>
+    struct NameHashElem {
+        static constexpr uint32_t value () { return RuntimeConfigManager__name_hash(FormatHasher(), TypeListGet<GlobalOptionsList, OptionIndex>::name()).end(); }
+    };
+    
+    AMBRO_STRUCT_IF(NameLookupFeature, (NumRuntimeOptions > 0)) {
+        using NameHash = ConstexprPerfectHash<NumRuntimeOptions, NameHashElem>;
+        
+        static int find_option (char const *name)
+        {
+            int index = NameHash::lookup(RuntimeConfigManager__hash_name(name));
+            ProgPtr<char> option_name = ProgPtr<char>::Make(nullptr);
+            ListForBreak<TypeGeneralList>([&] APRINTER_TL(type, return type::get_name_helper(index, &option_name)));
+            if (!RuntimeConfigManager__compare_option(name, option_name)) {
+                return -1;
+            }
+            return index;
+        }
+    }
+    AMBRO_STRUCT_ELSE(NameLookupFeature) {
+        static int find_option (char const *name)
+        {
+            return -1;
+        }
+    };
+    
     template <typename Option>
     struct OptionHelper {
         using Type = typename Option::Type;
         using TheTypeGeneral = TypeGeneral<GetTypeIndex<Type>::Value>;
         static int const GeneralIndex = TheTypeGeneral::template OptionIndex<Option>::Value;
+        static int const GlobalIndex = TheTypeGeneral::PrevTypeGeneral::OptionCounter + GeneralIndex;
         
         static Type * value (Context c)
         {
@@ -488,12 +554,43 @@ private:
         APRINTER_MAKE_INSTANCE(TheStore, (StoreService::template Store<Context, Object, RuntimeConfigManager, ThePrinterMain, StoreHandler>))
         enum {STATE_IDLE, STATE_LOADING, STATE_SAVING};
         
+        // One bit for each option, set if the option may have changed since
+        // it was last loaded or saved, so that the store can skip unchanged data.
+        static int const DirtyBytes = (NumRuntimeOptions + 7) / 8;
+        
+        APRINTER_DEFINE_CALL_IF_EXISTS(CallIfExists_get_json_status, get_json_status)
+        
         static void init (Context c)
         {
             auto *o = Object::self(c);
             
             TheStore::init(c);
             o->state = STATE_IDLE;
+            mark_all_dirty(c);
+        }
+        
+        static void mark_dirty (Context c, int global_option_index)
+        {
+            auto *o = Object::self(c);
+            o->option_dirty[global_option_index / 8] |= (uint8_t)1 << (global_option_index % 8);
+        }
+        
+        static void mark_all_dirty (Context c)
+        {
+            auto *o = Object::self(c);
+            memset(o->option_dirty, 0xFF, sizeof(o->option_dirty));
+        }
+        
+        static bool is_dirty (Context c, int global_option_index)
+        {
+            auto *o = Object::self(c);
+            return o->option_dirty[global_option_index / 8] & ((uint8_t)1 << (global_option_index % 8));
+        }
+        
+        template <typename TheJsonBuilder>
+        static void get_json_status (Context c, TheJsonBuilder *json)
+        {
+            CallIfExists_get_json_status::template call_void<TheStore>(c, json);
         }
         
         static void deinit (Context c)
@@ -527,7 +624,10 @@ private:
                 TheStore::startReading(c);
                 o->state = STATE_LOADING;
             } else {
+                // The store looks at the dirty bits here. Options changed from
+                // now on will be marked again and saved the next time.
                 TheStore::startWriting(c);
+                memset(o->option_dirty, 0, sizeof(o->option_dirty));
                 o->state = STATE_SAVING;
             }
             o->from_command = from_command;
@@ -538,6 +638,11 @@ private:
             auto *o = Object::self(c);
             AMBRO_ASSERT(o->state == STATE_LOADING || o->state == STATE_SAVING)
             
+            if (!success) {
+                mark_all_dirty(c);
+            } else if (o->state == STATE_LOADING) {
+                memset(o->option_dirty, 0, sizeof(o->option_dirty));
+            }
             o->state = STATE_IDLE;
             if (o->from_command) {
                 auto *cmd = ThePrinterMain::get_locked(c);
@@ -556,11 +661,17 @@ private:
         >> {
             uint8_t state;
             bool from_command;
+            uint8_t option_dirty[DirtyBytes > 0 ? DirtyBytes : 1];
         };
     } AMBRO_STRUCT_ELSE(StoreFeature) {
         struct Object {};
         static void init (Context c) {}
         static void deinit (Context c) {}
+        static void mark_dirty (Context c, int global_option_index) {}
+        static void mark_all_dirty (Context c) {}
+        static bool is_dirty (Context c, int global_option_index) { return true; }
+        template <typename TheJsonBuilder>
+        static void get_json_status (Context c, TheJsonBuilder *json) {}
         template <typename This=RuntimeConfigManager>
         static bool checkCommand (Context c, TheCommand<This> *cmd) { return true; }
     };
@@ -571,6 +682,7 @@ private:
         
         ListFor<TypeGeneralList>([&] APRINTER_TL(type, type::reset_config(c)));
         o->apply_pending = true;
+        StoreFeature::mark_all_dirty(c);
     }
     
     static void work_dump (Context c)
@@ -630,10 +742,14 @@ public:
             } else {
                 bool get_it = (cmd_num == GetConfigMCommand);
                 char const *name = cmd->get_command_param_str(c, 'I', "");
-                if (ListForBreak<TypeGeneralList>([&] APRINTER_TL(type, return type::get_set_cmd(c, cmd, get_it, name)))) {
+                int index = NameLookupFeature::find_option(name);
+                if (index < 0) {
                     cmd->reportError(c, AMBRO_PSTR("UnknownOption"));
-                } else if (get_it) {
-                    cmd->reply_append_ch(c, '\n');
+                } else {
+                    ListForBreak<TypeGeneralList>([&] APRINTER_TL(type, return type::get_set_cmd(c, cmd, get_it, index)));
+                    if (get_it) {
+                        cmd->reply_append_ch(c, '\n');
+                    }
                 }
             }
             cmd->finishCommand(c);
@@ -658,6 +774,7 @@ public:
         
         *OptionHelper<Option>::value(c) = value;
         o->apply_pending = true;
+        StoreFeature::mark_dirty(c, OptionHelper<Option>::GlobalIndex);
     }
     
     template <typename Option>
@@ -668,15 +785,27 @@ public:
         return *OptionHelper<Option>::value(c);
     }
     
+    // Whether the option may have changed since the last successful load or
+    // save; always true without dirty tracking.
+    template <typename Option>
+    static bool isOptionDirty (Context c, Option)
+    {
+        static_assert(OptionIsNotConstant<Option>::Value, "");
+        
+        return StoreFeature::is_dirty(c, OptionHelper<Option>::GlobalIndex);
+    }
+    
     static bool setOptionByStrings (Context c, char const *option_name, char const *option_value)
     {
         auto *o = Object::self(c);
         
-        bool res = !ListForBreak<TypeGeneralList>([&] APRINTER_TL(type, return type::set_by_strings(c, option_name, option_value)));
-        if (res) {
-            o->apply_pending = true;
+        int index = NameLookupFeature::find_option(option_name);
+        if (index < 0) {
+            return false;
         }
-        return res;
+        ListForBreak<TypeGeneralList>([&] APRINTER_TL(type, return type::set_by_strings(c, index, option_value)));
+        o->apply_pending = true;
+        return true;
     }
     
     static void getOptionString (Context c, int option_index, char *output, size_t output_avail)
@@ -713,6 +842,7 @@ public:
     {
         auto *o = Object::self(c);
         json->addSafeKeyVal("configDirty", JsonBool{o->apply_pending});
+        StoreFeature::get_json_status(c, json);
     }
     
     template <typename Option>
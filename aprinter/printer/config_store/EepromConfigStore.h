@@ -37,6 +37,7 @@
 #include <aprinter/base/Object.h>
 #include <aprinter/base/Callback.h>
 #include <aprinter/base/Assert.h>
+#include <aprinter/printer/utils/JsonBuilder.h>
 
 #include <aprinter/BeginNamespace.h>
 
@@ -54,6 +55,8 @@ public:
 private:
     struct EepromHandler;
     using Loop = typename Context::EventLoop;
+    using Clock = typename Context::Clock;
+    using TimeType = typename Clock::TimeType;
     using TheEeprom = typename Params::EepromService::template Eeprom<Context, Object, EepromHandler>;
     using OptionSpecList = typename ConfigManager::RuntimeConfigOptionsList;
     enum State {STATE_IDLE, STATE_START_READING, STATE_START_WRITING, STATE_READING, STATE_WRITING};
@@ -102,6 +105,14 @@ private:
             memcpy(&value, o->buffer + BlockStartOffset, sizeof(Type));
             ConfigManager::setOptionValue(c, Option(), value);
         }
+        
+        static void check_dirty (Context c)
+        {
+            auto *o = Object::self(c);
+            if (ConfigManager::isOptionDirty(c, Option())) {
+                o->dirty_blocks[RelBlockNumber / 8] |= (uint8_t)1 << (RelBlockNumber % 8);
+            }
+        }
     };
     
     template <typename Dummy>
@@ -196,6 +207,8 @@ public:
         TheEeprom::init(c);
         o->event.init(c, APRINTER_CB_STATFUNC_T(&EepromConfigStore::event_handler));
         o->state = STATE_IDLE;
+        o->last_save_ticks = 0;
+        o->last_save_bytes = 0;
     }
     
     static void deinit (Context c)
@@ -206,13 +219,26 @@ public:
         TheEeprom::deinit(c);
     }
     
+    // Only the blocks containing options which the config manager reports as
+    // changed are written, along with the header. The header is invalidated
+    // first and rewritten last, and nothing is written if there are no changes.
     static void startWriting (Context c)
     {
         auto *o = Object::self(c);
         AMBRO_ASSERT(o->state == STATE_IDLE)
         
+        memset(o->dirty_blocks, 0, sizeof(o->dirty_blocks));
+        ListFor<OptionHelperList>([&] APRINTER_TL(helper, helper::check_dirty(c)));
+        
+        bool any_dirty = false;
+        for (size_t i = 0; i < sizeof(o->dirty_blocks); i++) {
+            any_dirty |= (o->dirty_blocks[i] != 0);
+        }
+        
         o->state = STATE_START_WRITING;
-        o->current_block = 0;
+        o->current_block = any_dirty ? 0 : NumWriteBlocks;
+        o->write_start_time = Clock::getTime(c);
+        o->write_bytes = 0;
         o->event.prependNowNotAlready(c);
     }
     
@@ -226,14 +252,36 @@ public:
         o->event.prependNowNotAlready(c);
     }
     
+    template <typename TheJsonBuilder>
+    static void get_json_status (Context c, TheJsonBuilder *json)
+    {
+        auto *o = Object::self(c);
+        json->addSafeKeyVal("configSaveTime", JsonDouble{o->last_save_ticks * Clock::time_unit});
+        json->addSafeKeyVal("configSaveBytes", JsonUint32{o->last_save_bytes});
+    }
+    
     using GetEeprom = TheEeprom;
     
 private:
+    static bool block_is_dirty (Context c, int write_block)
+    {
+        auto *o = Object::self(c);
+        if (write_block == 0 || write_block == 1 + NumOptionBlocks) {
+            return true;
+        }
+        int rel_block = write_block - 1;
+        return o->dirty_blocks[rel_block / 8] & ((uint8_t)1 << (rel_block % 8));
+    }
+    
     static void finish (Context c, bool success)
     {
         auto *o = Object::self(c);
         AMBRO_ASSERT(o->state != STATE_IDLE)
         
+        if (o->state == STATE_WRITING) {
+            o->last_save_ticks = (TimeType)(Clock::getTime(c) - o->write_start_time);
+            o->last_save_bytes = o->write_bytes;
+        }
         o->state = STATE_IDLE;
         return Handler::call(c, success);
     }
@@ -243,11 +291,15 @@ private:
         auto *o = Object::self(c);
         AMBRO_ASSERT(o->state == STATE_WRITING)
         
+        while (o->current_block < NumWriteBlocks && !block_is_dirty(c, o->current_block)) {
+            o->current_block++;
+        }
         if (o->current_block == NumWriteBlocks) {
             return finish(c, true);
         }
         memset(o->buffer, 0, sizeof(o->buffer));
         int block_number = ListForOne<BlockWriteHelperList, 0, int>(o->current_block, [&] APRINTER_TL(helper, return helper::write(c)));
+        o->write_bytes += TheEeprom::BlockSize;
         TheEeprom::startWrite(c, block_number * TheEeprom::BlockSize, o->buffer, TheEeprom::BlockSize);
     }
     
@@ -307,6 +359,11 @@ public:
         State state;
         int current_block;
         uint8_t buffer[TheEeprom::BlockSize];
+        uint8_t dirty_blocks[(NumOptionBlocks + 7) / 8];
+        TimeType write_start_time;
+        uint32_t write_bytes;
+        TimeType last_save_ticks;
+        uint32_t last_save_bytes;
     };
 };
 
@@ -153,7 +153,9 @@ public:
         o->file_state = FILE_STATE_PAUSED;
     }
     
-    static bool rewind (Context c, typename ThePrinterMain::TheCommand *err_output)
+    // Positions the file at the start of the block containing pos. The seek itself
+    // is done as part of the next read, so that it can reuse the read error handling.
+    static bool seek (Context c, uint32_t pos, typename ThePrinterMain::TheCommand *err_output)
     {
         auto *o = Object::self(c);
         auto *fs_o = UnionFsPart::Object::self(c);
@@ -163,7 +165,15 @@ public:
         if (!check_file_paused(c, err_output)) {
             return false;
         }
-        fs_o->file.rewind(c);
+        if (pos > fs_o->file.getFileSize(c)) {
+            err_output->reply_append_error(c, AMBRO_PSTR("SeekPastEnd"));
+            return false;
+        }
+        o->seek_block_pos = pos - pos % BlockSize;
+        o->seek_pending = (o->seek_block_pos != 0);
+        if (!o->seek_pending) {
+            fs_o->file.rewind(c);
+        }
         o->file_eof = false;
         ClientParams::ClearBufferHandler::call(c);
         return true;
@@ -195,7 +205,12 @@ public:
         AMBRO_ASSERT(o->file_state == FILE_STATE_RUNNING)
         AMBRO_ASSERT(!o->file_eof)
         
-        fs_o->file.startReadUserBuf(c, buf);
+        o->read_buf = buf;
+        if (o->seek_pending) {
+            fs_o->file.startSeek(c, o->seek_block_pos);
+        } else {
+            fs_o->file.startReadUserBuf(c, buf);
+        }
         o->file_state = FILE_STATE_READING;
     }
     
@@ -718,6 +733,7 @@ private:
                 fs_o->file.init(c, entry, APRINTER_CB_STATFUNC_T(&SdFatInput::file_handler));
                 o->file_state = FILE_STATE_PAUSED;
                 o->file_eof = false;
+                o->seek_pending = false;
                 ClientParams::ClearBufferHandler::call(c);
                 
                 if (o->open_start_stream) {
@@ -773,11 +789,19 @@ private:
     static void file_handler (Context c, bool is_error, size_t length)
     {
         auto *o = Object::self(c);
+        auto *fs_o = UnionFsPart::Object::self(c);
         TheDebugObject::access(c);
         AMBRO_ASSERT(o->init_state == INIT_STATE_DONE)
         AMBRO_ASSERT(o->file_state == FILE_STATE_READING)
         AMBRO_ASSERT(!o->file_eof)
         
+        // A failed seek is reported as a read error and retried with the next read.
+        if (o->seek_pending && !is_error) {
+            o->seek_pending = false;
+            fs_o->file.startReadUserBuf(c, o->read_buf);
+            return;
+        }
+        
         if (!is_error && length < BlockSize) {
             o->file_eof = true;
         }
@@ -1031,6 +1055,9 @@ public:
         uint8_t unmount_readonly : 1;
         uint8_t unmount_force : 1;
         uint8_t open_start_stream : 1;
+        uint8_t seek_pending : 1;
+        uint32_t seek_block_pos;
+        DataWordType *read_buf;
         union {
             struct {
                 typename TheFs::DirLister dir_lister;
@@ -100,7 +100,8 @@ public:
         o->state = STATE_PAUSED;
     }
     
-    static bool rewind (Context c, typename ThePrinterMain::TheCommand *cmd)
+    // Positions the input at the start of the block containing pos.
+    static bool seek (Context c, uint32_t pos, typename ThePrinterMain::TheCommand *cmd)
     {
         auto *o = Object::self(c);
         TheDebugObject::access(c);
@@ -109,7 +110,11 @@ public:
         if (!check_file_paused(c, cmd)) {
             return false;
         }
-        o->block = 0;
+        if (pos / BlockSize > TheSdCard::getCapacityBlocks(c)) {
+            cmd->reply_append_error(c, AMBRO_PSTR("SeekPastEnd"));
+            return false;
+        }
+        o->block = pos / BlockSize;
         ClientParams::ClearBufferHandler::call(c);
         return true;
     }
@@ -41,6 +41,7 @@
 #include <aprinter/meta/BasicMetaUtils.h>
 #include <aprinter/meta/StructIf.h>
 #include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/CallIfExists.h>
 #include <aprinter/base/Object.h>
 #include <aprinter/base/Callback.h>
 #include <aprinter/base/ProgramMemory.h>
@@ -91,6 +92,9 @@ private:
     
     AMBRO_DECLARE_GET_MEMBER_TYPE_FUNC(GetMemberType_ChannelPayload, ChannelPayload)
     
+    APRINTER_DEFINE_CALL_IF_EXISTS(CallIfExists_init, init)
+    APRINTER_DEFINE_CALL_IF_EXISTS(CallIfExists_configuration_changed, configuration_changed)
+    
 public:
     static void init (Context c)
     {
@@ -151,6 +155,11 @@ public:
         ListFor<HeatersList>([&] APRINTER_TL(heater, heater::check_safety(c)));
     }
     
+    static void configuration_changed (Context c)
+    {
+        ListFor<HeatersList>([&] APRINTER_TL(heater, heater::configuration_changed(c)));
+    }
+    
     static bool check_move_interlocks (Context c, TheOutputStream *err_output, PhysVirtAxisMaskType move_axes)
     {
         return ListForBreak<HeatersList>([&] APRINTER_TL(heater, return heater::check_move_interlocks(c, err_output, move_axes)));
@@ -261,6 +270,7 @@ private:
             TimeType time = Clock::getTime(c) + (TimeType)(0.05 * TimeConversion::value());
             o->m_control_event.init(c, APRINTER_CB_STATFUNC_T(&Heater::control_event_handler));
             o->m_control_event.appendAt(c, time + (APRINTER_CFG(Config, CControlIntervalTicks, c) / 2));
+            CallIfExists_init::template call_void<TheFormula>(c);
             ThePwm::init(c, time);
             TheObserver::init(c);
             TheAnalogInput::init(c);
@@ -276,16 +286,36 @@ private:
             o->m_control_event.deinit(c);
         }
         
+        static void configuration_changed (Context c)
+        {
+            CallIfExists_configuration_changed::template call_void<TheFormula>(c);
+        }
+        
         static FpType adc_to_temp (Context c, AdcFixedType adc_value)
         {
             if (TheAnalogInput::isValueInvalid(adc_value)) {
                 return NAN;
             }
+            return formula_adc_to_temp<TheFormula>(c, adc_value, 0);
+        }
+        
+        // Formulas which provide adcBitsToTemp (e.g. using a lookup table) are
+        // given the ADC value in fixed-point, with an extra bit for the rounding.
+        template <typename Formula>
+        static auto formula_adc_to_temp (Context c, AdcFixedType adc_value, int) -> decltype(Formula::template adcBitsToTemp<AdcFixedType::num_bits + 1>(c, 0))
+        {
+            uint32_t adc_bits = ((uint32_t)adc_value.bitsValue() << 1) | !TheAnalogInput::IsRounded;
+            return Formula::template adcBitsToTemp<AdcFixedType::num_bits + 1>(c, adc_bits);
+        }
+        
+        template <typename Formula>
+        static FpType formula_adc_to_temp (Context c, AdcFixedType adc_value, long)
+        {
             FpType adc_fp = adc_value.template fpValue<FpType>();
             if (!TheAnalogInput::IsRounded) {
                 adc_fp += (FpType)(0.5 / PowerOfTwo<double, AdcFixedType::num_bits>::Value);
             }
-            return TheFormula::adcToTemp(c, adc_fp);
+            return Formula::adcToTemp(c, adc_fp);
         }
         
         static AdcFixedType get_adc (Context c)
@@ -330,9 +360,9 @@ private:
             cmd->reply_append_ch(c, ' ');
             print_name<typename HeaterSpec::Name>(c, cmd);
             cmd->reply_append_ch(c, ':');
-            cmd->reply_append_fp(c, st.current);
+            cmd->reply_append_fp(c, st.current, 2);
             cmd->reply_append_pstr(c, AMBRO_PSTR(" /"));
-            cmd->reply_append_fp(c, st.target);
+            cmd->reply_append_fp(c, st.target, 2);
             if (st.error) {
                 cmd->reply_append_pstr(c, AMBRO_PSTR(",err"));
             }
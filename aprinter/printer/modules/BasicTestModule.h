@@ -26,11 +26,15 @@
 #define APRINTER_BASIC_TEST_MODULE_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include <aprinter/meta/ServiceUtils.h>
 #include <aprinter/base/Object.h>
 #include <aprinter/base/Assert.h>
 #include <aprinter/base/ProgramMemory.h>
+#include <aprinter/printer/ServiceList.h>
+#include <aprinter/printer/utils/JsonBuilder.h>
+#include <aprinter/printer/utils/WebRequest.h>
 #include <aprinter/printer/utils/ModuleUtils.h>
 
 #include <aprinter/BeginNamespace.h>
@@ -39,6 +43,9 @@ template <typename ModuleArg>
 class BasicTestModule {
     APRINTER_UNPACK_MODULE_ARG(ModuleArg)
     
+    using TheCommand = typename ThePrinterMain::TheCommand;
+    using FpType = typename ThePrinterMain::FpType;
+    
 public:
     static void init (Context c)
     {
@@ -70,6 +77,24 @@ public:
             } break;
 #endif
             
+#ifdef EVENTLOOP_PROFILE
+            case 919: { // print event loop profile, or reset it with R
+                if (cmd->find_command_param(c, 'R', nullptr)) {
+                    if (!cmd->tryUnplannedCommand(c)) {
+                        break;
+                    }
+                    EventLoop::resetProfile(c);
+                    cmd->finishCommand(c);
+                    break;
+                }
+                if (!cmd->tryLockedCommand(c)) {
+                    break;
+                }
+                o->profile_print_index = 0;
+                profile_work_print(c);
+            } break;
+#endif
+            
             case 918: { // test assertions
                 uint32_t magic = cmd->get_command_param_uint32(c, 'M', 0);
                 if (magic != UINT32_C(122345)) {
@@ -112,14 +137,158 @@ public:
 #endif
     }
     
+#ifdef EVENTLOOP_PROFILE
+    template <typename WebApiConfig>
+    struct WebApi {
+        static bool handle_web_request (Context c, MemRef req_type, WebRequest<Context> *request)
+        {
+            if (req_type.equalTo("profile")) {
+                return request->template acceptRequest<ProfileRequest>(c);
+            }
+            return true;
+        }
+        
+        // The entries are sent one per JSON buffer, since all of them
+        // would not fit into one.
+        class ProfileRequest : public WebRequestHandler<Context, ProfileRequest> {
+        public:
+            void init (Context c)
+            {
+                JsonBuilder *json = this->startJson(c);
+                json->startObject();
+                json->addKeyArray(JsonSafeString{"entries"});
+                this->endJson(c);
+                
+                m_entry_index = 0;
+                this->waitForJsonBuffer(c);
+            }
+            
+            void jsonBufferAvailable (Context c)
+            {
+                JsonBuilder *json = this->startJson(c);
+                
+                if (m_entry_index >= EventLoop::getProfileNumEntries(c)) {
+                    json->endArray();
+                    json->endObject();
+                    this->endJson(c);
+                    return this->completeHandling(c);
+                }
+                
+                auto *entry = EventLoop::getProfileEntry(c, m_entry_index);
+                json->startObject();
+                char id[HandlerIdLength];
+                json->addSafeKeyVal("handler", JsonString{MemRef(id, format_handler_id(entry->handler_id, id))});
+                json->addSafeKeyVal("count", JsonUint32{entry->count});
+                json->addSafeKeyVal("totalMs", JsonUint32{ticks_to_uint32(entry->total_run_time, 1000.0)});
+                json->addSafeKeyVal("maxRunUs", JsonUint32{ticks_to_uint32(entry->max_run_time, 1000000.0)});
+                json->addSafeKeyVal("maxLatencyUs", JsonUint32{ticks_to_uint32(entry->max_latency, 1000000.0)});
+                json->addKeyArray(JsonSafeString{"latencyHist"});
+                for (int b = 0; b < EventLoop::ProfileNumBuckets; b++) {
+                    json->add(JsonUint32{entry->latency_hist[b]});
+                }
+                json->endArray();
+                json->endObject();
+                if (!this->endJson(c)) {
+                    return this->completeHandling(c);
+                }
+                
+                m_entry_index++;
+                this->waitForJsonBuffer(c);
+            }
+            
+        private:
+            int m_entry_index;
+        };
+        
+        using WebApiRequestHandlers = MakeTypeList<ProfileRequest>;
+    };
+#endif
+    
+private:
+#ifdef EVENTLOOP_PROFILE
+    using EventLoop = typename Context::EventLoop;
+    
+    static size_t const HandlerIdLength = 2 + 2 * sizeof(uintptr_t);
+    static size_t const ProfileLineLength = 128;
+    
+    static size_t format_handler_id (void const *handler_id, char *out)
+    {
+        uintptr_t value = (uintptr_t)handler_id;
+        out[0] = '0';
+        out[1] = 'x';
+        for (size_t i = 0; i < 2 * sizeof(uintptr_t); i++) {
+            int digit = (value >> (4 * (2 * sizeof(uintptr_t) - 1 - i))) & 0xF;
+            out[2 + i] = (digit < 10) ? ('0' + digit) : ('A' + (digit - 10));
+        }
+        return HandlerIdLength;
+    }
+    
+    template <typename Ticks>
+    static uint32_t ticks_to_uint32 (Ticks ticks, double units_per_second)
+    {
+        FpType value = (FpType)ticks * (FpType)(units_per_second * Context::Clock::time_unit);
+        return (value >= FpType(UINT32_MAX)) ? UINT32_MAX : (uint32_t)value;
+    }
+    
+    static void profile_work_print (Context c)
+    {
+        auto *o = Object::self(c);
+        TheCommand *cmd = ThePrinterMain::get_locked(c);
+        if (o->profile_print_index >= EventLoop::getProfileNumEntries(c)) {
+            cmd->finishCommand(c);
+            return;
+        }
+        if (!cmd->requestSendBufEvent(c, ProfileLineLength, BasicTestModule::profile_send_buf_event_handler)) {
+            cmd->reportError(c, AMBRO_PSTR("Print"));
+            cmd->finishCommand(c);
+        }
+    }
+    
+    static void profile_send_buf_event_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        TheCommand *cmd = ThePrinterMain::get_locked(c);
+        auto *entry = EventLoop::getProfileEntry(c, o->profile_print_index);
+        
+        char id[HandlerIdLength];
+        cmd->reply_append_pstr(c, AMBRO_PSTR("Handler "));
+        cmd->reply_append_buffer(c, id, format_handler_id(entry->handler_id, id));
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" N:"));
+        cmd->reply_append_uint32(c, entry->count);
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" TotalMs:"));
+        cmd->reply_append_uint32(c, ticks_to_uint32(entry->total_run_time, 1000.0));
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" MaxRunUs:"));
+        cmd->reply_append_uint32(c, ticks_to_uint32(entry->max_run_time, 1000000.0));
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" MaxLatencyUs:"));
+        cmd->reply_append_uint32(c, ticks_to_uint32(entry->max_latency, 1000000.0));
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" LatencyHist:"));
+        for (int b = 0; b < EventLoop::ProfileNumBuckets; b++) {
+            if (b > 0) {
+                cmd->reply_append_ch(c, '/');
+            }
+            cmd->reply_append_uint32(c, entry->latency_hist[b]);
+        }
+        cmd->reply_append_ch(c, '\n');
+        cmd->reply_poke(c);
+        o->profile_print_index++;
+        profile_work_print(c);
+    }
+#endif
+    
 public:
     struct Object : public ObjBase<BasicTestModule, ParentObject, EmptyTypeList> {
         uint32_t underrun_count;
+#ifdef EVENTLOOP_PROFILE
+        int profile_print_index;
+#endif
     };
 };
 
 struct BasicTestModuleService {
     APRINTER_MODULE_TEMPLATE(BasicTestModuleService, BasicTestModule)
+#ifdef EVENTLOOP_PROFILE
+    using ProvidedServices = MakeTypeList<ServiceDefinition<ServiceList::WebApiHandlerService>>;
+#endif
 };
 
 #include <aprinter/EndNamespace.h>
@@ -35,6 +35,8 @@
 #include <aprinter/meta/ChooseInt.h>
 #include <aprinter/meta/ServiceUtils.h>
 #include <aprinter/meta/WrapFunction.h>
+#include <aprinter/meta/MinMax.h>
+#include <aprinter/meta/Expr.h>
 #include <aprinter/base/Object.h>
 #include <aprinter/base/Assert.h>
 #include <aprinter/base/ProgramMemory.h>
@@ -42,6 +44,7 @@
 #include <aprinter/base/LoopUtils.h>
 #include <aprinter/math/Matrix.h>
 #include <aprinter/math/LinearLeastSquares.h>
+#include <aprinter/math/FloatTools.h>
 #include <aprinter/printer/Configuration.h>
 #include <aprinter/printer/ServiceList.h>
 #include <aprinter/printer/HookExecutor.h>
@@ -61,7 +64,8 @@ private:
     using ProbePoints = typename Params::ProbePoints;
     using PlatformAxesList = typename Params::PlatformAxesList;
     using CorrectionParams = typename Params::ProbeCorrectionParams;
-    static const int NumPoints = TypeListLength<ProbePoints>::Value;
+    static const bool MeshMode = CorrectionParams::Mesh;
+    static const int NumPoints = MeshMode ? CorrectionParams::NumMeshPoints : TypeListLength<ProbePoints>::Value;
     static const int NumPlatformAxes = TypeListLength<PlatformAxesList>::Value;
     using PointIndexType = ChooseIntForMax<NumPoints, true>;
     
@@ -72,8 +76,32 @@ private:
     
     struct BedProbeHookCompletedHandler;
     
+    template <int VirtAxisIndex>
+    struct VirtAxisHelper {
+        template <typename Src, typename Dst, bool Reverse>
+        static void correct_virt_axis (Context c, Src src, Dst dst, FpType correction_value, WrapBool<Reverse>)
+        {
+            FpType coord_value = src.template get<VirtAxisIndex>();
+            if (VirtAxisIndex == ThePrinterMain::template GetVirtAxisVirtIndex<ProbeAxisIndex>::Value) {
+                if (Reverse) {
+                    coord_value -= correction_value;
+                } else {
+                    coord_value += correction_value;
+                }
+            }
+            dst.template set<VirtAxisIndex>(coord_value);
+        }
+    };
+    
+    template <typename Src, typename Dst, bool Reverse>
+    static void correct_virt_axes (Context c, Src src, Dst dst, FpType correction_value, WrapBool<Reverse>)
+    {
+        using VirtAxisHelperList = IndexElemListCount<ThePrinterMain::TransformFeature::NumVirtAxes, VirtAxisHelper>;
+        ListFor<VirtAxisHelperList>([&] APRINTER_TL(helper, helper::correct_virt_axis(c, src, dst, correction_value, WrapBool<Reverse>())));
+    }
+    
 public:
-    AMBRO_STRUCT_IF(CorrectionFeature, CorrectionParams::Enabled) {
+    AMBRO_STRUCT_IF(FitCorrectionFeature, CorrectionParams::Enabled && !MeshMode) {
         friend BedProbeModule;
         static_assert(ThePrinterMain::IsTransformEnabled, "");
         static_assert(ThePrinterMain::template IsVirtAxis<ProbeAxisIndex>::Value, "");
@@ -300,24 +328,6 @@ public:
             return constant_correction + linear_correction + quadratic_correction;
         }
         
-        template <int VirtAxisIndex>
-        struct VirtAxisHelper {
-            template <typename Src, typename Dst, bool Reverse>
-            static void correct_virt_axis (Context c, Src src, Dst dst, FpType correction_value, WrapBool<Reverse>)
-            {
-                FpType coord_value = src.template get<VirtAxisIndex>();
-                if (VirtAxisIndex == ThePrinterMain::template GetVirtAxisVirtIndex<ProbeAxisIndex>::Value) {
-                    if (Reverse) {
-                        coord_value -= correction_value;
-                    } else {
-                        coord_value += correction_value;
-                    }
-                }
-                dst.template set<VirtAxisIndex>(coord_value);
-            }
-        };
-        using VirtAxisHelperList = IndexElemListCount<ThePrinterMain::TransformFeature::NumVirtAxes, VirtAxisHelper>;
-        
     public:
         static bool const CorrectionEnabled = true;
         
@@ -325,17 +335,17 @@ public:
         static void do_correction (Context c, Src src, Dst dst, WrapBool<Reverse>)
         {
             FpType correction_value = compute_correction_for_point(c, src);
-            ListFor<VirtAxisHelperList>([&] APRINTER_TL(helper, helper::correct_virt_axis(c, src, dst, correction_value, WrapBool<Reverse>())));
+            correct_virt_axes(c, src, dst, correction_value, WrapBool<Reverse>());
         }
         
     public:
         using ConfigExprs = typename QuadraticFeature::ConfigExprs;
         
-        struct Object : public ObjBase<CorrectionFeature, typename BedProbeModule::Object, EmptyTypeList> {
+        struct Object : public ObjBase<FitCorrectionFeature, typename BedProbeModule::Object, EmptyTypeList> {
             Matrix<FpType, NumPoints, 1> heights_matrix;
             CorrectionsMatrix corrections;
         };
-    } AMBRO_STRUCT_ELSE(CorrectionFeature) {
+    } AMBRO_STRUCT_ELSE(FitCorrectionFeature) {
         static void init (Context c) {}
         static bool check_command (Context c, TheCommand *cmd) { return true; }
         static void probing_staring (Context c) {}
@@ -344,6 +354,283 @@ public:
         struct Object {};
     };
     
+    /**
+     * Mesh bed correction.
+     * 
+     * The probe points form a PointsX by PointsY grid spanning MinX..MaxX and
+     * MinY..MaxY of the first and second platform axis, probed row by row in
+     * alternating directions. The grid heights are stored in micrometers as
+     * 16-bit integers. For each grid cell, the bilinear interpolation
+     * coefficients are cached, so that the correction is a cell lookup
+     * and a few multiply-adds. Outside the grid, the correction of the
+     * nearest edge applies.
+     * 
+     * Because the correction is not linear along a straight move, moves
+     * should be split into segments not much longer than a grid cell.
+     */
+    AMBRO_STRUCT_IF(MeshCorrectionFeature, MeshMode) {
+        friend BedProbeModule;
+        static_assert(ThePrinterMain::IsTransformEnabled, "");
+        static_assert(ThePrinterMain::template IsVirtAxis<ProbeAxisIndex>::Value, "");
+        static_assert(NumPlatformAxes == 2, "Mesh correction requires exactly two platform axes.");
+        static_assert(TypeListLength<ProbePoints>::Value == 0, "Mesh correction does not use ProbePoints.");
+        
+    private:
+        static int const PointsX = CorrectionParams::PointsX;
+        static int const PointsY = CorrectionParams::PointsY;
+        static_assert(PointsX >= 2 && PointsY >= 2, "");
+        static int const CellsX = PointsX - 1;
+        static int const CellsY = PointsY - 1;
+        
+        using HeightType = int16_t;
+        static HeightType const HeightUnknown = INT16_MIN;
+        static HeightType const HeightMax = INT16_MAX;
+        static constexpr FpType HeightUnitsPerMm () { return 1000.0f; }
+        static constexpr FpType MmPerHeightUnit () { return 0.001f; }
+        
+        static int const MaxRowLength = 20 + 8 * PointsX;
+        
+        struct CellCoeffs {
+            FpType a;
+            FpType b;
+            FpType c;
+            FpType d;
+        };
+        
+        using CellsXExpr = APRINTER_FP_CONST_EXPR(CellsX);
+        using CellsYExpr = APRINTER_FP_CONST_EXPR(CellsY);
+        
+        using CMinX = decltype(ExprCast<FpType>(Config::e(CorrectionParams::MinX::i())));
+        using CMinY = decltype(ExprCast<FpType>(Config::e(CorrectionParams::MinY::i())));
+        using CStepX = decltype(ExprCast<FpType>((Config::e(CorrectionParams::MaxX::i()) - Config::e(CorrectionParams::MinX::i())) / CellsXExpr()));
+        using CStepY = decltype(ExprCast<FpType>((Config::e(CorrectionParams::MaxY::i()) - Config::e(CorrectionParams::MinY::i())) / CellsYExpr()));
+        using CStepXRec = decltype(ExprCast<FpType>(CellsXExpr() / (Config::e(CorrectionParams::MaxX::i()) - Config::e(CorrectionParams::MinX::i()))));
+        using CStepYRec = decltype(ExprCast<FpType>(CellsYExpr() / (Config::e(CorrectionParams::MaxY::i()) - Config::e(CorrectionParams::MinY::i()))));
+        
+        static void point_grid_position (PointIndexType point_index, int *out_x, int *out_y)
+        {
+            int y = point_index / PointsX;
+            int x = point_index % PointsX;
+            *out_x = (y % 2) ? (PointsX - 1 - x) : x;
+            *out_y = y;
+        }
+        
+        template <int PlatformAxisIndex>
+        static FpType get_point_coord (Context c, PointIndexType point_index)
+        {
+            int x;
+            int y;
+            point_grid_position(point_index, &x, &y);
+            if (PlatformAxisIndex == 0) {
+                return APRINTER_CFG(Config, CMinX, c) + x * APRINTER_CFG(Config, CStepX, c);
+            } else {
+                return APRINTER_CFG(Config, CMinY, c) + y * APRINTER_CFG(Config, CStepY, c);
+            }
+        }
+        
+        static void update_cells (Context c)
+        {
+            auto *o = Object::self(c);
+            for (auto y : LoopRange<int>(CellsY)) {
+                for (auto x : LoopRange<int>(CellsX)) {
+                    FpType h00 = o->heights[y][x] * MmPerHeightUnit();
+                    FpType h10 = o->heights[y][x + 1] * MmPerHeightUnit();
+                    FpType h01 = o->heights[y + 1][x] * MmPerHeightUnit();
+                    FpType h11 = o->heights[y + 1][x + 1] * MmPerHeightUnit();
+                    CellCoeffs *cell = &o->cells[y][x];
+                    cell->a = h00;
+                    cell->b = h10 - h00;
+                    cell->c = h01 - h00;
+                    cell->d = (h11 - h10) - (h01 - h00);
+                }
+            }
+        }
+        
+        static void reset_heights (Context c)
+        {
+            auto *o = Object::self(c);
+            for (auto y : LoopRange<int>(PointsY)) {
+                for (auto x : LoopRange<int>(PointsX)) {
+                    o->heights[y][x] = 0;
+                }
+            }
+            update_cells(c);
+        }
+        
+        static void init (Context c)
+        {
+            reset_heights(c);
+        }
+        
+        static void apply_corrections (Context c)
+        {
+            ThePrinterMain::TransformFeature::handle_corrections_change(c);
+        }
+        
+        static bool check_command (Context c, TheCommand *cmd)
+        {
+            auto *o = Object::self(c);
+            if (cmd->getCmdNumber(c) == 937) {
+                if (!cmd->tryLockedCommand(c)) {
+                    return false;
+                }
+                o->print_row = 0;
+                work_print(c);
+                return false;
+            }
+            if (cmd->getCmdNumber(c) == 561) {
+                if (!cmd->tryUnplannedCommand(c)) {
+                    return false;
+                }
+                reset_heights(c);
+                apply_corrections(c);
+                cmd->finishCommand(c);
+                return false;
+            }
+            return true;
+        }
+        
+        static void work_print (Context c)
+        {
+            auto *o = Object::self(c);
+            TheCommand *cmd = ThePrinterMain::get_locked(c);
+            if (o->print_row == PointsY) {
+                cmd->finishCommand(c);
+                return;
+            }
+            if (!cmd->requestSendBufEvent(c, MaxRowLength, MeshCorrectionFeature::send_buf_event_handler)) {
+                cmd->reportError(c, AMBRO_PSTR("Print"));
+                cmd->finishCommand(c);
+            }
+        }
+        
+        static void send_buf_event_handler (Context c)
+        {
+            auto *o = Object::self(c);
+            AMBRO_ASSERT(o->print_row < PointsY)
+            
+            TheCommand *cmd = ThePrinterMain::get_locked(c);
+            cmd->reply_append_pstr(c, AMBRO_PSTR("EffectiveMesh Y"));
+            cmd->reply_append_uint32(c, o->print_row);
+            cmd->reply_append_ch(c, ':');
+            for (auto x : LoopRange<int>(PointsX)) {
+                cmd->reply_append_ch(c, ' ');
+                cmd->reply_append_fp(c, o->heights[o->print_row][x] * MmPerHeightUnit());
+            }
+            cmd->reply_append_ch(c, '\n');
+            cmd->reply_poke(c);
+            o->print_row++;
+            work_print(c);
+        }
+        
+        static void probing_staring (Context c)
+        {
+            auto *o = Object::self(c);
+            for (auto y : LoopRange<int>(PointsY)) {
+                for (auto x : LoopRange<int>(PointsX)) {
+                    o->new_heights[y][x] = HeightUnknown;
+                }
+            }
+        }
+        
+        static void probing_measurement (Context c, PointIndexType point_index, FpType height)
+        {
+            auto *o = Object::self(c);
+            int x;
+            int y;
+            point_grid_position(point_index, &x, &y);
+            FpType units = FloatRound(height * HeightUnitsPerMm());
+            o->new_heights[y][x] = (units >= -HeightMax && units <= HeightMax) ? (HeightType)units : HeightUnknown;
+        }
+        
+        static bool probing_completing (Context c, TheCommand *cmd)
+        {
+            auto *o = Object::self(c);
+            
+            HeightType min_height = HeightMax;
+            HeightType max_height = -HeightMax;
+            bool bad_corrections = false;
+            
+            for (auto y : LoopRange<int>(PointsY)) {
+                for (auto x : LoopRange<int>(PointsX)) {
+                    HeightType height = o->new_heights[y][x];
+                    int32_t sum = (int32_t)o->heights[y][x] + height;
+                    if (height == HeightUnknown || sum < -HeightMax || sum > HeightMax) {
+                        bad_corrections = true;
+                        continue;
+                    }
+                    min_height = MinValue(min_height, height);
+                    max_height = MaxValue(max_height, height);
+                }
+            }
+            
+            if (bad_corrections) {
+                cmd->reportError(c, AMBRO_PSTR("BadCorrections"));
+                return false;
+            }
+            
+            cmd->reply_append_pstr(c, AMBRO_PSTR("RelativeCorrections Min:"));
+            cmd->reply_append_fp(c, min_height * MmPerHeightUnit());
+            cmd->reply_append_pstr(c, AMBRO_PSTR(" Max:"));
+            cmd->reply_append_fp(c, max_height * MmPerHeightUnit());
+            cmd->reply_append_ch(c, '\n');
+            
+            if (!cmd->find_command_param(c, 'D', nullptr)) {
+                for (auto y : LoopRange<int>(PointsY)) {
+                    for (auto x : LoopRange<int>(PointsX)) {
+                        o->heights[y][x] += o->new_heights[y][x];
+                    }
+                }
+                update_cells(c);
+                apply_corrections(c);
+            }
+            
+            return true;
+        }
+        
+        template <typename Src>
+        static FpType compute_correction_for_point (Context c, Src src)
+        {
+            auto *o = Object::self(c);
+            FpType fx = (src.template get<AxisHelper<0>::VirtAxisIndex()>() - APRINTER_CFG(Config, CMinX, c)) * APRINTER_CFG(Config, CStepXRec, c);
+            FpType fy = (src.template get<AxisHelper<1>::VirtAxisIndex()>() - APRINTER_CFG(Config, CMinY, c)) * APRINTER_CFG(Config, CStepYRec, c);
+            fx = FloatMax(FpType(0.0f), FloatMin(fx, FpType(CellsX)));
+            fy = FloatMax(FpType(0.0f), FloatMin(fy, FpType(CellsY)));
+            int x = MinValue(CellsX - 1, (int)fx);
+            int y = MinValue(CellsY - 1, (int)fy);
+            FpType u = fx - x;
+            FpType v = fy - y;
+            CellCoeffs const *cell = &o->cells[y][x];
+            return cell->a + u * (cell->b + v * cell->d) + v * cell->c;
+        }
+        
+    public:
+        static bool const CorrectionEnabled = true;
+        
+        template <typename Src, typename Dst, bool Reverse>
+        static void do_correction (Context c, Src src, Dst dst, WrapBool<Reverse>)
+        {
+            FpType correction_value = compute_correction_for_point(c, src);
+            correct_virt_axes(c, src, dst, correction_value, WrapBool<Reverse>());
+        }
+        
+    public:
+        using ConfigExprs = MakeTypeList<CMinX, CMinY, CStepX, CStepY, CStepXRec, CStepYRec>;
+        
+        struct Object : public ObjBase<MeshCorrectionFeature, typename BedProbeModule::Object, EmptyTypeList> {
+            HeightType heights[PointsY][PointsX];
+            HeightType new_heights[PointsY][PointsX];
+            CellCoeffs cells[CellsY][CellsX];
+            uint8_t print_row;
+        };
+    } AMBRO_STRUCT_ELSE(MeshCorrectionFeature) {
+        template <int PlatformAxisIndex>
+        static FpType get_point_coord (Context c, PointIndexType point_index) { return 0.0f; }
+        struct Object {};
+    };
+    
+    using CorrectionFeature = If<MeshMode, MeshCorrectionFeature, FitCorrectionFeature>;
+    
 public:
     static void init (Context c)
     {
@@ -455,12 +742,18 @@ private:
     
     static FpType get_point_z_offset (Context c, PointIndexType point_index)
     {
+        if (MeshMode) {
+            return 0.0f;
+        }
         return ListForOne<PointHelperList, 0, FpType>(point_index, [&] APRINTER_TL(helper, return helper::get_z_offset(c)));
     }
     
     template <int PlatformAxisIndex>
     static FpType get_point_coord (Context c, PointIndexType point_index)
     {
+        if (MeshMode) {
+            return MeshCorrectionFeature::template get_point_coord<PlatformAxisIndex>(c, point_index);
+        }
         return ListForOne<PointHelperList, 0, FpType>(point_index, [&] APRINTER_TL(helper, return helper::get_coord(c, WrapInt<PlatformAxisIndex>())));
     }
     
@@ -710,7 +1003,7 @@ public:
     struct Object : public ObjBase<BedProbeModule, ParentObject, JoinTypeLists<
         PointHelperList,
         AxisHelperList,
-        MakeTypeList<CorrectionFeature>
+        MakeTypeList<FitCorrectionFeature, MeshCorrectionFeature>
     >> {
         ProbePlannerClient planner_client;
         PointIndexType m_current_point;
@@ -722,6 +1015,8 @@ public:
 
 struct BedProbeNoCorrectionParams {
     static bool const Enabled = false;
+    static bool const Mesh = false;
+    static int const NumMeshPoints = 0;
 };
 
 APRINTER_ALIAS_STRUCT_EXT(BedProbeCorrectionParams, (
@@ -729,6 +1024,21 @@ APRINTER_ALIAS_STRUCT_EXT(BedProbeCorrectionParams, (
     APRINTER_AS_TYPE(QuadraticCorrectionEnabled)
 ), (
     static bool const Enabled = true;
+    static bool const Mesh = false;
+    static int const NumMeshPoints = 0;
+))
+
+APRINTER_ALIAS_STRUCT_EXT(BedProbeMeshCorrectionParams, (
+    APRINTER_AS_VALUE(int, PointsX),
+    APRINTER_AS_VALUE(int, PointsY),
+    APRINTER_AS_TYPE(MinX),
+    APRINTER_AS_TYPE(MaxX),
+    APRINTER_AS_TYPE(MinY),
+    APRINTER_AS_TYPE(MaxY)
+), (
+    static bool const Enabled = true;
+    static bool const Mesh = true;
+    static int const NumMeshPoints = PointsX * PointsY;
 ))
 
 APRINTER_ALIAS_STRUCT(BedProbePointParams, (
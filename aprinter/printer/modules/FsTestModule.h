@@ -52,7 +52,7 @@ private:
     using TheFsAccess = typename ThePrinterMain::template GetFsAccess<>;
     using TheBufferedFile = BufferedFile<Context, TheFsAccess>;
     
-    enum class State : uint8_t {IDLE, WRITE_OPEN, WRITE_DATA, WRITE_EOF, READ_OPEN, READ_DATA};
+    enum class State : uint8_t {IDLE, WRITE_OPEN, WRITE_DATA, WRITE_EOF, READ_OPEN, READ_SEEK, READ_DATA};
     
     static size_t const ReadBufferSize = 128;
     
@@ -123,6 +123,8 @@ private:
             if (o->write_data_size == 0) {
                 o->write_size = 0;
             }
+        } else {
+            o->read_offset = cmd->get_command_param_uint32(c, 'O', 0);
         }
         
         auto mode = is_write ? TheBufferedFile::OpenMode::OPEN_WRITE : TheBufferedFile::OpenMode::OPEN_READ;
@@ -143,11 +145,23 @@ private:
                 }
                 if (o->state == State::WRITE_OPEN) {
                     work_write(c);
-                } else {
+                }
+                else if (o->read_offset > 0) {
+                    o->buffered_file.startSeek(c, o->read_offset);
+                    o->state = State::READ_SEEK;
+                }
+                else {
                     work_read(c);
                 }
             } break;
             
+            case State::READ_SEEK: {
+                if (error != TheBufferedFile::Error::NO_ERROR) {
+                    return complete_command(c, AMBRO_PSTR("Seek"));
+                }
+                work_read(c);
+            } break;
+            
             case State::WRITE_DATA: {
                 if (error != TheBufferedFile::Error::NO_ERROR) {
                     return complete_command(c, AMBRO_PSTR("WriteData"));
@@ -216,6 +230,7 @@ public:
                 uint32_t write_size;
             };
             struct {
+                uint32_t read_offset;
                 char read_buffer[ReadBufferSize];
             };
         };
@@ -110,6 +110,9 @@ private:
             return cmd->finishCommand(c);
         }
         
+        // The expected size is optional, it lets the file be allocated contiguously.
+        o->prealloc_size = cmd->get_command_param_uint32(c, 'S', 0);
+        
         o->state = State::OPENING;
         o->file.startOpen(c, filename, true, TheBufferedFile::OpenMode::OPEN_WRITE);
     }
@@ -145,6 +148,7 @@ private:
                     o->file.reset(c);
                     o->state = State::IDLE;
                 } else {
+                    o->file.setPreallocationSize(c, o->prealloc_size);
                     o->state = State::READY;
                     cmd->startCapture(c, &GcodeUploadModule::captured_command_handler);
                     o->captured_stream = cmd;
@@ -330,6 +334,7 @@ public:
         State state;
         TheCommand *captured_stream;
         bool closing_for_command;
+        uint32_t prealloc_size;
         char command_buf[MaxCommandSize];
     };
 };
@@ -356,13 +356,17 @@ private:
                 break;
             }
             uint32_t seek_pos = cmd->get_command_param_uint32(c, 'S', 0);
-            if (seek_pos != 0) {
-                cmd->reportError(c, AMBRO_PSTR("CanOnlySeekToZero"));
+            // Packed binary moves depend on all preceding data.
+            if (seek_pos > 0 && !o->gcode_parser.canSeek(c)) {
+                cmd->reportError(c, AMBRO_PSTR("SdSeekNotSupported"));
                 break;
             }
-            if (!TheInput::rewind(c, cmd)) {
+            if (!TheInput::seek(c, seek_pos, cmd)) {
                 cmd->reportError(c, nullptr);
+                break;
             }
+            // The input starts at the beginning of the block, skip the rest.
+            o->m_skip_length = seek_pos % BlockSize;
         } while (false);
         cmd->finishCommand(c);
     }
@@ -388,6 +392,18 @@ private:
                 memcpy((char *)o->m_buffer + BufferBaseSize, (char *)o->m_buffer, MinValue(bytes_read - (BufferBaseSize - write_offset), WrapExtraSize));
             }
             o->m_length += bytes_read;
+            
+            if (o->m_skip_length > 0) {
+                // The parser may already have been started at the old buffer start,
+                // but it has not seen any data yet.
+                if (o->gcode_parser.haveCommand(c)) {
+                    o->gcode_parser.resetCommand(c);
+                }
+                size_t skip = MinValue(o->m_skip_length, o->m_length);
+                o->m_start = buf_add(o->m_start, skip);
+                o->m_length -= skip;
+                o->m_skip_length -= skip;
+            }
         }
         
         if (o->m_state == SDCARD_PAUSING) {
@@ -508,6 +524,7 @@ private:
         o->gcode_parser.init(c);
         o->m_start = 0;
         o->m_length = 0;
+        o->m_skip_length = 0;
     }
     
     static void deinit_buffering (Context c)
@@ -581,6 +598,7 @@ public:
         uint8_t m_retry_counter;
         size_t m_start;
         size_t m_length;
+        size_t m_skip_length;
         DataWordType m_buffer[BufferBaseSizeWords + WrapExtraSizeWords];
     };
 };
@@ -41,6 +41,22 @@
 
 #include <aprinter/BeginNamespace.h>
 
+/*
+ * G-code over a serial port.
+ * 
+ * By default every line is answered with "ok" once it has been processed,
+ * and the host waits for that before sending the next one. A host may switch
+ * to the streaming mode by sending M110 with W1 (and back with W0). In this
+ * mode the host keeps sending numbered lines with checksums as long as the
+ * bytes in flight fit into the window. There is no "ok"; instead credit
+ * reports "cr N<line> B<bytes> W<window>" tell the last line accepted, the
+ * number of bytes consumed from the receive buffer since the M110 (modulo
+ * 2^32, including the M110 line) and the number of bytes the host may have
+ * in flight. Reports are sent when a good part of the window has been freed
+ * and whenever the receive buffer drains. When a line is corrupted or
+ * missing, "rs N<line>" asks the host to resend starting with that line;
+ * lines until then are consumed and dropped without replies.
+ */
 template <typename ModuleArg>
 class SerialModule {
     APRINTER_UNPACK_MODULE_ARG(ModuleArg)
@@ -58,6 +74,8 @@ private:
     
     static_assert(SendSizeType::maxIntValue() >= ThePrinterMain::CommandSendBufClearance, "Serial send buffer is too small");
     
+    static size_t const StreamWindow = RecvSizeType::maxIntValue();
+    
 public:
     static void init (Context c)
     {
@@ -67,6 +85,11 @@ public:
         o->command_stream.init(c, &o->callback, &o->callback);
         o->m_recv_next_error = 0;
         o->m_line_number = 1;
+        o->m_streaming = false;
+        o->m_resend_pending = false;
+        o->m_line_dropped = false;
+        o->m_consumed_bytes = 0;
+        o->m_reported_bytes = 0;
     }
     
     static void deinit (Context c)
@@ -95,14 +118,11 @@ private:
             bool is_m110 = (o->gcode_parser.getCmdCode(c) == 'M' && o->gcode_parser.getCmdNumber(c) == 110);
             if (is_m110) {
                 o->m_line_number = o->command_stream.get_command_param_uint32(c, 'L', (o->gcode_parser.getCmd(c)->have_line_number ? o->gcode_parser.getCmd(c)->line_number : (uint32_t)-1));
+                o->m_resend_pending = false;
+                set_streaming(c, o->command_stream.get_command_param_uint32(c, 'W', o->m_streaming));
             }
-            if (o->gcode_parser.getCmd(c)->have_line_number) {
-                if (o->gcode_parser.getCmd(c)->line_number != o->m_line_number) {
-                    o->command_stream.reply_append_pstr(c, AMBRO_PSTR("Error:Line Number is not Last Line Number+1, Last Line:"));
-                    o->command_stream.reply_append_uint32(c, (uint32_t)(o->m_line_number - 1));
-                    o->command_stream.reply_append_ch(c, '\n');
-                    return false;
-                }
+            if (!check_line_number(c)) {
+                return false;
             }
             if (o->gcode_parser.getCmd(c)->have_line_number || is_m110) {
                 o->m_line_number++;
@@ -118,8 +138,54 @@ private:
             auto *o = Object::self(c);
             AMBRO_ASSERT(o->command_stream.hasCommand(c))
             
-            TheSerial::recvConsume(c, RecvSizeType::import(o->gcode_parser.getLength(c)));
+            size_t length = o->gcode_parser.getLength(c);
+            TheSerial::recvConsume(c, RecvSizeType::import(length));
             TheSerial::recvForceEvent(c);
+            
+            if (o->m_streaming) {
+                // Lines which failed to parse did not go through start_command_impl.
+                auto num_parts = o->gcode_parser.getNumParts(c);
+                if (num_parts == GCODE_ERROR_CHECKSUM || num_parts == GCODE_ERROR_RECV_OVERRUN) {
+                    drop_line(c);
+                } else if (num_parts < 0 && num_parts != GCODE_ERROR_NO_PARTS) {
+                    // The line arrived intact, so it is not to be resent.
+                    if (check_line_number(c) && o->gcode_parser.getCmd(c)->have_line_number) {
+                        o->m_line_number++;
+                    }
+                }
+                
+                o->m_consumed_bytes += length;
+                bool overrun;
+                bool report = ((uint32_t)(o->m_consumed_bytes - o->m_reported_bytes) >= StreamWindow / 4 || TheSerial::recvQuery(c, &overrun).value() == 0);
+                
+                if (o->m_line_dropped) {
+                    o->m_line_dropped = false;
+                    // While a resend is pending, the dropped lines are mostly ones which
+                    // were in flight, but the resent line may have been lost as well.
+                    // So the request is repeated along with the credit reports, and B
+                    // lets the host ignore it if it has already gone back since.
+                    if (!o->m_resend_pending || report) {
+                        o->m_resend_pending = true;
+                        o->command_stream.reply_append_pstr(c, AMBRO_PSTR("rs N"));
+                        o->command_stream.reply_append_uint32(c, o->m_line_number);
+                        o->command_stream.reply_append_pstr(c, AMBRO_PSTR(" B"));
+                        o->command_stream.reply_append_uint32(c, o->m_consumed_bytes);
+                        o->command_stream.reply_append_ch(c, '\n');
+                    }
+                }
+                
+                if (report) {
+                    o->m_reported_bytes = o->m_consumed_bytes;
+                    o->command_stream.reply_append_pstr(c, AMBRO_PSTR("cr N"));
+                    o->command_stream.reply_append_uint32(c, (uint32_t)(o->m_line_number - 1));
+                    o->command_stream.reply_append_pstr(c, AMBRO_PSTR(" B"));
+                    o->command_stream.reply_append_uint32(c, o->m_consumed_bytes);
+                    o->command_stream.reply_append_pstr(c, AMBRO_PSTR(" W"));
+                    o->command_stream.reply_append_uint32(c, StreamWindow);
+                    o->command_stream.reply_append_ch(c, '\n');
+                }
+                TheSerial::sendPoke(c);
+            }
         }
         
         void reply_poke_impl (Context c)
@@ -180,6 +246,48 @@ private:
         }
     };
     
+    static bool check_line_number (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        if (!o->gcode_parser.getCmd(c)->have_line_number) {
+            // Lines in flight behind a bad one are dropped until the resend.
+            return !o->m_resend_pending;
+        }
+        if (o->gcode_parser.getCmd(c)->line_number != o->m_line_number) {
+            if (o->m_streaming) {
+                drop_line(c);
+            } else {
+                o->command_stream.reply_append_pstr(c, AMBRO_PSTR("Error:Line Number is not Last Line Number+1, Last Line:"));
+                o->command_stream.reply_append_uint32(c, (uint32_t)(o->m_line_number - 1));
+                o->command_stream.reply_append_ch(c, '\n');
+            }
+            return false;
+        }
+        o->m_resend_pending = false;
+        return true;
+    }
+    
+    static void drop_line (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        // The resend is requested in finish_command_impl, once the byte count
+        // includes this line.
+        o->m_line_dropped = true;
+    }
+    
+    static void set_streaming (Context c, bool streaming)
+    {
+        auto *o = Object::self(c);
+        
+        o->m_streaming = streaming;
+        o->command_stream.setAutoOkAndPoke(c, !streaming);
+        o->m_consumed_bytes = 0;
+        // Make sure the host gets a report for the M110 right away.
+        o->m_reported_bytes = -(uint32_t)StreamWindow;
+    }
+    
     static void serial_recv_handler (Context c)
     {
         auto *o = Object::self(c);
@@ -221,6 +329,11 @@ public:
         StreamCallback callback;
         int8_t m_recv_next_error;
         uint32_t m_line_number;
+        bool m_streaming;
+        bool m_resend_pending;
+        bool m_line_dropped;
+        uint32_t m_consumed_bytes;
+        uint32_t m_reported_bytes;
     };
 };
 
@@ -46,6 +46,7 @@
 #include <aprinter/net/http/HttpServer.h>
 #include <aprinter/fs/BufferedFile.h>
 #include <aprinter/misc/StringTools.h>
+#include <aprinter/misc/CrcItuT.h>
 #include <aprinter/printer/ServiceList.h>
 #include <aprinter/printer/utils/JsonBuilder.h>
 #include <aprinter/printer/utils/ConvenientCommandStream.h>
@@ -130,6 +131,15 @@ private:
     
     using TheFsAccess = typename ThePrinterMain::template GetFsAccess<>;
     using TheBufferedFile = BufferedFile<Context, TheFsAccess>;
+    using TheCacheRef = typename TheBufferedFile::CacheRef;
+    
+    // Number of file blocks which may be pinned in the cache for each client,
+    // while their data is being sent directly from the cache. Zero means that
+    // data is copied into the send buffer.
+    static int const SendfileBlocks = Params::SendfileBlocks;
+    static_assert(SendfileBlocks >= 0, "");
+    static_assert(SendfileBlocks <= TheHttpServer::MaxTxExtChunks, "");
+    static int const PinRefsArraySize = MaxValue(1, SendfileBlocks);
     
     using TheWebRequest = WebRequest<Context>;
     using TheWebRequestCallback = WebRequestCallback<Context>;
@@ -148,9 +158,22 @@ private:
     static_assert(TheHttpServer::MaxTxChunkOverhead <= 255, "");
     static_assert(TheHttpServer::MaxGuaranteedBufferAvailBeforeHeadSent >= JsonBufferSize, "");
     static_assert(TheHttpServer::MaxTxChunkSize >= GetSdChunkSize, "");
+    static_assert(SendfileBlocks == 0 || TheHttpServer::MaxTxChunkSize >= TheFsAccess::TheFileSystem::BlockSize, "");
     
     static TimeType const GcodeSendBufTimeoutTicks = Params::GcodeSendBufTimeout::value() * Context::Clock::time_freq;
     
+    // Status streams (/rr_statusStream) keep a client and push the status
+    // as server-sent events. Each event has only the top-level members of the
+    // status which changed since the previous one, and a full status is sent
+    // at the start and periodically, under the event name "full".
+    static int const MaxStatusStreams = Params::MaxStatusStreams;
+    static_assert(MaxStatusStreams >= 0, "");
+    static TimeType const StatusStreamIntervalTicks = Params::StatusStreamInterval::value() * Context::Clock::time_freq;
+    static int const StatusStreamFullRefreshIntervals = MaxValue(1.0, 10.0 / Params::StatusStreamInterval::value());
+    static int const StatusStreamMaxMembers = 16;
+    static size_t const StatusStreamEventOverhead = 24;
+    static_assert(TheHttpServer::MaxTxChunkSize >= JsonBufferSize + StatusStreamEventOverhead, "");
+    
 public:
     static void init (Context c)
     {
@@ -160,6 +183,8 @@ public:
             slot.init(c);
         }
         
+        o->num_status_streams = 0;
+        
         TheHttpServer::init(c);
     }
     
@@ -199,6 +224,7 @@ private:
     
     static void http_request_handler (Context c, TheRequestInterface *request)
     {
+        auto *o = Object::self(c);
         char const *method = request->getMethod(c);
         MemRef path = request->getPath(c);
         UserClientState *state = request->getUserState(c);
@@ -214,6 +240,15 @@ private:
             }
 #endif
             
+            if (path.equalTo("/rr_statusStream")) {
+                if (o->num_status_streams >= MaxStatusStreams) {
+                    request->setResponseStatus(c, HttpStatusCodes::ServiceUnavailable());
+                    goto error;
+                }
+                
+                return state->acceptStatusStreamRequest(c, request);
+            }
+            
             if (path.removePrefix("/rr_")) {
                 return state->acceptJsonResponseRequest(c, request, path);
             }
@@ -229,7 +264,12 @@ private:
                 } else {
                     file_path = path.ptr + 1;
                 }
-                return state->acceptGetFileRequest(c, request, file_path, base_dir);
+                uint32_t offset = 0;
+                MemRef offset_str;
+                if (request->getParam(c, "offset", &offset_str) && !StringParseDecimal(offset_str, &offset)) {
+                    goto bad_params;
+                }
+                return state->acceptGetFileRequest(c, request, file_path, base_dir, offset);
             }
         }
         else if (!strcmp(method, "POST")) {
@@ -306,29 +346,41 @@ private:
     private:
         enum class State : uint8_t {
             NO_CLIENT,
-            READ_OPEN, READ_WAIT, READ_READ,
-            WRITE_OPEN, WRITE_WAIT, WRITE_WRITE, WRITE_EOF,
+            READ_OPEN, READ_SEEK, READ_WAIT, READ_READ, READ_PIN_WAIT, READ_PIN_READ,
+            WRITE_OPEN, WRITE_WAIT, WRITE_DIRECT, WRITE_PREPARE, WRITE_WRITE, WRITE_EOF,
             JSONRESP_WAITBUF, JSONRESP_CUSTOM_TRY, JSONRESP_CUSTOM,
-            GCODE,
+            GCODE, STATUS_STREAM,
             DL_TEST, UL_TEST
         };
         
-        enum class ResourceState : uint8_t {NONE, FILE, GCODE_SLOT, CUSTOM_REQ};
+        enum class ResourceState : uint8_t {NONE, FILE, GCODE_SLOT, CUSTOM_REQ, STATUS_STREAM};
         
     public:
         void init (Context c)
         {
             m_state = State::NO_CLIENT;
             m_resource_state = ResourceState::NONE;
+            for (TheCacheRef &ref : m_pin_refs) {
+                ref.init(c, TheCacheRef::CacheHandler::MakeNull());
+            }
+            m_stream_timer.init(c, APRINTER_CB_OBJFUNC_T(&UserClientState::stream_timer_handler, this));
         }
         
         void deinit (Context c)
         {
+            auto *o = Object::self(c);
+            
+            m_stream_timer.deinit(c);
+            for (TheCacheRef &ref : m_pin_refs) {
+                ref.deinit(c);
+            }
+            
             switch (m_resource_state) {
                 case ResourceState::NONE: break;
-                case ResourceState::FILE:       m_buffered_file.deinit(c);                     break;
-                case ResourceState::GCODE_SLOT: m_gcode_slot->detach(c);                       break;
-                case ResourceState::CUSTOM_REQ: m_custom_req.callback->cbRequestTerminated(c); break;
+                case ResourceState::FILE:          m_buffered_file.deinit(c);                     break;
+                case ResourceState::GCODE_SLOT:    m_gcode_slot->detach(c);                       break;
+                case ResourceState::CUSTOM_REQ:    m_custom_req.callback->cbRequestTerminated(c); break;
+                case ResourceState::STATUS_STREAM: o->num_status_streams--;                       break;
                 default: AMBRO_ASSERT(false);
             }
         }
@@ -364,11 +416,12 @@ private:
         }
         
     public:
-        void acceptGetFileRequest (Context c, TheRequestInterface *request, char const *file_path, char const *base_dir)
+        void acceptGetFileRequest (Context c, TheRequestInterface *request, char const *file_path, char const *base_dir, uint32_t offset)
         {
             accept_request_common(c, request);
             
             m_file_path = file_path;
+            m_read_offset = offset;
             m_state = State::READ_OPEN;
             init_file(c);
             m_buffered_file.startOpen(c, file_path, false, TheBufferedFile::OpenMode::OPEN_READ, base_dir);
@@ -395,6 +448,26 @@ private:
             m_request->controlResponseBodyTimeout(c, true);
         }
         
+        void acceptStatusStreamRequest (Context c, TheRequestInterface *request)
+        {
+            auto *o = Object::self(c);
+            AMBRO_ASSERT(o->num_status_streams < MaxStatusStreams)
+            
+            accept_request_common(c, request);
+            
+            o->num_status_streams++;
+            m_resource_state = ResourceState::STATUS_STREAM;
+            m_state = State::STATUS_STREAM;
+            m_stream.num_members = 0;
+            m_stream.intervals_since_full = 0;
+            m_stream.update_pending = true;
+            
+            m_request->setResponseContentType(c, "text/event-stream");
+            m_request->setResponseExtraHeaders(c, "Cache-Control: no-cache\r\n");
+            m_request->adoptResponseBody(c);
+            m_request->controlResponseBodyTimeout(c, true);
+        }
+        
         void acceptGcodeRequest (Context c, TheRequestInterface *request, GcodeSlot *gcode_slot)
         {
             accept_request_common(c, request);
@@ -437,21 +510,21 @@ private:
         void requestBufferEvent (Context c) override
         {
             switch (m_state) {
-                case State::WRITE_WAIT: {
-                    auto buf_st = m_request->getRequestBodyBufferState(c);
-                    if (buf_st.length > 0) {
-                        m_cur_chunk_size = MinValue(buf_st.data.wrap, buf_st.length);
-                        m_buffered_file.startWriteData(c, buf_st.data.ptr1, m_cur_chunk_size);
-                        m_state = State::WRITE_WRITE;
-                        m_request->controlRequestBodyTimeout(c, false);
-                    }
-                    else if (buf_st.eof) {
-                        m_buffered_file.startWriteEof(c);
-                        m_state = State::WRITE_EOF;
-                        m_request->controlRequestBodyTimeout(c, false);
+                case State::WRITE_DIRECT: {
+                    // Submit any data which was received directly into the file buffer.
+                    size_t length = m_request->takeRequestBodyDirectData(c);
+                    if (length > 0) {
+                        m_buffered_file.commitWriteBuffer(c, length);
+                        m_request->controlRequestBodyTimeout(c, true);
                     }
-                } break;
+                    m_state = State::WRITE_WAIT;
+                    return write_wait_event(c);
+                }
+                
+                case State::WRITE_WAIT:
+                    return write_wait_event(c);
                 
+                case State::WRITE_PREPARE:
                 case State::WRITE_WRITE:
                 case State::WRITE_EOF:
                     break;
@@ -491,7 +564,22 @@ private:
                     }
                 } break;
                 
+                case State::READ_PIN_WAIT: {
+                    release_sent_pins(c);
+                    if (m_pin_eof) {
+                        if (m_num_pins == 0) {
+                            return complete_request(c);
+                        }
+                    }
+                    else if (m_num_pins < SendfileBlocks && m_request->haveResponseBodyExtSpace(c)) {
+                        m_buffered_file.startReadPinned(c, &m_pin_refs[pin_index(m_num_pins)], &m_pin_data);
+                        m_state = State::READ_PIN_READ;
+                        m_request->controlResponseBodyTimeout(c, false);
+                    }
+                } break;
+                
                 case State::READ_READ:
+                case State::READ_PIN_READ:
                     break;
                 
                 case State::JSONRESP_WAITBUF: {
@@ -552,6 +640,25 @@ private:
                 case State::GCODE:
                     return m_gcode_slot->responseBufferEvent(c);
                 
+                case State::STATUS_STREAM: {
+                    if (!m_stream.update_pending) {
+                        return;
+                    }
+                    auto buf_st = m_request->getResponseBodyBufferState(c);
+                    if (buf_st.length < JsonBufferSize + StatusStreamEventOverhead) {
+                        return;
+                    }
+                    
+                    m_stream.update_pending = false;
+                    m_request->controlResponseBodyTimeout(c, false);
+                    
+                    if (!send_status_event(c, buf_st.data)) {
+                        return complete_request(c);
+                    }
+                    
+                    m_stream_timer.appendAfter(c, StatusStreamIntervalTicks);
+                } break;
+                
 #if APRINTER_ENABLE_HTTP_TEST
                 case State::DL_TEST: {
                     while (true) {
@@ -581,6 +688,7 @@ private:
             
             switch (m_state) {
                 case State::READ_OPEN:
+                case State::READ_SEEK:
                 case State::WRITE_OPEN: {
                     if (error != TheBufferedFile::Error::NO_ERROR) {
                         auto status = (error == TheBufferedFile::Error::NOT_FOUND) ? HttpStatusCodes::NotFound() : HttpStatusCodes::InternalServerError();
@@ -588,14 +696,32 @@ private:
                         return complete_request(c);
                     }
                     
-                    if (m_state == State::READ_OPEN) {
+                    if (m_state == State::READ_OPEN && m_read_offset > 0) {
+                        m_state = State::READ_SEEK;
+                        m_buffered_file.startSeek(c, m_read_offset);
+                        return;
+                    }
+                    
+                    if (m_state != State::WRITE_OPEN) {
                         m_request->setResponseContentType(c, get_content_type(m_file_path));
                         m_request->adoptResponseBody(c);
                         
-                        m_state = State::READ_WAIT;
-                        m_cur_chunk_size = 0;
+                        if (SendfileBlocks > 0) {
+                            m_state = State::READ_PIN_WAIT;
+                            m_first_pin = 0;
+                            m_num_pins = 0;
+                            m_pin_eof = false;
+                        } else {
+                            m_state = State::READ_WAIT;
+                            m_cur_chunk_size = 0;
+                        }
                         m_request->controlResponseBodyTimeout(c, true);
                     } else {
+                        uint64_t body_length;
+                        if (m_request->getRequestBodyLength(c, &body_length)) {
+                            m_buffered_file.setPreallocationSize(c, MinValue(body_length, (uint64_t)UINT32_MAX));
+                        }
+                        
                         m_request->adoptRequestBody(c);
                         
                         m_state = State::WRITE_WAIT;
@@ -626,6 +752,28 @@ private:
                     m_request->pokeResponseBodyBufferEvent(c);
                 } break;
                 
+                case State::READ_PIN_READ: {
+                    // On error, end the response like at the end of the file, once
+                    // the data already provided has been sent.
+                    if (error != TheBufferedFile::Error::NO_ERROR) {
+                        ThePrinterMain::print_pgm_string(c, AMBRO_PSTR("//HttpSdReadError\n"));
+                        m_pin_eof = true;
+                    }
+                    else if (read_length == 0) {
+                        m_pin_eof = true;
+                    }
+                    else {
+                        // The block is now pinned by the ref and we send from it directly.
+                        m_request->provideResponseBodyExtData(c, MemRef(m_pin_data, read_length));
+                        m_num_pins++;
+                    }
+                    
+                    m_state = State::READ_PIN_WAIT;
+                    m_request->controlResponseBodyTimeout(c, true);
+                    m_request->pokeResponseBodyBufferEvent(c);
+                } break;
+                
+                case State::WRITE_PREPARE:
                 case State::WRITE_WRITE:
                 case State::WRITE_EOF: {
                     if (error != TheBufferedFile::Error::NO_ERROR) {
@@ -638,7 +786,9 @@ private:
                         return complete_request(c);
                     }
                     
-                    m_request->acceptRequestBodyData(c, m_cur_chunk_size);
+                    if (m_state == State::WRITE_WRITE) {
+                        m_request->acceptRequestBodyData(c, m_cur_chunk_size);
+                    }
                     
                     m_state = State::WRITE_WAIT;
                     m_request->controlRequestBodyTimeout(c, true);
@@ -649,6 +799,150 @@ private:
             }
         }
         
+        int pin_index (int i)
+        {
+            int x = m_first_pin + i;
+            if (x >= SendfileBlocks) {
+                x -= SendfileBlocks;
+            }
+            return x;
+        }
+        
+        // Unpins the blocks whose data has been sent and acknowledged. These
+        // are the oldest ones, since the data is acknowledged in order.
+        void release_sent_pins (Context c)
+        {
+            while (m_num_pins > m_request->getResponseBodyExtPending(c)) {
+                m_pin_refs[m_first_pin].reset(c);
+                m_first_pin = pin_index(1);
+                m_num_pins--;
+            }
+        }
+        
+        void write_wait_event (Context c)
+        {
+            auto buf_st = m_request->getRequestBodyBufferState(c);
+            if (buf_st.length > 0) {
+                m_cur_chunk_size = MinValue(buf_st.data.wrap, buf_st.length);
+                m_buffered_file.startWriteData(c, buf_st.data.ptr1, m_cur_chunk_size);
+                m_state = State::WRITE_WRITE;
+                m_request->controlRequestBodyTimeout(c, false);
+            }
+            else if (buf_st.eof) {
+                m_buffered_file.startWriteEof(c);
+                m_state = State::WRITE_EOF;
+                m_request->controlRequestBodyTimeout(c, false);
+            }
+            else {
+                // Have further data received straight into the file buffer,
+                // first starting the next block if the current one is full.
+                size_t space;
+                char *write_buf = m_buffered_file.getWriteBuffer(c, &space);
+                if (space > 0) {
+                    m_request->setRequestBodyDirectBuffer(c, write_buf, space);
+                    m_state = State::WRITE_DIRECT;
+                } else {
+                    m_buffered_file.startPrepareWrite(c);
+                    m_state = State::WRITE_PREPARE;
+                    m_request->controlRequestBodyTimeout(c, false);
+                }
+            }
+        }
+        
+        void stream_timer_handler (Context c)
+        {
+            AMBRO_ASSERT(m_state == State::STATUS_STREAM)
+            AMBRO_ASSERT(!m_stream.update_pending)
+            
+            m_stream.update_pending = true;
+            m_request->controlResponseBodyTimeout(c, true);
+            m_request->pokeResponseBodyBufferEvent(c);
+        }
+        
+        // Renders the status and writes an event with the changed members
+        // into the response buffer, if there is anything to send.
+        bool send_status_event (Context c, WrapBuffer out)
+        {
+            auto *o = Object::self(c);
+            
+            JsonBuilder json;
+            json.loadBuffer(o->json_buffer, sizeof(o->json_buffer));
+            json.start();
+            json.startObject();
+            ThePrinterMain::get_json_status(c, &json);
+            json.endObject();
+            
+            size_t length = json.getLength();
+            if (length > JsonBufferSize) {
+                ThePrinterMain::print_pgm_string(c, AMBRO_PSTR("//HttpJsonBufOverrun\n"));
+                return false;
+            }
+            
+            // Find the top-level members, the last one taking any excess members.
+            size_t member_start[StatusStreamMaxMembers + 1];
+            member_start[0] = 1;
+            int num_members = (length > 2);
+            bool in_string = false;
+            int depth = 0;
+            for (size_t i = 1; i + 1 < length; i++) {
+                char ch = o->json_buffer[i];
+                if (in_string) {
+                    if (ch == '\\') {
+                        i++;
+                    } else if (ch == '"') {
+                        in_string = false;
+                    }
+                }
+                else if (ch == '"') {
+                    in_string = true;
+                }
+                else if (ch == '{' || ch == '[') {
+                    depth++;
+                }
+                else if (ch == '}' || ch == ']') {
+                    depth--;
+                }
+                else if (ch == ',' && depth == 0 && num_members < StatusStreamMaxMembers) {
+                    member_start[num_members++] = i + 1;
+                }
+            }
+            member_start[num_members] = length;
+            
+            bool full = (num_members != m_stream.num_members || ++m_stream.intervals_since_full >= StatusStreamFullRefreshIntervals);
+            if (full) {
+                m_stream.num_members = num_members;
+                m_stream.intervals_since_full = 0;
+            }
+            
+            size_t out_pos = 0;
+            auto out_str = [&](MemRef str) {
+                out.subFrom(out_pos).copyIn(str);
+                out_pos += str.len;
+            };
+            
+            for (int i = 0; i < num_members; i++) {
+                // The member text is without the trailing comma (or closing brace).
+                MemRef member(o->json_buffer + member_start[i], member_start[i + 1] - 1 - member_start[i]);
+                uint16_t hash = CrcItuTUpdate(CrcItuTInitial, member.ptr, member.len);
+                if (!full && hash == m_stream.member_hashes[i]) {
+                    continue;
+                }
+                m_stream.member_hashes[i] = hash;
+                out_str(out_pos == 0 ? (full ? MemRef("event: full\ndata: {") : MemRef("data: {")) : MemRef(","));
+                out_str(member);
+            }
+            
+            if (out_pos == 0 && full) {
+                out_str(MemRef("event: full\ndata: {"));
+            }
+            if (out_pos > 0) {
+                out_str(MemRef("}\n\n"));
+                m_request->provideResponseBodyData(c, out_pos);
+            }
+            
+            return true;
+        }
+        
         void load_json_buffer (Context c)
         {
             auto *o = Object::self(c);
@@ -773,7 +1067,12 @@ private:
         union {
             struct {
                 char const *m_file_path;
+                uint32_t m_read_offset;
                 size_t m_cur_chunk_size;
+                char const *m_pin_data;
+                int m_first_pin;
+                int m_num_pins;
+                bool m_pin_eof;
             };
             struct {
                 MemRef req_type;
@@ -781,7 +1080,15 @@ private:
                 bool resp_body_pending;
                 bool custom_waiting;
             } m_json_req;
+            struct {
+                uint16_t member_hashes[StatusStreamMaxMembers];
+                uint8_t num_members;
+                int intervals_since_full;
+                bool update_pending;
+            } m_stream;
         };
+        TheCacheRef m_pin_refs[PinRefsArraySize];
+        typename Context::EventLoop::TimedEvent m_stream_timer;
     };
     
     static GcodeSlot * find_available_gcode_slot (Context c)
@@ -1021,6 +1328,7 @@ public:
         TheHttpServer
     >> {
         GcodeSlot gcode_slots[NumGcodeSlots];
+        int num_status_streams;
         char json_buffer[JsonBufferSize + 2];
     };
 };
@@ -1031,7 +1339,10 @@ APRINTER_ALIAS_STRUCT_EXT(WebInterfaceModuleService, (
     APRINTER_AS_VALUE(int, NumGcodeSlots),
     APRINTER_AS_TYPE(TheGcodeParserService),
     APRINTER_AS_VALUE(size_t, MaxGcodeCommandSize),
-    APRINTER_AS_TYPE(GcodeSendBufTimeout)
+    APRINTER_AS_TYPE(GcodeSendBufTimeout),
+    APRINTER_AS_VALUE(int, SendfileBlocks),
+    APRINTER_AS_VALUE(int, MaxStatusStreams),
+    APRINTER_AS_TYPE(StatusStreamInterval)
 ), (
     APRINTER_MODULE_TEMPLATE(WebInterfaceModuleService, WebInterfaceModule)
 ))
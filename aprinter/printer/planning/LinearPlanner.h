@@ -76,6 +76,14 @@ struct LinearPlanner {
         return FloatMin(segment->max_start_v, end_v + segment->a_x);
     }
 
+    // Returns true if push() for this segment with the given end_v would
+    // give the same result as the last push(), meaning that the states of
+    // the preceding segments are also still valid.
+    static bool pushIsNoop (SegmentState const *s, FpType end_v)
+    {
+        return s->end_v == end_v;
+    }
+
     static FpType pull (SegmentData *segment, SegmentState *s, FpType start_v, SegmentResult *result)
     {
         AMBRO_ASSERT(s->end_v <= segment->max_v)
@@ -1230,16 +1230,26 @@ private:
         AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) { AMBRO_ASSERT(planner_have_commit_space(c)) }
 #endif
         
+        // Backward pass. The segments before m_segments_staging_length have been
+        // pushed in the previous plan() and only their end speed limits can have
+        // changed since (due to the newly added segments). Once we reach such a
+        // segment whose end speed limit did not change, all further ones are still
+        // valid, so we can stop there.
         SegmentBufferSizeType i = o->m_segments_length;
         FpType v = 0.0f;
         do {
             i--;
-            Segment *entry = &o->m_segments[segments_add(o->m_segments_start, i)];
+            SegmentBufferSizeType index = segments_add(o->m_segments_start, i);
+            Segment *entry = &o->m_segments[index];
             if (AMBRO_LIKELY((entry->dir_and_type & TypeMask) == 0)) {
-                v = TheLinearPlanner::push(&entry->axes.lp_seg, &o->m_segment_state[i], v);
+                if (i < o->m_segments_staging_length && TheLinearPlanner::pushIsNoop(&o->m_segment_state[index], v)) {
+                    break;
+                }
+                v = TheLinearPlanner::push(&entry->axes.lp_seg, &o->m_segment_state[index], v);
             }
         } while (i != 0);
         
+        i = 0;
         SegmentBufferSizeType commit_count = MinValue(o->m_segments_length, (SegmentBufferSizeType)LookaheadCommitCount);
         
         o->m_new_to_backup = false;
@@ -1251,10 +1261,11 @@ private:
         FpType v_start = o->m_staging_v;
         
         do {
-            Segment *entry = &o->m_segments[segments_add(o->m_segments_start, i)];
+            SegmentBufferSizeType index = segments_add(o->m_segments_start, i);
+            Segment *entry = &o->m_segments[index];
             if (AMBRO_LIKELY((entry->dir_and_type & TypeMask) == 0)) {
                 typename TheLinearPlanner::SegmentResult result;
-                v = TheLinearPlanner::pull(&entry->axes.lp_seg, &o->m_segment_state[i], v, &result);
+                v = TheLinearPlanner::pull(&entry->axes.lp_seg, &o->m_segment_state[index], v, &result);
                 FpType v_end = FloatSqrt(v);
                 FpType v_const = FloatSqrt(result.const_v);
                 FpType vdiff0 = v_const - v_start;
@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2013 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef AMBROLIB_SOFT_PWM_MUX_H
+#define AMBROLIB_SOFT_PWM_MUX_H
+
+#include <stdint.h>
+
+#include <aprinter/meta/WrapFunction.h>
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/TypeListUtils.h>
+#include <aprinter/meta/ListForEach.h>
+#include <aprinter/meta/ChooseInt.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Lock.h>
+#include <aprinter/base/Hints.h>
+#include <aprinter/system/InterruptLock.h>
+
+#include <aprinter/BeginNamespace.h>
+
+template <typename TPin, bool TInvert>
+struct SoftPwmMuxChannel {
+    using Pin = TPin;
+    static bool const Invert = TInvert;
+};
+
+/**
+ * Software PWM for a number of pins, all driven from a single interrupt timer.
+ *
+ * All channels share the same period. At the start of each period, all
+ * channels with nonzero duty are turned on, and for the channels with
+ * a partial duty cycle, the turn-off edges are processed in the order of
+ * their times. Edges closer than EdgeTolerance to the first edge of a group
+ * are coalesced into that edge, so that they are handled in one interrupt
+ * (shortening the pulses of the later channels by at most EdgeTolerance).
+ *
+ * Duty cycle changes are latched and applied together at the start of the
+ * next period, which is also the only time the edge list is rebuilt.
+ */
+template <typename Arg>
+class SoftPwmMux {
+    using Context      = typename Arg::Context;
+    using ParentObject = typename Arg::ParentObject;
+    using ChannelsList = typename Arg::ChannelsList;
+    using Params       = typename Arg::Params;
+
+private:
+    struct TimerHandler;
+
+public:
+    struct Object;
+
+private:
+    using TheDebugObject = DebugObject<Context, Object>;
+
+public:
+    using Clock = typename Context::Clock;
+    using TimeType = typename Clock::TimeType;
+    APRINTER_MAKE_INSTANCE(TheTimer, (Params::TimerService::template InterruptTimer<Context, Object, TimerHandler>))
+    
+    static int const NumChannels = TypeListLength<ChannelsList>::Value;
+    static_assert(NumChannels > 0 && NumChannels <= 32, "");
+    
+    struct DutyCycleData {
+        TimeType on_time;
+        uint8_t type;
+    };
+    
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        for (int i = 0; i < NumChannels; i++) {
+            o->m_duty[i].type = 0;
+            o->m_pending[i].type = 0;
+            o->m_order[i] = i;
+        }
+        o->m_pending_changed = false;
+        o->m_on_mask = 0;
+        o->m_num_edges = 0;
+        o->m_edge_pos = 0;
+        ListFor<ChannelHelperList>([&] APRINTER_TL(channel, channel::init_pin(c)));
+        TheTimer::init(c);
+        o->m_period_start = Clock::getTime(c);
+        TheTimer::setFirst(c, o->m_period_start);
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        TheDebugObject::deinit(c);
+        
+        TheTimer::deinit(c);
+        ListFor<ChannelHelperList>([&] APRINTER_TL(channel, channel::set_pin(c, false)));
+    }
+    
+    static void computeZeroDutyCycle (DutyCycleData *duty)
+    {
+        duty->type = 0;
+        duty->on_time = 0;
+    }
+    
+    template <typename FpType>
+    static void computeDutyCycle (FpType frac, DutyCycleData *duty)
+    {
+        if (!(frac > 0.005f)) {
+            duty->type = 0;
+            duty->on_time = 0;
+        } else {
+            if (!(frac < 0.995f)) {
+                duty->type = 2;
+                duty->on_time = 0;
+            } else {
+                duty->type = 1;
+                duty->on_time = frac * (FpType)Interval;
+            }
+        }
+    }
+    
+    template <int ChannelIndex, typename ThisContext>
+    static void setDutyCycle (ThisContext c, DutyCycleData duty)
+    {
+        auto *o = Object::self(c);
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            o->m_pending[ChannelIndex] = duty;
+            o->m_pending_changed = true;
+        }
+    }
+    
+    template <int ChannelIndex, typename ThisContext>
+    static void disableChannel (ThisContext c)
+    {
+        auto *o = Object::self(c);
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            o->m_pending[ChannelIndex].type = 0;
+            o->m_pending_changed = true;
+            ChannelHelper<ChannelIndex>::set_pin(lock_c, false);
+        }
+    }
+    
+    template <int ChannelIndex, typename FpType>
+    static FpType getCurrentDutyFp (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        DutyCycleData duty;
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            duty = o->m_pending[ChannelIndex];
+        }
+        
+        return (duty.type == 0) ? 0.0f :
+               (duty.type == 2) ? 1.0f :
+               (duty.on_time / (FpType)Interval);
+    }
+    
+    template <int ChannelIndex>
+    static void emergency ()
+    {
+        using TheChannel = TypeListGet<ChannelsList, ChannelIndex>;
+        Context::Pins::template emergencySet<typename TheChannel::Pin>(TheChannel::Invert);
+    }
+
+private:
+    using MaskType = ChooseInt<NumChannels, false>;
+    
+    static TimeType const Interval = Params::PulseInterval::value() / Clock::time_unit;
+    static TimeType const Tolerance = Params::EdgeTolerance::value() / Clock::time_unit;
+    
+    template <int ChannelIndex>
+    struct ChannelHelper {
+        using TheChannel = TypeListGet<ChannelsList, ChannelIndex>;
+        static MaskType const Mask = (MaskType)1 << ChannelIndex;
+        
+        static void init_pin (Context c)
+        {
+            Context::Pins::template set<typename TheChannel::Pin>(c, TheChannel::Invert);
+            Context::Pins::template setOutput<typename TheChannel::Pin>(c);
+        }
+        
+        template <typename ThisContext>
+        static void set_pin (ThisContext c, bool on)
+        {
+            Context::Pins::template set<typename TheChannel::Pin>(c, on != TheChannel::Invert);
+        }
+        
+        template <typename ThisContext>
+        static void set_pin_masked (ThisContext c, MaskType mask, MaskType on_mask)
+        {
+            if ((mask & Mask)) {
+                set_pin(c, (on_mask & Mask));
+            }
+        }
+    };
+    
+    using ChannelHelperList = IndexElemList<ChannelsList, ChannelHelper>;
+    
+    struct Edge {
+        TimeType time;
+        MaskType mask;
+    };
+    
+    static void rebuild_edges (Object *o)
+    {
+        // Insertion sort of the channels by turn-off time, with the channels
+        // without an edge last. The previous order is the starting point, so
+        // this is fast when only a few duty cycles have changed.
+        for (int i = 1; i < NumChannels; i++) {
+            uint8_t ch = o->m_order[i];
+            TimeType key = edge_key(o, ch);
+            int j = i;
+            while (j > 0 && edge_key(o, o->m_order[j - 1]) > key) {
+                o->m_order[j] = o->m_order[j - 1];
+                j--;
+            }
+            o->m_order[j] = ch;
+        }
+        
+        MaskType on_mask = 0;
+        uint8_t num_edges = 0;
+        for (int i = 0; i < NumChannels; i++) {
+            uint8_t ch = o->m_order[i];
+            MaskType bit = (MaskType)1 << ch;
+            DutyCycleData const *duty = &o->m_duty[ch];
+            if (duty->type != 0) {
+                on_mask |= bit;
+            }
+            if (duty->type == 1) {
+                if (num_edges > 0 && (TimeType)(duty->on_time - o->m_edges[num_edges - 1].time) <= Tolerance) {
+                    o->m_edges[num_edges - 1].mask |= bit;
+                } else {
+                    o->m_edges[num_edges].time = duty->on_time;
+                    o->m_edges[num_edges].mask = bit;
+                    num_edges++;
+                }
+            }
+        }
+        o->m_on_mask = on_mask;
+        o->m_num_edges = num_edges;
+    }
+    
+    static TimeType edge_key (Object *o, uint8_t ch)
+    {
+        return (o->m_duty[ch].type == 1) ? o->m_duty[ch].on_time : Interval;
+    }
+    
+    static bool timer_handler (typename TheTimer::HandlerContext c)
+    {
+        auto *o = Object::self(c);
+        
+        TimeType next_time;
+        if (AMBRO_UNLIKELY(o->m_edge_pos == o->m_num_edges)) {
+            bool changed = false;
+            AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+                if (o->m_pending_changed) {
+                    for (int i = 0; i < NumChannels; i++) {
+                        o->m_duty[i] = o->m_pending[i];
+                    }
+                    o->m_pending_changed = false;
+                    changed = true;
+                }
+            }
+            if (changed) {
+                rebuild_edges(o);
+            }
+            MaskType on_mask = o->m_on_mask;
+            ListFor<ChannelHelperList>([&] APRINTER_TL(channel, channel::set_pin_masked(c, (MaskType)-1, on_mask)));
+            o->m_edge_pos = 0;
+        } else {
+            MaskType mask = o->m_edges[o->m_edge_pos].mask;
+            ListFor<ChannelHelperList>([&] APRINTER_TL(channel, channel::set_pin_masked(c, mask, 0)));
+            o->m_edge_pos++;
+        }
+        if (o->m_edge_pos < o->m_num_edges) {
+            next_time = o->m_period_start + o->m_edges[o->m_edge_pos].time;
+        } else {
+            o->m_period_start += Interval;
+            next_time = o->m_period_start;
+        }
+        TheTimer::setNext(c, next_time);
+        return true;
+    }
+    
+    struct TimerHandler : public AMBRO_WFUNC_TD(&SoftPwmMux::timer_handler) {};
+
+public:
+    struct Object : public ObjBase<SoftPwmMux, ParentObject, MakeTypeList<
+        TheDebugObject,
+        TheTimer
+    >> {
+        DutyCycleData m_duty[NumChannels];
+        DutyCycleData m_pending[NumChannels];
+        bool m_pending_changed;
+        uint8_t m_order[NumChannels];
+        Edge m_edges[NumChannels];
+        uint8_t m_num_edges;
+        uint8_t m_edge_pos;
+        MaskType m_on_mask;
+        TimeType m_period_start;
+    };
+};
+
+APRINTER_ALIAS_STRUCT_EXT(SoftPwmMuxService, (
+    APRINTER_AS_TYPE(PulseInterval),
+    APRINTER_AS_TYPE(EdgeTolerance),
+    APRINTER_AS_TYPE(TimerService)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(Mux, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(ChannelsList)
+    ), (
+        using Params = SoftPwmMuxService;
+        APRINTER_DEF_INSTANCE(Mux, SoftPwmMux)
+    ))
+))
+
+/**
+ * PWM output using one channel of the SoftPwmMux available as
+ * Context::SoftPwmMux. It provides the same interface as SoftPwm.
+ */
+template <typename Arg>
+class SoftPwmMuxPwm {
+    using Context      = typename Arg::Context;
+    using ParentObject = typename Arg::ParentObject;
+    using Params       = typename Arg::Params;
+    
+    using Mux = typename Context::SoftPwmMux;
+    static int const ChannelIndex = Params::ChannelIndex;
+
+public:
+    struct Object;
+
+private:
+    using TheDebugObject = DebugObject<Context, Object>;
+
+public:
+    using TimeType = typename Mux::TimeType;
+    using DutyCycleData = typename Mux::DutyCycleData;
+    
+    static void init (Context c, TimeType start_time)
+    {
+        DutyCycleData duty;
+        computeZeroDutyCycle(&duty);
+        Mux::template setDutyCycle<ChannelIndex>(c, duty);
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        TheDebugObject::deinit(c);
+        
+        Mux::template disableChannel<ChannelIndex>(c);
+    }
+    
+    static void computeZeroDutyCycle (DutyCycleData *duty)
+    {
+        Mux::computeZeroDutyCycle(duty);
+    }
+    
+    template <typename FpType>
+    static void computeDutyCycle (FpType frac, DutyCycleData *duty)
+    {
+        Mux::computeDutyCycle(frac, duty);
+    }
+    
+    template <typename ThisContext>
+    static void setDutyCycle (ThisContext c, DutyCycleData duty)
+    {
+        Mux::template setDutyCycle<ChannelIndex>(c, duty);
+    }
+    
+    template <typename FpType>
+    static FpType getCurrentDutyFp (Context c)
+    {
+        return Mux::template getCurrentDutyFp<ChannelIndex, FpType>(c);
+    }
+    
+    static void emergency ()
+    {
+        Mux::template emergency<ChannelIndex>();
+    }
+
+public:
+    struct Object : public ObjBase<SoftPwmMuxPwm, ParentObject, MakeTypeList<
+        TheDebugObject
+    >> {};
+};
+
+APRINTER_ALIAS_STRUCT_EXT(SoftPwmMuxPwmService, (
+    APRINTER_AS_VALUE(int, ChannelIndex)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(Pwm, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject)
+    ), (
+        using Params = SoftPwmMuxPwmService;
+        APRINTER_DEF_INSTANCE(Pwm, SoftPwmMuxPwm)
+    ))
+))
+
+#include <aprinter/EndNamespace.h>
+
+#endif
@@ -25,7 +25,14 @@
 #ifndef AMBROLIB_GENERIC_THERMISTOR_H
 #define AMBROLIB_GENERIC_THERMISTOR_H
 
+#include <stdint.h>
+
 #include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/StructIf.h>
+#include <aprinter/meta/StaticArray.h>
+#include <aprinter/meta/ConstexprMath.h>
+#include <aprinter/meta/PowerOfTwo.h>
+#include <aprinter/base/Object.h>
 #include <aprinter/math/FloatTools.h>
 #include <aprinter/printer/Configuration.h>
 
@@ -34,6 +41,7 @@
 template <typename Arg>
 class GenericThermistor {
     using Context      = typename Arg::Context;
+    using ParentObject = typename Arg::ParentObject;
     using Config       = typename Arg::Config;
     using FpType       = typename Arg::FpType;
     using Params       = typename Arg::Params;
@@ -47,12 +55,68 @@ class GenericThermistor {
     template <typename Temp>
     static auto FracThermistor (Temp) -> decltype((RInf() * ExprExp(Config::e(Params::ThermistorBeta::i()) / (Temp() + ZeroCelsiusTemp()))) / Config::e(Params::ResistorR::i()));
     
+    // Table mode: the temperature is interpolated from a table of temperatures
+    // at 2^TableBits+1 evenly spaced ADC values. The table is computed at compile
+    // time and stored in program memory if the configuration is constant,
+    // otherwise it is in RAM and is recomputed when the configuration changes.
+    static int const TableBits = Params::TableBits;
+    static_assert(TableBits >= 0 && TableBits <= 10, "");
+    static bool const UseTable = (TableBits > 0);
+    static int const TableSize = PowerOfTwo<int, TableBits>::Value + 1;
+    
+    // Table entries are temperatures in units of 1/16 degree. Entries are
+    // limited to a range which is wider than that of any useful temperature.
+    using TableEntryType = int16_t;
+    static constexpr double TableTempScale () { return 16.0; }
+    static constexpr double TableTempLimit () { return 2000.0; }
+    
+    // The ADC values at the ends of the table are moved inward slightly,
+    // and the log term is bounded from below, to keep the formula finite.
+    static constexpr double TableAdcMargin () { return 1.0 / 1048576.0; }
+    using TableMinDenom = APRINTER_FP_CONST_EXPR(0.001);
+    
+    template <typename Adc>
+    static auto TableTemp (Adc) -> decltype(Config::e(Params::ThermistorBeta::i()) / ExprFmax(ExprLog(Adc() / (One() - Adc())) + ExprLog(Config::e(Params::ResistorR::i()) / RInf()), TableMinDenom()) - ZeroCelsiusTemp());
+    
+    template <int Index>
+    struct TableAdcValue {
+        static constexpr double value () { return ConstexprFmin(ConstexprFmax((double)Index / (TableSize - 1), TableAdcMargin()), 1.0 - TableAdcMargin()); }
+    };
+    
+    template <int Index>
+    using TableAdc = DoubleConstantExpr<TableAdcValue<Index>>;
+    
+    static constexpr TableEntryType table_entry (double temp)
+    {
+        return ConstexprRound(ConstexprFmin(ConstexprFmax(temp, -TableTempLimit()), TableTempLimit()) * TableTempScale());
+    }
+    
+    template <int Index>
+    struct TableElem {
+        using TempExpr = decltype(TableTemp(TableAdc<Index>()));
+        static_assert(TempExpr::IsConstexpr, "");
+        
+        static constexpr TableEntryType value () { return table_entry(TempExpr::value()); }
+    };
+    
+    static bool const UseRamTable = UseTable && !decltype(Config::e(Params::ThermistorBeta::i()) * Config::e(Params::ThermistorR0::i()) * Config::e(Params::ResistorR::i()))::IsConstexpr;
+    
 public:
     static bool const NegativeSlope = true;
     
     template <typename Temp>
     static auto TempToAdc (Temp) -> decltype(FracThermistor(Temp()) / (One() + FracThermistor(Temp())));
     
+    static void init (Context c)
+    {
+        RamTableFeature::update(c);
+    }
+    
+    static void configuration_changed (Context c)
+    {
+        RamTableFeature::update(c);
+    }
+    
     static FpType adcToTemp (Context c, FpType adc)
     {
         if (!(adc >= APRINTER_CFG(Config, CAdcMaxTemp, c))) {
@@ -65,16 +129,100 @@ public:
         return (APRINTER_CFG(Config, CThermistorBeta, c) / (FloatLog(frac_thermistor) + APRINTER_CFG(Config, CLogRByRInf, c))) - 273.15f;
     }
     
+    // Converts an ADC value given as adc_bits/2^AdcBits. In table mode this
+    // uses fixed-point interpolation in the table, otherwise it is the same
+    // as adcToTemp.
+    template <int AdcBits>
+    static FpType adcBitsToTemp (Context c, uint32_t adc_bits)
+    {
+        return TableFeature::template adc_bits_to_temp<AdcBits>(c, adc_bits);
+    }
+    
 private:
+    AMBRO_STRUCT_IF(TableFeature, UseTable) {
+        template <int AdcBits>
+        static FpType adc_bits_to_temp (Context c, uint32_t adc_bits)
+        {
+            static int const FracBits = AdcBits - TableBits;
+            static_assert(FracBits >= 0 && FracBits <= 14, "");
+            AMBRO_ASSERT(adc_bits < (PowerOfTwo<uint32_t, AdcBits>::Value))
+            
+            int index = adc_bits >> FracBits;
+            int32_t frac = adc_bits & PowerOfTwoMinusOne<uint32_t, FracBits>::Value;
+            int32_t temp0 = RamTableFeature::read(c, index);
+            int32_t temp1 = RamTableFeature::read(c, index + 1);
+            int32_t temp_fixed = temp0 + (((temp1 - temp0) * frac) >> FracBits);
+            
+            FpType temp = temp_fixed * (FpType)(1.0 / TableTempScale());
+            if (!(temp <= APRINTER_CFG(Config, CMaxTemp, c))) {
+                return INFINITY;
+            }
+            if (!(temp >= APRINTER_CFG(Config, CMinTemp, c))) {
+                return -INFINITY;
+            }
+            return temp;
+        }
+    }
+    AMBRO_STRUCT_ELSE(TableFeature) {
+        template <int AdcBits>
+        static FpType adc_bits_to_temp (Context c, uint32_t adc_bits)
+        {
+            return adcToTemp(c, adc_bits * (FpType)(1.0 / PowerOfTwo<double, AdcBits>::Value));
+        }
+    };
+    
+    AMBRO_STRUCT_IF(RamTableFeature, UseRamTable) {
+        struct Object;
+        
+        static void update (Context c)
+        {
+            auto *o = Object::self(c);
+            
+            for (int i = 0; i < TableSize; i++) {
+                FpType adc = FloatMin(FloatMax(i * (FpType)(1.0 / (TableSize - 1)), (FpType)TableAdcMargin()), (FpType)(1.0 - TableAdcMargin()));
+                FpType denom = FloatLog(adc / (1.0f - adc)) + APRINTER_CFG(Config, CLogRByRInf, c);
+                FpType temp = APRINTER_CFG(Config, CThermistorBeta, c) / FloatMax(denom, (FpType)TableMinDenom::value()) - 273.15f;
+                temp = FloatMin(FloatMax(temp, (FpType)-TableTempLimit()), (FpType)TableTempLimit());
+                o->table[i] = FloatIntRound<TableEntryType>(temp * (FpType)TableTempScale());
+            }
+        }
+        
+        static TableEntryType read (Context c, int index)
+        {
+            auto *o = Object::self(c);
+            return o->table[index];
+        }
+        
+        struct Object : public ObjBase<RamTableFeature, typename GenericThermistor::Object, EmptyTypeList> {
+            TableEntryType table[TableSize];
+        };
+    }
+    AMBRO_STRUCT_ELSE(RamTableFeature) {
+        using Table = StaticArray<TableEntryType, TableSize, TableElem>;
+        
+        static void update (Context c) {}
+        
+        static TableEntryType read (Context c, int index)
+        {
+            return Table::readAt(index);
+        }
+        
+        struct Object {};
+    };
+    
     using CAdcMinTemp = decltype(ExprCast<FpType>(TempToAdc(Config::e(Params::MinTemp::i()))));
     using CAdcMaxTemp = decltype(ExprCast<FpType>(TempToAdc(Config::e(Params::MaxTemp::i()))));
     using CThermistorBeta = decltype(ExprCast<FpType>(Config::e(Params::ThermistorBeta::i())));
     using CLogRByRInf = decltype(ExprCast<FpType>(ExprLog(Config::e(Params::ResistorR::i()) / RInf())));
+    using CMinTemp = decltype(ExprCast<FpType>(Config::e(Params::MinTemp::i())));
+    using CMaxTemp = decltype(ExprCast<FpType>(Config::e(Params::MaxTemp::i())));
     
 public:
-    struct Object {};
+    struct Object : public ObjBase<GenericThermistor, ParentObject, MakeTypeList<
+        RamTableFeature
+    >> {};
     
-    using ConfigExprs = MakeTypeList<CAdcMinTemp, CAdcMaxTemp, CThermistorBeta, CLogRByRInf>;
+    using ConfigExprs = MakeTypeList<CAdcMinTemp, CAdcMaxTemp, CThermistorBeta, CLogRByRInf, CMinTemp, CMaxTemp>;
 };
 
 APRINTER_ALIAS_STRUCT_EXT(GenericThermistorService, (
@@ -82,7 +230,8 @@ APRINTER_ALIAS_STRUCT_EXT(GenericThermistorService, (
     APRINTER_AS_TYPE(ThermistorR0),
     APRINTER_AS_TYPE(ThermistorBeta),
     APRINTER_AS_TYPE(MinTemp),
-    APRINTER_AS_TYPE(MaxTemp)
+    APRINTER_AS_TYPE(MaxTemp),
+    APRINTER_AS_VALUE(int, TableBits)
 ), (
     APRINTER_ALIAS_STRUCT_EXT(Formula, (
         APRINTER_AS_TYPE(Context),
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2013 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef AMBROLIB_ADAPTIVE_SPLITTER_H
+#define AMBROLIB_ADAPTIVE_SPLITTER_H
+
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/math/FloatTools.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/printer/Configuration.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/**
+ * Splitter which chooses the length of each segment based on how nonlinear
+ * the transform is along the move, instead of using a uniform segment length.
+ * 
+ * For a candidate segment, the evaluator passed to pull() computes the
+ * physical positions at the start, end and middle of the segment, and gives
+ * the largest deviation of the middle position from the straight line
+ * (chord) between the start and end positions. The deviation is in units of
+ * the physical axes. A segment is accepted when the deviation is at most
+ * MaxDeviation, else it is halved, but never below the minimum length. Since
+ * the deviation is about proportional to the square of the segment length,
+ * a deviation below a quarter of MaxDeviation lets the next segment try
+ * twice the length, up to MaxSplitLength.
+ * 
+ * The minimum length is MinSplitLength, or the distance travelled in the
+ * time of one segment at SegmentsPerSecond if that is longer, so that fast
+ * moves do not produce more segments per second than the planner can take.
+ * It is never above MaxSplitLength.
+ * 
+ * The evaluator must provide:
+ *   bool get_deviation (FpType frac0, FpType frac1, FpType *out_deviation);
+ * which returns false if the transform failed, in which case the segment is
+ * taken as is and the error is detected when computing its end position.
+ * The middle of the segment is at 0.5f * (frac0 + frac1). When a segment is
+ * halved, its new end is exactly the previous middle, and the next segment
+ * starts exactly at the end of the previous accepted one, so the evaluator
+ * can reuse the positions it computed before.
+ */
+template <typename Arg>
+class AdaptiveSplitter {
+    using Context      = typename Arg::Context;
+    using ParentObject = typename Arg::ParentObject;
+    using Config       = typename Arg::Config;
+    using FpType       = typename Arg::FpType;
+    using Params       = typename Arg::Params;
+
+public:
+    struct Object;
+
+private:
+    using Quarter = APRINTER_FP_CONST_EXPR(0.25);
+    using ClockTimeUnit = APRINTER_FP_CONST_EXPR(Context::Clock::time_unit);
+    
+    using CMinSplitLength = decltype(ExprCast<FpType>(Config::e(Params::MinSplitLength::i())));
+    using CMaxSplitLength = decltype(ExprCast<FpType>(Config::e(Params::MaxSplitLength::i())));
+    using CMaxDeviation = decltype(ExprCast<FpType>(Config::e(Params::MaxDeviation::i())));
+    using CMaxDeviationQuarter = decltype(ExprCast<FpType>(Config::e(Params::MaxDeviation::i()) * Quarter()));
+    using CSegmentsPerSecondTimeUnitRec = decltype(ExprCast<FpType>(ExprRec(Config::e(Params::SegmentsPerSecond::i()) * ClockTimeUnit())));
+
+public:
+    class Splitter {
+    public:
+        void start (Context c, FpType distance, FpType base_max_v_rec, FpType time_freq_by_max_speed)
+        {
+            FpType max_length = APRINTER_CFG(Config, CMaxSplitLength, c);
+            FpType length_by_time = APRINTER_CFG(Config, CSegmentsPerSecondTimeUnitRec, c) / time_freq_by_max_speed;
+            FpType min_length = FloatMin(max_length, FloatMax(APRINTER_CFG(Config, CMinSplitLength, c), length_by_time));
+            if (distance > min_length) {
+                m_min_step = min_length / distance;
+                m_max_step = FloatMax(m_min_step, max_length / distance);
+            } else {
+                m_min_step = 1.0f;
+                m_max_step = 1.0f;
+            }
+            m_next_step = m_max_step;
+            m_frac = 0.0f;
+            m_base_max_v_rec = base_max_v_rec;
+        }
+        
+        template <typename Evaluator>
+        bool pull (Context c, FpType *out_rel_max_v_rec, FpType *out_frac, Evaluator eval)
+        {
+            FpType remaining = 1.0f - m_frac;
+            FpType step = FloatMin(remaining, m_next_step);
+            FpType end_frac = m_frac + step;
+            
+            if (remaining > m_min_step) {
+                FpType max_deviation = APRINTER_CFG(Config, CMaxDeviation, c);
+                m_next_step = step;
+                while (true) {
+                    FpType deviation;
+                    if (!eval.get_deviation(m_frac, end_frac, &deviation)) {
+                        break;
+                    }
+                    if (deviation <= max_deviation) {
+                        if (deviation <= APRINTER_CFG(Config, CMaxDeviationQuarter, c)) {
+                            m_next_step = FloatMin(m_max_step, 2.0f * step);
+                        }
+                        break;
+                    }
+                    if (step <= m_min_step) {
+                        break;
+                    }
+                    end_frac = 0.5f * (m_frac + end_frac);
+                    step = end_frac - m_frac;
+                    if (step < m_min_step) {
+                        step = m_min_step;
+                        end_frac = m_frac + step;
+                    }
+                    m_next_step = step;
+                }
+                
+                // Rather than leaving a remainder shorter than the minimum
+                // length, split what is left in two equal segments.
+                if (step < remaining && remaining - step < m_min_step) {
+                    step = 0.5f * remaining;
+                    end_frac = m_frac + step;
+                }
+            }
+            
+            if (step >= remaining) {
+                *out_rel_max_v_rec = remaining * m_base_max_v_rec;
+                return false;
+            }
+            
+            m_frac = end_frac;
+            *out_rel_max_v_rec = step * m_base_max_v_rec;
+            *out_frac = m_frac;
+            return true;
+        }
+    
+    private:
+        FpType m_min_step;
+        FpType m_max_step;
+        FpType m_next_step;
+        FpType m_frac;
+        FpType m_base_max_v_rec;
+    };
+
+public:
+    using ConfigExprs = MakeTypeList<CMinSplitLength, CMaxSplitLength, CMaxDeviation, CMaxDeviationQuarter, CSegmentsPerSecondTimeUnitRec>;
+    
+    struct Object : public ObjBase<AdaptiveSplitter, ParentObject, EmptyTypeList> {};
+};
+
+APRINTER_ALIAS_STRUCT_EXT(AdaptiveSplitterService, (
+    APRINTER_AS_TYPE(MinSplitLength),
+    APRINTER_AS_TYPE(MaxSplitLength),
+    APRINTER_AS_TYPE(MaxDeviation),
+    APRINTER_AS_TYPE(SegmentsPerSecond)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(Splitter, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(Config),
+        APRINTER_AS_TYPE(FpType)
+    ), (
+        using Params = AdaptiveSplitterService;
+        APRINTER_DEF_INSTANCE(Splitter, AdaptiveSplitter)
+    ))
+))
+
+#include <aprinter/EndNamespace.h>
+
+#endif
@@ -29,6 +29,10 @@
 
 #include <aprinter/meta/BasicMetaUtils.h>
 #include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/StructIf.h>
+#include <aprinter/meta/PowerOfTwo.h>
+#include <aprinter/meta/StaticArray.h>
+#include <aprinter/meta/ConstexprMath.h>
 #include <aprinter/base/Object.h>
 #include <aprinter/math/Vector3.h>
 #include <aprinter/math/FloatTools.h>
@@ -61,9 +65,9 @@ public:
             return false;
         }
         
-        out_phys.template set<0>(FloatSqrt(APRINTER_CFG(Config, CDiagonalRod2, c) - FloatSquare(APRINTER_CFG(Config, CTower1X, c) - x) - FloatSquare(APRINTER_CFG(Config, CTower1Y, c) - y)) + z);
-        out_phys.template set<1>(FloatSqrt(APRINTER_CFG(Config, CDiagonalRod2, c) - FloatSquare(APRINTER_CFG(Config, CTower2X, c) - x) - FloatSquare(APRINTER_CFG(Config, CTower2Y, c) - y)) + z);
-        out_phys.template set<2>(FloatSqrt(APRINTER_CFG(Config, CDiagonalRod2, c) - FloatSquare(APRINTER_CFG(Config, CTower3X, c) - x) - FloatSquare(APRINTER_CFG(Config, CTower3Y, c) - y)) + z);
+        out_phys.template set<0>(TableFeature::rod_height(c, FloatSquare(APRINTER_CFG(Config, CTower1X, c) - x) + FloatSquare(APRINTER_CFG(Config, CTower1Y, c) - y)) + z);
+        out_phys.template set<1>(TableFeature::rod_height(c, FloatSquare(APRINTER_CFG(Config, CTower2X, c) - x) + FloatSquare(APRINTER_CFG(Config, CTower2Y, c) - y)) + z);
+        out_phys.template set<2>(TableFeature::rod_height(c, FloatSquare(APRINTER_CFG(Config, CTower3X, c) - x) + FloatSquare(APRINTER_CFG(Config, CTower3Y, c) - y)) + z);
         return true;
     }
     
@@ -89,6 +93,54 @@ public:
     }
     
 private:
+    // The height of a carriage above the effector is sqrt(DiagonalRod^2 - d2),
+    // where d2 is the squared horizontal distance of the effector from the
+    // tower. With TableBits > 0, this is computed as DiagonalRod * sqrt(1 - t)
+    // with t = d2 / DiagonalRod^2, with sqrt(1 - t) interpolated from a table
+    // in program memory of 2^TableBits+1 values evenly spaced in t over
+    // 0..TableMaxT. This does not depend on the configuration. With
+    // TableRefine, one Newton step is done, which makes the result about as
+    // precise as the exact formula, at the cost of a division. Outside of the
+    // table (which is well beyond the reach of usual deltas) the exact formula
+    // is used.
+    static int const TableBits = Params::TableBits;
+    static_assert(TableBits >= 0 && TableBits <= 12, "");
+    static bool const UseTable = (TableBits > 0);
+    static int const TableSize = PowerOfTwo<int, TableBits>::Value + 1;
+    static constexpr double TableMaxT () { return 0.9375; }
+    
+    template <int Index>
+    struct TableElem {
+        static constexpr FpType value () { return ConstexprSqrt(1.0 - Index * (TableMaxT() / (TableSize - 1))); }
+    };
+    
+    AMBRO_STRUCT_IF(TableFeature, UseTable) {
+        using Table = StaticArray<FpType, TableSize, TableElem>;
+        
+        static FpType rod_height (Context c, FpType d2)
+        {
+            FpType pos = d2 * APRINTER_CFG(Config, CTableScale, c);
+            if (!(pos < (FpType)(TableSize - 1))) {
+                return FloatSqrt(APRINTER_CFG(Config, CDiagonalRod2, c) - d2);
+            }
+            int index = (int)pos;
+            FpType frac = pos - index;
+            FpType s0 = Table::readAt(index);
+            FpType s1 = Table::readAt(index + 1);
+            FpType height = (s0 + frac * (s1 - s0)) * APRINTER_CFG(Config, CDiagonalRod, c);
+            if (Params::TableRefine) {
+                height = 0.5f * (height + (APRINTER_CFG(Config, CDiagonalRod2, c) - d2) / height);
+            }
+            return height;
+        }
+    }
+    AMBRO_STRUCT_ELSE(TableFeature) {
+        static FpType rod_height (Context c, FpType d2)
+        {
+            return FloatSqrt(APRINTER_CFG(Config, CDiagonalRod2, c) - d2);
+        }
+    };
+    
     using DiagonalRod = decltype(Config::e(Params::DiagonalRod::i()));
     using Radius = decltype(Config::e(Params::SmoothRodOffset::i()) - Config::e(Params::EffectorOffset::i()) - Config::e(Params::CarriageOffset::i()));
     using LimitRadius = decltype(Config::e(Params::LimitRadius::i()));
@@ -98,8 +150,11 @@ private:
     using Value3 = APRINTER_FP_CONST_EXPR(0.8660254037844386);
     using Value4 = APRINTER_FP_CONST_EXPR(0.0);
     using Value5 = APRINTER_FP_CONST_EXPR(1.0);
+    using TableScaleNum = APRINTER_FP_CONST_EXPR((TableSize - 1) / TableMaxT());
     
+    using CDiagonalRod = decltype(ExprCast<FpType>(DiagonalRod()));
     using CDiagonalRod2 = decltype(ExprCast<FpType>(DiagonalRod() * DiagonalRod()));
+    using CTableScale = decltype(ExprCast<FpType>(TableScaleNum() / (DiagonalRod() * DiagonalRod())));
     using CTower1X = decltype(ExprCast<FpType>(Radius() * Value1()));
     using CTower1Y = decltype(ExprCast<FpType>(Radius() * Value2()));
     using CTower2X = decltype(ExprCast<FpType>(Radius() * Value3()));
@@ -109,7 +164,7 @@ private:
     using CLimitRadius2 = decltype(ExprCast<FpType>(LimitRadius() * LimitRadius()));
     
 public:
-    using ConfigExprs = MakeTypeList<CDiagonalRod2, CTower1X, CTower1Y, CTower2X, CTower2Y, CTower3X, CTower3Y, CLimitRadius2>;
+    using ConfigExprs = MakeTypeList<CDiagonalRod, CDiagonalRod2, CTower1X, CTower1Y, CTower2X, CTower2Y, CTower3X, CTower3Y, CLimitRadius2, CTableScale>;
     
     struct Object : public ObjBase<DeltaTransform, ParentObject, EmptyTypeList> {};
 };
@@ -119,7 +174,9 @@ APRINTER_ALIAS_STRUCT_EXT(DeltaTransformService, (
     APRINTER_AS_TYPE(SmoothRodOffset),
     APRINTER_AS_TYPE(EffectorOffset),
     APRINTER_AS_TYPE(CarriageOffset),
-    APRINTER_AS_TYPE(LimitRadius)
+    APRINTER_AS_TYPE(LimitRadius),
+    APRINTER_AS_VALUE(int, TableBits),
+    APRINTER_AS_VALUE(bool, TableRefine)
 ), (
     APRINTER_ALIAS_STRUCT_EXT(Transform, (
         APRINTER_AS_TYPE(Context),
@@ -69,7 +69,8 @@ public:
             m_max_v_rec = base_max_v_rec / m_count;
         }
         
-        bool pull (Context c, FpType *out_rel_max_v_rec, FpType *out_frac)
+        template <typename Evaluator>
+        bool pull (Context c, FpType *out_rel_max_v_rec, FpType *out_frac, Evaluator eval)
         {
             *out_rel_max_v_rec = m_max_v_rec;
             if (m_pos == m_count) {
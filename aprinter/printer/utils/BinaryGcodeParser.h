@@ -39,6 +39,42 @@
 
 #include <aprinter/BeginNamespace.h>
 
+/**
+ * Parser for the binary G-code format produced by aprinter_encode.py.
+ * 
+ * Each command starts with a header byte, whose high nibble is the command type
+ * and low nibble is the number of parts. Type LONG is followed by two bytes
+ * giving the command letter and number. Then come index bytes giving the type
+ * and letter of each part, followed by the payloads of the parts.
+ * 
+ * Version 2 of the format adds two record types which do not follow the above
+ * layout. Both are only understood here and may be freely mixed with plain
+ * commands.
+ * 
+ * SETUP (0x50): followed by one byte for each move channel giving the number
+ * of decimal digits of the fixed-point positions of that channel (0-9).
+ * The positions of all channels are reset to zero. This record does not
+ * result in a command, it is consumed together with the following one.
+ * 
+ * MOVES (0x4n): a packed record of n+1 consecutive G1 moves. Follows a byte
+ * with the mask of channels present in each move, and a flags byte, with bits
+ * 0-1 giving the size of each delta (1, 2 or 4 bytes) and bit 2 indicating
+ * that an F value (float) follows, which applies to the first move only.
+ * Then come the deltas of the positions of the channels, move by move, as
+ * little-endian signed integers. Each move results in a G1 command with the
+ * absolute values of the channels, as if it had been written as text with
+ * that number of decimal digits. The feedrate persists in the firmware from
+ * one move to the next, so it is only present when it changes.
+ * 
+ * The moves of a record are reported as separate commands. All but the last
+ * one report a length of zero (not counting any preceding SETUP record), so
+ * that the record stays in the buffer until all of its moves are done.
+ * 
+ * Since the moves are relative to the preceding ones, parsing of a file with
+ * packed moves can only start at the beginning. A MOVES record which is not
+ * preceded by a SETUP record since init() is an error, and canSeek() reports
+ * whether a SETUP record has been seen.
+ */
 template <typename Context, typename TBufferSizeType, typename FpType, typename Params>
 class BinaryGcodeParser
 : public GcodeCommand<Context, FpType>,
@@ -50,6 +86,8 @@ class BinaryGcodeParser
         CMD_TYPE_G0 = 1,
         CMD_TYPE_G1 = 2,
         CMD_TYPE_G92 = 3,
+        CMD_TYPE_MOVES = 4,
+        CMD_TYPE_SETUP = 5,
         CMD_TYPE_EOF = 14,
         CMD_TYPE_LONG = 15,
     };
@@ -59,9 +97,15 @@ class BinaryGcodeParser
         DATA_TYPE_DOUBLE = 2,
         DATA_TYPE_UINT32 = 3,
         DATA_TYPE_UINT64 = 4,
-        DATA_TYPE_VOID = 5
+        DATA_TYPE_VOID = 5,
+        DATA_TYPE_POSITION = 6
     };
     
+    static int const NumChannels = 8;
+    static uint8_t const MaxChannelDigits = 9;
+    static uint8_t const MovesFlagDeltaSizeMask = 0x3;
+    static uint8_t const MovesFlagHaveF = 0x4;
+    
 public:
     using BufferSizeType = TBufferSizeType;
     using PartsSizeType = int8_t;
@@ -80,6 +124,12 @@ public:
     void init (Context c)
     {
         m_state = STATE_NOCMD;
+        m_moves_left = 0;
+        m_have_setup = false;
+        for (auto ch : LoopRangeAuto(NumChannels)) {
+            m_positions[ch] = 0;
+            m_divisors[ch] = 1000;
+        }
         
         this->debugInit(c);
     }
@@ -103,8 +153,9 @@ public:
         AMBRO_ASSERT(buffer)
         AMBRO_ASSERT(assume_error <= 0)
         
-        m_state = STATE_HEADER;
+        m_state = (m_moves_left > 0 && assume_error == 0) ? STATE_NEXT_MOVE : STATE_HEADER;
         m_buffer = (uint8_t *)buffer;
+        m_prefix_length = 0;
         m_length = 0;
         m_num_parts = assume_error;
     }
@@ -113,7 +164,10 @@ public:
     {
         this->debugAccess(c);
         AMBRO_ASSERT(m_state != STATE_NOCMD)
-        AMBRO_ASSERT(avail >= m_length)
+        AMBRO_ASSERT(avail >= m_prefix_length + m_length)
+        
+        // Make avail relative to the part of the buffer after any SETUP record.
+        avail -= m_prefix_length;
         
         while (1) {
             switch (m_state) {
@@ -126,6 +180,14 @@ public:
                         return false;
                     }
                     m_length = 1;
+                    if ((m_buffer[0] >> 4) == CMD_TYPE_SETUP) {
+                        m_state = STATE_SETUP;
+                        break;
+                    }
+                    if ((m_buffer[0] >> 4) == CMD_TYPE_MOVES) {
+                        m_state = STATE_MOVES;
+                        break;
+                    }
                     m_num_parts = m_buffer[0] & 0x0f;
                     if (m_num_parts > Params::MaxParts) {
                         m_num_parts = GCODE_ERROR_TOO_MANY_PARTS;
@@ -209,6 +271,93 @@ public:
                     m_length = m_total_size;
                     goto finish;
                 } break;
+                
+                case STATE_SETUP: {
+                    AMBRO_ASSERT(m_length == 1)
+                    if (avail < 1 + NumChannels) {
+                        return false;
+                    }
+                    m_length = 1 + NumChannels;
+                    for (auto ch : LoopRangeAuto(NumChannels)) {
+                        if (m_buffer[1 + ch] > MaxChannelDigits) {
+                            m_num_parts = GCODE_ERROR_INVALID_PART;
+                            goto finish;
+                        }
+                    }
+                    for (auto ch : LoopRangeAuto(NumChannels)) {
+                        uint32_t divisor = 1;
+                        for (uint8_t i = 0; i < m_buffer[1 + ch]; i++) {
+                            divisor *= 10;
+                        }
+                        m_divisors[ch] = divisor;
+                        m_positions[ch] = 0;
+                    }
+                    m_have_setup = true;
+                    m_prefix_length += m_length;
+                    m_buffer += m_length;
+                    avail -= m_length;
+                    m_length = 0;
+                    m_state = STATE_HEADER;
+                } break;
+                
+                case STATE_MOVES: {
+                    AMBRO_ASSERT(m_length == 1)
+                    if (avail < 3) {
+                        return false;
+                    }
+                    m_length = 3;
+                    uint8_t channel_mask = m_buffer[1];
+                    uint8_t flags = m_buffer[2];
+                    uint8_t delta_shift = flags & MovesFlagDeltaSizeMask;
+                    bool have_f = (flags & MovesFlagHaveF);
+                    if (channel_mask == 0 || delta_shift > 2 || (flags & ~(MovesFlagDeltaSizeMask | MovesFlagHaveF))) {
+                        m_num_parts = GCODE_ERROR_INVALID_PART;
+                        goto finish;
+                    }
+                    uint8_t num_channels = 0;
+                    for (auto ch : LoopRangeAuto(NumChannels)) {
+                        num_channels += (channel_mask >> ch) & 1;
+                    }
+                    if (num_channels + have_f > Params::MaxParts) {
+                        m_num_parts = GCODE_ERROR_TOO_MANY_PARTS;
+                        goto finish;
+                    }
+                    uint8_t num_moves = (m_buffer[0] & 0x0f) + 1;
+                    BufferSizeType moves_offset = 3 + (have_f ? 4 : 0);
+                    m_move_size = num_channels << delta_shift;
+                    size_t total_size = moves_offset + (size_t)num_moves * m_move_size;
+                    if (avail < total_size) {
+                        return false;
+                    }
+                    if (!m_have_setup) {
+                        // Skip the whole record, so that resuming after the error
+                        // continues with the next one.
+                        m_length = total_size;
+                        m_num_parts = GCODE_ERROR_NO_SETUP;
+                        goto finish;
+                    }
+                    m_total_size = total_size;
+                    m_channel_mask = channel_mask;
+                    m_delta_shift = delta_shift;
+                    m_move_offset = moves_offset;
+                    m_moves_left = num_moves;
+                    PartsSizeType part_index = 0;
+                    if (have_f) {
+                        m_parts[part_index].data_type = DATA_TYPE_FLOAT;
+                        m_parts[part_index].code = 'F';
+                        m_parts[part_index].data_size = 4;
+                        m_parts[part_index].data = m_buffer + 3;
+                        part_index++;
+                    }
+                    next_move(part_index);
+                    goto finish;
+                } break;
+                
+                case STATE_NEXT_MOVE: {
+                    AMBRO_ASSERT(m_moves_left > 0)
+                    next_move(0);
+                    goto finish;
+                } break;
             }
         }
         
@@ -230,7 +379,14 @@ public:
         this->debugAccess(c);
         AMBRO_ASSERT(m_state == STATE_NOCMD)
         
-        return m_length;
+        return m_prefix_length + m_length;
+    }
+    
+    bool canSeek (Context c)
+    {
+        this->debugAccess(c);
+        
+        return !m_have_setup;
     }
     
     PartsSizeType getNumParts (Context c)
@@ -300,6 +456,12 @@ public:
                 return val;
             } break;
             
+            case DATA_TYPE_POSITION: {
+                // Same result as parsing the decimal number as text.
+                int32_t *position = (int32_t *)cast_part_ref(part)->data;
+                return (FpType)*position / (FpType)m_divisors[position - m_positions];
+            } break;
+            
             default:
                 return 0.0f;
         }
@@ -334,13 +496,56 @@ public:
     }
     
 private:
-    enum {STATE_NOCMD, STATE_HEADER, STATE_HEADER_LONG, STATE_INDEX, STATE_PAYLOAD};
+    enum {STATE_NOCMD, STATE_HEADER, STATE_HEADER_LONG, STATE_INDEX, STATE_PAYLOAD, STATE_SETUP, STATE_MOVES, STATE_NEXT_MOVE};
     
     static Part * cast_part_ref (PartRef part_ref)
     {
         return (Part *)part_ref.ptr;
     }
     
+    void next_move (PartsSizeType part_index)
+    {
+        AMBRO_ASSERT(m_moves_left > 0)
+        
+        m_cmd_code = 'G';
+        m_cmd_num = 1;
+        
+        uint8_t *delta_data = m_buffer + m_move_offset;
+        for (auto ch : LoopRangeAuto(NumChannels)) {
+            if ((m_channel_mask >> ch) & 1) {
+                m_positions[ch] = (uint32_t)m_positions[ch] + (uint32_t)read_delta(delta_data);
+                delta_data += (uint8_t)1 << m_delta_shift;
+                m_parts[part_index].data_type = DATA_TYPE_POSITION;
+                m_parts[part_index].code = ChannelCodes()[ch];
+                m_parts[part_index].data_size = 0;
+                m_parts[part_index].data = (uint8_t *)&m_positions[ch];
+                part_index++;
+            }
+        }
+        m_num_parts = part_index;
+        
+        m_move_offset += m_move_size;
+        m_moves_left--;
+        m_length = (m_moves_left == 0) ? m_total_size : 0;
+    }
+    
+    int32_t read_delta (uint8_t const *data)
+    {
+        switch (m_delta_shift) {
+            case 0:
+                return (int8_t)data[0];
+            case 1:
+                return (int16_t)((uint16_t)data[0] | ((uint16_t)data[1] << 8));
+            default:
+                return (int32_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        }
+    }
+    
+    static char const * ChannelCodes ()
+    {
+        return "XYZEUVAB";
+    }
+    
     uint8_t m_state;
     uint8_t *m_buffer;
     BufferSizeType m_length;
@@ -348,6 +553,15 @@ private:
     uint16_t m_cmd_num;
     PartsSizeType m_num_parts;
     BufferSizeType m_total_size;
+    BufferSizeType m_prefix_length;
+    BufferSizeType m_move_offset;
+    uint8_t m_move_size;
+    uint8_t m_moves_left;
+    uint8_t m_channel_mask;
+    uint8_t m_delta_shift;
+    bool m_have_setup;
+    int32_t m_positions[NumChannels];
+    uint32_t m_divisors[NumChannels];
     Part m_parts[Params::MaxParts];
 };
 
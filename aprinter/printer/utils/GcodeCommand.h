@@ -38,7 +38,8 @@ enum GcodeError {
     GCODE_ERROR_CHECKSUM = -4,
     GCODE_ERROR_RECV_OVERRUN = -5,
     GCODE_ERROR_EOF = -6,
-    GCODE_ERROR_BAD_ESCAPE = -7
+    GCODE_ERROR_BAD_ESCAPE = -7,
+    GCODE_ERROR_NO_SETUP = -8
 };
 
 template <typename Context, typename FpType>
@@ -30,6 +30,7 @@
 #include <stddef.h>
 
 #include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/StructIf.h>
 #include <aprinter/math/FloatTools.h>
 #include <aprinter/base/DebugObject.h>
 #include <aprinter/base/Assert.h>
@@ -69,7 +70,45 @@ public:
     template <typename TheParserType, typename Dummy = void>
     struct CommandExtra {};
     
-    struct CommandPart {
+    struct CommandPart;
+    
+private:
+    AMBRO_STRUCT_IF(ParseOnceFeature, Params::ParseOnce) {
+        struct PartExtra {
+            bool have_fp_value;
+            FpType fp_value;
+        };
+        
+        // Numbers in the common format are converted once when the part is
+        // finished, others are left for getPartFpValue() to convert.
+        static void part_finished_hook (CommandPart *part)
+        {
+            part->have_fp_value = StrToFloatFast<FpType>(part->data, &part->fp_value);
+        }
+        
+        static FpType get_fp_value (CommandPart *part)
+        {
+            if (AMBRO_LIKELY(part->have_fp_value)) {
+                return part->fp_value;
+            }
+            return StrToFloat<FpType>(part->data, NULL);
+        }
+    }
+    AMBRO_STRUCT_ELSE(ParseOnceFeature) {
+        struct PartExtra {};
+        
+        static void part_finished_hook (CommandPart *part)
+        {
+        }
+        
+        static FpType get_fp_value (CommandPart *part)
+        {
+            return StrToFloat<FpType>(part->data, NULL);
+        }
+    };
+    
+public:
+    struct CommandPart : public ParseOnceFeature::PartExtra {
         char code;
         char *data;
     };
@@ -145,6 +184,10 @@ public:
                             m_command.cmd_number = atoi(m_command.parts[0].data);
                         }
                     }
+                } else if (TheTypeHelper::ChecksumEnabled && m_state == STATE_CHECKSUM && m_command.num_parts != GCODE_ERROR_RECV_OVERRUN) {
+                    // A corrupted line is reported as a checksum error, not as
+                    // whatever parse error the corruption happened to cause.
+                    TheTypeHelper::checksum_check_hook(c, this);
                 }
                 m_command.length++;
                 m_state = STATE_NOCMD;
@@ -152,12 +195,12 @@ public:
                 return true;
             }
             
-            if (AMBRO_UNLIKELY(m_command.num_parts < 0 || (TheTypeHelper::ChecksumEnabled && m_state == STATE_CHECKSUM))) {
+            if (AMBRO_UNLIKELY(TheTypeHelper::ChecksumEnabled && m_state == STATE_CHECKSUM)) {
                 continue;
             }
             
             if (AMBRO_UNLIKELY(TheTypeHelper::ChecksumEnabled && ch == '*')) {
-                if (m_state == STATE_INSIDE) {
+                if (m_state == STATE_INSIDE && m_command.num_parts >= 0) {
                     finish_part(c);
                 }
                 m_temp = m_command.length;
@@ -167,6 +210,10 @@ public:
             
             TheTypeHelper::checksum_add_hook(c, this, ch);
             
+            if (AMBRO_UNLIKELY(m_command.num_parts < 0)) {
+                continue;
+            }
+            
             if (TheTypeHelper::CommentsEnabled) {
                 if (AMBRO_UNLIKELY(m_state == STATE_COMMENT)) {
                     continue;
@@ -229,6 +276,13 @@ public:
         return m_command.length;
     }
     
+    bool canSeek (Context c)
+    {
+        this->debugAccess(c);
+        
+        return true;
+    }
+    
     PartsSizeType getNumParts (Context c)
     {
         this->debugAccess(c);
@@ -281,7 +335,7 @@ public:
         AMBRO_ASSERT(m_state == STATE_NOCMD)
         AMBRO_ASSERT(m_command.num_parts >= 0)
         
-        return StrToFloat<FpType>(cast_part_ref(part)->data, NULL);
+        return ParseOnceFeature::get_fp_value(cast_part_ref(part));
     }
     
     uint32_t getPartUint32Value (Context c, PartRef part)
@@ -357,7 +411,7 @@ private:
         
         static void checksum_check_hook (Context c, GcodeParser *o)
         {
-            AMBRO_ASSERT(o->m_command.num_parts >= 0)
+            AMBRO_ASSERT(o->m_command.num_parts != GCODE_ERROR_RECV_OVERRUN)
             AMBRO_ASSERT(o->m_state == STATE_CHECKSUM)
             
             char *received = o->m_buffer + (o->m_temp + 1);
@@ -503,8 +557,12 @@ private:
             return;
         }
         
-        m_command.parts[m_command.num_parts].code = code;
-        m_command.parts[m_command.num_parts].data = m_buffer + (m_temp + 1);
+        CommandPart *part = &m_command.parts[m_command.num_parts];
+        part->code = code;
+        part->data = m_buffer + (m_temp + 1);
+        if (m_command.num_parts > 0) {
+            ParseOnceFeature::part_finished_hook(part);
+        }
         m_command.num_parts++;
     }
     
@@ -525,14 +583,16 @@ private:
 };
 
 APRINTER_ALIAS_STRUCT_EXT(SerialGcodeParserService, (
-    APRINTER_AS_VALUE(int, MaxParts)
+    APRINTER_AS_VALUE(int, MaxParts),
+    APRINTER_AS_VALUE(bool, ParseOnce)
 ), (
     template <typename Context, typename TBufferSizeType, typename FpType>
     using Parser = GcodeParser<Context, TBufferSizeType, FpType, GcodeParserTypeSerial, SerialGcodeParserService>;
 ))
 
 APRINTER_ALIAS_STRUCT_EXT(FileGcodeParserService, (
-    APRINTER_AS_VALUE(int, MaxParts)
+    APRINTER_AS_VALUE(int, MaxParts),
+    APRINTER_AS_VALUE(bool, ParseOnce)
 ), (
     template <typename Context, typename TBufferSizeType, typename FpType>
     using Parser = GcodeParser<Context, TBufferSizeType, FpType, GcodeParserTypeFile, FileGcodeParserService>;
@@ -28,8 +28,6 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
-#include <stdio.h>
-#include <inttypes.h>
 #include <math.h>
 
 #include <aprinter/base/Hints.h>
@@ -37,6 +35,8 @@
 #include <aprinter/base/MemRef.h>
 #include <aprinter/base/LoopUtils.h>
 #include <aprinter/math/FloatTools.h>
+#include <aprinter/math/PrintInt.h>
+#include <aprinter/math/PrintFloat.h>
 
 #include <aprinter/BeginNamespace.h>
 
@@ -92,9 +92,9 @@ public:
     {
         adding_element();
         
-        char *end = get_end();
-        snprintf(end, get_rem()+1, "%" PRIu32, val.val);
-        m_length += strlen(end);
+        char buf[10];
+        int len = PrintNonnegativeIntDecimal<uint32_t>(val.val, buf);
+        add_chars(buf, len);
     }
     
     void add (JsonDouble val)
@@ -108,9 +108,9 @@ public:
             add_token("-1e1024");
         }
         else {
-            char *end = get_end();
-            snprintf(end, get_rem()+1, "%.6g", val.val);
-            m_length += strlen(end);
+            char buf[PrintFloatMaxLength];
+            int len = PrintFloatDecimal<double>(val.val, buf, 6);
+            add_chars(buf, len);
         }
     }
     
@@ -270,16 +270,6 @@ private:
         return (value < 10) ? ('0' + value) : ('A' + (value - 10));
     }
     
-    char * get_end ()
-    {
-        return m_buffer + m_length;
-    }
-    
-    size_t get_rem ()
-    {
-        return m_buffer_size - m_length;
-    }
-    
     void add_char (char ch)
     {
         if (AMBRO_LIKELY(m_length < m_buffer_size)) {
@@ -287,6 +277,13 @@ private:
         }
     }
     
+    void add_chars (char const *chars, size_t count)
+    {
+        for (auto i : LoopRange<size_t>(count)) {
+            add_char(chars[i]);
+        }
+    }
+    
     void add_token (char const *token)
     {
         while (*token != '\0') {
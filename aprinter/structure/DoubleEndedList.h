@@ -74,6 +74,16 @@ public:
         return ac(e)->next;
     }
     
+    Entry * prev (Entry *e) const
+    {
+        return (e == m_first) ? nullptr : ac(e)->prev;
+    }
+    
+    APRINTER_FUNCTION_IF(WithLast, Entry *, last () const)
+    {
+        return m_first ? this->m_last : nullptr;
+    }
+    
     void prepend (Entry *e)
     {
         ac(e)->next = m_first;
@@ -97,6 +107,18 @@ public:
         this->m_last = e;
     }
     
+    void insertAfter (Entry *e, Entry *after)
+    {
+        ac(e)->next = ac(after)->next;
+        ac(e)->prev = after;
+        if (ac(after)->next) {
+            ac(ac(after)->next)->prev = e;
+        } else {
+            set_last(e);
+        }
+        ac(after)->next = e;
+    }
+    
     void remove (Entry *e)
     {
         if (e != m_first) {
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_HASH_INDEX_TABLE_H
+#define APRINTER_HASH_INDEX_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <aprinter/meta/BitsInInt.h>
+#include <aprinter/base/Assert.h>
+
+#include <aprinter/BeginNamespace.h>
+
+/**
+ * Open-addressing hash table mapping integer keys to indices of entries
+ * which live elsewhere (e.g. in an array). Only the entry indices are stored
+ * in the table, the key of an indexed entry is obtained by calling the
+ * key_of_entry function given to the operations.
+ *
+ * Linear probing is used, and removal shifts the following entries back
+ * instead of leaving tombstones, so lookups do not degrade over time.
+ * The table is sized such that it is at most half full.
+ *
+ * IndexType must be a signed integer type, -1 denotes an empty slot.
+ */
+template <typename KeyType, typename IndexType, int MaxEntries>
+class HashIndexTable {
+    static_assert(MaxEntries > 0, "");
+    static_assert(sizeof(KeyType) <= sizeof(uint32_t), "");
+    static_assert(IndexType(-1) < 0, "");
+    
+    static int const TableBits = BitsInInt<MaxEntries>::Value + 1;
+    static size_t const TableSize = (size_t)1 << TableBits;
+    static size_t const TableMask = TableSize - 1;
+
+public:
+    void init ()
+    {
+        for (size_t i = 0; i < TableSize; i++) {
+            m_slots[i] = -1;
+        }
+    }
+    
+    template <typename KeyOfEntry>
+    IndexType find (KeyType key, KeyOfEntry key_of_entry) const
+    {
+        size_t pos = hash(key);
+        while (m_slots[pos] != -1) {
+            if (key_of_entry(m_slots[pos]) == key) {
+                return m_slots[pos];
+            }
+            pos = (pos + 1) & TableMask;
+        }
+        return -1;
+    }
+    
+    // The key must not already be in the table.
+    void insert (IndexType index, KeyType key)
+    {
+        AMBRO_ASSERT(index >= 0)
+        AMBRO_ASSERT(index < MaxEntries)
+        
+        size_t pos = hash(key);
+        while (m_slots[pos] != -1) {
+            AMBRO_ASSERT(m_slots[pos] != index)
+            pos = (pos + 1) & TableMask;
+        }
+        m_slots[pos] = index;
+    }
+    
+    // The entry must be in the table under the given key.
+    // The key_of_entry function is only called for other entries.
+    template <typename KeyOfEntry>
+    void remove (IndexType index, KeyType key, KeyOfEntry key_of_entry)
+    {
+        size_t pos = hash(key);
+        while (m_slots[pos] != index) {
+            AMBRO_ASSERT(m_slots[pos] != -1)
+            pos = (pos + 1) & TableMask;
+        }
+        
+        size_t hole = pos;
+        pos = (pos + 1) & TableMask;
+        while (m_slots[pos] != -1) {
+            // The entry may move into the hole if the hole is not before
+            // its home slot, in the cyclic order of probing.
+            size_t home = hash(key_of_entry(m_slots[pos]));
+            if (((pos - home) & TableMask) >= ((pos - hole) & TableMask)) {
+                m_slots[hole] = m_slots[pos];
+                hole = pos;
+            }
+            pos = (pos + 1) & TableMask;
+        }
+        m_slots[hole] = -1;
+    }
+
+private:
+    static size_t hash (KeyType key)
+    {
+        return (uint32_t)((uint32_t)key * UINT32_C(2654435769)) >> (32 - TableBits);
+    }
+    
+    IndexType m_slots[TableSize];
+};
+
+#include <aprinter/EndNamespace.h>
+
+#endif
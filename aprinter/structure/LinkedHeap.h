@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2013 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef AMBROLIB_LINKED_HEAP
+#define AMBROLIB_LINKED_HEAP
+
+#include <stddef.h>
+
+#include <aprinter/base/Assert.h>
+
+#include <aprinter/BeginNamespace.h>
+
+template <class, class, class>
+class LinkedHeapWithAccessor;
+
+template <class Entry>
+class LinkedHeapNode {
+    template <class, class, class>
+    friend class LinkedHeapWithAccessor;
+    Entry *parent;
+    Entry *link[2];
+};
+
+/**
+ * Intrusive binary min-heap, where the nodes are linked by pointers
+ * rather than stored in an array, so no memory needs to be reserved
+ * for the maximum number of entries.
+ * 
+ * Compare::lessThan(a, b) must give whether the entry a is to be
+ * before b. The first() entry is one which no other entry is less than.
+ * Insertion and removal of any entry are O(log n). Entries which
+ * compare equal come out in an unspecified order.
+ */
+template <class Entry, class Accessor, class Compare>
+class LinkedHeapWithAccessor {
+public:
+    void init ()
+    {
+        m_root = nullptr;
+        m_count = 0;
+    }
+    
+    bool isEmpty () const
+    {
+        return (m_root == nullptr);
+    }
+    
+    Entry * first () const
+    {
+        return m_root;
+    }
+    
+    void insert (Entry *e)
+    {
+        m_count++;
+        ac(e)->link[0] = nullptr;
+        ac(e)->link[1] = nullptr;
+        if (m_count == 1) {
+            ac(e)->parent = nullptr;
+            m_root = e;
+            return;
+        }
+        Entry *parent = get_at(m_count / 2);
+        ac(parent)->link[m_count % 2] = e;
+        ac(e)->parent = parent;
+        sift_up(e);
+    }
+    
+    void remove (Entry *e)
+    {
+        AMBRO_ASSERT(m_count > 0)
+        
+        // Detach the last entry, and if that was not the one
+        // being removed, put it in the place of the removed one.
+        Entry *last = get_at(m_count);
+        if (last == m_root) {
+            m_root = nullptr;
+        } else {
+            Entry *parent = ac(last)->parent;
+            ac(parent)->link[ac(parent)->link[1] == last] = nullptr;
+        }
+        m_count--;
+        
+        if (last != e) {
+            replace(e, last);
+            if (ac(last)->parent && Compare::lessThan(last, ac(last)->parent)) {
+                sift_up(last);
+            } else {
+                sift_down(last);
+            }
+        }
+    }
+    
+    static void markRemoved (Entry *e)
+    {
+        ac(e)->parent = e;
+    }
+    
+    static bool isRemoved (Entry *e)
+    {
+        return (ac(e)->parent == e);
+    }
+
+private:
+    static LinkedHeapNode<Entry> * ac (Entry *e)
+    {
+        return Accessor::access(e);
+    }
+    
+    // Finds the entry at a position in level order, starting with 1 for the
+    // root. The bits of the position after the highest one give the path.
+    Entry * get_at (size_t pos) const
+    {
+        AMBRO_ASSERT(pos >= 1)
+        AMBRO_ASSERT(pos <= m_count)
+        
+        size_t mask = 1;
+        while (mask <= pos / 2) {
+            mask *= 2;
+        }
+        Entry *e = m_root;
+        while (mask > 1) {
+            mask /= 2;
+            e = ac(e)->link[(pos & mask) != 0];
+        }
+        return e;
+    }
+    
+    void set_parent_link (Entry *parent, Entry *old_child, Entry *new_child)
+    {
+        if (parent) {
+            ac(parent)->link[ac(parent)->link[1] == old_child] = new_child;
+        } else {
+            m_root = new_child;
+        }
+    }
+    
+    void replace (Entry *old_e, Entry *new_e)
+    {
+        ac(new_e)->parent = ac(old_e)->parent;
+        set_parent_link(ac(old_e)->parent, old_e, new_e);
+        for (int i = 0; i < 2; i++) {
+            Entry *child = ac(old_e)->link[i];
+            ac(new_e)->link[i] = child;
+            if (child) {
+                ac(child)->parent = new_e;
+            }
+        }
+    }
+    
+    // Exchanges an entry with its parent.
+    void swap_with_parent (Entry *e)
+    {
+        Entry *parent = ac(e)->parent;
+        int side = (ac(parent)->link[1] == e);
+        Entry *sibling = ac(parent)->link[!side];
+        Entry *child0 = ac(e)->link[0];
+        Entry *child1 = ac(e)->link[1];
+        
+        ac(e)->parent = ac(parent)->parent;
+        set_parent_link(ac(parent)->parent, parent, e);
+        ac(e)->link[side] = parent;
+        ac(e)->link[!side] = sibling;
+        if (sibling) {
+            ac(sibling)->parent = e;
+        }
+        
+        ac(parent)->parent = e;
+        ac(parent)->link[0] = child0;
+        ac(parent)->link[1] = child1;
+        if (child0) {
+            ac(child0)->parent = parent;
+        }
+        if (child1) {
+            ac(child1)->parent = parent;
+        }
+    }
+    
+    void sift_up (Entry *e)
+    {
+        while (ac(e)->parent && Compare::lessThan(e, ac(e)->parent)) {
+            swap_with_parent(e);
+        }
+    }
+    
+    void sift_down (Entry *e)
+    {
+        while (true) {
+            Entry *child = ac(e)->link[0];
+            if (!child) {
+                break;
+            }
+            Entry *child1 = ac(e)->link[1];
+            if (child1 && Compare::lessThan(child1, child)) {
+                child = child1;
+            }
+            if (!Compare::lessThan(child, e)) {
+                break;
+            }
+            swap_with_parent(child);
+        }
+    }
+    
+    Entry *m_root;
+    size_t m_count;
+};
+
+template <class Entry, class Base, LinkedHeapNode<Entry> Base::*NodeMember>
+struct LinkedHeapAccessor {
+    static LinkedHeapNode<Entry> * access (Entry *e)
+    {
+        return &(e->*NodeMember);
+    }
+};
+
+template <class Entry, LinkedHeapNode<Entry> Entry::*NodeMember, class Compare>
+class LinkedHeap : public LinkedHeapWithAccessor<Entry, LinkedHeapAccessor<Entry, Entry, NodeMember>, Compare> {};
+
+#include <aprinter/EndNamespace.h>
+
+#endif
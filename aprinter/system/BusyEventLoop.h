@@ -36,6 +36,7 @@
 #include <aprinter/meta/BasicMetaUtils.h>
 #include <aprinter/meta/ServiceUtils.h>
 #include <aprinter/structure/DoubleEndedList.h>
+#include <aprinter/structure/LinkedHeap.h>
 #include <aprinter/base/Object.h>
 #include <aprinter/base/DebugObject.h>
 #include <aprinter/base/Assert.h>
@@ -76,13 +77,16 @@ public:
         o->m_quitting = false;
 #endif
         o->m_event_list.init();
+        o->m_timer_heap.init();
+        o->m_timers_turn = false;
         Delay::extra(c)->m_fast_event_pos = 0;
-        for (typename Delay::Extra::FastEventSizeType i = 0; i < Delay::Extra::NumFastEvents; i++) {
-            Delay::extra(c)->m_fast_events[i].not_triggered = true;
-        }
+        Delay::extra(c)->m_fast_pending = 0;
 #ifdef EVENTLOOP_BENCHMARK
         o->m_bench_time = 0;
 #endif
+#ifdef EVENTLOOP_PROFILE
+        resetProfile(c);
+#endif
         
         TheDebugObject::init(c);
     }
@@ -92,6 +96,7 @@ public:
         auto *o = Object::self(c);
         TheDebugObject::deinit(c);
         AMBRO_ASSERT(o->m_event_list.isEmpty())
+        AMBRO_ASSERT(o->m_timer_heap.isEmpty())
     }
     
     static void run (Context c)
@@ -100,39 +105,41 @@ public:
         TheDebugObject::access(c);
         
         while (1) {
-            for (typename Delay::Extra::FastEventSizeType i = 0; i < Delay::Extra::NumFastEvents; i++) {
-                Delay::extra(c)->m_fast_event_pos++;
-                if (AMBRO_UNLIKELY(Delay::extra(c)->m_fast_event_pos == Delay::Extra::NumFastEvents)) {
-                    Delay::extra(c)->m_fast_event_pos = 0;
-                }
+            // The pending mask can be read without a lock, since only this
+            // code clears bits; a bit set concurrently is seen on the next pass.
+            typename Delay::Extra::FastEventMaskType pending = Delay::extra(c)->m_fast_pending;
+            if (pending) {
+                auto index = Delay::Extra::next_fast_event(pending, Delay::extra(c)->m_fast_event_pos);
+                Delay::extra(c)->m_fast_event_pos = index;
+                // The trigger time is taken together with clearing the bit,
+                // since the event may be triggered again while it is handled.
                 cli();
-                if (!Delay::extra(c)->m_fast_events[Delay::extra(c)->m_fast_event_pos].not_triggered) {
-                    Delay::extra(c)->m_fast_events[Delay::extra(c)->m_fast_event_pos].not_triggered = true;
-                    sei();
-                    bench_start_measuring(c);
-                    Delay::extra(c)->m_fast_events[Delay::extra(c)->m_fast_event_pos].handler(c);
-                    c.check();
-                    bench_stop_measuring(c);
-                    break;
-                }
+                Delay::extra(c)->m_fast_pending &= ~Delay::Extra::fast_event_bit(index);
+                TimeType trigger_time = fast_trigger_time(c, index);
                 sei();
+                bench_start_measuring(c);
+                profile_start(c);
+                Delay::extra(c)->m_fast_handlers[index](c);
+                c.check();
+                profile_stop(c, (void const *)Delay::extra(c)->m_fast_handlers[index], trigger_time);
+                bench_stop_measuring(c);
             }
             
         again:;
-            TimeType now = Clock::getTime(c);
-            for (BaseEventStruct *ev = o->m_event_list.first(); ev; ev = o->m_event_list.next(ev)) {
-                AMBRO_ASSERT(!EventList::isRemoved(ev))
-                if (ev->handler_or_hack || TheClockUtils::timeGreaterOrEqual(now, static_cast<TimedEventStruct *>(ev)->time)) {
-                    o->m_event_list.remove(ev);
-                    EventList::markRemoved(ev);
+            // Queued events and expired timers take turns, so that neither
+            // can starve the other.
+            QueuedEventStruct *ev = o->m_event_list.first();
+            if (!ev || o->m_timers_turn) {
+                o->m_timers_turn = false;
+                TimedEventStruct *tev = o->m_timer_heap.first();
+                if (tev && TheClockUtils::timeGreaterOrEqual(Clock::getTime(c), tev->time)) {
+                    o->m_timer_heap.remove(tev);
+                    TimerHeap::markRemoved(tev);
                     bench_start_measuring(c);
-                    if (ev->handler_or_hack) {
-                        ev->handler_or_hack(c);
-                    } else {
-                        auto handler = EventHandlerType::Make(static_cast<TimedEventStruct *>(ev)->handler_func, ev->handler_or_hack.m_arg);
-                        handler(c);
-                    }
+                    profile_start(c);
+                    tev->handler(c);
                     c.check();
+                    profile_stop(c, (void const *)tev->handler.m_func, tev->time);
                     bench_stop_measuring(c);
 #ifdef AMBROLIB_SUPPORT_QUIT
                     if (o->m_quitting) {
@@ -142,6 +149,23 @@ public:
                     goto again;
                 }
             }
+            if (ev) {
+                o->m_timers_turn = true;
+                o->m_event_list.removeFirst();
+                EventList::markRemoved(ev);
+                bench_start_measuring(c);
+                profile_start(c);
+                ev->handler(c);
+                c.check();
+                profile_stop(c, (void const *)ev->handler.m_func, queued_arm_time(ev));
+                bench_stop_measuring(c);
+#ifdef AMBROLIB_SUPPORT_QUIT
+                if (o->m_quitting) {
+                    return;
+                }
+#endif
+                goto again;
+            }
         }
     }
     
@@ -159,6 +183,46 @@ public:
     }
 #endif
     
+#ifdef EVENTLOOP_PROFILE
+    static int const ProfileMaxEntries = 32;
+    static int const ProfileNumBuckets = 6;
+    
+    // Statistics of the dispatches of one handler. Handlers are identified by
+    // the address of the function called by the loop, which for callbacks to
+    // member functions is a trampoline specific to the member function.
+    // The latency is from arming (queued events), the set time (timers) or
+    // the first trigger (fast events) to the dispatch. The histogram counts
+    // latencies below 10us, 100us, 1ms, 10ms, 100ms and the rest.
+    struct ProfileEntry {
+        void const *handler_id;
+        uint32_t count;
+        uint64_t total_run_time;
+        TimeType max_run_time;
+        TimeType max_latency;
+        uint16_t latency_hist[ProfileNumBuckets];
+    };
+    
+    static void resetProfile (Context c)
+    {
+        auto *o = Object::self(c);
+        o->m_profile_num_entries = 0;
+    }
+    
+    static int getProfileNumEntries (Context c)
+    {
+        auto *o = Object::self(c);
+        return o->m_profile_num_entries;
+    }
+    
+    static ProfileEntry const * getProfileEntry (Context c, int index)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(index >= 0)
+        AMBRO_ASSERT(index < o->m_profile_num_entries)
+        return &o->m_profile_entries[index];
+    }
+#endif
+    
 #ifdef AMBROLIB_SUPPORT_QUIT
     static void quit (Context c)
     {
@@ -175,7 +239,7 @@ public:
     {
         TheDebugObject::access(c);
         
-        Delay::extra(c)->m_fast_events[Delay::Extra::template get_event_index<EventSpec>()].handler = handler;
+        Delay::extra(c)->m_fast_handlers[Delay::Extra::template get_event_index<EventSpec>()] = handler;
     }
     
     template <typename EventSpec>
@@ -183,7 +247,9 @@ public:
     {
         TheDebugObject::access(c);
         
-        Delay::extra(c)->m_fast_events[Delay::Extra::template get_event_index<EventSpec>()].not_triggered = true;
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            Delay::extra(c)->m_fast_pending &= ~Delay::Extra::fast_event_bit(Delay::Extra::template get_event_index<EventSpec>());
+        }
     }
     
     template <typename EventSpec, typename ThisContext>
@@ -193,7 +259,12 @@ public:
         TheDebugObject::access(c);
         
         AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
-            Delay::extra(c)->m_fast_events[Delay::Extra::template get_event_index<EventSpec>()].not_triggered = false;
+#ifdef EVENTLOOP_PROFILE
+            if (!(Delay::extra(c)->m_fast_pending & Delay::Extra::fast_event_bit(Delay::Extra::template get_event_index<EventSpec>()))) {
+                Delay::extra(c)->m_fast_trigger_times[Delay::Extra::template get_event_index<EventSpec>()] = Clock::getTime(lock_c);
+            }
+#endif
+            Delay::extra(c)->m_fast_pending |= Delay::Extra::fast_event_bit(Delay::Extra::template get_event_index<EventSpec>());
         }
     }
     
@@ -203,17 +274,33 @@ private:
     
     using EventHandlerType = Callback<void(Context)>;
     
-    struct BaseEventStruct {
-        EventHandlerType handler_or_hack;
-        DoubleEndedListNode<BaseEventStruct> list_node;
+    struct QueuedEventStruct {
+        EventHandlerType handler;
+        DoubleEndedListNode<QueuedEventStruct> list_node;
+#ifdef EVENTLOOP_PROFILE
+        TimeType arm_time;
+#endif
     };
     
-    struct TimedEventStruct : public BaseEventStruct {
-        typename EventHandlerType::FuncType handler_func;
+    struct TimedEventStruct {
+        EventHandlerType handler;
+        LinkedHeapNode<TimedEventStruct> heap_node;
         TimeType time;
     };
     
-    using EventList = DoubleEndedList<BaseEventStruct, &BaseEventStruct::list_node>;
+    // Ordering of timers for the heap. The times are compared relative to
+    // each other, which is correct as long as all of them are within half
+    // of the clock range, as is already assumed when comparing with the
+    // current time.
+    struct TimerCompare {
+        static bool lessThan (TimedEventStruct *e1, TimedEventStruct *e2)
+        {
+            return !TheClockUtils::timeGreaterOrEqual(e1->time, e2->time);
+        }
+    };
+    
+    using EventList = DoubleEndedList<QueuedEventStruct, &QueuedEventStruct::list_node>;
+    using TimerHeap = LinkedHeap<TimedEventStruct, &TimedEventStruct::heap_node, TimerCompare>;
     
     struct Delay {
         using Extra = typename ExtraDelay::Type;
@@ -236,15 +323,103 @@ private:
 #endif
     }
     
+    static void profile_arm (Context c, QueuedEventStruct *ev)
+    {
+#ifdef EVENTLOOP_PROFILE
+        ev->arm_time = Clock::getTime(c);
+#endif
+    }
+    
+    static TimeType queued_arm_time (QueuedEventStruct *ev)
+    {
+#ifdef EVENTLOOP_PROFILE
+        return ev->arm_time;
+#else
+        return 0;
+#endif
+    }
+    
+    static TimeType fast_trigger_time (Context c, int index)
+    {
+#ifdef EVENTLOOP_PROFILE
+        return Delay::extra(c)->m_fast_trigger_times[index];
+#else
+        return 0;
+#endif
+    }
+    
+#ifdef EVENTLOOP_PROFILE
+    static constexpr TimeType ProfileFirstBucketLimit = 1e-5 * Clock::time_freq;
+#endif
+    
+    static void profile_start (Context c)
+    {
+#ifdef EVENTLOOP_PROFILE
+        auto *o = Object::self(c);
+        o->m_profile_start_time = Clock::getTime(c);
+#endif
+    }
+    
+    static void profile_stop (Context c, void const *handler_id, TimeType arm_time)
+    {
+#ifdef EVENTLOOP_PROFILE
+        auto *o = Object::self(c);
+        TimeType run_time = Clock::getTime(c) - o->m_profile_start_time;
+        TimeType latency = o->m_profile_start_time - arm_time;
+        if (TheClockUtils::differenceIsNegative(latency)) {
+            latency = 0;
+        }
+        
+        // The last entry is reserved for the handlers which do not fit in the
+        // table, which are accounted together with a null handler_id.
+        int num_handler_entries = MinValue(o->m_profile_num_entries, ProfileMaxEntries - 1);
+        int i = 0;
+        while (i < num_handler_entries && o->m_profile_entries[i].handler_id != handler_id) {
+            i++;
+        }
+        if (i == ProfileMaxEntries - 1) {
+            handler_id = nullptr;
+        }
+        ProfileEntry *entry = &o->m_profile_entries[i];
+        if (i == o->m_profile_num_entries) {
+            o->m_profile_num_entries++;
+            *entry = ProfileEntry{};
+            entry->handler_id = handler_id;
+        }
+        
+        entry->count++;
+        entry->total_run_time += run_time;
+        entry->max_run_time = MaxValue(entry->max_run_time, run_time);
+        entry->max_latency = MaxValue(entry->max_latency, latency);
+        
+        int bucket = 0;
+        TimeType limit = ProfileFirstBucketLimit;
+        while (bucket < ProfileNumBuckets - 1 && latency >= limit) {
+            bucket++;
+            limit *= 10;
+        }
+        if (entry->latency_hist[bucket] != UINT16_MAX) {
+            entry->latency_hist[bucket]++;
+        }
+#endif
+    }
+    
 public:
     struct Object : public ObjBase<BusyEventLoop, ParentObject, MakeTypeList<TheDebugObject>> {
 #ifdef AMBROLIB_SUPPORT_QUIT
         bool m_quitting;
 #endif
         EventList m_event_list;
+        TimerHeap m_timer_heap;
+        bool m_timers_turn;
 #ifdef EVENTLOOP_BENCHMARK
         TimeType m_bench_time;
         TimeType m_bench_enter_time;
+#endif
+#ifdef EVENTLOOP_PROFILE
+        TimeType m_profile_start_time;
+        int m_profile_num_entries;
+        ProfileEntry m_profile_entries[ProfileMaxEntries];
 #endif
     };
 };
@@ -266,12 +441,9 @@ class BusyEventLoopExtra {
     friend Loop;
     
     static const int NumFastEvents = TypeListLength<FastEventList>::Value;
+    static_assert(NumFastEvents <= 64, "Too many fast events.");
     using FastEventSizeType = ChooseInt<MaxValue(1, BitsInInt<NumFastEvents>::Value), false>;
-    
-    struct FastEventState {
-        bool not_triggered;
-        typename Loop::FastHandlerType handler;
-    };
+    using FastEventMaskType = ChooseInt<MaxValue(1, NumFastEvents), false>;
     
     template <typename EventSpec>
     static constexpr FastEventSizeType get_event_index ()
@@ -279,10 +451,37 @@ class BusyEventLoopExtra {
         return TypeListIndex<FastEventList, EventSpec>::Value;
     }
     
+    static FastEventMaskType fast_event_bit (FastEventSizeType index)
+    {
+        return (FastEventMaskType)1 << index;
+    }
+    
+    static FastEventSizeType highest_bit (FastEventMaskType mask)
+    {
+        if (sizeof(FastEventMaskType) <= sizeof(unsigned int)) {
+            return (sizeof(unsigned int) * 8 - 1) - __builtin_clz((unsigned int)mask);
+        } else {
+            return (sizeof(unsigned long long) * 8 - 1) - __builtin_clzll((unsigned long long)mask);
+        }
+    }
+    
+    // Chooses which pending fast event to dispatch. For round-robin
+    // fairness, this is the next one below the last dispatched one,
+    // wrapping around to the highest.
+    static FastEventSizeType next_fast_event (FastEventMaskType pending, FastEventSizeType last_pos)
+    {
+        FastEventMaskType below = pending & (fast_event_bit(last_pos) - 1);
+        return highest_bit(below ? below : pending);
+    }
+    
 public:
     struct Object : public ObjBase<BusyEventLoopExtra, ParentObject, EmptyTypeList> {
         FastEventSizeType m_fast_event_pos;
-        FastEventState m_fast_events[NumFastEvents];
+        FastEventMaskType volatile m_fast_pending;
+        typename Loop::FastHandlerType m_fast_handlers[NumFastEvents];
+#ifdef EVENTLOOP_PROFILE
+        typename Loop::TimeType m_fast_trigger_times[NumFastEvents];
+#endif
     };
 };
 
@@ -296,7 +495,7 @@ APRINTER_ALIAS_STRUCT_EXT(BusyEventLoopExtraArg, (
 
 template <typename Loop>
 class BusyEventLoopQueuedEvent
-: private SimpleDebugObject<typename Loop::Context>, private Loop::BaseEventStruct
+: private SimpleDebugObject<typename Loop::Context>, private Loop::QueuedEventStruct
 {
 public:
     using Context = typename Loop::Context;
@@ -307,7 +506,7 @@ public:
     {
         AMBRO_ASSERT(handler)
         
-        this->handler_or_hack = handler;
+        this->handler = handler;
         Loop::EventList::markRemoved(this);
         
         this->debugInit(c);
@@ -348,6 +547,7 @@ public:
         AMBRO_ASSERT(Loop::EventList::isRemoved(this))
         
         lo->m_event_list.append(this);
+        Loop::profile_arm(c, this);
     }
     
     void appendNow (Context c)
@@ -359,6 +559,7 @@ public:
             lo->m_event_list.remove(this);
         }
         lo->m_event_list.append(this);
+        Loop::profile_arm(c, this);
     }
     
     void prependNowNotAlready (Context c)
@@ -368,6 +569,7 @@ public:
         AMBRO_ASSERT(Loop::EventList::isRemoved(this))
         
         lo->m_event_list.prepend(this);
+        Loop::profile_arm(c, this);
     }
     
     void prependNow (Context c)
@@ -379,6 +581,7 @@ public:
             lo->m_event_list.remove(this);
         }
         lo->m_event_list.prepend(this);
+        Loop::profile_arm(c, this);
     }
 };
 
@@ -395,9 +598,8 @@ public:
     {
         AMBRO_ASSERT(handler)
         
-        this->handler_or_hack = HandlerType::Make(nullptr, handler.m_arg);
-        Loop::EventList::markRemoved(this);
-        this->handler_func = handler.m_func;
+        this->handler = handler;
+        Loop::TimerHeap::markRemoved(this);
         
         this->debugInit(c);
     }
@@ -407,8 +609,8 @@ public:
         this->debugDeinit(c);
         auto *lo = Loop::Object::self(c);
         
-        if (!Loop::EventList::isRemoved(this)) {
-            lo->m_event_list.remove(this);
+        if (!Loop::TimerHeap::isRemoved(this)) {
+            lo->m_timer_heap.remove(this);
         }
     }
     
@@ -417,9 +619,9 @@ public:
         this->debugAccess(c);
         auto *lo = Loop::Object::self(c);
         
-        if (!Loop::EventList::isRemoved(this)) {
-            lo->m_event_list.remove(this);
-            Loop::EventList::markRemoved(this);
+        if (!Loop::TimerHeap::isRemoved(this)) {
+            lo->m_timer_heap.remove(this);
+            Loop::TimerHeap::markRemoved(this);
         }
     }
     
@@ -427,17 +629,17 @@ public:
     {
         this->debugAccess(c);
         
-        return !Loop::EventList::isRemoved(this);
+        return !Loop::TimerHeap::isRemoved(this);
     }
     
     void appendNowNotAlready (Context c)
     {
         this->debugAccess(c);
         auto *lo = Loop::Object::self(c);
-        AMBRO_ASSERT(Loop::EventList::isRemoved(this))
+        AMBRO_ASSERT(Loop::TimerHeap::isRemoved(this))
         
-        lo->m_event_list.append(this);
         this->time = Context::Clock::getTime(c);
+        lo->m_timer_heap.insert(this);
     }
     
     void appendAt (Context c, TimeType time)
@@ -445,11 +647,11 @@ public:
         this->debugAccess(c);
         auto *lo = Loop::Object::self(c);
         
-        if (!Loop::EventList::isRemoved(this)) {
-            lo->m_event_list.remove(this);
+        if (!Loop::TimerHeap::isRemoved(this)) {
+            lo->m_timer_heap.remove(this);
         }
-        lo->m_event_list.append(this);
         this->time = time;
+        lo->m_timer_heap.insert(this);
     }
     
     void appendAfter (Context c, TimeType after_time)
@@ -461,20 +663,20 @@ public:
     {
         this->debugAccess(c);
         auto *lo = Loop::Object::self(c);
-        AMBRO_ASSERT(Loop::EventList::isRemoved(this))
+        AMBRO_ASSERT(Loop::TimerHeap::isRemoved(this))
         
-        lo->m_event_list.append(this);
         this->time = Context::Clock::getTime(c) + after_time;
+        lo->m_timer_heap.insert(this);
     }
     
     void appendAfterPrevious (Context c, TimeType after_time)
     {
         this->debugAccess(c);
         auto *lo = Loop::Object::self(c);
-        AMBRO_ASSERT(Loop::EventList::isRemoved(this))
+        AMBRO_ASSERT(Loop::TimerHeap::isRemoved(this))
         
-        lo->m_event_list.append(this);
         this->time += after_time;
+        lo->m_timer_heap.insert(this);
     }
     
     TimeType getSetTime (Context c)
@@ -24,6 +24,7 @@
 from __future__ import print_function
 from __future__ import with_statement
 import struct
+import re
 
 class GcodeSyntaxError(Exception):
     pass
@@ -98,21 +99,196 @@ def encode_line(line):
     packet = packet_header + packet_index + packet_payload
     return packet
 
+# Version 2 of the format (see BinaryGcodeParser.h) adds packed records of
+# consecutive G1 moves with delta-encoded fixed-point positions of the move
+# channels. Moves are only packed if their values are exactly representable
+# with the number of decimal digits chosen for each channel, so that they are
+# decoded to the same values as the text would be. Anything else is encoded
+# as in version 1. The F value of G0/G1 is dropped when it is unchanged,
+# since the firmware remembers it.
+
+V2Channels = 'XYZEUVAB'
+V2MaxChannelDigits = 6
+V2MaxExactCount = 2**24
+V2MaxRecordMoves = 16
+V2DefaultMaxRecordSize = 64
+
+_v2_number_re = re.compile(r'^([+-]?)([0-9]+)(?:\.([0-9]*))?$')
+
+def _v2_split_line(line):
+    comment_index = line.find(';')
+    if comment_index >= 0:
+        line = line[:comment_index]
+    parts = line.split()
+    if len(parts) == 0 or parts[0][0] == 'E':
+        return None
+    return (parts[0], [(part[0], part[1:]) for part in parts[1:]])
+
+def _v2_fraction_digits(value):
+    match = _v2_number_re.match(value)
+    if match is None:
+        return None
+    return len(match.group(3) or '')
+
+def _v2_fixed_value(value, digits):
+    match = _v2_number_re.match(value)
+    if match is None:
+        return None
+    fraction = match.group(3) or ''
+    if len(fraction) > digits:
+        return None
+    count = int(match.group(2) + fraction.ljust(digits, '0'))
+    if count > V2MaxExactCount:
+        return None
+    return -count if match.group(1) == '-' else count
+
+def _v2_delta_shift(delta):
+    for shift in range(3):
+        bits = 8 << shift
+        if -2**(bits - 1) <= delta < 2**(bits - 1):
+            return shift
+    raise GcodeSyntaxError('delta out of range')
+
+def v2_choose_digits(lines):
+    digits = [0] * len(V2Channels)
+    for line in lines:
+        split = _v2_split_line(line)
+        if split is None or split[0] not in ('G1', 'G01'):
+            continue
+        for (letter, value) in split[1]:
+            ch = V2Channels.find(letter)
+            if ch >= 0:
+                frac_digits = _v2_fraction_digits(value)
+                if frac_digits is not None and frac_digits <= V2MaxChannelDigits:
+                    digits[ch] = max(digits[ch], frac_digits)
+    return digits
+
+class V2Encoder(object):
+    def __init__(self, digits, max_record_size=V2DefaultMaxRecordSize):
+        self._digits = digits
+        self._max_record_size = max_record_size
+        self._positions = [0] * len(V2Channels)
+        self._last_f = None
+        self._record = None
+        self._prefix_size = 0
+    
+    def start(self):
+        # The SETUP record is consumed together with the following command,
+        # so its size counts toward the size limit of that command.
+        data = struct.pack('B', 0x50) + ''.join(chr(d) for d in self._digits)
+        self._prefix_size = len(data)
+        return data
+    
+    def encode_line(self, line):
+        split = _v2_split_line(line)
+        if split is None:
+            if line.split(';')[0].strip() == '':
+                return ''
+            return self._flush() + self._plain(line)
+        (cmd, parts) = split
+        if cmd in ('G0', 'G00', 'G1', 'G01'):
+            f_parts = [value for (letter, value) in parts if letter == 'F']
+            if len(f_parts) == 1:
+                try:
+                    f_value = float(f_parts[0])
+                except ValueError:
+                    f_value = None
+                if f_value is not None and f_value == self._last_f and len(parts) > 1:
+                    parts = [(letter, value) for (letter, value) in parts if letter != 'F']
+                self._last_f = f_value
+        if cmd in ('G1', 'G01'):
+            move = self._make_move(parts)
+            if move is not None:
+                return self._add_move(*move)
+        text = ' '.join([cmd] + [letter + value for (letter, value) in parts])
+        return self._flush() + self._plain(text)
+    
+    def finish(self):
+        return self._flush()
+    
+    def _plain(self, line):
+        self._prefix_size = 0
+        return encode_line(line)
+    
+    def _make_move(self, parts):
+        mask = 0
+        f_value = None
+        counts = {}
+        for (letter, value) in parts:
+            if letter == 'F' and f_value is None:
+                try:
+                    f_value = float(value)
+                except ValueError:
+                    return None
+                continue
+            ch = V2Channels.find(letter)
+            if ch < 0 or (mask & (1 << ch)):
+                return None
+            count = _v2_fixed_value(value, self._digits[ch])
+            if count is None:
+                return None
+            mask |= 1 << ch
+            counts[ch] = count
+        if mask == 0:
+            return None
+        return (mask, f_value, [counts[ch] for ch in range(len(V2Channels)) if (mask & (1 << ch))])
+    
+    def _add_move(self, mask, f_value, counts):
+        channels = [ch for ch in range(len(V2Channels)) if (mask & (1 << ch))]
+        deltas = [count - self._positions[ch] for (ch, count) in zip(channels, counts)]
+        shift = max(_v2_delta_shift(delta) for delta in deltas)
+        data = ''
+        rec = self._record
+        if rec is not None:
+            new_size = 3 + (4 if rec['f'] is not None else 0) + (len(rec['moves']) + 1) * (len(channels) << max(shift, rec['shift']))
+            if not (rec['mask'] == mask and f_value is None and shift <= rec['shift'] and len(rec['moves']) < V2MaxRecordMoves and new_size <= rec['max_size']):
+                data += self._flush()
+                rec = None
+        if rec is None:
+            rec = {'mask': mask, 'f': f_value, 'shift': shift, 'moves': [], 'max_size': self._max_record_size - self._prefix_size}
+            self._record = rec
+            self._prefix_size = 0
+        rec['moves'].append(deltas)
+        for (ch, count) in zip(channels, counts):
+            self._positions[ch] = count
+        return data
+    
+    def _flush(self):
+        rec = self._record
+        if rec is None:
+            return ''
+        self._record = None
+        fmt = '<' + {0: 'b', 1: 'h', 2: 'i'}[rec['shift']]
+        flags = rec['shift'] | (0x4 if rec['f'] is not None else 0)
+        data = struct.pack('BBB', 0x40 + (len(rec['moves']) - 1), rec['mask'], flags)
+        if rec['f'] is not None:
+            data += struct.pack('<f', rec['f'])
+        for deltas in rec['moves']:
+            for delta in deltas:
+                data += struct.pack(fmt, delta)
+        return data
+
 EncodeFileErrors = (IOError, GcodeSyntaxError)
 
-def encode_file(input_file_name, output_file_name):
+def encode_file(input_file_name, output_file_name, v2=False, max_record_size=V2DefaultMaxRecordSize):
     line_num = 0
     with open(input_file_name, "r") as input_file:
-        with open(output_file_name, "w") as output_file:
-            for line in input_file:
-                line_num += 1
-                try:
-                    encoded_data = encode_line(line)
-                except GcodeSyntaxError as e:
-                    e.args = ('line {}: {}'.format(line_num, e.args[0]),)
-                    raise
-                output_file.write(encoded_data)
-            output_file.write(chr(0xE0))
+        lines = input_file.readlines()
+    with open(output_file_name, "wb") as output_file:
+        if v2:
+            encoder = V2Encoder(v2_choose_digits(lines), max_record_size)
+            output_file.write(encoder.start())
+        for line in lines:
+            line_num += 1
+            try:
+                encoded_data = encoder.encode_line(line) if v2 else encode_line(line)
+            except GcodeSyntaxError as e:
+                e.args = ('line {}: {}'.format(line_num, e.args[0]),)
+                raise
+            output_file.write(encoded_data)
+        if v2:
+            output_file.write(encoder.finish())
+        output_file.write(chr(0xE0))
 
 _SmallCommands = {
     ('G', 0) : 1,
@@ -128,8 +304,10 @@ def main():
     parser = argparse.ArgumentParser(description='G-code packet for APrinter firmware.')
     parser.add_argument('--input', required=True)
     parser.add_argument('--output', required=True)
+    parser.add_argument('--v2', action='store_true', help='Use version 2 of the format, with packed delta-encoded moves.')
+    parser.add_argument('--max-record-size', type=int, default=V2DefaultMaxRecordSize, help='Maximum size of a packed move record, must not exceed the MaxCommandSize of the firmware.')
     args = parser.parse_args()
-    encode_file(args.input, args.output)
+    encode_file(args.input, args.output, args.v2, args.max_record_size)
 
 if __name__ == '__main__':
     main()
@@ -140,6 +140,9 @@ class GenState(object):
         assert kind in self._singleton_objects
         return self._singleton_objects[kind]
     
+    def has_singleton_object (self, kind):
+        return kind in self._singleton_objects
+    
     def add_global_code (self, priority, code):
         self._global_code.append({'priority':priority, 'code':code})
     
@@ -424,6 +427,12 @@ def setup_platform(gen, config, key):
         gen.add_final_init_call(-1, 'platform_init_final();')
         gen.register_singleton_object('lwip_cpu_info', lwip_cpu_info_arm)
     
+    @platform_sel.option('Linux')
+    def option(platform):
+        gen.add_platform_include('aprinter/platform/linux/linux_support.h')
+        gen.add_init_call(-1, 'platform_init();')
+        gen.register_singleton_object('lwip_cpu_info', {'alignment': 'u32_t'})
+    
     config.do_selection(key, platform_sel)
 
 def setup_debug_interface(gen, config, key):
@@ -487,7 +496,8 @@ class CommonClock(object):
         self._interrupt_timers.append(it)
         clearance_name = '{}_{}_Clearance'.format(self._my_clock, name)
         self._gen.add_float_constant(clearance_name, clearance)
-        self._gen.add_isr(self._clockdef.INTERRUPT_TIMER_ISR(it, user))
+        if hasattr(self._clockdef, 'INTERRUPT_TIMER_ISR'):
+            self._gen.add_isr(self._clockdef.INTERRUPT_TIMER_ISR(it, user))
         return self._clockdef.INTERRUPT_TIMER_EXPR(it, clearance_name)
     
     def finalize (self):
@@ -587,6 +597,14 @@ def Stm32f4ClockDef(x):
     x.TIMER_EXPR = lambda tc: 'Stm32f4ClockTIM{}'.format(tc)
     x.TIMER_ISR = lambda my_clock, tc: 'AMBRO_STM32F4_CLOCK_TC_GLOBAL({}, {}, Context())'.format(tc, my_clock)
 
+def LinuxClockDef(x):
+    x.INCLUDE = 'hal/linux/LinuxClock.h'
+    x.CLOCK_SERVICE = lambda config: TemplateExpr('LinuxClockService', [config.get_int_constant('prescaler')])
+    x.TIMER_RE = '\\ATC([0-9])\\Z'
+    x.CHANNEL_RE = '\\ATC([0-9])_([0-9]{1,2})\\Z'
+    x.INTERRUPT_TIMER_EXPR = lambda it, clearance: 'LinuxClockInterruptTimerService<LinuxClockTc<{}>, {}, {}>'.format(it['tc'], it['channel'], clearance)
+    x.TIMER_EXPR = lambda tc: 'LinuxClockTc<{}>'.format(tc)
+
 def setup_clock(gen, config, key, clock_name, priority, allow_disabled):
     clock_sel = selection.Selection()
     
@@ -616,6 +634,10 @@ def setup_clock(gen, config, key, clock_name, priority, allow_disabled):
     def option(clock):
         return CommonClock(gen, clock, clock_name, priority, Stm32f4ClockDef)
     
+    @clock_sel.option('LinuxClock')
+    def option(clock):
+        return CommonClock(gen, clock, clock_name, priority, LinuxClockDef)
+    
     clock_object = config.do_selection(key, clock_sel)
     if clock_object is not None:
         gen.register_singleton_object(clock_name, clock_object)
@@ -667,6 +689,12 @@ def setup_pins (gen, config, key):
         pin_regexes.append('\\AStm32f4Pin<Stm32f4Port[A-Z],[0-9]{1,3}>\\Z')
         return TemplateLiteral('Stm32f4PinsService')
     
+    @pins_sel.option('LinuxPins')
+    def options(pin_config):
+        gen.add_aprinter_include('hal/linux/LinuxPins.h')
+        pin_regexes.append('\\ALinuxPin<[0-9]{1,3}>\\Z')
+        return TemplateLiteral('LinuxPinsService')
+    
     service_expr = config.do_selection(key, pins_sel)
     service_code = 'using PinsService = {};'.format(service_expr.build(indent=0))
     pins_expr = TemplateExpr('PinsService::Pins', ['Context', 'Program'])
@@ -721,6 +749,11 @@ def setup_watchdog (gen, config, key, disable_watchdog, user):
             watchdog.get_int('Reload'),
         ])
     
+    @watchdog_sel.option('NullWatchdog')
+    def option(watchdog):
+        gen.add_aprinter_include('hal/generic/NullWatchdog.h')
+        return 'NullWatchdogService'
+    
     return config.do_selection(key, watchdog_sel)
 
 def setup_adc (gen, config, key):
@@ -805,6 +838,19 @@ def setup_adc (gen, config, key):
             'pin_func': lambda pin: pin
         }
     
+    @adc_sel.option('LinuxAdc')
+    def option(adc_config):
+        gen.add_aprinter_include('hal/linux/LinuxAdc.h')
+        value = adc_config.get_float('Value')
+        if not 0.0 <= value <= 1.0:
+            adc_config.key_path('Value').error('Value out of range.')
+        gen.add_float_constant('AdcValue', value)
+        
+        return {
+            'service_expr': TemplateExpr('LinuxAdcService', ['AdcValue']),
+            'pin_func': lambda pin: pin
+        }
+    
     result = config.do_selection(key, adc_sel)
     if result is None:
         return
@@ -865,6 +911,10 @@ def use_input_mode (config, key):
     def option(im_config):
         return im_config.do_enum('PullMode', {'Normal': 'Mk20PinInputModeNormal', 'Pull-up': 'Mk20PinInputModePullUp', 'Pull-down': 'Mk20PinInputModePullDown'})
     
+    @im_sel.option('LinuxPinInputMode')
+    def option(im_config):
+        return im_config.do_enum('PullMode', {'Normal': 'LinuxPinInputModeNormal', 'Pull-up': 'LinuxPinInputModePullUp'})
+    
     return config.do_selection(key, im_sel)
 
 def use_digital_input (gen, config, key):
@@ -918,6 +968,23 @@ def use_pwm_output (gen, config, key, user, username, hard=False):
             use_interrupt_timer(gen, backend, 'Timer', '{}::TheTimer'.format(user))
         ])
     
+    @backend_sel.option('SoftPwmMux')
+    def option(backend):
+        if hard:
+            config.path().error('Only Hard PWM is allowed here.')
+        
+        if not gen.has_singleton_object('soft_pwm_mux'):
+            backend.path().error('The multiplexed soft PWM is not enabled for the board.')
+        mux = gen.get_singleton_object('soft_pwm_mux')
+        
+        channel_index = len(mux['channels'])
+        mux['channels'].append(TemplateExpr('SoftPwmMuxChannel', [
+            get_pin(gen, backend, 'OutputPin'),
+            backend.get_bool('OutputInvert'),
+        ]))
+        
+        return TemplateExpr('SoftPwmMuxPwmService', [channel_index])
+    
     @backend_sel.option('HardPwm')
     def option(backend):
         gen.add_aprinter_include('printer/pwm/HardPwm.h')
@@ -956,6 +1023,50 @@ def use_pwm_output (gen, config, key, user, username, hard=False):
     
     return pwm_output.do_selection('Backend', backend_sel)
 
+def setup_soft_pwm_mux (gen, config, key):
+    mux_sel = selection.Selection()
+    
+    @mux_sel.option('Disabled')
+    def option(mux_config):
+        return None
+    
+    @mux_sel.option('SoftPwmMux')
+    def option(mux_config):
+        pulse_interval = mux_config.get_float('PulseInterval')
+        if not pulse_interval > 0.0:
+            mux_config.key_path('PulseInterval').error('Value out of range.')
+        edge_tolerance = mux_config.get_float('EdgeTolerance')
+        if not 0.0 <= edge_tolerance < pulse_interval:
+            mux_config.key_path('EdgeTolerance').error('Value out of range.')
+        
+        return {
+            'config': mux_config,
+            'pulse_interval': gen.add_float_constant('SoftPwmMuxPulseInterval', pulse_interval),
+            'edge_tolerance': gen.add_float_constant('SoftPwmMuxEdgeTolerance', edge_tolerance),
+            'channels': [],
+        }
+    
+    mux = config.do_selection(key, mux_sel)
+    if mux is None:
+        return
+    
+    gen.add_aprinter_include('printer/pwm/SoftPwmMux.h')
+    gen.register_singleton_object('soft_pwm_mux', mux)
+    
+    # The timer is only allocated if some PWM output uses the mux.
+    def finalize():
+        if len(mux['channels']) == 0:
+            return
+        service_code = 'using SoftPwmMuxServiceType = {};'.format(TemplateExpr('SoftPwmMuxService', [
+            mux['pulse_interval'],
+            mux['edge_tolerance'],
+            use_interrupt_timer(gen, mux['config'], 'Timer', 'MySoftPwmMux::TheTimer'),
+        ]).build(indent=0))
+        mux_expr = TemplateExpr('SoftPwmMuxServiceType::Mux', ['Context', 'Program', TemplateList(mux['channels'])])
+        gen.add_global_resource(26, 'MySoftPwmMux', mux_expr, use_instance=True, code_before=service_code, context_name='SoftPwmMux')
+    
+    gen.add_finalize_action(finalize)
+
 def use_spi (gen, config, key, user):
     spi_sel = selection.Selection()
     
@@ -988,6 +1099,11 @@ def use_spi (gen, config, key, user):
         gen.add_isr('AMBRO_AVR_SPI_ISRS({}, Context())'.format(user))
         return TemplateExpr('AvrSpiService', [spi_config.get_int('SpeedDiv')])
     
+    @spi_sel.option('LinuxSdSpi')
+    def option(spi_config):
+        gen.add_aprinter_include('hal/linux/LinuxSdSpi.h')
+        return 'LinuxSdSpiService'
+    
     return config.do_selection(key, spi_sel)
 
 def use_sdio (gen, config, key, user):
@@ -1061,6 +1177,11 @@ def use_eeprom(gen, config, key, user):
             use_flash(gen, eeprom, 'FlashDriver', '{}::GetFlash'.format(user)),
         ])
     
+    @eeprom_sel.option('LinuxEeprom')
+    def option(eeprom):
+        gen.add_aprinter_include('hal/linux/LinuxEeprom.h')
+        return TemplateExpr('LinuxEepromService', [eeprom.get_int('Size'), eeprom.get_int('FakeBlockSize')])
+    
     return config.do_selection(key, eeprom_sel)
 
 def use_flash(gen, config, key, user):
@@ -1123,6 +1244,11 @@ def use_serial(gen, config, key, user):
         gen.add_aprinter_include('hal/generic/NullSerial.h')
         return 'NullSerialService'
     
+    @serial_sel.option('LinuxPtySerial')
+    def option(serial_service):
+        gen.add_aprinter_include('hal/linux/LinuxPtySerial.h')
+        return 'LinuxPtySerialService'
+    
     return config.do_selection(key, serial_sel)
 
 def use_sdcard(gen, config, key, user):
@@ -1131,9 +1257,13 @@ def use_sdcard(gen, config, key, user):
     @sd_service_sel.option('SpiSdCard')
     def option(spi_sd):
         gen.add_aprinter_include('hal/generic/SpiSdCard.h')
+        max_io_blocks = spi_sd.get_int('MaxIoBlocks')
+        if not (1 <= max_io_blocks <= 64):
+            spi_sd.key_path('MaxIoBlocks').error('Bad value.')
         return TemplateExpr('SpiSdCardService', [
             get_pin(gen, spi_sd, 'SsPin'),
             use_spi(gen, spi_sd, 'SpiService', '{}::GetSpi'.format(user)),
+            max_io_blocks,
         ])
     
     @sd_service_sel.option('SdioSdCard')
@@ -1143,6 +1273,14 @@ def use_sdcard(gen, config, key, user):
             use_sdio(gen, sdio_sd, 'SdioService', '{}::GetSdio'.format(user)),
         ])
     
+    @sd_service_sel.option('LinuxSdCard')
+    def option(linux_sd):
+        gen.add_aprinter_include('hal/linux/LinuxSdCard.h')
+        return TemplateExpr('LinuxSdCardService', [
+            linux_sd.get_int('MaxIoBlocks'),
+            linux_sd.get_int('MaxIoDescriptors'),
+        ])
+    
     return config.do_selection(key, sd_service_sel)
 
 def use_config_manager(gen, config, key, user):
@@ -1438,6 +1576,9 @@ def generate(config_root_data, cfg_name, main_template):
                 gen.register_objects('pwm_output', board_data, 'pwm_outputs')
                 gen.register_objects('laser_port', board_data, 'laser_ports')
                 
+                if board_data.has('soft_pwm_mux'):
+                    setup_soft_pwm_mux(gen, board_data, 'soft_pwm_mux')
+                
                 led_pin_expr = get_pin(gen, board_data, 'LedPin')
                 
                 for performance in board_data.enter_config('performance'):
@@ -1451,6 +1592,7 @@ def generate(config_root_data, cfg_name, main_template):
                 for development in board_data.enter_config('development'):
                     assertions_enabled = development.get_bool('AssertionsEnabled')
                     event_loop_benchmark_enabled = development.get_bool('EventLoopBenchmarkEnabled')
+                    event_loop_profile_enabled = development.get_bool('EventLoopProfileEnabled')
                     detect_overload_enabled = development.get_bool('DetectOverloadEnabled')
                     disable_watchdog = development.get_bool('DisableWatchdog')
                     build_with_clang = development.get_bool('BuildWithClang')
@@ -1468,6 +1610,8 @@ def generate(config_root_data, cfg_name, main_template):
                         basic_test_module.set_expr('BasicTestModuleService')
                     elif detect_overload_enabled:
                         development.key_path('DetectOverloadEnabled').error('BasicTestModule is required for overload detection.')
+                    elif event_loop_profile_enabled:
+                        development.key_path('EventLoopProfileEnabled').error('BasicTestModule is required for event-loop profiling.')
                     
                     if development.get_bool('EnableStubCommandModule'):
                         gen.add_aprinter_include('printer/modules/StubCommandModule.h')
@@ -1487,6 +1631,7 @@ def generate(config_root_data, cfg_name, main_template):
                         serial.get_int_constant('SendBufferSizeExp'),
                         TemplateExpr('SerialGcodeParserService', [
                             serial.get_int_constant('GcodeMaxParts'),
+                            serial.get_bool_constant('GcodeParseOnce'),
                         ]),
                         use_serial(gen, serial, 'Service', serial_user),
                     ]))
@@ -1511,6 +1656,7 @@ def generate(config_root_data, cfg_name, main_template):
                         gen.add_aprinter_include('printer/utils/GcodeParser.h')
                         return TemplateExpr('FileGcodeParserService', [
                             parser.get_int('MaxParts'),
+                            parser.get_bool_constant('ParseOnce'),
                         ])
                     
                     @gcode_parser_sel.option('BinaryGcodeParser')
@@ -1536,13 +1682,21 @@ def generate(config_root_data, cfg_name, main_template):
                             fs_config.key_path('MaxFileNameSize').error('Bad value.')
                         
                         num_cache_entries = fs_config.get_int('NumCacheEntries')
-                        if not (1 <= num_cache_entries <= 64):
+                        if not (1 <= num_cache_entries <= 1024):
                             fs_config.key_path('NumCacheEntries').error('Bad value.')
                         
                         max_io_blocks = fs_config.get_int('MaxIoBlocks')
                         if not (1 <= max_io_blocks <= num_cache_entries):
                             fs_config.key_path('MaxIoBlocks').error('Bad value.')
                         
+                        num_chain_extents = fs_config.get_int('NumChainExtents')
+                        if not (1 <= num_chain_extents <= 16):
+                            fs_config.key_path('NumChainExtents').error('Bad value.')
+                        
+                        num_name_cache_entries = fs_config.get_int('NumNameCacheEntries')
+                        if not (0 <= num_name_cache_entries <= 32):
+                            fs_config.key_path('NumNameCacheEntries').error('Bad value.')
+                        
                         gen.add_aprinter_include('printer/input/SdFatInput.h')
                         gen.add_aprinter_include('fs/FatFs.h')
                         
@@ -1579,6 +1733,8 @@ def generate(config_root_data, cfg_name, main_template):
                                 num_cache_entries,
                                 1, # NumIoUnits
                                 max_io_blocks,
+                                num_chain_extents,
+                                num_name_cache_entries,
                                 fs_config.get_bool_constant('CaseInsensFileName'),
                                 fs_config.get_bool_constant('FsWritable'),
                                 fs_config.get_bool_constant('EnableReadHinting'),
@@ -1642,6 +1798,7 @@ def generate(config_root_data, cfg_name, main_template):
                             tcp_console_module.set_expr(TemplateExpr('TcpConsoleModuleService', [
                                 TemplateExpr('SerialGcodeParserService', [
                                     console_max_parts,
+                                    True, # ParseOnce
                                 ]),
                                 console_port,
                                 console_max_clients,
@@ -1675,6 +1832,14 @@ def generate(config_root_data, cfg_name, main_template):
                             
                             allow_persistent = webif_config.get_bool('AllowPersistent')
                             
+                            max_status_streams = webif_config.get_int('MaxStatusStreams')
+                            if not (0 <= max_status_streams <= webif_max_clients):
+                                webif_config.key_path('MaxStatusStreams').error('Value out of range.')
+                            
+                            status_stream_interval = webif_config.get_float('StatusStreamInterval')
+                            if not (0.05 <= status_stream_interval <= 10.0):
+                                webif_config.key_path('StatusStreamInterval').error('Value out of range.')
+                            
                             gen.add_float_constant('WebInterfaceQueueTimeout', webif_config.get_float('QueueTimeout'))
                             gen.add_float_constant('WebInterfaceInactivityTimeout', webif_config.get_float('InactivityTimeout'))
                             
@@ -1712,9 +1877,13 @@ def generate(config_root_data, cfg_name, main_template):
                                 webif_config.get_int('NumGcodeSlots'),
                                 TemplateExpr('SerialGcodeParserService', [
                                     webif_config.get_int('MaxGcodeParts'),
+                                    True, # ParseOnce
                                 ]),
                                 webif_config.get_int('MaxGcodeCommandSize'),
                                 gen.add_float_constant('WebInterfaceGcodeSendBufTimeout', webif_config.get_float('GcodeSendBufTimeout')),
+                                webif_config.get_int('SendfileBlocks'),
+                                max_status_streams,
+                                gen.add_float_constant('WebInterfaceStatusStreamInterval', status_stream_interval),
                             ]))
                             
                             gen.get_singleton_object('network').add_resource_counts(listeners=1, connections=webif_max_clients, queued_connections=webif_queue_size)
@@ -1867,12 +2036,16 @@ def generate(config_root_data, cfg_name, main_template):
                 @conversion_sel.option('conversion')
                 def option(conversion_config):
                     gen.add_aprinter_include('printer/thermistor/GenericThermistor.h')
+                    table_bits = conversion_config.get_int('TableBits')
+                    if not 0 <= table_bits <= 10:
+                        conversion_config.key_path('TableBits').error('Value out of range.')
                     return TemplateExpr('GenericThermistorService', [
                         gen.add_float_config('{}HeaterTempResistorR'.format(name), conversion_config.get_float('ResistorR')),
                         gen.add_float_config('{}HeaterTempR0'.format(name), conversion_config.get_float('R0')),
                         gen.add_float_config('{}HeaterTempBeta'.format(name), conversion_config.get_float('Beta')),
                         gen.add_float_config('{}HeaterTempMinTemp'.format(name), conversion_config.get_float('MinTemp')),
                         gen.add_float_config('{}HeaterTempMaxTemp'.format(name), conversion_config.get_float('MaxTemp')),
+                        table_bits,
                     ])
                 
                 @conversion_sel.option('PtRtdFormula')
@@ -1951,6 +2124,7 @@ def generate(config_root_data, cfg_name, main_template):
             
             transform_sel = selection.Selection()
             transform_axes = []
+            transform_splitter = []
             
             @transform_sel.option('NoTransform')
             def option(transform):
@@ -2023,12 +2197,17 @@ def generate(config_root_data, cfg_name, main_template):
                 @transform_type_sel.option('Delta')
                 def option():
                     gen.add_aprinter_include('printer/transform/DeltaTransform.h')
+                    table_bits = transform.get_int('TableBits')
+                    if not 0 <= table_bits <= 12:
+                        transform.key_path('TableBits').error('Value out of range.')
                     return TemplateExpr('DeltaTransformService', [
                         gen.add_float_config('DeltaDiagonalRod', transform.get_float('DiagnalRod')),
                         gen.add_float_config('DeltaSmoothRodOffset', transform.get_float('SmoothRodOffset')),
                         gen.add_float_config('DeltaEffectorOffset', transform.get_float('EffectorOffset')),
                         gen.add_float_config('DeltaCarriageOffset', transform.get_float('CarriageOffset')),
                         gen.add_float_config('DeltaLimitRadius', transform.get_float('LimitRadius')),
+                        table_bits,
+                        transform.get_bool_constant('TableRefine'),
                     ]), 'Delta'
                 
                 @transform_type_sel.option('RotationalDelta')
@@ -2064,6 +2243,7 @@ def generate(config_root_data, cfg_name, main_template):
                 
                 @splitter_sel.option('DistanceSplitter')
                 def option(splitter):
+                    transform_splitter.append('DistanceSplitter')
                     gen.add_aprinter_include('printer/transform/DistanceSplitter.h')
                     return TemplateExpr('DistanceSplitterService', [
                         gen.add_float_config('{}MinSplitLength'.format(transform_prefix), splitter.get_float('MinSplitLength')),
@@ -2071,6 +2251,17 @@ def generate(config_root_data, cfg_name, main_template):
                         gen.add_float_config('{}SegmentsPerSecond'.format(transform_prefix), splitter.get_float('SegmentsPerSecond')),
                     ])
                 
+                @splitter_sel.option('AdaptiveSplitter')
+                def option(splitter):
+                    transform_splitter.append('AdaptiveSplitter')
+                    gen.add_aprinter_include('printer/transform/AdaptiveSplitter.h')
+                    return TemplateExpr('AdaptiveSplitterService', [
+                        gen.add_float_config('{}MinSplitLength'.format(transform_prefix), splitter.get_float('MinSplitLength')),
+                        gen.add_float_config('{}MaxSplitLength'.format(transform_prefix), splitter.get_float('MaxSplitLength')),
+                        gen.add_float_config('{}MaxSplitDeviation'.format(transform_prefix), splitter.get_float('MaxDeviation')),
+                        gen.add_float_config('{}SegmentsPerSecond'.format(transform_prefix), splitter.get_float('SegmentsPerSecond')),
+                    ])
+                
                 splitter_expr = transform.do_selection('Splitter', splitter_sel)
                 
                 max_dimensions = 10
@@ -2174,15 +2365,8 @@ def generate(config_root_data, cfg_name, main_template):
                 gen.add_float_config('ProbeSlowSpeed', probe.get_float('SlowSpeed'))
                 gen.add_float_config('ProbeGeneralZOffset', probe.get_float('GeneralZOffset'))
                 
-                num_points = 0
-                for (i, point) in enumerate(probe.iter_list_config('ProbePoints', min_count=1, max_count=20)):
-                    num_points += 1
-                    gen.add_bool_config('ProbeP{}Enabled'.format(i+1), point.get_bool('Enabled'))
-                    gen.add_float_config('ProbeP{}X'.format(i+1), point.get_float('X'))
-                    gen.add_float_config('ProbeP{}Y'.format(i+1), point.get_float('Y'))
-                    gen.add_float_config('ProbeP{}ZOffset'.format(i+1), point.get_float('Z-offset'))
-                
                 correction_sel = selection.Selection()
+                mesh_points = []
                 
                 @correction_sel.option('NoCorrection')
                 def option(correction):
@@ -2198,8 +2382,43 @@ def generate(config_root_data, cfg_name, main_template):
                     
                     return TemplateExpr('BedProbeCorrectionParams', [quadratic_supported, quadratic_enabled])
                 
+                @correction_sel.option('MeshCorrection')
+                def option(correction):
+                    if 'Z' not in transform_axes:
+                        correction.path().error('Bed correction is only supported when the Z axis is involved in the coordinate transformation.')
+                    if 'DistanceSplitter' not in transform_splitter and 'AdaptiveSplitter' not in transform_splitter:
+                        correction.path().error('Mesh bed correction requires the DistanceSplitter or AdaptiveSplitter, since the correction changes along straight moves.')
+                    
+                    points_x = correction.get_int('PointsX')
+                    points_y = correction.get_int('PointsY')
+                    if not 2 <= points_x <= 16:
+                        correction.key_path('PointsX').error('Value out of range.')
+                    if not 2 <= points_y <= 16:
+                        correction.key_path('PointsY').error('Value out of range.')
+                    
+                    mesh_points.append(points_x * points_y)
+                    
+                    return TemplateExpr('BedProbeMeshCorrectionParams', [
+                        points_x,
+                        points_y,
+                        gen.add_float_config('ProbeMeshMinX', correction.get_float('MinX')),
+                        gen.add_float_config('ProbeMeshMaxX', correction.get_float('MaxX')),
+                        gen.add_float_config('ProbeMeshMinY', correction.get_float('MinY')),
+                        gen.add_float_config('ProbeMeshMaxY', correction.get_float('MaxY')),
+                    ])
+                
                 correction_expr = probe.do_selection('correction', correction_sel)
                 
+                # In mesh mode, the probe points are given by the mesh.
+                num_points = 0
+                if len(mesh_points) == 0:
+                    for (i, point) in enumerate(probe.iter_list_config('ProbePoints', min_count=1, max_count=20)):
+                        num_points += 1
+                        gen.add_bool_config('ProbeP{}Enabled'.format(i+1), point.get_bool('Enabled'))
+                        gen.add_float_config('ProbeP{}X'.format(i+1), point.get_float('X'))
+                        gen.add_float_config('ProbeP{}Y'.format(i+1), point.get_float('Y'))
+                        gen.add_float_config('ProbeP{}ZOffset'.format(i+1), point.get_float('Z-offset'))
+                
                 probe_module.set_expr(TemplateExpr('BedProbeModuleService', [
                     'MakeTypeList<WrapInt<\'X\'>, WrapInt<\'Y\'>>',
                     '\'Z\'',
@@ -2390,6 +2609,7 @@ def generate(config_root_data, cfg_name, main_template):
         'optimize_libc_for_size': optimize_libc_for_size,
         'assertions_enabled': assertions_enabled,
         'event_loop_benchmark_enabled': event_loop_benchmark_enabled,
+        'event_loop_profile_enabled': event_loop_profile_enabled,
         'detect_overload_enabled': detect_overload_enabled,
         'build_with_clang': build_with_clang,
         'verbose_build': verbose_build,
@@ -2429,7 +2649,8 @@ def main():
         'with ((import (builtins.toPath {})) {{}}); aprinterFunc {{\n'
         '    boardName = {}; buildName = "aprinter"; desiredOutputs = {}; optimizeForSize = {};\n'
         '    optimizeLibcForSize = {};\n'
-        '    assertionsEnabled = {}; eventLoopBenchmarkEnabled = {}; detectOverloadEnabled = {};\n'
+        '    assertionsEnabled = {}; eventLoopBenchmarkEnabled = {}; eventLoopProfileEnabled = {};\n'
+        '    detectOverloadEnabled = {};\n'
         '    buildWithClang = {}; verboseBuild = {}; debugSymbols = {}; buildVars = {};\n'
         '    extraSources = {}; extraIncludes = {}; defines = {}; linkerSymbols = {};\n'
         '    mainText = {};\n'
@@ -2442,6 +2663,7 @@ def main():
         nix_utils.convert_bool_for_nix(result['optimize_libc_for_size']),
         nix_utils.convert_bool_for_nix(result['assertions_enabled']),
         nix_utils.convert_bool_for_nix(result['event_loop_benchmark_enabled']),
+        nix_utils.convert_bool_for_nix(result['event_loop_profile_enabled']),
         nix_utils.convert_bool_for_nix(result['detect_overload_enabled']),
         nix_utils.convert_bool_for_nix(result['build_with_clang']),
         nix_utils.convert_bool_for_nix(result['verbose_build']),
@@ -36,7 +36,9 @@ $${PLATFORM_INCLUDES}
 static void emergency (void);
 
 #define AMBROLIB_EMERGENCY_ACTION { cli(); emergency(); }
+#ifndef AMBROLIB_ABORT_ACTION
 #define AMBROLIB_ABORT_ACTION { while (1); }
+#endif
 
 #include <aprinter/meta/BasicMetaUtils.h>
 #include <aprinter/meta/TypeListUtils.h>
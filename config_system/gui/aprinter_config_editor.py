@@ -56,6 +56,9 @@ def input_mode_choice(context, **kwargs):
         ce.Compound('Mk20PinInputMode', attrs=[
             ce.String(key='PullMode', title='Pull mode', enum=['Normal', 'Pull-up', 'Pull-down']),
         ]),
+        ce.Compound('LinuxPinInputMode', attrs=[
+            ce.String(key='PullMode', title='Pull mode', enum=['Normal', 'Pull-up']),
+        ]),
     ], **kwargs)
 
 def i2c_choice(**kwargs):
@@ -79,6 +82,7 @@ def spi_choice(**kwargs):
         ce.Compound('AvrSpi', attrs=[
             ce.Integer(key='SpeedDiv')
         ]),
+        ce.Compound('LinuxSdSpi', title='Simulated SD card (Linux)', attrs=[]),
     ], **kwargs)
 
 def sdio_choice(**kwargs):
@@ -297,6 +301,26 @@ def platform_Stm32f4():
         ]),
     ])
 
+def platform_Linux():
+    return ce.Compound('Linux', attrs=[
+        ce.Compound('LinuxClock', key='clock', title='Clock', collapsable=True, attrs=[
+            ce.Integer(key='prescaler', title='Prescaler (as power of two)'),
+            ce.String(key='primary_timer', title='Primary timer'),
+            ce.Constant(key='avail_oc_units', value=[
+                {
+                    'value': 'TC0_{}'.format(i)
+                } for i in range(16)
+            ])
+        ]),
+        ce.Compound('LinuxAdc', key='adc', title='ADC', collapsable=True, attrs=[
+            ce.Float(key='Value', title='Value of all inputs (fraction of full scale)', default=0.5),
+        ]),
+        ce.Compound('NullWatchdog', key='watchdog', title='Watchdog', collapsable=True, attrs=[]),
+        ce.Compound('LinuxPins', key='pins', title='Pins', collapsable=True, attrs=[
+            ce.Constant(key='input_mode_type', value='LinuxPinInputMode'),
+        ]),
+    ])
+
 def hard_pwm_choice(**kwargs):
     return ce.OneOf(title='Hard-PWM driver', choices=[
         ce.Compound('AvrClockPwm', ident='id_pwm_output', attrs=[
@@ -359,6 +383,12 @@ def make_transform_type(transform_type, transform_title, stepper_defs, axis_defs
                     ce.Float(key='MaxSplitLength', title='Maximum segment length [mm]', default=4.0),
                     ce.Float(key='SegmentsPerSecond', title='Segments per second', default=100.0),
                 ]),
+                ce.Compound('AdaptiveSplitter', title='Adaptive', attrs=[
+                    ce.Float(key='MinSplitLength', title='Minimum segment length [mm]', default=0.1),
+                    ce.Float(key='MaxSplitLength', title='Maximum segment length [mm]', default=20.0),
+                    ce.Float(key='MaxDeviation', title='Maximum deviation from the exact path [physical axis units]', default=0.01),
+                    ce.Float(key='SegmentsPerSecond', title='Maximum segments per second', default=200.0),
+                ]),
                 ce.Compound('NoSplitter', title='Disabled', attrs=[]),
             ]),
         ] +
@@ -529,6 +559,8 @@ def editor():
                         ce.Float(key='EffectorOffset', title='Effector offset [mm]', default=19.9),
                         ce.Float(key='CarriageOffset', title='Carriage offset [mm]', default=19.5),
                         ce.Float(key='LimitRadius', title='Radius of XY disk to permit motion in [mm]', default=150.0),
+                        ce.Integer(key='TableBits', title='Rod height lookup table size as power of two (0=exact formula, 8 is within ~7um)', default=0),
+                        ce.Boolean(key='TableRefine', title='Refine lookup table results (one Newton step, about as exact as the formula)', default=True),
                     ]
                 ),
                 make_transform_type(transform_type='RotationalDelta', transform_title='Rotational delta',
@@ -581,7 +613,8 @@ def editor():
                         ce.Float(key='R0', title='Thermistor resistance @25C [ohm]', default=100000),
                         ce.Float(key='Beta', title='Thermistor beta value [K]', default=3960),
                         ce.Float(key='MinTemp', title='Reliable measurements are above [C]', default=10),
-                        ce.Float(key='MaxTemp', title='Reliable measurements are below [C]', default=300)
+                        ce.Float(key='MaxTemp', title='Reliable measurements are below [C]', default=300),
+                        ce.Integer(key='TableBits', title='Lookup table size as power of two (0=exact formula, 8 is within ~0.2C)', default=0)
                     ]),
                     ce.Compound('PtRtdFormula', title='Platinum resistance thermometer (PRT)', attrs=[
                         ce.Float(key='ResistorR', title='Series-resistor resistance [ohm]', default=4700),
@@ -649,6 +682,14 @@ def editor():
                                 ce.Boolean(key='QuadraticCorrectionSupported', title='Support quadratic correction', default=False),
                                 ce.Boolean(key='QuadraticCorrectionEnabled', title='Enable quadratic correction', default=False),
                             ]),
+                            ce.Compound('MeshCorrection', title='Mesh (probes a grid instead of the points above; needs segmentation)', attrs=[
+                                ce.Integer(key='PointsX', title='Number of points along X', default=5),
+                                ce.Integer(key='PointsY', title='Number of points along Y', default=5),
+                                ce.Float(key='MinX', title='X of first grid column [mm]', default=10),
+                                ce.Float(key='MaxX', title='X of last grid column [mm]', default=190),
+                                ce.Float(key='MinY', title='Y of first grid row [mm]', default=10),
+                                ce.Float(key='MaxY', title='Y of last grid row [mm]', default=190),
+                            ]),
                         ])
                     ])
                 ])
@@ -694,6 +735,7 @@ def editor():
                     platform_Avr('ATmega2560'),
                     platform_Avr('ATmega1284p'),
                     platform_Stm32f4(),
+                    platform_Linux(),
                 ]),
                 ce.OneOf(key='debug_interface', title='Debug interface', choices=[
                     ce.Compound('NoDebug', title='None or specified elsewhere', attrs=[]),
@@ -731,6 +773,10 @@ def editor():
                                     ce.Compound('FlashWrapper', attrs=[
                                         flash_choice(key='FlashDriver', title='Flash driver'),
                                     ]),
+                                    ce.Compound('LinuxEeprom', title='File (Linux)', attrs=[
+                                        ce.Integer(key='Size'),
+                                        ce.Integer(key='FakeBlockSize'),
+                                    ]),
                                 ]),
                             ]),
                             ce.Compound('FileConfigStore', title='File on SD card', attrs=[]),
@@ -743,6 +789,7 @@ def editor():
                 ce.Integer(key='RecvBufferSizeExp', title='Receive buffer size (power of two exponent)'),
                 ce.Integer(key='SendBufferSizeExp', title='Send buffer size (power of two exponent)'),
                 ce.Integer(key='GcodeMaxParts', title='Max parts in GCode command'),
+                ce.Boolean(key='GcodeParseOnce', title='Convert numbers in GCode commands once when received (uses more RAM)', default=True),
                 ce.OneOf(key='Service', title='Backend', choices=[
                     ce.Compound('AsfUsbSerial', title='AT91 USB', attrs=[]),
                     ce.Compound('At91Sam3xSerial', title='AT91 UART', attrs=[
@@ -754,6 +801,7 @@ def editor():
                     ]),
                     ce.Compound('Stm32f4UsbSerial', title='STM32F4 USB', attrs=[]),
                     ce.Compound('NullSerial', title='Null serial driver', attrs=[]),
+                    ce.Compound('LinuxPtySerial', title='Linux pseudo-terminal', attrs=[]),
                 ])
             ])),
             ce.Compound('SdCardConfig', key='sdcard_config', title='SD card configuration', collapsable=True, attrs=[
@@ -766,6 +814,8 @@ def editor():
                                 ce.Integer(key='MaxFileNameSize', title='Maximum filename size', default=32),
                                 ce.Integer(key='NumCacheEntries', title='Block cache size (in blocks)', default=2),
                                 ce.Integer(key='MaxIoBlocks', title='Maximum blocks in single I/O command', default=1),
+                                ce.Integer(key='NumChainExtents', title='Cluster extents cached per open file', default=4),
+                                ce.Integer(key='NumNameCacheEntries', title='Path name lookups cached (0 to disable)', default=8),
                                 ce.Boolean(key='CaseInsensFileName', title='Case-insensitive filename matching', default=True),
                                 ce.Boolean(key='FsWritable', title='Writable filesystem', default=False),
                                 ce.Boolean(key='EnableReadHinting', title='Enable read-ahead hinting', default=False),
@@ -783,7 +833,8 @@ def editor():
                         ce.Integer(key='MaxCommandSize', title='Maximum command size'),
                         ce.OneOf(key='GcodeParser', title='G-code parser', choices=[
                             ce.Compound('TextGcodeParser', title='Text G-code parser', attrs=[
-                                ce.Integer(key='MaxParts', title='Maximum number of command parts')
+                                ce.Integer(key='MaxParts', title='Maximum number of command parts'),
+                                ce.Boolean(key='ParseOnce', title='Convert numbers once when a command is read (uses more RAM)', default=True)
                             ]),
                             ce.Compound('BinaryGcodeParser', title='Binary G-code parser', attrs=[
                                 ce.Integer(key='MaxParts', title='Maximum number of command parts')
@@ -792,11 +843,16 @@ def editor():
                         ce.OneOf(key='SdCardService', title='Driver', choices=[
                             ce.Compound('SpiSdCard', title='SPI', attrs=[
                                 pin_choice(key='SsPin', title='SS pin'),
-                                spi_choice(key='SpiService', title='SPI driver')
+                                spi_choice(key='SpiService', title='SPI driver'),
+                                ce.Integer(key='MaxIoBlocks', title='Maximum blocks in single I/O command', default=1),
                             ]),
                             ce.Compound('SdioSdCard', title='SDIO', attrs=[
                                 sdio_choice(key='SdioService', title='SDIO driver'),
                             ]),
+                            ce.Compound('LinuxSdCard', title='Image file (Linux)', attrs=[
+                                ce.Integer(key='MaxIoBlocks', title='Maximum blocks in single I/O command', default=8),
+                                ce.Integer(key='MaxIoDescriptors', title='Maximum number of buffers in transfer', default=8),
+                            ]),
                         ])
                     ])
                 ]),
@@ -845,6 +901,9 @@ def editor():
                                 ce.Integer(key='MaxGcodeParts', title='Max parts in g-code command', default=16),
                                 ce.Integer(key='MaxGcodeCommandSize', title='Maximum g-code command size', default=128),
                                 ce.Float(key='GcodeSendBufTimeout', title='Timeout when waiting for send buffer space for g-code commands [s]', default=5.0),
+                                ce.Integer(key='SendfileBlocks', title='File blocks pinned per client for sending from the cache (0 to copy)', default=4),
+                                ce.Integer(key='MaxStatusStreams', title='Maximum clients receiving pushed status updates (0 to disable)', default=1),
+                                ce.Float(key='StatusStreamInterval', title='Interval for checking for status changes to push [s]', default=0.5),
                             ]),
                         ]),
                     ])
@@ -868,6 +927,7 @@ def editor():
             ce.Compound('development', key='development', title='Development features', collapsable=True, attrs=[
                 ce.Boolean(key='AssertionsEnabled', title='Enable assertions', default=False),
                 ce.Boolean(key='EventLoopBenchmarkEnabled', title='Enable event-loop execution timing', default=False),
+                ce.Boolean(key='EventLoopProfileEnabled', title='Enable per-handler event-loop profiling (M919, needs the BasicTestModule)', default=False),
                 ce.Boolean(key='DetectOverloadEnabled', title='Enable interrupt overload detection', default=False),
                 ce.Boolean(key='DisableWatchdog', title='Disable the watchdog timer', default=False),
                 ce.Boolean(key='BuildWithClang', title='Build with the Clang compiler', default=False),
@@ -926,6 +986,14 @@ def editor():
                     ]),
                 ]),
             ])),
+            ce.OneOf(key='soft_pwm_mux', title='Multiplexed soft PWM (one timer for all such PWM outputs)', choices=[
+                ce.Compound('Disabled', title='Disabled', attrs=[]),
+                ce.Compound('SoftPwmMux', title='Enabled', attrs=[
+                    ce.Float(key='PulseInterval', title='PWM pulse duration', default=0.2),
+                    ce.Float(key='EdgeTolerance', title='Tolerance for coalescing turn-off edges [s]', default=0.0002),
+                    interrupt_timer_choice(key='Timer', title='Timer'),
+                ]),
+            ]),
             ce.Array(key='pwm_outputs', title='PWM outputs', copy_name_key='Name', processing_order=-6, elem=ce.Compound('pwm_output', title='PWM output', title_key='Name', collapsable=True, attrs=[
                 ce.String(key='Name', title='Name'),
                 ce.OneOf(key='Backend', title='Backend', choices=[
@@ -935,6 +1003,10 @@ def editor():
                         ce.Float(key='PulseInterval', title='PWM pulse duration'),
                         interrupt_timer_choice(key='Timer', title='Soft PWM Timer'),
                     ]),
+                    ce.Compound('SoftPwmMux', title='Multiplexed soft PWM', attrs=[
+                        pin_choice(key='OutputPin', title='Output pin'),
+                        ce.Boolean(key='OutputInvert', title='Output logic', false_title='Normal (On=High)', true_title='Inverted (On=Low)'),
+                    ]),
                     ce.Compound('HardPwm', attrs=[
                         hard_pwm_choice(key='HardPwmDriver'),
                     ]),
@@ -14,10 +14,13 @@ class Program (littlevent.close.Obj):
     def __init__ (self):
         littlevent.close.Obj.__init__ (self)
         try:
-            parser = argparse.ArgumentParser(description='Test 3D printer serial port latency.')
+            parser = argparse.ArgumentParser(description='Test 3D printer serial port latency or streaming throughput.')
             parser.add_argument('--port', required=True, help='Serial port device.')
             parser.add_argument('--baud', type=int, required=True, help='Baud rate.')
             parser.add_argument('--count', type=int, default=5000, help='Number of commands.')
+            parser.add_argument('--stream', action='store_true', help='Measure throughput using the streaming mode (M110 W1).')
+            parser.add_argument('--corrupt-every', type=int, default=0, help='In streaming mode, corrupt the first transmission of every Nth line.')
+            parser.add_argument('--corrupt-times', type=int, default=1, help='With --corrupt-every, corrupt this many transmissions of those lines, so that resent lines are corrupted too.')
             args = parser.parse_args()
             print(args.port)
             print(args.baud)
@@ -33,6 +36,22 @@ class Program (littlevent.close.Obj):
             self.start_time = time.time()
             self.frame = ''
             
+            self.stream = args.stream
+            self.corrupt_every = args.corrupt_every
+            self.corrupt_times = args.corrupt_times
+            if self.stream:
+                # The M110 line is number 0 and is included in the byte counts.
+                self.next_line = 0
+                self.sent_bytes = 0
+                self.consumed_bytes = 0
+                self.window = None
+                self.resend_count = 0
+                self.corrupt_count = 0
+                self.corrupted = {}
+                # Byte position where the lines resent after the last resend
+                # request start; requests for lines before it are stale.
+                self.resend_bytes = None
+            
             self._read()
             self._write()
             
@@ -60,7 +79,10 @@ class Program (littlevent.close.Obj):
             data = data[(newline_pos + 1):]
             if len(response) > 0 and response[-1] == '\r':
                 response = response[:-1]
-            if not response.startswith('ok'):
+            if self.stream:
+                if not self._stream_response(response):
+                    return
+            elif not response.startswith('ok'):
                 print('Unknown line received: >{}<'.format(response))
             else:
                 if self.writing:
@@ -77,16 +99,87 @@ class Program (littlevent.close.Obj):
             print('ERROR: write error: {}'.format(err))
             return self._quit()
         self.writing = False
+        if self.stream:
+            self._stream_write()
     
     def _read (self):
         self.serial.read_io().read_start(512)
     
     def _write (self):
         assert not self.writing
+        if self.stream:
+            return self._stream_write()
         msg = 'G1\n'
         self.serial.write_io().write_start(msg)
         self.writing = True
     
+    def _stream_line (self, number, corrupt):
+        if number == 0:
+            line = 'N0 M110 W1'
+        else:
+            line = 'N{} G1'.format(number)
+        checksum = 0
+        for ch in line:
+            checksum ^= ord(ch)
+        if corrupt:
+            # Does not change the length of the line.
+            checksum ^= 1
+        return '{}*{}\n'.format(line, checksum)
+    
+    def _stream_write (self):
+        # Send as many lines as fit into the window; until the first credit
+        # report the window is not known, so just the M110 is sent.
+        if self.writing or self.next_line > self.want_count:
+            return
+        if self.window is None and self.next_line > 0:
+            return
+        msg = ''
+        while self.next_line <= self.want_count:
+            corrupt = (self.corrupt_every > 0 and self.next_line > 0 and self.next_line % self.corrupt_every == 0 and self.corrupted.get(self.next_line, 0) < self.corrupt_times)
+            line = self._stream_line(self.next_line, corrupt)
+            in_flight = (self.sent_bytes + len(msg) - self.consumed_bytes) % 2**32
+            if self.window is not None and in_flight + len(line) > self.window:
+                break
+            if corrupt:
+                self.corrupted[self.next_line] = self.corrupted.get(self.next_line, 0) + 1
+                self.corrupt_count += 1
+            msg += line
+            self.next_line += 1
+            if self.window is None:
+                break
+        if len(msg) == 0:
+            return
+        self.sent_bytes = (self.sent_bytes + len(msg)) % 2**32
+        self.serial.write_io().write_start(msg)
+        self.writing = True
+    
+    def _stream_response (self, response):
+        fields = response.split(' ')
+        if fields[0] == 'cr':
+            values = dict((field[0], int(field[1:])) for field in fields[1:])
+            self.consumed_bytes = values['B']
+            self.window = values['W']
+            self.done_count = values['N']
+            if self.done_count >= self.want_count:
+                self._finished()
+                return False
+            self._stream_write()
+        elif fields[0] == 'rs':
+            values = dict((field[0], int(field[1:])) for field in fields[1:])
+            # The request is repeated until the line arrives, also for the lines
+            # which were in flight when we went back; skip those.
+            if self.resend_bytes is not None:
+                past_resend = (values['B'] - self.resend_bytes) % 2**32
+                if past_resend == 0 or past_resend >= 2**31:
+                    return True
+            self.resend_count += 1
+            self.next_line = values['N']
+            self.resend_bytes = self.sent_bytes
+            self._stream_write()
+        elif not response.startswith('Error:'):
+            print('Unknown line received: >{}<'.format(response))
+        return True
+    
     def _quit (self):
         print('Quitting.')
         self.loop.quit(1)
@@ -94,7 +187,11 @@ class Program (littlevent.close.Obj):
     def _finished (self):
         total_time = time.time() - self.start_time
         print('Done {} requests in {} seconds.'.format(self.done_count, total_time))
-        print('Average request time is {} seconds.'.format(total_time / self.done_count))
+        if self.stream:
+            print('Throughput is {} commands per second.'.format(self.done_count / total_time))
+            print('Corrupted {} lines, got {} resend requests.'.format(self.corrupt_count, self.resend_count))
+        else:
+            print('Average request time is {} seconds.'.format(total_time / self.done_count))
         self.loop.quit(0)
     
 p = Program()
@@ -29,6 +29,7 @@
 , optimizeForSize ? false
 , assertionsEnabled ? false
 , eventLoopBenchmarkEnabled ? false
+, eventLoopProfileEnabled ? false
 , detectOverloadEnabled ? false
 , buildWithClang ? false
 , verboseBuild ? false
@@ -92,6 +93,7 @@ let
     compileFlags = stdenv.lib.concatStringsSep " " [
         (stdenv.lib.optionalString assertionsEnabled "-DAMBROLIB_ASSERTIONS")
         (stdenv.lib.optionalString eventLoopBenchmarkEnabled "-DEVENTLOOP_BENCHMARK")
+        (stdenv.lib.optionalString eventLoopProfileEnabled "-DEVENTLOOP_PROFILE")
         (stdenv.lib.optionalString detectOverloadEnabled "-DAXISDRIVER_DETECT_OVERLOAD")
     ];
     
@@ -134,5 +134,12 @@ rec {
             APB2_PRESC_DIV = "1";
             USB_MODE = "FS";
         };
-    };    
+    };
+    
+    linux = {
+        platform = "linux";
+        targetVars = {
+            F_CPU = "96000000";
+        };
+    };
 }
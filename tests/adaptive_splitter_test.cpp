@@ -0,0 +1,434 @@
+/*
+ * Copyright (c) 2013 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Compares the AdaptiveSplitter with the uniform DistanceSplitter on the
+ * moves of a print, using the exact DeltaTransform. The moves are read
+ * from a G-code file given as the argument (absolute G0/G1 moves only),
+ * or a synthetic print with perimeters, infill and travel moves is used.
+ * For both splitters, the number of segments, the number of virtToPhys()
+ * evaluations and the largest deviation of the carriage positions from
+ * the straight segments (sampled along each segment) are printed.
+ * The evaluator reuses positions like the one in PrinterMain. The adaptive
+ * splitter must stay within its maximum deviation and within its limit of
+ * segments per second.
+ *
+ * Build: g++ -std=c++14 -O2 -I.. adaptive_splitter_test.cpp -o adaptive_splitter_test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Needed by InterruptLock.h; there are no real interrupts here.
+inline static void cli (void) {}
+inline static void sei (void) {}
+
+#include <aprinter/meta/BasicMetaUtils.h>
+#include <aprinter/meta/TypeList.h>
+#include <aprinter/meta/Expr.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/printer/Configuration.h>
+#include <aprinter/printer/transform/DeltaTransform.h>
+#include <aprinter/printer/transform/DistanceSplitter.h>
+#include <aprinter/printer/transform/AdaptiveSplitter.h>
+
+using namespace APrinter;
+
+static constexpr double DiagonalRod = 214.0;
+static constexpr double SmoothRodOffset = 145.0;
+static constexpr double EffectorOffset = 19.9;
+static constexpr double CarriageOffset = 19.5;
+static constexpr double LimitRadius = 90.0;
+static constexpr double MaxDeviation = 0.01;
+static constexpr double MinSplitLength = 0.1;
+static constexpr double AdaptiveMaxSplitLength = 20.0;
+static constexpr double AdaptiveSegmentsPerSecond = 200.0;
+
+struct MyClock {
+    static constexpr double time_unit = 1e-6;
+};
+
+struct MyContext {
+    using Clock = MyClock;
+};
+
+APRINTER_CONFIG_START
+
+APRINTER_CONFIG_OPTION_DOUBLE(OptDiagonalRod, DiagonalRod, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptSmoothRodOffset, SmoothRodOffset, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptEffectorOffset, EffectorOffset, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptCarriageOffset, CarriageOffset, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptLimitRadius, LimitRadius, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptMinSplitLength, MinSplitLength, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptUniformMaxSplitLength, 4.0, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptSegmentsPerSecond, 100.0, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptAdaptiveMaxSplitLength, AdaptiveMaxSplitLength, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptMaxDeviation, MaxDeviation, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptAdaptiveSegmentsPerSecond, AdaptiveSegmentsPerSecond, ConfigNoProperties)
+
+APRINTER_CONFIG_END
+
+template <typename TheExpr>
+struct ConstantHelper {
+    static typename TheExpr::Type value () { return TheExpr::value(); }
+    static typename TheExpr::Type eval (MyContext c) { return TheExpr::value(); }
+};
+
+struct TestConfig {
+    template <typename Option>
+    static auto e (Option) -> ConstantExpr<typename Option::Type, typename Option::DefaultValue>;
+    
+    template <typename TheExpr>
+    static TheExpr getExpr (TheExpr);
+    
+    template <typename TheExpr>
+    static ConstantHelper<TheExpr> getHelper (TheExpr);
+};
+
+struct Program;
+
+using TransformService = DeltaTransformService<OptDiagonalRod, OptSmoothRodOffset, OptEffectorOffset, OptCarriageOffset, OptLimitRadius, 0, false>;
+using UniformService = DistanceSplitterService<OptMinSplitLength, OptUniformMaxSplitLength, OptSegmentsPerSecond>;
+using AdaptiveService = AdaptiveSplitterService<OptMinSplitLength, OptAdaptiveMaxSplitLength, OptMaxDeviation, OptAdaptiveSegmentsPerSecond>;
+
+APRINTER_MAKE_INSTANCE(TheTransform, (TransformService::Transform<MyContext, Program, TestConfig, float>))
+APRINTER_MAKE_INSTANCE(UniformSplitterClass, (UniformService::Splitter<MyContext, Program, TestConfig, float>))
+APRINTER_MAKE_INSTANCE(AdaptiveSplitterClass, (AdaptiveService::Splitter<MyContext, Program, TestConfig, float>))
+
+struct Program : public ObjBase<void, void, MakeTypeList<
+    TheTransform,
+    UniformSplitterClass,
+    AdaptiveSplitterClass
+>> {
+    static Program * self (MyContext c);
+};
+
+Program p;
+
+Program * Program::self (MyContext c) { return &p; }
+
+struct ArraySrc {
+    float const *arr;
+    
+    template <int Index>
+    float get () { return arr[Index]; }
+};
+
+struct ArrayDst {
+    float *arr;
+    
+    template <int Index>
+    void set (float x) { arr[Index] = x; }
+};
+
+struct Move {
+    double start[3];
+    double end[3];
+    double speed;
+};
+
+static Move *moves;
+static int num_moves;
+static int moves_capacity;
+
+static void add_move (double const *start, double const *end, double speed)
+{
+    if (num_moves == moves_capacity) {
+        moves_capacity = 2 * moves_capacity + 1024;
+        moves = (Move *)realloc(moves, moves_capacity * sizeof(Move));
+        AMBRO_ASSERT_FORCE(moves)
+    }
+    Move *m = &moves[num_moves++];
+    for (int i = 0; i < 3; i++) {
+        m->start[i] = start[i];
+        m->end[i] = end[i];
+    }
+    m->speed = speed;
+}
+
+static void read_gcode (char const *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        exit(1);
+    }
+    double pos[3] = {0.0, 0.0, 0.0};
+    double speed = 50.0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char *comment = strchr(line, ';');
+        if (comment) {
+            *comment = '\0';
+        }
+        if (strncmp(line, "G0 ", 3) && strncmp(line, "G1 ", 3)) {
+            continue;
+        }
+        double new_pos[3] = {pos[0], pos[1], pos[2]};
+        for (char *s = line + 3; *s; s++) {
+            if (*s >= 'X' && *s <= 'Z') {
+                new_pos[*s - 'X'] = strtod(s + 1, NULL);
+            } else if (*s == 'F') {
+                speed = strtod(s + 1, NULL) / 60.0;
+            }
+        }
+        if (new_pos[0] != pos[0] || new_pos[1] != pos[1] || new_pos[2] != pos[2]) {
+            add_move(pos, new_pos, speed);
+        }
+        memcpy(pos, new_pos, sizeof(pos));
+    }
+    fclose(f);
+}
+
+// Layers of a round part: three perimeters made of short chords, like
+// a slicer would output them, a zig-zag infill and travel moves.
+static void make_synthetic_print ()
+{
+    double pos[3] = {0.0, 0.0, 0.2};
+    for (int layer = 0; layer < 50; layer++) {
+        double z = 0.2 * (layer + 1);
+        for (int perimeter = 0; perimeter < 3; perimeter++) {
+            double radius = 85.0 - 0.5 * perimeter;
+            int chords = (int)(2.0 * M_PI * radius / 1.5);
+            double next[3] = {radius, 0.0, z};
+            add_move(pos, next, 150.0);
+            memcpy(pos, next, sizeof(pos));
+            for (int i = 1; i <= chords; i++) {
+                double angle = 2.0 * M_PI * i / chords;
+                next[0] = radius * cos(angle);
+                next[1] = radius * sin(angle);
+                add_move(pos, next, 40.0);
+                memcpy(pos, next, sizeof(pos));
+            }
+        }
+        double infill_radius = 83.0;
+        bool vertical = layer % 2;
+        for (double a = -infill_radius + 2.0; a < infill_radius; a += 2.0) {
+            double half = sqrt(infill_radius * infill_radius - a * a);
+            double from[3] = {a, -half, z};
+            double to[3] = {a, half, z};
+            if (!vertical) {
+                from[0] = -half; from[1] = a;
+                to[0] = half; to[1] = a;
+            }
+            if ((int)((a + infill_radius) / 2.0) % 2) {
+                double t[3];
+                memcpy(t, from, sizeof(t));
+                memcpy(from, to, sizeof(t));
+                memcpy(to, t, sizeof(t));
+            }
+            add_move(pos, from, 60.0);
+            add_move(from, to, 60.0);
+            memcpy(pos, to, sizeof(pos));
+        }
+    }
+}
+
+static double exact_height (int tower, double const *pos)
+{
+    double radius = SmoothRodOffset - EffectorOffset - CarriageOffset;
+    double angle = (210.0 + 120.0 * tower) * (M_PI / 180.0);
+    double tx = radius * cos(angle);
+    double ty = radius * sin(angle);
+    return sqrt(DiagonalRod * DiagonalRod - (tx - pos[0]) * (tx - pos[0]) - (ty - pos[1]) * (ty - pos[1])) + pos[2];
+}
+
+static void line_pos (Move const *m, double frac, double *pos)
+{
+    for (int i = 0; i < 3; i++) {
+        pos[i] = m->start[i] + frac * (m->end[i] - m->start[i]);
+    }
+}
+
+// Largest deviation of the carriages from the straight segment between
+// the carriage positions at frac0 and frac1, sampled along the segment.
+static double segment_deviation (Move const *m, double frac0, double frac1)
+{
+    double pos0[3];
+    double pos1[3];
+    line_pos(m, frac0, pos0);
+    line_pos(m, frac1, pos1);
+    double max_deviation = 0.0;
+    for (int j = 1; j < 8; j++) {
+        double t = j / 8.0;
+        double pos[3];
+        line_pos(m, frac0 + t * (frac1 - frac0), pos);
+        for (int tower = 0; tower < 3; tower++) {
+            double chord = exact_height(tower, pos0) + t * (exact_height(tower, pos1) - exact_height(tower, pos0));
+            max_deviation = fmax(max_deviation, fabs(exact_height(tower, pos) - chord));
+        }
+    }
+    return max_deviation;
+}
+
+static uint64_t num_evaluations;
+
+// The end of the last chord, kept across pulls, reset for each move.
+static float split_end_frac;
+static float split_end_pos[3];
+
+struct Evaluator {
+    Evaluator (Move const *m)
+    : m(m), start_frac(-1.0f), mid_frac(-1.0f)
+    {}
+    
+    bool eval (float frac, float *phys)
+    {
+        num_evaluations++;
+        double pos[3];
+        line_pos(m, frac, pos);
+        float virt[3] = {(float)pos[0], (float)pos[1], (float)pos[2]};
+        return TheTransform::virtToPhys(MyContext(), ArraySrc{virt}, ArrayDst{phys});
+    }
+    
+    bool get_deviation (float frac0, float frac1, float *out_deviation)
+    {
+        float frac_mid = 0.5f * (frac0 + frac1);
+        float pos1[3];
+        float pos_mid[3];
+        
+        if (frac0 == split_end_frac) {
+            memcpy(start_pos, split_end_pos, sizeof(start_pos));
+        } else if (frac0 != start_frac && !eval(frac0, start_pos)) {
+            return false;
+        }
+        start_frac = frac0;
+        if (frac1 == mid_frac) {
+            memcpy(pos1, mid_pos, sizeof(pos1));
+        } else if (!eval(frac1, pos1)) {
+            return false;
+        }
+        if (!eval(frac_mid, pos_mid)) {
+            return false;
+        }
+        
+        float deviation = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            deviation = fmaxf(deviation, fabsf(pos_mid[i] - 0.5f * (start_pos[i] + pos1[i])));
+        }
+        *out_deviation = deviation;
+        
+        mid_frac = frac_mid;
+        memcpy(mid_pos, pos_mid, sizeof(pos_mid));
+        split_end_frac = frac1;
+        memcpy(split_end_pos, pos1, sizeof(pos1));
+        return true;
+    }
+    
+    Move const *m;
+    float start_frac;
+    float mid_frac;
+    float start_pos[3];
+    float mid_pos[3];
+};
+
+struct Result {
+    uint64_t segments;
+    uint64_t evaluations;
+    double max_deviation;
+};
+
+template <typename SplitterClass>
+static Result run_splitter (bool adaptive)
+{
+    MyContext c;
+    Result res = {0, 0, 0.0};
+    num_evaluations = 0;
+    
+    for (int i = 0; i < num_moves; i++) {
+        Move const *m = &moves[i];
+        double distance = 0.0;
+        for (int j = 0; j < 3; j++) {
+            distance += (m->end[j] - m->start[j]) * (m->end[j] - m->start[j]);
+        }
+        distance = sqrt(distance);
+        float time_freq_by_max_speed = 1.0 / (MyClock::time_unit * m->speed);
+        float base_max_v_rec = distance * time_freq_by_max_speed;
+        
+        typename SplitterClass::Splitter splitter;
+        splitter.start(c, distance, base_max_v_rec, time_freq_by_max_speed);
+        split_end_frac = -1.0f;
+        float frac = 0.0f;
+        uint64_t move_segments = 0;
+        float rel_max_v_rec_sum = 0.0f;
+        bool more;
+        do {
+            float prev_frac = frac;
+            float rel_max_v_rec;
+            more = splitter.pull(c, &rel_max_v_rec, &frac, Evaluator{m});
+            if (!more) {
+                frac = 1.0f;
+            }
+            AMBRO_ASSERT_FORCE(frac > prev_frac)
+            rel_max_v_rec_sum += rel_max_v_rec;
+            res.segments++;
+            move_segments++;
+            // Each segment's end position is computed by the transform.
+            num_evaluations++;
+            res.max_deviation = fmax(res.max_deviation, segment_deviation(m, prev_frac, frac));
+        } while (more);
+        
+        // The segments together must not be faster than the whole move.
+        AMBRO_ASSERT_FORCE(fabsf(rel_max_v_rec_sum - base_max_v_rec) <= 1e-3f * base_max_v_rec)
+        
+        // Segments are at least the minimum length, except that the last
+        // two may share a remainder shorter than that.
+        if (adaptive) {
+            double min_length = fmin(AdaptiveMaxSplitLength, fmax(MinSplitLength, m->speed / AdaptiveSegmentsPerSecond));
+            AMBRO_ASSERT_FORCE(move_segments <= distance / min_length * 1.001 + 2)
+        }
+    }
+    
+    res.evaluations = num_evaluations;
+    return res;
+}
+
+int main (int argc, char *argv[])
+{
+    if (argc > 1) {
+        read_gcode(argv[1]);
+    } else {
+        make_synthetic_print();
+    }
+    
+    Result uniform = run_splitter<UniformSplitterClass>(false);
+    Result adaptive = run_splitter<AdaptiveSplitterClass>(true);
+    
+    printf("%d moves\n", num_moves);
+    printf("%-10s %12s %14s %20s\n", "splitter", "segments", "evaluations", "max deviation [um]");
+    printf("%-10s %12llu %14llu %20.3f\n", "uniform", (unsigned long long)uniform.segments, (unsigned long long)uniform.evaluations, uniform.max_deviation * 1000.0);
+    printf("%-10s %12llu %14llu %20.3f\n", "adaptive", (unsigned long long)adaptive.segments, (unsigned long long)adaptive.evaluations, adaptive.max_deviation * 1000.0);
+    printf("segments saved: %.1f%%\n", 100.0 * (1.0 - (double)adaptive.segments / uniform.segments));
+    
+    // The deviation is estimated in single precision at the middle of the
+    // segment only, allow some slack.
+    AMBRO_ASSERT_FORCE(adaptive.max_deviation <= 1.1 * MaxDeviation)
+    
+    return 0;
+}
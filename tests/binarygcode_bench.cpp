@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Round-trip test and benchmark of the binary G-code format, comparing the
+ * text GcodeParser with the BinaryGcodeParser reading the same G-code encoded
+ * by aprinter_encode.py, in version 1 and in version 2 (packed delta-encoded
+ * moves) of the format. The commands of all three are checked to have
+ * identical parts and values, except that version 2 may leave out the F
+ * value of G0/G1 when it is unchanged. Resuming in the middle of the file, as
+ * with M26, is checked to be refused for version 2. Then the size per move
+ * and the time to parse the commands and get their values are printed.
+ *
+ * Synthetic G-code resembling slicer output can be generated by this program,
+ * but any G-code meant for the firmware may be used:
+ *   ./binarygcode_bench --generate test.gcode
+ *   python2.7 ../aprinter_encode.py --input test.gcode --output test.bin
+ *   python2.7 ../aprinter_encode.py --v2 --input test.gcode --output test_v2.bin
+ *   ./binarygcode_bench test.gcode test.bin test_v2.bin
+ *
+ * Build: g++ -std=c++11 -O2 -I.. binarygcode_bench.cpp -o binarygcode_bench
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Needed by InterruptLock.h; there are no real interrupts here.
+inline static void cli (void) {}
+inline static void sei (void) {}
+
+#include <aprinter/base/Assert.h>
+#include <aprinter/printer/utils/GcodeParser.h>
+#include <aprinter/printer/utils/BinaryGcodeParser.h>
+
+using namespace APrinter;
+
+using FpType = float;
+
+static int const MaxParts = 14;
+static size_t const MaxCommandSize = 128;
+static int const NumRuns = 20;
+
+struct MyContext {};
+
+using TheTextParser = FileGcodeParserService<MaxParts, true>::Parser<MyContext, size_t, FpType>;
+using TheBinaryParser = BinaryGcodeParserService<MaxParts>::Parser<MyContext, size_t, FpType>;
+
+struct Command {
+    char cmd_code;
+    uint16_t cmd_number;
+    int num_parts;
+    char codes[MaxParts];
+    FpType values[MaxParts];
+};
+
+struct Data {
+    char *buffer;
+    size_t size;
+};
+
+static Data read_file (char const *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    Data data;
+    data.size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data.buffer = (char *)malloc(data.size + 1);
+    AMBRO_ASSERT_FORCE(fread(data.buffer, 1, data.size, f) == data.size)
+    fclose(f);
+    return data;
+}
+
+static void generate (char const *path)
+{
+    FILE *f = fopen(path, "w");
+    AMBRO_ASSERT_FORCE(f)
+    
+    srand(1);
+    fprintf(f, "G90\nM83\nG92 E0\n");
+    for (int layer = 1; layer <= 100; layer++) {
+        fprintf(f, ";LAYER:%d\nG0 F9000 Z%.3f\n", layer, 0.2 * layer);
+        // Perimeters of a few round islands, in short segments.
+        for (int island = 0; island < 4; island++) {
+            double cx = 40.0 + 40.0 * (island % 2) + 0.001 * (rand() % 1000);
+            double cy = 40.0 + 40.0 * (island / 2) + 0.001 * (rand() % 1000);
+            for (int loop = 0; loop < 3; loop++) {
+                double r = 15.0 - 0.4 * loop;
+                fprintf(f, "G0 F9000 X%.3f Y%.3f\n", cx + r, cy);
+                int segments = 200;
+                for (int i = 1; i <= segments; i++) {
+                    double a = 2.0 * M_PI * i / segments;
+                    double seg_len = 2.0 * M_PI * r / segments;
+                    fprintf(f, "G1 F1800 X%.3f Y%.3f E%.5f\n", cx + r * cos(a), cy + r * sin(a), 0.0333 * seg_len);
+                }
+            }
+        }
+        // Infill of long lines.
+        fprintf(f, "G0 F9000 X20.000 Y20.000\n");
+        for (int i = 0; i < 100; i++) {
+            double y = 20.0 + 0.8 * i;
+            fprintf(f, "G1 F3600 X%.3f Y%.3f E%.5f\n", (i % 2) ? 20.0 : 100.0, y, 0.0333 * 80.0);
+            fprintf(f, "G1 X%.3f Y%.3f E%.5f\n", (i % 2) ? 20.0 : 100.0, y + 0.8, 0.0333 * 0.8);
+        }
+    }
+    fprintf(f, "M104 S0\n");
+    
+    fclose(f);
+}
+
+static void get_command (GcodeCommand<MyContext, FpType> *cmd, Command *out)
+{
+    MyContext c;
+    out->cmd_code = cmd->getCmdCode(c);
+    out->cmd_number = cmd->getCmdNumber(c);
+    out->num_parts = cmd->getNumParts(c);
+    for (int i = 0; i < out->num_parts; i++) {
+        auto part = cmd->getPart(c, i);
+        out->codes[i] = cmd->getPartCode(c, part);
+        out->values[i] = cmd->getPartFpValue(c, part);
+    }
+}
+
+// Parses all commands, storing them to the commands array if given.
+// Returns the number of commands, excluding empty lines.
+template <typename Parser>
+static size_t parse_all (Parser *parser, char *buffer, size_t size, Command *commands)
+{
+    MyContext c;
+    parser->init(c);
+    size_t pos = 0;
+    size_t count = 0;
+    while (pos < size) {
+        size_t avail = size - pos;
+        bool exhausted = false;
+        if (avail >= MaxCommandSize) {
+            avail = MaxCommandSize;
+            exhausted = true;
+        }
+        parser->startCommand(c, buffer + pos, 0);
+        AMBRO_ASSERT_FORCE(parser->extendCommand(c, avail, exhausted))
+        pos += parser->getLength(c);
+        int num_parts = parser->getNumParts(c);
+        if (num_parts == GCODE_ERROR_EOF) {
+            break;
+        }
+        if (num_parts == GCODE_ERROR_NO_PARTS) {
+            continue;
+        }
+        AMBRO_ASSERT_FORCE(num_parts >= 0)
+        if (commands) {
+            get_command(parser, &commands[count]);
+        } else {
+            // Get the values as the firmware would.
+            volatile FpType sum = 0.0f;
+            for (int i = 0; i < num_parts; i++) {
+                sum = sum + parser->getPartFpValue(c, parser->getPart(c, i));
+            }
+        }
+        count++;
+    }
+    parser->deinit(c);
+    return count;
+}
+
+// Parses a binary file and checks canSeek() after it. For a version 2 file,
+// also starts parsing at a MOVES record in the middle of the file, which must
+// be reported as an error with the length of the whole record.
+static void check_resume (Data const *data, bool packed)
+{
+    MyContext c;
+    static TheBinaryParser parser;
+    parser.init(c);
+    AMBRO_ASSERT_FORCE(parser.canSeek(c))
+    size_t pos = 0;
+    size_t resume_pos = 0;
+    size_t resume_length = 0;
+    while (pos < data->size) {
+        size_t avail = data->size - pos;
+        if (avail > MaxCommandSize) {
+            avail = MaxCommandSize;
+        }
+        parser.startCommand(c, data->buffer + pos, 0);
+        AMBRO_ASSERT_FORCE(parser.extendCommand(c, avail, avail == MaxCommandSize))
+        size_t length = parser.getLength(c);
+        if (parser.getNumParts(c) == GCODE_ERROR_EOF) {
+            break;
+        }
+        AMBRO_ASSERT_FORCE(parser.getNumParts(c) >= 0)
+        if (pos < data->size / 2 && ((uint8_t)data->buffer[pos] >> 4) == 4 && length > 0) {
+            resume_pos = pos;
+            resume_length = length;
+        }
+        pos += length;
+    }
+    AMBRO_ASSERT_FORCE(parser.canSeek(c) == !packed)
+    parser.deinit(c);
+    
+    if (packed) {
+        AMBRO_ASSERT_FORCE(resume_length > 0)
+        parser.init(c);
+        parser.startCommand(c, data->buffer + resume_pos, 0);
+        AMBRO_ASSERT_FORCE(parser.extendCommand(c, data->size - resume_pos, false))
+        AMBRO_ASSERT_FORCE(parser.getNumParts(c) == GCODE_ERROR_NO_SETUP)
+        AMBRO_ASSERT_FORCE(parser.getLength(c) == resume_length)
+        AMBRO_ASSERT_FORCE(parser.canSeek(c))
+        parser.deinit(c);
+    }
+}
+
+static bool is_move (Command const *cmd)
+{
+    return cmd->cmd_code == 'G' && (cmd->cmd_number == 0 || cmd->cmd_number == 1);
+}
+
+// Compares the parts other than F regardless of order, and the F value
+// remembered after the command.
+static void check_command (Command const *ref, Command const *cmd, FpType *ref_f, FpType *cmd_f)
+{
+    AMBRO_ASSERT_FORCE(cmd->cmd_code == ref->cmd_code)
+    AMBRO_ASSERT_FORCE(cmd->cmd_number == ref->cmd_number)
+    
+    int num_ref_parts = 0;
+    int num_cmd_parts = 0;
+    for (int j = 0; j < 2; j++) {
+        Command const *a = j ? cmd : ref;
+        FpType *f = j ? cmd_f : ref_f;
+        for (int i = 0; i < a->num_parts; i++) {
+            if (is_move(a) && a->codes[i] == 'F') {
+                *f = a->values[i];
+            } else {
+                *(j ? &num_cmd_parts : &num_ref_parts) += 1;
+            }
+        }
+    }
+    AMBRO_ASSERT_FORCE(num_cmd_parts == num_ref_parts)
+    AMBRO_ASSERT_FORCE(*cmd_f == *ref_f)
+    
+    for (int i = 0; i < ref->num_parts; i++) {
+        if (is_move(ref) && ref->codes[i] == 'F') {
+            continue;
+        }
+        int k = 0;
+        while (k < cmd->num_parts && cmd->codes[k] != ref->codes[i]) {
+            k++;
+        }
+        AMBRO_ASSERT_FORCE(k < cmd->num_parts)
+        AMBRO_ASSERT_FORCE(cmd->values[k] == ref->values[i])
+    }
+}
+
+template <typename Parser>
+static double time_parse (Data const *data, size_t *out_count)
+{
+    static Parser parser;
+    char *copy = (char *)malloc(data->size + 1);
+    double total_ns = 0.0;
+    for (int run = 0; run < NumRuns; run++) {
+        // The text parser modifies the buffer.
+        memcpy(copy, data->buffer, data->size);
+        struct timespec t1, t2;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        *out_count = parse_all(&parser, copy, data->size, nullptr);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        total_ns += (t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec);
+    }
+    free(copy);
+    return total_ns / NumRuns / *out_count;
+}
+
+int main (int argc, char *argv[])
+{
+    if (argc == 3 && !strcmp(argv[1], "--generate")) {
+        generate(argv[2]);
+        return 0;
+    }
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s --generate <text>\n       %s <text> <binary> <binary_v2>\n", argv[0], argv[0]);
+        return 1;
+    }
+    
+    Data text = read_file(argv[1]);
+    Data binary[2] = {read_file(argv[2]), read_file(argv[3])};
+    
+    // Upper bound on the number of commands, one per line of text.
+    size_t max_commands = 1;
+    for (size_t i = 0; i < text.size; i++) {
+        max_commands += (text.buffer[i] == '\n');
+    }
+    
+    static TheTextParser text_parser;
+    static TheBinaryParser binary_parser;
+    
+    Command *text_commands = new Command[max_commands];
+    Command *binary_commands = new Command[max_commands];
+    
+    char *text_copy = (char *)malloc(text.size + 1);
+    memcpy(text_copy, text.buffer, text.size);
+    size_t num_commands = parse_all(&text_parser, text_copy, text.size, text_commands);
+    free(text_copy);
+    
+    size_t num_moves = 0;
+    for (size_t i = 0; i < num_commands; i++) {
+        num_moves += (text_commands[i].cmd_code == 'G' && text_commands[i].cmd_number == 1);
+    }
+    
+    for (int version = 0; version < 2; version++) {
+        size_t num_binary = parse_all(&binary_parser, binary[version].buffer, binary[version].size, binary_commands);
+        AMBRO_ASSERT_FORCE(num_binary == num_commands)
+        FpType text_f = -1.0f;
+        FpType binary_f = -1.0f;
+        for (size_t i = 0; i < num_commands; i++) {
+            check_command(&text_commands[i], &binary_commands[i], &text_f, &binary_f);
+        }
+        check_resume(&binary[version], version == 1);
+    }
+    
+    printf("%zu commands, %zu G1 moves, all commands identical\n\n", num_commands, num_moves);
+    printf("%10s %12s %12s %12s\n", "format", "bytes/move", "ns/command", "ns/move");
+    
+    size_t count;
+    double ns;
+    
+    ns = time_parse<TheTextParser>(&text, &count);
+    printf("%10s %12.2f %12.1f %12.1f\n", "text", (double)text.size / num_moves, ns, ns * count / num_moves);
+    
+    char const *names[2] = {"binary v1", "binary v2"};
+    for (int version = 0; version < 2; version++) {
+        ns = time_parse<TheBinaryParser>(&binary[version], &count);
+        printf("%10s %12.2f %12.1f %12.1f\n", names[version], (double)binary[version].size / num_moves, ns, ns * count / num_moves);
+    }
+    
+    return 0;
+}
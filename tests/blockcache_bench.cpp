@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark of the block lookup and eviction as done by BlockCache, comparing
+ * a linear scan over all entries (lookup by block, eviction of the least
+ * recently used entry) with the HashIndexTable lookup and an LRU list.
+ * The access pattern mixes sequential file reads with a few hot (FAT and
+ * directory) blocks. The hit counts of both methods are checked to be identical.
+ *
+ * Build: g++ -std=c++11 -O2 -I.. blockcache_bench.cpp -o blockcache_bench
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <aprinter/base/Assert.h>
+#include <aprinter/structure/HashIndexTable.h>
+#include <aprinter/structure/DoubleEndedList.h>
+
+using namespace APrinter;
+
+static int const MaxEntries = 1024;
+static size_t const NumAccesses = 2000000;
+
+static uint32_t accesses[NumAccesses];
+
+struct Entry {
+    bool assigned;
+    uint32_t block;
+    uint32_t last_use;
+    DoubleEndedListNode<Entry> lru_node;
+};
+
+struct Cache {
+    int num_entries;
+    uint32_t time;
+    uint64_t hits;
+    Entry entries[MaxEntries];
+    HashIndexTable<uint32_t, int16_t, MaxEntries> index;
+    DoubleEndedList<Entry, &Entry::lru_node> lru;
+};
+
+static void init_cache (Cache *ca, int num_entries)
+{
+    ca->num_entries = num_entries;
+    ca->time = 0;
+    ca->hits = 0;
+    ca->index.init();
+    ca->lru.init();
+    for (int i = 0; i < num_entries; i++) {
+        ca->entries[i].assigned = false;
+        ca->entries[i].last_use = 0;
+        ca->lru.append(&ca->entries[i]);
+    }
+}
+
+static void access_linear (Cache *ca, uint32_t block)
+{
+    ca->time++;
+    int victim = 0;
+    for (int i = 0; i < ca->num_entries; i++) {
+        Entry *e = &ca->entries[i];
+        if (e->assigned && e->block == block) {
+            e->last_use = ca->time;
+            ca->hits++;
+            return;
+        }
+        // Unassigned entries have last_use zero so they are taken first.
+        if (e->last_use < ca->entries[victim].last_use) {
+            victim = i;
+        }
+    }
+    Entry *e = &ca->entries[victim];
+    e->assigned = true;
+    e->block = block;
+    e->last_use = ca->time;
+}
+
+static void access_hashed (Cache *ca, uint32_t block)
+{
+    auto key = [&](int16_t i) { return ca->entries[i].block; };
+    int16_t index = ca->index.find(block, key);
+    Entry *e;
+    if (index != -1) {
+        e = &ca->entries[index];
+        ca->hits++;
+    } else {
+        e = ca->lru.first();
+        index = e - ca->entries;
+        if (e->assigned) {
+            ca->index.remove(index, e->block, key);
+        }
+        e->assigned = true;
+        e->block = block;
+        ca->index.insert(index, block);
+    }
+    ca->lru.remove(e);
+    ca->lru.append(e);
+}
+
+static uint64_t run (Cache *ca, int num_entries, bool hashed, double *out_ns_per_access)
+{
+    init_cache(ca, num_entries);
+    
+    struct timespec t1, t2;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    
+    for (size_t n = 0; n < NumAccesses; n++) {
+        if (hashed) {
+            access_hashed(ca, accesses[n]);
+        } else {
+            access_linear(ca, accesses[n]);
+        }
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    double ns = (t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec);
+    *out_ns_per_access = ns / NumAccesses;
+    return ca->hits;
+}
+
+static Cache cache;
+
+int main ()
+{
+    // A few files being read sequentially in turns, each read followed
+    // by a lookup of one of a small set of FAT and directory blocks.
+    srand(1);
+    uint32_t file_pos[4] = {100000, 300000, 500000, 700000};
+    size_t n = 0;
+    while (n < NumAccesses) {
+        int file = rand() % 4;
+        int run_length = 1 + rand() % 8;
+        for (int i = 0; i < run_length && n < NumAccesses; i++) {
+            accesses[n++] = file_pos[file]++;
+            if (n < NumAccesses) {
+                accesses[n++] = 2000 + (rand() % 32);
+            }
+        }
+        if (rand() % 64 == 0) {
+            file_pos[file] = 100000 + 200000 * file;
+        }
+    }
+    
+    printf("%8s %14s %14s %10s\n", "entries", "linear ns/acc", "hashed ns/acc", "hit ratio");
+    
+    for (int num_entries = 8; num_entries <= MaxEntries; num_entries *= 2) {
+        double linear_ns;
+        uint64_t linear_hits = run(&cache, num_entries, false, &linear_ns);
+        
+        double hashed_ns;
+        uint64_t hashed_hits = run(&cache, num_entries, true, &hashed_ns);
+        
+        AMBRO_ASSERT_FORCE(hashed_hits == linear_hits)
+        
+        printf("%8d %14.1f %14.1f %10.3f\n", num_entries, linear_ns, hashed_ns, (double)hashed_hits / NumAccesses);
+    }
+    
+    return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Benchmark and accuracy test of the rod height lookup table of
+ * DeltaTransform. For the exact formula and a few table configurations,
+ * virtToPhys() is run on random points within the limit radius, printing
+ * the number of transformed points per second and the maximum error of
+ * the carriage positions relative to a double precision computation.
+ * The maximum errors are checked against a bound for each configuration.
+ *
+ * Build: g++ -std=c++14 -O2 -I.. delta_transform_bench.cpp -o delta_transform_bench
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+// Needed by InterruptLock.h; there are no real interrupts here.
+inline static void cli (void) {}
+inline static void sei (void) {}
+
+#include <aprinter/meta/BasicMetaUtils.h>
+#include <aprinter/meta/TypeList.h>
+#include <aprinter/meta/Expr.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/printer/Configuration.h>
+#include <aprinter/printer/transform/DeltaTransform.h>
+
+using namespace APrinter;
+
+static constexpr double DiagonalRod = 214.0;
+static constexpr double SmoothRodOffset = 145.0;
+static constexpr double EffectorOffset = 19.9;
+static constexpr double CarriageOffset = 19.5;
+static constexpr double LimitRadius = 90.0;
+
+struct MyContext {};
+
+APRINTER_CONFIG_START
+
+APRINTER_CONFIG_OPTION_DOUBLE(OptDiagonalRod, DiagonalRod, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptSmoothRodOffset, SmoothRodOffset, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptEffectorOffset, EffectorOffset, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptCarriageOffset, CarriageOffset, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptLimitRadius, LimitRadius, ConfigNoProperties)
+
+APRINTER_CONFIG_END
+
+// The configuration expressions are read from a cache at runtime, as with
+// a runtime configuration manager.
+static float config_cache[64];
+static int config_cache_used;
+
+template <typename TheExpr>
+struct CachedExpr {
+    static bool const IsConstexpr = false;
+};
+
+template <typename TheExpr>
+struct ExprHelper {
+    static int const index;
+    
+    static typename TheExpr::Type value () { return TheExpr::value(); }
+    static typename TheExpr::Type eval (MyContext c) { return config_cache[index]; }
+};
+
+template <typename TheExpr>
+int const ExprHelper<TheExpr>::index = (config_cache[config_cache_used] = TheExpr::value(), config_cache_used++);
+
+struct TestConfig {
+    template <typename Option>
+    static auto e (Option) -> ConstantExpr<typename Option::Type, typename Option::DefaultValue>;
+    
+    template <typename TheExpr>
+    static CachedExpr<TheExpr> getExpr (TheExpr);
+    
+    template <typename TheExpr>
+    static ExprHelper<TheExpr> getHelper (TheExpr);
+};
+
+struct Program;
+
+template <int TableBits, bool TableRefine>
+using TestTransformService = DeltaTransformService<OptDiagonalRod, OptSmoothRodOffset, OptEffectorOffset, OptCarriageOffset, OptLimitRadius, TableBits, TableRefine>;
+
+APRINTER_MAKE_INSTANCE(ExactTransform, (TestTransformService<0, false>::Transform<MyContext, Program, TestConfig, float>))
+APRINTER_MAKE_INSTANCE(Table6Transform, (TestTransformService<6, false>::Transform<MyContext, Program, TestConfig, float>))
+APRINTER_MAKE_INSTANCE(Table8Transform, (TestTransformService<8, false>::Transform<MyContext, Program, TestConfig, float>))
+APRINTER_MAKE_INSTANCE(Table10Transform, (TestTransformService<10, false>::Transform<MyContext, Program, TestConfig, float>))
+APRINTER_MAKE_INSTANCE(Table6RefineTransform, (TestTransformService<6, true>::Transform<MyContext, Program, TestConfig, float>))
+APRINTER_MAKE_INSTANCE(Table8RefineTransform, (TestTransformService<8, true>::Transform<MyContext, Program, TestConfig, float>))
+
+struct Program : public ObjBase<void, void, MakeTypeList<
+    ExactTransform,
+    Table6Transform,
+    Table8Transform,
+    Table10Transform,
+    Table6RefineTransform,
+    Table8RefineTransform
+>> {
+    static Program * self (MyContext c);
+};
+
+Program p;
+
+Program * Program::self (MyContext c) { return &p; }
+
+struct ArraySrc {
+    float const *arr;
+    
+    template <int Index>
+    float get () { return arr[Index]; }
+};
+
+struct ArrayDst {
+    float *arr;
+    
+    template <int Index>
+    void set (float x) { arr[Index] = x; }
+};
+
+static int const NumPoints = 1000000;
+static float points[NumPoints][3];
+static float results[NumPoints][3];
+
+static double seconds ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double exact_height (int tower, double x, double y, double z)
+{
+    double radius = SmoothRodOffset - EffectorOffset - CarriageOffset;
+    double angle = (210.0 + 120.0 * tower) * (M_PI / 180.0);
+    double tx = radius * cos(angle);
+    double ty = radius * sin(angle);
+    return sqrt(DiagonalRod * DiagonalRod - (tx - x) * (tx - x) - (ty - y) * (ty - y)) + z;
+}
+
+// Transforms all points, returning the rate in points per second and the
+// maximum error in micrometers.
+template <typename Transform>
+static void run_transform (double *out_rate, double *out_max_error)
+{
+    MyContext c;
+    
+    double t0 = seconds();
+    for (int i = 0; i < NumPoints; i++) {
+        bool ok = Transform::virtToPhys(c, ArraySrc{points[i]}, ArrayDst{results[i]});
+        AMBRO_ASSERT_FORCE(ok)
+    }
+    double t1 = seconds();
+    
+    double max_error = 0.0;
+    for (int i = 0; i < NumPoints; i++) {
+        for (int tower = 0; tower < 3; tower++) {
+            double exact = exact_height(tower, points[i][0], points[i][1], points[i][2]);
+            max_error = fmax(max_error, fabs(results[i][tower] - exact));
+        }
+    }
+    
+    *out_rate = NumPoints / (t1 - t0);
+    *out_max_error = max_error * 1000.0;
+}
+
+int main ()
+{
+    srand(1);
+    for (int i = 0; i < NumPoints; i++) {
+        double x;
+        double y;
+        do {
+            x = LimitRadius * (2.0 * rand() / RAND_MAX - 1.0);
+            y = LimitRadius * (2.0 * rand() / RAND_MAX - 1.0);
+        } while (x * x + y * y > LimitRadius * LimitRadius);
+        points[i][0] = x;
+        points[i][1] = y;
+        points[i][2] = 100.0 * rand() / RAND_MAX;
+    }
+    
+    printf("%-16s %14s %16s %10s\n", "method", "points/s", "max error [um]", "bound");
+    
+    struct Row {
+        char const *name;
+        void (*run) (double *, double *);
+        double bound;
+    };
+    
+    Row const rows[] = {
+        {"exact", run_transform<ExactTransform>, 0.1},
+        {"table 6", run_transform<Table6Transform>, 30.0},
+        {"table 8", run_transform<Table8Transform>, 2.0},
+        {"table 10", run_transform<Table10Transform>, 0.2},
+        {"table 6 refine", run_transform<Table6RefineTransform>, 0.1},
+        {"table 8 refine", run_transform<Table8RefineTransform>, 0.1},
+    };
+    
+    for (Row const &row : rows) {
+        double rate;
+        double max_error;
+        row.run(&rate, &max_error);
+        printf("%-16s %14.0f %16.3f %10.3f\n", row.name, rate, max_error, row.bound);
+        AMBRO_ASSERT_FORCE(max_error <= row.bound)
+    }
+    
+    return 0;
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2013 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Benchmarks of BusyEventLoop, using the EVENTLOOP_BENCHMARK time accounting.
+ * 
+ * Timers: a queued event re-queues itself continuously, like a busy command
+ * processor, and on each run re-arms one of N idle timeouts (never expiring,
+ * like per-connection timeouts). Eight periodic timers fire every
+ * millisecond. For different N, the number of dispatches per second and the
+ * share of time spent outside of the handlers are printed.
+ * 
+ * Fast events: with 16 fast events registered, the number of idle loop passes
+ * per second is printed, and then the number of dispatches per second when
+ * two fast events keep triggering each other, which is the inverse of the
+ * latency from triggering a fast event to running its handler.
+ *
+ * Build: g++ -std=c++14 -O2 -I.. eventloop_bench.cpp -o eventloop_bench
+ */
+
+#define EVENTLOOP_BENCHMARK
+#define AMBROLIB_SUPPORT_QUIT
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Needed by InterruptLock.h; there are no real interrupts here.
+inline static void cli (void) {}
+inline static void sei (void) {}
+
+#include <aprinter/meta/TypeList.h>
+#include <aprinter/meta/BasicMetaUtils.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Callback.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/system/BusyEventLoop.h>
+
+using namespace APrinter;
+
+struct Context;
+struct Program;
+
+struct MyClock {
+    using TimeType = uint32_t;
+    static constexpr double time_unit = 1e-6;
+    static constexpr double time_freq = 1e6;
+    
+    static uint64_t num_calls;
+    
+    template <typename ThisContext>
+    static TimeType getTime (ThisContext c)
+    {
+        num_calls++;
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+};
+
+uint64_t MyClock::num_calls;
+
+using MyDebugObjectGroup = DebugObjectGroup<Context, Program>;
+struct MyLoopExtraDelay;
+APRINTER_MAKE_INSTANCE(MyLoop, (BusyEventLoopArg<Context, Program, MyLoopExtraDelay>))
+
+struct Context {
+    using DebugGroup = MyDebugObjectGroup;
+    using Clock = MyClock;
+    using EventLoop = MyLoop;
+    void check () const {}
+};
+
+template <int Index>
+struct FastEventId {};
+
+template <int Index>
+using FastSpec = MyLoop::FastEventSpec<FastEventId<Index>>;
+
+static int const NumFastEvents = 16;
+
+using FastEventList = MakeTypeList<
+    FastSpec<0>, FastSpec<1>, FastSpec<2>, FastSpec<3>, FastSpec<4>, FastSpec<5>, FastSpec<6>, FastSpec<7>,
+    FastSpec<8>, FastSpec<9>, FastSpec<10>, FastSpec<11>, FastSpec<12>, FastSpec<13>, FastSpec<14>, FastSpec<15>
+>;
+
+APRINTER_MAKE_INSTANCE(MyLoopExtra, (BusyEventLoopExtraArg<Program, MyLoop, FastEventList>))
+struct MyLoopExtraDelay : public WrapType<MyLoopExtra> {};
+
+struct Program : public ObjBase<void, void, MakeTypeList<
+    MyDebugObjectGroup,
+    MyLoop,
+    MyLoopExtra
+>> {
+    static Program * self (Context c);
+};
+
+Program program;
+
+Program * Program::self (Context c) { return &program; }
+
+static int const MaxIdleTimers = 1024;
+static int const NumPeriodicTimers = 8;
+static MyClock::TimeType const PeriodicInterval = 1000;
+static MyClock::TimeType const IdleTimeout = 10000000;
+static MyClock::TimeType const RunTime = 1000000;
+
+struct Bench {
+    MyLoop::QueuedEvent work_event;
+    MyLoop::TimedEvent idle_timers[MaxIdleTimers];
+    MyLoop::TimedEvent periodic_timers[NumPeriodicTimers];
+    MyLoop::TimedEvent quit_timer;
+    int num_idle_timers;
+    int next_idle_timer;
+    uint32_t work_count;
+    uint32_t periodic_count;
+    
+    void work_handler (Context c)
+    {
+        work_count++;
+        if (num_idle_timers > 0) {
+            idle_timers[next_idle_timer].appendAfter(c, IdleTimeout);
+            next_idle_timer = (next_idle_timer + 1) % num_idle_timers;
+        }
+        work_event.appendNowNotAlready(c);
+    }
+    
+    void idle_handler (Context c)
+    {
+        AMBRO_ASSERT_FORCE(0)
+    }
+    
+    void periodic_timer_handler (Context c)
+    {
+        periodic_count++;
+        // The timer which fired is the one which is not set.
+        for (int i = 0; i < NumPeriodicTimers; i++) {
+            if (!periodic_timers[i].isSet(c)) {
+                periodic_timers[i].appendAfterPrevious(c, PeriodicInterval);
+                break;
+            }
+        }
+    }
+    
+    void quit_handler (Context c)
+    {
+        MyLoop::quit(c);
+    }
+    
+    void run (Context c, int num_idle)
+    {
+        num_idle_timers = num_idle;
+        next_idle_timer = 0;
+        work_count = 0;
+        periodic_count = 0;
+        
+        MyLoop::init(c);
+        work_event.init(c, APRINTER_CB_OBJFUNC(&Bench::work_handler, this));
+        for (int i = 0; i < num_idle; i++) {
+            idle_timers[i].init(c, APRINTER_CB_OBJFUNC(&Bench::idle_handler, this));
+            idle_timers[i].appendAfter(c, IdleTimeout);
+        }
+        for (int i = 0; i < NumPeriodicTimers; i++) {
+            periodic_timers[i].init(c, APRINTER_CB_OBJFUNC(&Bench::periodic_timer_handler, this));
+            periodic_timers[i].appendAfter(c, PeriodicInterval);
+        }
+        quit_timer.init(c, APRINTER_CB_OBJFUNC(&Bench::quit_handler, this));
+        quit_timer.appendAfter(c, RunTime);
+        work_event.appendNowNotAlready(c);
+        
+        MyLoop::resetBenchTime(c);
+        MyClock::TimeType start = MyClock::getTime(c);
+        MyLoop::run(c);
+        MyClock::TimeType total = MyClock::getTime(c) - start;
+        MyClock::TimeType handlers = MyLoop::getBenchTime(c);
+        
+        quit_timer.deinit(c);
+        for (int i = 0; i < NumPeriodicTimers; i++) {
+            periodic_timers[i].deinit(c);
+        }
+        for (int i = 0; i < num_idle; i++) {
+            idle_timers[i].deinit(c);
+        }
+        work_event.deinit(c);
+        MyLoop::deinit(c);
+        
+        uint32_t expected_periodic = NumPeriodicTimers * (RunTime / PeriodicInterval);
+        AMBRO_ASSERT_FORCE(periodic_count + NumPeriodicTimers >= expected_periodic)
+        
+        printf("%12d %16.0f %14lu %18.1f\n", num_idle, work_count / (total * MyClock::time_unit),
+               (unsigned long)periodic_count, 100.0 * (total - handlers) / total);
+    }
+};
+
+static Bench bench;
+
+struct FastBench {
+    static uint32_t dispatch_count;
+    static MyLoop::TimedEvent quit_timer;
+    
+    // Events 0 and NumFastEvents-1 trigger each other, so that the others
+    // have to be skipped in between.
+    template <int Index>
+    static void fast_handler (Context c)
+    {
+        dispatch_count++;
+        if (Index == 0) {
+            MyLoop::triggerFastEvent<FastSpec<NumFastEvents - 1>>(c);
+        } else if (Index == NumFastEvents - 1) {
+            MyLoop::triggerFastEvent<FastSpec<0>>(c);
+        } else {
+            AMBRO_ASSERT_FORCE(0)
+        }
+    }
+    
+    template <int Index>
+    static void init_fast_event (Context c)
+    {
+        MyLoop::initFastEvent<FastSpec<Index>>(c, fast_handler<Index>);
+        if (Index + 1 < NumFastEvents) {
+            init_fast_event<(Index + 1 < NumFastEvents ? Index + 1 : Index)>(c);
+        }
+    }
+    
+    static void quit_handler (Context c)
+    {
+        MyLoop::quit(c);
+    }
+    
+    static void run (Context c, bool ping_pong)
+    {
+        dispatch_count = 0;
+        
+        MyLoop::init(c);
+        init_fast_event<0>(c);
+        quit_timer.init(c, APRINTER_CB_STATFUNC(&FastBench::quit_handler));
+        quit_timer.appendAfter(c, RunTime);
+        if (ping_pong) {
+            MyLoop::triggerFastEvent<FastSpec<0>>(c);
+        }
+        
+        uint64_t start_calls = MyClock::num_calls;
+        MyClock::TimeType start = MyClock::getTime(c);
+        MyLoop::run(c);
+        MyClock::TimeType total = MyClock::getTime(c) - start;
+        double passes = MyClock::num_calls - start_calls;
+        
+        quit_timer.deinit(c);
+        MyLoop::deinit(c);
+        
+        if (ping_pong) {
+            printf("fast event dispatches/s: %.0f\n", dispatch_count / (total * MyClock::time_unit));
+        } else {
+            AMBRO_ASSERT_FORCE(dispatch_count == 0)
+            printf("idle loop passes/s:      %.0f\n", passes / (total * MyClock::time_unit));
+        }
+    }
+};
+
+uint32_t FastBench::dispatch_count;
+MyLoop::TimedEvent FastBench::quit_timer;
+
+int main ()
+{
+    Context c;
+    MyDebugObjectGroup::init(c);
+    
+    printf("%12s %16s %14s %18s\n", "idle timers", "dispatches/s", "periodic runs", "loop overhead [%]");
+    int const counts[] = {0, 16, 128, 512, 1024};
+    for (int num_idle : counts) {
+        bench.run(c, num_idle);
+    }
+    
+    FastBench::run(c, false);
+    FastBench::run(c, true);
+    
+    MyDebugObjectGroup::deinit(c);
+    return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark of the backward (push) pass of the lookahead planning, comparing
+ * the full pass over the whole lookahead buffer with the incremental pass
+ * as done by MotionPlanner::plan(), which stops at the first previously
+ * pushed segment whose end speed limit did not change.
+ * The planned speeds of the committed segments are checked to be identical.
+ *
+ * Build: g++ -std=c++11 -O2 -I.. linearplanner_bench.cpp -o linearplanner_bench
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include <aprinter/base/Assert.h>
+#include <aprinter/printer/planning/LinearPlanner.h>
+
+using namespace APrinter;
+
+using FpType = double;
+
+using TheLinearPlanner = LinearPlanner<FpType>;
+
+static size_t const MaxBufferSize = 512;
+static size_t const CommitCount = 8;
+static size_t const NumSegments = 200000;
+
+struct SegmentParams {
+    FpType max_start_v;
+    FpType max_v;
+    FpType a_x;
+};
+
+static SegmentParams segment_params[NumSegments];
+
+struct Planner {
+    size_t buffer_size;
+    size_t commit_count;
+    bool incremental;
+    size_t start;
+    size_t length;
+    size_t staging_length;
+    FpType staging_v;
+    FpType last_max_v;
+    uint64_t num_pushes;
+    TheLinearPlanner::SegmentData sd[MaxBufferSize];
+    TheLinearPlanner::SegmentState ss[MaxBufferSize];
+};
+
+static size_t ring (Planner *p, size_t i)
+{
+    return (p->start + i) % p->buffer_size;
+}
+
+static FpType rand_fp (FpType min, FpType max)
+{
+    return min + (max - min) * ((FpType)rand() / RAND_MAX);
+}
+
+// Plans the buffer and commits, returning the sum of the committed end speeds.
+static FpType plan (Planner *p)
+{
+    size_t i = p->length;
+    FpType v = 0.0;
+    do {
+        i--;
+        size_t index = ring(p, i);
+        if (p->incremental && i < p->staging_length && TheLinearPlanner::pushIsNoop(&p->ss[index], v)) {
+            break;
+        }
+        v = TheLinearPlanner::push(&p->sd[index], &p->ss[index], v);
+        p->num_pushes++;
+    } while (i != 0);
+
+    // Only the committed segments are pulled here, this benchmark is about the backward pass.
+    size_t commit_count = p->commit_count < p->length ? p->commit_count : p->length;
+    v = p->staging_v;
+    FpType sum = 0.0;
+    for (i = 0; i < commit_count; i++) {
+        TheLinearPlanner::SegmentResult result;
+        v = TheLinearPlanner::pull(&p->sd[ring(p, i)], &p->ss[ring(p, i)], v, &result);
+        sum += v;
+    }
+
+    p->staging_v = v;
+    p->start = ring(p, commit_count);
+    p->length -= commit_count;
+    p->staging_length = p->length;
+    return sum;
+}
+
+static FpType run (Planner *p, size_t buffer_size, bool incremental, double *out_ns_per_seg)
+{
+    p->buffer_size = buffer_size;
+    p->commit_count = CommitCount;
+    p->incremental = incremental;
+    p->start = 0;
+    p->length = 0;
+    p->staging_length = 0;
+    p->staging_v = 0.0;
+    p->last_max_v = 0.0;
+    p->num_pushes = 0;
+
+    struct timespec t1, t2;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    FpType sum = 0.0;
+    for (size_t n = 0; n < NumSegments; n++) {
+        if (p->length == p->buffer_size) {
+            sum += plan(p);
+        }
+        SegmentParams const *sp = &segment_params[n];
+        TheLinearPlanner::initSegment(&p->sd[ring(p, p->length)], p->last_max_v, sp->max_start_v, sp->max_v, sp->a_x);
+        p->last_max_v = sp->max_v;
+        p->length++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    double ns = (t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec);
+    *out_ns_per_seg = ns / NumSegments;
+    return sum;
+}
+
+static Planner planner;
+
+int main ()
+{
+    // Dense short segments: mostly at full speed, sometimes a sharp corner.
+    srand(1);
+    for (size_t n = 0; n < NumSegments; n++) {
+        segment_params[n].max_start_v = (rand() % 16 == 0) ? 0.0 : INFINITY;
+        segment_params[n].max_v = rand_fp(50.0, 100.0);
+        segment_params[n].a_x = rand_fp(0.5, 2.0);
+    }
+
+    printf("%8s %14s %14s %14s %14s\n", "bufsize", "full ns/seg", "incr ns/seg", "full push/seg", "incr push/seg");
+
+    for (size_t buffer_size = 16; buffer_size <= MaxBufferSize; buffer_size *= 2) {
+        double full_ns;
+        FpType full_sum = run(&planner, buffer_size, false, &full_ns);
+        double full_pushes = (double)planner.num_pushes / NumSegments;
+
+        double incr_ns;
+        FpType incr_sum = run(&planner, buffer_size, true, &incr_ns);
+        double incr_pushes = (double)planner.num_pushes / NumSegments;
+
+        AMBRO_ASSERT_FORCE(incr_sum == full_sum)
+
+        printf("%8zu %14.1f %14.1f %14.2f %14.2f\n", buffer_size, full_ns, incr_ns, full_pushes, incr_pushes);
+    }
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2013 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Randomized test of LinkedHeap against a simple array. Entries are
+ * inserted and removed (both the first one and arbitrary ones) in random
+ * order, and after each operation first() is compared with the minimum
+ * of the inserted entries.
+ *
+ * Build: g++ -std=c++14 -O2 -I.. linked_heap_test.cpp -o linked_heap_test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <aprinter/base/Assert.h>
+#include <aprinter/structure/LinkedHeap.h>
+
+using namespace APrinter;
+
+struct Entry {
+    LinkedHeapNode<Entry> heap_node;
+    int key;
+    bool inserted;
+};
+
+struct EntryCompare {
+    static bool lessThan (Entry *e1, Entry *e2)
+    {
+        return e1->key < e2->key;
+    }
+};
+
+using Heap = LinkedHeap<Entry, &Entry::heap_node, EntryCompare>;
+
+static int const NumEntries = 300;
+static Entry entries[NumEntries];
+
+int main ()
+{
+    Heap heap;
+    heap.init();
+    for (int i = 0; i < NumEntries; i++) {
+        entries[i].inserted = false;
+        Heap::markRemoved(&entries[i]);
+    }
+    
+    srand(1);
+    int count = 0;
+    for (int iter = 0; iter < 1000000; iter++) {
+        Entry *e = &entries[rand() % NumEntries];
+        int op = rand() % 3;
+        if (!e->inserted) {
+            AMBRO_ASSERT_FORCE(Heap::isRemoved(e))
+            e->key = rand() % 1000;
+            heap.insert(e);
+            e->inserted = true;
+            count++;
+        } else if (op == 0 && !heap.isEmpty()) {
+            Entry *first = heap.first();
+            heap.remove(first);
+            Heap::markRemoved(first);
+            first->inserted = false;
+            count--;
+        } else {
+            heap.remove(e);
+            Heap::markRemoved(e);
+            e->inserted = false;
+            count--;
+        }
+        
+        int min_key = 1000;
+        for (int i = 0; i < NumEntries; i++) {
+            if (entries[i].inserted && entries[i].key < min_key) {
+                min_key = entries[i].key;
+            }
+        }
+        AMBRO_ASSERT_FORCE(heap.isEmpty() == (count == 0))
+        AMBRO_ASSERT_FORCE(heap.isEmpty() || heap.first()->key == min_key)
+    }
+    
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark of the configuration option name lookup of RuntimeConfigManager,
+ * comparing the linear case-insensitive scan over all option names with the
+ * perfect hash lookup. Option names are made from combinations of typical axis
+ * and heater prefixes and suffixes. Loading a configuration file is simulated
+ * by looking up all option names (in a different case) plus some unknown ones.
+ * The results of both methods are checked to be identical, as is the runtime
+ * name hash with the compile-time one.
+ *
+ * Build: g++ -std=c++14 -O2 -I.. option_lookup_bench.cpp -o option_lookup_bench
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Needed by InterruptLock.h; there are no real interrupts here.
+inline static void cli (void) {}
+inline static void sei (void) {}
+
+#include <aprinter/base/Assert.h>
+#include <aprinter/base/ProgramMemory.h>
+#include <aprinter/meta/ConstexprPerfectHash.h>
+#include <aprinter/printer/config_manager/RuntimeConfigManager.h>
+
+using namespace APrinter;
+
+static int const NumPrefixes = 16;
+static int const NumSuffixes = 32;
+static int const MaxOptions = NumPrefixes * NumSuffixes;
+static int const NumLoads = 200;
+
+static constexpr char const *Prefixes[NumPrefixes] = {
+    "X", "Y", "Z", "E", "U", "V", "A", "B", "C", "T", "T1", "T2", "B1", "F", "F1", "Probe"
+};
+
+static constexpr char const *Suffixes[NumSuffixes] = {
+    "StepsPerUnit", "MinPos", "MaxPos", "MaxSpeed", "MaxAccel", "DistanceFactor",
+    "CorneringDistance", "InvertDir", "HomeDir", "HomeFastMaxDist", "HomeRetractDist",
+    "HomeSlowMaxDist", "HomeFastSpeed", "HomeRetractSpeed", "HomeSlowSpeed",
+    "HomeEndInvert", "HomeEndPos", "EnableCartesianSpeedLimit", "IsExtruder",
+    "HeaterPulseInterval", "HeaterControlInterval", "HeaterPidP", "HeaterPidI",
+    "HeaterPidD", "HeaterPidIStateMin", "HeaterPidIStateMax", "HeaterObserverInterval",
+    "HeaterObserverTolerance", "HeaterObserverMinTime", "HeaterMinSafeTemp",
+    "HeaterMaxSafeTemp", "OffsetX"
+};
+
+using FormatHasher = ConstexprHash<ConstexprCrc32>;
+
+template <int Index>
+struct KeyHash {
+    static constexpr uint32_t value ()
+    {
+        return RuntimeConfigManager__name_hash(RuntimeConfigManager__name_hash(FormatHasher(), Prefixes[Index / NumSuffixes]), Suffixes[Index % NumSuffixes]).end();
+    }
+};
+
+static char names[MaxOptions][40];
+static char lookup_names[MaxOptions + MaxOptions / 8][40];
+
+static int find_linear (int num_options, char const *name)
+{
+    for (int i = 0; i < num_options; i++) {
+        if (RuntimeConfigManager__compare_option(name, ProgPtr<char>::Make(names[i]))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <int NumOptions>
+static int find_hashed (char const *name)
+{
+    int index = ConstexprPerfectHash<NumOptions, KeyHash>::lookup(RuntimeConfigManager__hash_name(name));
+    if (!RuntimeConfigManager__compare_option(name, ProgPtr<char>::Make(names[index]))) {
+        return -1;
+    }
+    return index;
+}
+
+static double now_ns ()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+template <int NumOptions>
+static void run ()
+{
+    int num_lookups = NumOptions + NumOptions / 8;
+    
+    // Lookups in random order, with names in lowercase, and some unknown names.
+    for (int i = 0; i < num_lookups; i++) {
+        if (i < NumOptions) {
+            int j = rand() % NumOptions;
+            for (int k = 0; names[j][k] != '\0'; k++) {
+                lookup_names[i][k] = AsciiToLower(names[j][k]);
+                lookup_names[i][k + 1] = '\0';
+            }
+        } else {
+            sprintf(lookup_names[i], "%sUnknown%d", Suffixes[i % NumSuffixes], i);
+        }
+    }
+    
+    for (int i = 0; i < NumOptions; i++) {
+        AMBRO_ASSERT_FORCE(find_hashed<NumOptions>(names[i]) == i)
+    }
+    for (int i = 0; i < num_lookups; i++) {
+        AMBRO_ASSERT_FORCE(find_hashed<NumOptions>(lookup_names[i]) == find_linear(NumOptions, lookup_names[i]))
+    }
+    
+    int found = 0;
+    double t1 = now_ns();
+    for (int n = 0; n < NumLoads; n++) {
+        for (int i = 0; i < num_lookups; i++) {
+            found += find_linear(NumOptions, lookup_names[i]) >= 0;
+        }
+    }
+    double t2 = now_ns();
+    for (int n = 0; n < NumLoads; n++) {
+        for (int i = 0; i < num_lookups; i++) {
+            found += find_hashed<NumOptions>(lookup_names[i]) >= 0;
+        }
+    }
+    double t3 = now_ns();
+    AMBRO_ASSERT_FORCE(found == 2 * NumLoads * NumOptions)
+    
+    printf("%8d %16.1f %16.1f %14.1f %14.1f\n", NumOptions,
+           (t2 - t1) / 1e3 / NumLoads, (t3 - t2) / 1e3 / NumLoads,
+           (t2 - t1) / NumLoads / num_lookups, (t3 - t2) / NumLoads / num_lookups);
+}
+
+int main ()
+{
+    for (int i = 0; i < MaxOptions; i++) {
+        sprintf(names[i], "%s%s", Prefixes[i / NumSuffixes], Suffixes[i % NumSuffixes]);
+        AMBRO_ASSERT_FORCE(RuntimeConfigManager__hash_name(names[i]) == RuntimeConfigManager__name_hash(FormatHasher(), names[i]).end())
+    }
+    
+    printf("%8s %16s %16s %14s %14s\n", "options", "linear us/load", "hashed us/load", "linear ns/lu", "hashed ns/lu");
+    
+    srand(1);
+    run<32>();
+    run<64>();
+    run<128>();
+    run<256>();
+    run<512>();
+    
+    return 0;
+}
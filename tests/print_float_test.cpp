@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2014 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Tests of PrintFloatDecimal(), PrintFloatFixed() and PrintNonnegativeIntDecimal()
+ * against snprintf, round-trip tests through strtod/strtof, and a benchmark
+ * comparing their speed with snprintf.
+ *
+ * Build: g++ -std=c++14 -O2 -I.. print_float_test.cpp -o print_float_test
+ */
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <aprinter/base/Assert.h>
+#include <aprinter/math/PrintInt.h>
+#include <aprinter/math/PrintFloat.h>
+
+using namespace APrinter;
+
+static uint64_t rng_state = 88172645463325252ull;
+
+static uint64_t rng ()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// A random value with a random magnitude in about 1e-12..1e12.
+template <typename T>
+static T random_value ()
+{
+    double mag = pow(10.0, (double)(int)(rng() % 25) - 12);
+    T x = mag * 10.0 * ((double)(rng() >> 11) / 9007199254740992.0);
+    return (rng() % 4 == 0) ? -x : x;
+}
+
+// A random short decimal like those in G-code, e.g. 123.45.
+static double random_short_decimal ()
+{
+    double x = (double)(rng() % 1000000) / pow(10.0, (double)(rng() % 6));
+    return (rng() % 4 == 0) ? -x : x;
+}
+
+static char const * print_decimal (double x, int precision)
+{
+    static char buf[PrintFloatMaxLength + 1];
+    int len = PrintFloatDecimal(x, buf, precision);
+    AMBRO_ASSERT_FORCE(len <= PrintFloatMaxLength)
+    buf[len] = '\0';
+    return buf;
+}
+
+// Checks that the output equals printf's or differs by one in the last
+// digit, as allowed when x is extremely close to a rounding boundary.
+// Returns whether the output differed.
+template <typename T>
+static bool check_decimal (T x, int precision)
+{
+    char buf[PrintFloatMaxLength + 1];
+    int len = PrintFloatDecimal(x, buf, precision);
+    AMBRO_ASSERT_FORCE(len <= PrintFloatMaxLength)
+    buf[len] = '\0';
+    
+    char ref[64];
+    snprintf(ref, sizeof(ref), "%.*g", precision, (double)x);
+    if (!strcmp(buf, ref)) {
+        return false;
+    }
+    
+    double val = strtod(buf, NULL);
+    double ref_val = strtod(ref, NULL);
+    double ulp = fabs(ref_val) * pow(10.0, 1 - precision);
+    if (!(fabs(val - ref_val) <= ulp)) {
+        fprintf(stderr, "MISMATCH %.17g precision %d: got %s expected %s\n", (double)x, precision, buf, ref);
+        abort();
+    }
+    return true;
+}
+
+// Like check_decimal(), for PrintFloatFixed(). Large values are written
+// with 9 significant digits, which is checked by the tolerance.
+static bool check_fixed (double x, int frac_digits)
+{
+    char buf[PrintFloatMaxLength + 1];
+    int len = PrintFloatFixed(x, buf, frac_digits);
+    AMBRO_ASSERT_FORCE(len <= PrintFloatMaxLength)
+    buf[len] = '\0';
+    
+    char ref[400];
+    snprintf(ref, sizeof(ref), "%.*f", frac_digits, x);
+    if (!strcmp(buf, ref)) {
+        return false;
+    }
+    
+    double val = strtod(buf, NULL);
+    double ref_val = strtod(ref, NULL);
+    double ulp = fmax(pow(10.0, -frac_digits), fabs(ref_val) * 1e-8);
+    if (!(fabs(val - ref_val) <= ulp * (1.0 + 1e-9))) {
+        fprintf(stderr, "MISMATCH fixed %.17g digits %d: got %s expected %s\n", x, frac_digits, buf, ref);
+        abort();
+    }
+    return true;
+}
+
+static void check_int (uint32_t x)
+{
+    char buf[11];
+    int len = PrintNonnegativeIntDecimal<uint32_t>(x, buf);
+    buf[len] = '\0';
+    
+    char ref[16];
+    sprintf(ref, "%" PRIu32, x);
+    AMBRO_ASSERT_FORCE(!strcmp(buf, ref))
+}
+
+static double seconds ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main ()
+{
+    // Special values and boundaries.
+    double const specials[] = {
+        0.0, -0.0, 1.0, -1.0, 0.5, 2.5, 9.5, 0.1, 0.15, 1e-4, 9.99999e-5, 9.999995e-5,
+        999999.0, 999999.5, 1000000.0, 123456.5, 1234565.0, 1e100, 1e-100, 1e300,
+        1.7976931348623157e308, 2.2250738585072014e-308, 5e-324, INFINITY, -INFINITY, NAN,
+        4294967295.0, 0.000123456, 12345678.9, 100.0, 1e21, 1e22, 1e23
+    };
+    for (double x : specials) {
+        for (int p = 1; p <= 9; p++) {
+            check_decimal(x, p);
+        }
+        for (int d = 0; d <= 6; d++) {
+            check_fixed(x, d);
+        }
+    }
+    AMBRO_ASSERT_FORCE(!strcmp(print_decimal(-0.0, 6), "-0"))
+    AMBRO_ASSERT_FORCE(!strcmp(print_decimal(NAN, 6), "nan"))
+    AMBRO_ASSERT_FORCE(!strcmp(print_decimal(-INFINITY, 6), "-inf"))
+    AMBRO_ASSERT_FORCE(!strcmp(print_decimal(1e-5, 6), "1e-05"))
+    AMBRO_ASSERT_FORCE(!strcmp(print_decimal(1e100, 6), "1e+100"))
+    AMBRO_ASSERT_FORCE(!strcmp(print_decimal(123.456, 6), "123.456"))
+    
+    // Random values, against printf. Differences in the last digit should be
+    // rare and only occur very near rounding boundaries. For fixed output of
+    // short decimals they are common, since e.g. 0.15 is printed as 0.2
+    // while printf gives 0.1 (the double is slightly below 0.15).
+    int const num_random = 1000000;
+    int double_diffs = 0;
+    int float_diffs = 0;
+    int fixed_diffs = 0;
+    for (int i = 0; i < num_random; i++) {
+        double_diffs += check_decimal(random_value<double>(), 6);
+        float_diffs += check_decimal(random_value<float>(), 6);
+        fixed_diffs += check_fixed(random_short_decimal(), (int)(rng() % 7));
+        check_int((uint32_t)rng());
+        check_int((uint32_t)(rng() % 1000));
+    }
+    printf("last digit differences from printf: double %d, float %d, fixed %d (of %d)\n", double_diffs, float_diffs, fixed_diffs, num_random);
+    AMBRO_ASSERT_FORCE(double_diffs < num_random / 10000)
+    AMBRO_ASSERT_FORCE(float_diffs < num_random / 10000)
+    
+    // Round trips: short decimals parsed as float or double print exactly
+    // as written, and other values parse back to within half a unit of the
+    // last digit.
+    for (int i = 0; i < num_random; i++) {
+        double x = random_short_decimal();
+        char ref[32];
+        snprintf(ref, sizeof(ref), "%.6g", x);
+        AMBRO_ASSERT_FORCE(!strcmp(print_decimal(strtod(ref, NULL), 6), ref))
+        
+        char buf[PrintFloatMaxLength + 1];
+        buf[PrintFloatDecimal(strtof(ref, NULL), buf, 6)] = '\0';
+        AMBRO_ASSERT_FORCE(!strcmp(buf, ref))
+        
+        double d = random_value<double>();
+        double back = strtod(print_decimal(d, 6), NULL);
+        AMBRO_ASSERT_FORCE(fabs(back - d) <= fabs(d) * 0.5e-5 * (1.0 + 1e-9))
+    }
+    
+    // Benchmark.
+    int const bench_count = 2000000;
+    double *values = (double *)malloc(bench_count * sizeof(double));
+    for (int i = 0; i < bench_count; i++) {
+        values[i] = random_short_decimal();
+    }
+    char buf[64];
+    size_t sum = 0;
+    
+    double t0 = seconds();
+    for (int i = 0; i < bench_count; i++) {
+        sum += snprintf(buf, sizeof(buf), "%.6g", values[i]);
+    }
+    double t1 = seconds();
+    for (int i = 0; i < bench_count; i++) {
+        sum += PrintFloatDecimal(values[i], buf, 6);
+    }
+    double t2 = seconds();
+    for (int i = 0; i < bench_count; i++) {
+        sum += PrintFloatDecimal((float)values[i], buf, 6);
+    }
+    double t3 = seconds();
+    for (int i = 0; i < bench_count; i++) {
+        sum += snprintf(buf, sizeof(buf), "%" PRIu32, (uint32_t)values[i]);
+    }
+    double t4 = seconds();
+    for (int i = 0; i < bench_count; i++) {
+        sum += PrintNonnegativeIntDecimal<uint32_t>((uint32_t)values[i], buf);
+    }
+    double t5 = seconds();
+    free(values);
+    
+    printf("snprintf %%.6g:               %6.1f ns\n", (t1 - t0) / bench_count * 1e9);
+    printf("PrintFloatDecimal (double):  %6.1f ns\n", (t2 - t1) / bench_count * 1e9);
+    printf("PrintFloatDecimal (float):   %6.1f ns\n", (t3 - t2) / bench_count * 1e9);
+    printf("snprintf %%u:                 %6.1f ns\n", (t4 - t3) / bench_count * 1e9);
+    printf("PrintNonnegativeIntDecimal:  %6.1f ns\n", (t5 - t4) / bench_count * 1e9);
+    printf("(checksum %zu)\n", sum);
+    
+    return 0;
+}
@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Test of SoftPwmMux, driving 8 PWM channels from one interrupt timer.
+ * The mux is driven by a fake clock and interrupt timer, and the pin
+ * transitions are recorded. It is checked that in each period, each channel
+ * is on for its duty cycle, shortened by at most the edge tolerance, and
+ * that duty cycle changes only take effect at the start of the next period.
+ *
+ * The interrupts per period are compared to those needed by 8 SoftPwm
+ * instances, and the host time of the most expensive interrupt paths is
+ * printed: the period start with a full rebuild of the edge list (the duty
+ * cycles changed and their order reversed), and the period start and
+ * turn-off edge without changes.
+ *
+ * Build: g++ -std=c++14 -O2 -I.. softpwm_mux_test.cpp -o softpwm_mux_test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Needed by InterruptLock.h; there are no real interrupts here.
+inline static void cli (void) {}
+inline static void sei (void) {}
+
+#include <aprinter/meta/BasicMetaUtils.h>
+#include <aprinter/meta/TypeList.h>
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/printer/pwm/SoftPwmMux.h>
+
+using namespace APrinter;
+
+static int const NumChannels = 8;
+static int const MaxTransitions = 64;
+
+static uint32_t sim_time;
+
+struct FakeClock {
+    using TimeType = uint32_t;
+    static constexpr double time_freq = 1e6;
+    static constexpr double time_unit = 1.0 / time_freq;
+    
+    template <typename ThisContext>
+    static TimeType getTime (ThisContext c)
+    {
+        return sim_time;
+    }
+};
+
+template <int PinIndex>
+struct FakePin {};
+
+struct PinTransition {
+    uint32_t time;
+    bool value;
+};
+
+struct PinRecord {
+    bool value;
+    bool initial_value;
+    int num_transitions;
+    PinTransition transitions[MaxTransitions];
+};
+
+static PinRecord pin_records[NumChannels];
+
+struct FakePins {
+    template <typename Pin, typename ThisContext>
+    static void setOutput (ThisContext c)
+    {
+    }
+    
+    template <typename Pin, typename ThisContext>
+    static void set (ThisContext c, bool value)
+    {
+        record(Pin(), value);
+    }
+    
+    template <typename Pin>
+    static void emergencySet (bool value)
+    {
+        record(Pin(), value);
+    }
+    
+    template <int PinIndex>
+    static void record (FakePin<PinIndex>, bool value)
+    {
+        PinRecord *r = &pin_records[PinIndex];
+        if (value != r->value && r->num_transitions < MaxTransitions) {
+            r->transitions[r->num_transitions++] = PinTransition{sim_time, value};
+        }
+        r->value = value;
+    }
+};
+
+struct MyContext;
+
+template <typename Arg>
+class FakeInterruptTimer {
+    using Context      = typename Arg::Context;
+    using ParentObject = typename Arg::ParentObject;
+    using Handler      = typename Arg::Handler;
+
+public:
+    struct Object;
+    using TimeType = uint32_t;
+    using HandlerContext = Context;
+    
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        o->armed = false;
+    }
+    
+    static void deinit (Context c)
+    {
+        auto *o = Object::self(c);
+        o->armed = false;
+    }
+    
+    static void setFirst (Context c, TimeType time)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT_FORCE(!o->armed)
+        o->armed = true;
+        o->time = time;
+    }
+    
+    static void setNext (HandlerContext c, TimeType time)
+    {
+        auto *o = Object::self(c);
+        o->armed = true;
+        o->time = time;
+    }
+    
+    // Deliver interrupts due up to the given time.
+    static void run_until (Context c, uint32_t end_time)
+    {
+        auto *o = Object::self(c);
+        while (o->armed && o->time <= end_time) {
+            o->armed = false;
+            sim_time = o->time;
+            o->interrupts++;
+            Handler::call(c);
+        }
+        sim_time = end_time;
+    }
+    
+    // Deliver one interrupt, returning the host time it took in nanoseconds.
+    static double timed_interrupt (Context c)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT_FORCE(o->armed)
+        o->armed = false;
+        sim_time = o->time;
+        o->interrupts++;
+        struct timespec t1, t2;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        Handler::call(c);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        return (t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec);
+    }
+
+public:
+    struct Object : public ObjBase<FakeInterruptTimer, ParentObject, EmptyTypeList> {
+        bool armed;
+        TimeType time;
+        uint32_t interrupts;
+    };
+};
+
+struct FakeTimerService {
+    APRINTER_ALIAS_STRUCT_EXT(InterruptTimer, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(Handler)
+    ), (
+        APRINTER_DEF_INSTANCE(InterruptTimer, FakeInterruptTimer)
+    ))
+};
+
+struct Program;
+
+using PulseInterval = AMBRO_WRAP_DOUBLE(0.01);
+using EdgeTolerance = AMBRO_WRAP_DOUBLE(0.0002);
+
+using ChannelsList = MakeTypeList<
+    SoftPwmMuxChannel<FakePin<0>, false>,
+    SoftPwmMuxChannel<FakePin<1>, false>,
+    SoftPwmMuxChannel<FakePin<2>, true>,
+    SoftPwmMuxChannel<FakePin<3>, false>,
+    SoftPwmMuxChannel<FakePin<4>, false>,
+    SoftPwmMuxChannel<FakePin<5>, false>,
+    SoftPwmMuxChannel<FakePin<6>, true>,
+    SoftPwmMuxChannel<FakePin<7>, false>
+>;
+
+APRINTER_MAKE_INSTANCE(TheMux, (SoftPwmMuxService<PulseInterval, EdgeTolerance, FakeTimerService>::Mux<MyContext, Program, ChannelsList>))
+
+struct MyContext {
+    using Clock = FakeClock;
+    using Pins = FakePins;
+    using SoftPwmMux = TheMux;
+};
+
+// Channel 7 goes through the per-output interface as the printer modules do.
+APRINTER_MAKE_INSTANCE(ThePwm7, (SoftPwmMuxPwmService<7>::Pwm<MyContext, Program>))
+
+struct Program : public ObjBase<void, void, MakeTypeList<
+    TheMux,
+    ThePwm7
+>> {
+    static Program * self (MyContext c);
+};
+
+Program p;
+
+Program * Program::self (MyContext c) { return &p; }
+
+using Timer = TheMux::TheTimer;
+
+static uint32_t const Interval = PulseInterval::value() * FakeClock::time_freq;
+static uint32_t const Tolerance = EdgeTolerance::value() * FakeClock::time_freq;
+
+static void set_duty (MyContext c, int channel, double frac)
+{
+    TheMux::DutyCycleData duty;
+    TheMux::computeDutyCycle(frac, &duty);
+    ListForOne<IndexElemListCount<NumChannels, WrapInt>>(channel, [&] APRINTER_TL(index, {
+        if (index::Value == 7) {
+            ThePwm7::setDutyCycle(c, duty);
+        } else {
+            TheMux::setDutyCycle<index::Value>(c, duty);
+        }
+    }));
+}
+
+// Returns the time the channel was on within the period [start, start+Interval).
+static uint32_t on_time_in_period (int channel, uint32_t start)
+{
+    PinRecord const *r = &pin_records[channel];
+    bool const invert = (channel == 2 || channel == 6);
+    uint32_t end = start + Interval;
+    uint32_t total = 0;
+    bool on = r->initial_value != invert;
+    uint32_t on_since = start;
+    // Find the state at the period start.
+    for (int i = 0; i < r->num_transitions; i++) {
+        if (r->transitions[i].time < start) {
+            on = r->transitions[i].value != invert;
+        }
+    }
+    for (int i = 0; i < r->num_transitions; i++) {
+        PinTransition const *t = &r->transitions[i];
+        if (t->time < start || t->time >= end) {
+            continue;
+        }
+        bool new_on = t->value != invert;
+        if (on && !new_on) {
+            total += t->time - on_since;
+        } else if (!on && new_on) {
+            on_since = t->time;
+        }
+        on = new_on;
+    }
+    if (on) {
+        total += end - on_since;
+    }
+    return total;
+}
+
+static void clear_records ()
+{
+    for (int i = 0; i < NumChannels; i++) {
+        pin_records[i].initial_value = pin_records[i].value;
+        pin_records[i].num_transitions = 0;
+    }
+}
+
+static void check_period (uint32_t start, double const *fracs)
+{
+    for (int i = 0; i < NumChannels; i++) {
+        TheMux::DutyCycleData duty;
+        TheMux::computeDutyCycle(fracs[i], &duty);
+        uint32_t expected = (duty.type == 0) ? 0 : (duty.type == 2) ? Interval : duty.on_time;
+        uint32_t actual = on_time_in_period(i, start);
+        AMBRO_ASSERT_FORCE(actual <= expected)
+        AMBRO_ASSERT_FORCE(expected - actual <= Tolerance)
+    }
+}
+
+int main ()
+{
+    MyContext c;
+    
+    sim_time = 1000;
+    for (int i = 0; i < NumChannels; i++) {
+        pin_records[i].value = (i == 2 || i == 6);
+    }
+    clear_records();
+    TheMux::init(c);
+    ThePwm7::init(c, sim_time);
+    uint32_t start = Timer::Object::self(c)->time;
+    
+    // Duty cycles with some edges within the tolerance of each other.
+    double const fracs1[NumChannels] = {0.5, 0.51, 0.505, 0.0, 1.0, 0.25, 0.9, 0.252};
+    double const fracs2[NumChannels] = {0.1, 0.3, 0.2, 0.7, 0.0, 0.6, 0.4, 0.5};
+    
+    // Nothing is on in the first period.
+    Timer::run_until(c, start);
+    for (int i = 0; i < NumChannels; i++) {
+        set_duty(c, i, fracs1[i]);
+    }
+    Timer::run_until(c, start + Interval - 1);
+    for (int i = 0; i < NumChannels; i++) {
+        AMBRO_ASSERT_FORCE(on_time_in_period(i, start) == 0)
+    }
+    start += Interval;
+    
+    uint32_t irq_before = Timer::Object::self(c)->interrupts;
+    clear_records();
+    Timer::run_until(c, start + 3 * Interval - 1);
+    uint32_t mux_irqs_per_period = (Timer::Object::self(c)->interrupts - irq_before) / 3;
+    for (int k = 0; k < 3; k++) {
+        check_period(start + k * Interval, fracs1);
+    }
+    start += 3 * Interval;
+    
+    // Changes in the middle of a period take effect in the next one.
+    clear_records();
+    Timer::run_until(c, start + Interval / 3);
+    for (int i = 0; i < NumChannels; i++) {
+        set_duty(c, i, fracs2[i]);
+    }
+    Timer::run_until(c, start + 3 * Interval - 1);
+    check_period(start, fracs1);
+    check_period(start + Interval, fracs2);
+    check_period(start + 2 * Interval, fracs2);
+    start += 3 * Interval;
+    
+    AMBRO_ASSERT_FORCE(ThePwm7::getCurrentDutyFp<double>(c) == 0.5)
+    
+    // 8 SoftPwm instances would take two interrupts per period for each
+    // channel with a partial duty cycle, and one for the others.
+    int soft_pwm_irqs = 0;
+    for (int i = 0; i < NumChannels; i++) {
+        TheMux::DutyCycleData duty;
+        TheMux::computeDutyCycle(fracs1[i], &duty);
+        soft_pwm_irqs += (duty.type == 1) ? 2 : 1;
+    }
+    printf("interrupts per period: mux %u, separate SoftPwm %d\n", (unsigned)mux_irqs_per_period, soft_pwm_irqs);
+    
+    // Time the interrupt paths. In each round, all duty cycles change and
+    // their order is reversed, so the period start does a full rebuild.
+    int const NumRounds = 200000;
+    double rebuild_ns = 0.0;
+    double start_ns = 0.0;
+    double edge_ns = 0.0;
+    int num_edges = 0;
+    for (int round = 0; round < NumRounds; round++) {
+        for (int i = 0; i < NumChannels; i++) {
+            int rank = (round % 2 == 0) ? i : (NumChannels - 1 - i);
+            set_duty(c, i, 0.1 + 0.1 * rank);
+        }
+        clear_records();
+        rebuild_ns += Timer::timed_interrupt(c);
+        while (Timer::Object::self(c)->time != TheMux::Object::self(c)->m_period_start) {
+            edge_ns += Timer::timed_interrupt(c);
+            num_edges++;
+        }
+        start_ns += Timer::timed_interrupt(c);
+        while (Timer::Object::self(c)->time != TheMux::Object::self(c)->m_period_start) {
+            edge_ns += Timer::timed_interrupt(c);
+            num_edges++;
+        }
+    }
+    
+    // All 8 edges coalesced into one interrupt.
+    double const fracs3[NumChannels] = {0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5};
+    for (int i = 0; i < NumChannels; i++) {
+        set_duty(c, i, fracs3[i]);
+    }
+    Timer::timed_interrupt(c);
+    while (Timer::Object::self(c)->time != TheMux::Object::self(c)->m_period_start) {
+        Timer::timed_interrupt(c);
+    }
+    double edge8_ns = 0.0;
+    for (int round = 0; round < NumRounds; round++) {
+        Timer::timed_interrupt(c);
+        edge8_ns += Timer::timed_interrupt(c);
+        AMBRO_ASSERT_FORCE(Timer::Object::self(c)->time == TheMux::Object::self(c)->m_period_start)
+    }
+    
+    printf("period start with rebuild: %6.1f ns\n", rebuild_ns / NumRounds);
+    printf("period start:              %6.1f ns\n", start_ns / NumRounds);
+    printf("turn-off edge (1 channel): %6.1f ns\n", edge_ns / num_edges);
+    printf("turn-off edge (8 channels):%6.1f ns\n", edge8_ns / NumRounds);
+    
+    ThePwm7::deinit(c);
+    TheMux::deinit(c);
+    
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2014 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Tests of StrToFloatFast() against StrToFloat(): edge cases of the
+ * accepted form, random slicer-style numbers compared bit for bit, and
+ * a benchmark comparing their speed.
+ *
+ * Build: g++ -std=c++14 -O2 -I.. str_to_float_test.cpp -o str_to_float_test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <aprinter/base/Assert.h>
+#include <aprinter/math/FloatTools.h>
+
+using namespace APrinter;
+
+static uint64_t rng_state = 88172645463325252ull;
+
+static uint64_t rng ()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// Checks that StrToFloatFast() accepts exactly when expected, and that an
+// accepted result is bit for bit the same as from StrToFloat().
+template <typename T>
+static void check (char const *str, bool expect_accept)
+{
+    T value;
+    bool accepted = StrToFloatFast<T>(str, &value);
+    if (accepted != expect_accept) {
+        fprintf(stderr, "MISMATCH %s (%s): accepted %d expected %d\n", str, sizeof(T) == 4 ? "float" : "double", (int)accepted, (int)expect_accept);
+        abort();
+    }
+    if (accepted) {
+        T ref = StrToFloat<T>(str, NULL);
+        if (memcmp(&value, &ref, sizeof(T))) {
+            fprintf(stderr, "MISMATCH %s (%s): got %.17g expected %.17g\n", str, sizeof(T) == 4 ? "float" : "double", (double)value, (double)ref);
+            abort();
+        }
+    }
+}
+
+static void check_both (char const *str, bool expect_accept)
+{
+    check<float>(str, expect_accept);
+    check<double>(str, expect_accept);
+}
+
+// A random number as written by slicers: an optional sign, up to 4 integer
+// digits (sometimes none, as in ".5") and up to 5 fractional digits.
+static void random_slicer_number (char *buf)
+{
+    char *p = buf;
+    uint32_t sign = rng() % 8;
+    if (sign == 0) {
+        *p++ = '-';
+    } else if (sign == 1) {
+        *p++ = '+';
+    }
+    int int_digits = rng() % 5;
+    if (int_digits == 0 && rng() % 2 == 0) {
+        *p++ = '0';
+    }
+    for (int i = 0; i < int_digits; i++) {
+        *p++ = '0' + rng() % 10;
+    }
+    int frac_digits = rng() % 6;
+    if (frac_digits > 0 || int_digits == 0) {
+        *p++ = '.';
+        frac_digits += (int_digits == 0 && frac_digits == 0);
+        for (int i = 0; i < frac_digits; i++) {
+            *p++ = '0' + rng() % 10;
+        }
+    }
+    *p = '\0';
+}
+
+// The integer formed by all the digits of a number, which must be at
+// most 2^24 for StrToFloatFast<float>() to accept it.
+static uint32_t digits_value (char const *str)
+{
+    uint32_t value = 0;
+    for (; *str; str++) {
+        if (*str >= '0' && *str <= '9') {
+            value = 10 * value + (*str - '0');
+        }
+    }
+    return value;
+}
+
+static double seconds ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main ()
+{
+    // Accepted forms.
+    char const *const accepted[] = {
+        "0", "-0", "+0", "0.0", "-0.0", "1", "-1", "+1", "10", "0.5", ".5", "-.5", "+.5",
+        "5.", "-5.", "123.456", "-123.456", "0.1", "0.3", "0.7", "2.675", "1.005",
+        "00012.5000", "0.000000001", "-0.000000001", "16777216", "1677.7216",
+        "3.4028", "0.12345678", "-0.12345678", "1234.5678"
+    };
+    for (char const *str : accepted) {
+        check_both(str, true);
+    }
+    
+    // Forms left to StrToFloat(): empty, sign or dot alone, exponents,
+    // garbage, more than 9 significant digits or 9 fractional digits.
+    char const *const rejected[] = {
+        "", "-", "+", ".", "-.", "+-1", "--1", "1..2", "1.2.3", "1e5", "1E5", "1.5e-3",
+        "0x10", "inf", "nan", " 1", "1 ", "1a", "1,5", "1234567890", "0.1234567890",
+        "0.0000000001", "12345.678901", "-9999999999"
+    };
+    for (char const *str : rejected) {
+        check_both(str, false);
+    }
+    
+    // Values whose digits form an integer above 2^24 are not exact as float,
+    // so they are only accepted as double. This includes trailing zeros.
+    char const *const double_only[] = {
+        "16777217", "16777215.0", "123456.789", "999999999", "99999.9999", "0.123456789", "-1234.56789"
+    };
+    for (char const *str : double_only) {
+        check<float>(str, false);
+        check<double>(str, true);
+    }
+    
+    // Random slicer-style numbers. All of them are accepted as double, and
+    // most of them as float.
+    int const num_random = 5000000;
+    int float_fallbacks = 0;
+    char buf[32];
+    for (int i = 0; i < num_random; i++) {
+        random_slicer_number(buf);
+        bool float_exact = digits_value(buf) <= UINT32_C(16777216);
+        check<float>(buf, float_exact);
+        check<double>(buf, true);
+        float_fallbacks += !float_exact;
+    }
+    printf("random numbers: %d, left to StrToFloat<float>(): %d\n", num_random, float_fallbacks);
+    
+    // Benchmark.
+    int const bench_count = 2000000;
+    char (*strs)[16] = (char (*)[16])malloc(bench_count * sizeof(*strs));
+    for (int i = 0; i < bench_count; i++) {
+        random_slicer_number(strs[i]);
+    }
+    float sum = 0.0f;
+    
+    double t0 = seconds();
+    for (int i = 0; i < bench_count; i++) {
+        sum += StrToFloat<float>(strs[i], NULL);
+    }
+    double t1 = seconds();
+    for (int i = 0; i < bench_count; i++) {
+        float value;
+        if (!StrToFloatFast<float>(strs[i], &value)) {
+            value = StrToFloat<float>(strs[i], NULL);
+        }
+        sum += value;
+    }
+    double t2 = seconds();
+    free(strs);
+    
+    printf("StrToFloat<float>:           %6.1f ns\n", (t1 - t0) / bench_count * 1e9);
+    printf("with StrToFloatFast<float>:  %6.1f ns\n", (t2 - t1) / bench_count * 1e9);
+    printf("(checksum %g)\n", (double)sum);
+    
+    return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of the table mode of GenericThermistor. For a few table sizes, the
+ * temperatures interpolated from the table are compared with the exact formula
+ * for every value of a 12-bit ADC within the configured temperature range.
+ * Both the compile-time table (constant configuration) and the table computed
+ * at runtime (runtime configuration) are checked. The maximum error is printed
+ * and checked against a bound for each table size.
+ *
+ * Build: g++ -std=c++14 -O2 -I.. thermistor_table_test.cpp -o thermistor_table_test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+// Needed by InterruptLock.h; there are no real interrupts here.
+inline static void cli (void) {}
+inline static void sei (void) {}
+
+#include <aprinter/meta/BasicMetaUtils.h>
+#include <aprinter/meta/TypeList.h>
+#include <aprinter/meta/Expr.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/printer/Configuration.h>
+#include <aprinter/printer/thermistor/GenericThermistor.h>
+
+using namespace APrinter;
+
+static int const AdcBits = 12;
+
+static constexpr double ResistorR = 4700.0;
+static constexpr double ThermistorR0 = 100000.0;
+static constexpr double ThermistorBeta = 3960.0;
+static constexpr double MinTemp = 10.0;
+static constexpr double MaxTemp = 300.0;
+
+struct MyContext {};
+
+APRINTER_CONFIG_START
+
+APRINTER_CONFIG_OPTION_DOUBLE(OptResistorR, ResistorR, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptThermistorR0, ThermistorR0, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptThermistorBeta, ThermistorBeta, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptMinTemp, MinTemp, ConfigNoProperties)
+APRINTER_CONFIG_OPTION_DOUBLE(OptMaxTemp, MaxTemp, ConfigNoProperties)
+
+APRINTER_CONFIG_END
+
+// Reads an option as a runtime configuration manager would, but it
+// just returns the default value.
+template <typename Option>
+struct OptionValueFunc {
+    static typename Option::Type call (MyContext c)
+    {
+        typename Option::Type volatile value = Option::DefaultValue::value();
+        return value;
+    }
+};
+
+template <typename TheExpr, bool IsConstexpr = TheExpr::IsConstexpr>
+struct ExprHelper {
+    static constexpr typename TheExpr::Type value () { return TheExpr::value(); }
+    static typename TheExpr::Type eval (MyContext c) { return TheExpr::value(); }
+};
+
+template <typename TheExpr>
+struct ExprHelper<TheExpr, false> {
+    static typename TheExpr::Type value ();
+    static typename TheExpr::Type eval (MyContext c) { return TheExpr::eval(c); }
+};
+
+// Minimal configuration manager, providing options as constants or as runtime values.
+template <bool Runtime>
+struct TestConfig {
+    template <typename Option>
+    static auto e (Option) -> If<Runtime, VariableExpr<typename Option::Type, OptionValueFunc<Option>>, ConstantExpr<typename Option::Type, typename Option::DefaultValue>>;
+    
+    template <typename TheExpr>
+    static TheExpr getExpr (TheExpr);
+    
+    template <typename TheExpr>
+    static ExprHelper<TheExpr> getHelper (TheExpr);
+};
+
+struct Program;
+
+template <int TableBits>
+using TestFormulaService = GenericThermistorService<OptResistorR, OptThermistorR0, OptThermistorBeta, OptMinTemp, OptMaxTemp, TableBits>;
+
+APRINTER_MAKE_INSTANCE(ConstFormula4, (TestFormulaService<4>::Formula<MyContext, Program, TestConfig<false>, float>))
+APRINTER_MAKE_INSTANCE(ConstFormula6, (TestFormulaService<6>::Formula<MyContext, Program, TestConfig<false>, float>))
+APRINTER_MAKE_INSTANCE(ConstFormula8, (TestFormulaService<8>::Formula<MyContext, Program, TestConfig<false>, float>))
+APRINTER_MAKE_INSTANCE(RuntimeFormula4, (TestFormulaService<4>::Formula<MyContext, Program, TestConfig<true>, float>))
+APRINTER_MAKE_INSTANCE(RuntimeFormula6, (TestFormulaService<6>::Formula<MyContext, Program, TestConfig<true>, float>))
+APRINTER_MAKE_INSTANCE(RuntimeFormula8, (TestFormulaService<8>::Formula<MyContext, Program, TestConfig<true>, float>))
+
+struct Program : public ObjBase<void, void, MakeTypeList<
+    ConstFormula4,
+    ConstFormula6,
+    ConstFormula8,
+    RuntimeFormula4,
+    RuntimeFormula6,
+    RuntimeFormula8
+>> {
+    static Program * self (MyContext c);
+};
+
+Program p;
+
+Program * Program::self (MyContext c) { return &p; }
+
+static double exact_temp (double adc)
+{
+    double r_inf = ThermistorR0 * exp(-ThermistorBeta / (25.0 + 273.15));
+    double r_thermistor = ResistorR * adc / (1.0 - adc);
+    return ThermistorBeta / log(r_thermistor / r_inf) - 273.15;
+}
+
+// Returns the maximum error within the temperature range. The table must
+// also agree with the range check of the formula, except within the given
+// bound of the limits.
+template <typename Formula>
+static double check_formula (double bound)
+{
+    MyContext c;
+    Formula::init(c);
+    
+    double max_error = 0.0;
+    
+    for (uint32_t bits = 0; bits < ((uint32_t)1 << AdcBits); bits++) {
+        // The ADC value is in the middle of the step, like for unrounded ADCs.
+        uint32_t adc_bits = (bits << 1) | 1;
+        double adc = adc_bits / (double)((uint32_t)1 << (AdcBits + 1));
+        double exact = exact_temp(adc);
+        float temp = Formula::template adcBitsToTemp<AdcBits + 1>(c, adc_bits);
+        
+        if (exact >= MinTemp + bound && exact <= MaxTemp - bound) {
+            AMBRO_ASSERT_FORCE(isfinite(temp))
+        }
+        if (exact > MaxTemp + bound) {
+            AMBRO_ASSERT_FORCE(temp == INFINITY)
+        }
+        if (exact < MinTemp - bound) {
+            AMBRO_ASSERT_FORCE(temp == -INFINITY)
+        }
+        if (isfinite(temp) && exact >= MinTemp && exact <= MaxTemp) {
+            max_error = fmax(max_error, fabs(temp - exact));
+        }
+    }
+    
+    AMBRO_ASSERT_FORCE(max_error <= bound)
+    
+    return max_error;
+}
+
+int main ()
+{
+    printf("%10s %16s %16s %10s\n", "table bits", "constant error", "runtime error", "bound");
+    
+    struct Row {
+        int table_bits;
+        double (*check_const) (double);
+        double (*check_runtime) (double);
+        double bound;
+    };
+    
+    Row const rows[] = {
+        {4, check_formula<ConstFormula4>, check_formula<RuntimeFormula4>, 50.0},
+        {6, check_formula<ConstFormula6>, check_formula<RuntimeFormula6>, 2.5},
+        {8, check_formula<ConstFormula8>, check_formula<RuntimeFormula8>, 0.2},
+    };
+    
+    for (Row const &row : rows) {
+        double const_error = row.check_const(row.bound);
+        double runtime_error = row.check_runtime(row.bound);
+        printf("%10d %16.3f %16.3f %10.3f\n", row.table_bits, const_error, runtime_error, row.bound);
+    }
+    
+    return 0;
+}
@@ -1581,8 +1581,16 @@ function makeEcInputProps(ecInputs) {
 
 // Generic status updating
 
-function StatusUpdater(reqPath, refreshInterval, waitingRespTime, handleNewStatus, handleCondition) {
+// If streamPath is given and the browser supports server-sent events, the
+// status is received as a stream of events from streamPath, with "full"
+// events carrying the whole status and other events only the changed
+// top-level members. If the stream cannot be established (e.g. the number
+// of streaming clients is limited), it falls back to polling reqPath.
+function StatusUpdater(reqPath, refreshInterval, waitingRespTime, handleNewStatus, handleCondition, streamPath) {
     this._reqPath = reqPath;
+    this._streamPath = (streamPath && typeof EventSource !== 'undefined') ? streamPath : null;
+    this._eventSource = null;
+    this._streamStatus = null;
     this._refreshInterval = refreshInterval;
     this._waitingRespTime = waitingRespTime;
     this._handleNewStatus = handleNewStatus;
@@ -1603,12 +1611,17 @@ StatusUpdater.prototype.setRunning = function(running) {
     if (running) {
         if (!this._running) {
             this._running = true;
-            this.requestUpdate(true);
+            if (this._streamPath !== null) {
+                this._startStream();
+            } else {
+                this.requestUpdate(true);
+            }
         }
     } else {
         if (this._running) {
             this._running = false;
             this._changeCondition('Disabled');
+            this._stopStream();
             this._stopTimer();
             this._stopWaitingTimer();
             this._handleCondition();
@@ -1617,7 +1630,8 @@ StatusUpdater.prototype.setRunning = function(running) {
 };
 
 StatusUpdater.prototype.requestUpdate = function(setWaiting) {
-    if (!this._running) {
+    // When streaming, changes are pushed without asking.
+    if (!this._running || this._eventSource !== null) {
         return;
     }
     if (setWaiting) {
@@ -1645,6 +1659,56 @@ StatusUpdater.prototype._stopWaitingTimer = function() {
     }
 };
 
+StatusUpdater.prototype._startStream = function() {
+    this._changeCondition('WaitingResponse');
+    this._streamStatus = null;
+    var receivedEvent = false;
+    
+    var handleEvent = function(full, event) {
+        if (!full && this._streamStatus === null) {
+            return;
+        }
+        var data;
+        try {
+            data = JSON.parse(event.data);
+        } catch (e) {
+            return;
+        }
+        receivedEvent = true;
+        if (full) {
+            this._streamStatus = {};
+        }
+        $.extend(this._streamStatus, data);
+        this._changeCondition('Okay');
+        this._handleNewStatus($.extend(true, {}, this._streamStatus));
+    };
+    
+    this._eventSource = new EventSource(this._streamPath);
+    this._eventSource.addEventListener('full', handleEvent.bind(this, true));
+    this._eventSource.onmessage = handleEvent.bind(this, false);
+    this._eventSource.onerror = function() {
+        if (!receivedEvent) {
+            // Streaming is not available, poll instead.
+            this._stopStream();
+            this._streamPath = null;
+            if (this._running) {
+                this.requestUpdate(true);
+            }
+        } else {
+            // The browser reconnects by itself and a full status comes first.
+            this._streamStatus = null;
+            this._changeCondition('Error');
+        }
+    }.bind(this);
+};
+
+StatusUpdater.prototype._stopStream = function() {
+    if (this._eventSource !== null) {
+        this._eventSource.close();
+        this._eventSource = null;
+    }
+};
+
 StatusUpdater.prototype._startRequest = function() {
     this._stopTimer();
     this._reqestInProgress = true;
@@ -2222,7 +2286,7 @@ function handleStatusCondition() {
     wrapper_toppanel.forceUpdate();
 }
 
-var statusUpdater = new StatusUpdater('/rr_status', statusRefreshInterval, statusWaitingRespTime, handleNewStatus, handleStatusCondition);
+var statusUpdater = new StatusUpdater('/rr_status', statusRefreshInterval, statusWaitingRespTime, handleNewStatus, handleStatusCondition, '/rr_statusStream');
 
 function fixupStateObject(state, name) {
     return preprocessObjectForState($has(state, name) ? state[name] : {});